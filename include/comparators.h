@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <cstdio>
 #include <cstring>
+#include <vector>
+#include <utility>
 
 static int compare_string(void *value1, void* value2, int attrLength){
   return strncmp((char *) value1, (char *) value2, attrLength);
@@ -30,6 +32,30 @@ static int compare_float(void *value1, void* value2, int attrLength){
     return 0;
 }
 
+// Compares two INT, FLOAT or STRING values of the given type
+static int compare_attr(void *value1, void *value2, AttrType attrType, int attrLength){
+  switch(attrType){
+    case INT: return compare_int(value1, value2, attrLength);
+    case FLOAT: return compare_float(value1, value2, attrLength);
+    default: return compare_string(value1, value2, attrLength);
+  }
+}
+
+// Compares two keys of the given type and lengths. A string shorter than
+// the other is taken as null terminated, as CheckConditions does, so it
+// only equals the longer one if that ends within the shorter length.
+static int compare_key(void *value1, int length1, void *value2, int length2, AttrType attrType){
+  if(attrType != STRING || length1 == length2)
+    return compare_attr(value1, value2, attrType, length1);
+  int length = (length1 < length2) ? length1 : length2;
+  int comp = strncmp((char *)value1, (char *)value2, length);
+  if(comp != 0 || (int)strnlen((char *)value1, length) < length)
+    return comp;
+  if(length1 < length2)
+    return (((char *)value2)[length] == '\0') ? 0 : -1;
+  return (((char *)value1)[length] == '\0') ? 0 : 1;
+}
+
 //Adding MBR 
 static int compare_mbr(void *value1, void* value2, int attrLength){
   
@@ -47,6 +73,118 @@ static int compare_mbr(void *value1, void* value2, int attrLength){
 
 }
 
+// Returns true if the two MBRs share at least one point. Each axis is
+// compared on its (min, max) interval, so either corner orientation works.
+static bool intersects_mbr(const mbr &a, const mbr &b){
+  int a_x1 = a.top_left_x < a.bottom_right_x ? a.top_left_x : a.bottom_right_x;
+  int a_x2 = a.top_left_x < a.bottom_right_x ? a.bottom_right_x : a.top_left_x;
+  int a_y1 = a.top_left_y < a.bottom_right_y ? a.top_left_y : a.bottom_right_y;
+  int a_y2 = a.top_left_y < a.bottom_right_y ? a.bottom_right_y : a.top_left_y;
+  int b_x1 = b.top_left_x < b.bottom_right_x ? b.top_left_x : b.bottom_right_x;
+  int b_x2 = b.top_left_x < b.bottom_right_x ? b.bottom_right_x : b.top_left_x;
+  int b_y1 = b.top_left_y < b.bottom_right_y ? b.top_left_y : b.bottom_right_y;
+  int b_y2 = b.top_left_y < b.bottom_right_y ? b.bottom_right_y : b.top_left_y;
+  return (a_x1 <= b_x2 && b_x1 <= a_x2 && a_y1 <= b_y2 && b_y1 <= a_y2);
+}
+
+// Returns the squared MINDIST between two MBRs: the smallest squared
+// euclidean distance between any point of a and any point of b. It is 0
+// when they intersect.
+static double mindist_mbr(const mbr &a, const mbr &b){
+  double a_x1 = a.top_left_x < a.bottom_right_x ? a.top_left_x : a.bottom_right_x;
+  double a_x2 = a.top_left_x < a.bottom_right_x ? a.bottom_right_x : a.top_left_x;
+  double a_y1 = a.top_left_y < a.bottom_right_y ? a.top_left_y : a.bottom_right_y;
+  double a_y2 = a.top_left_y < a.bottom_right_y ? a.bottom_right_y : a.top_left_y;
+  double b_x1 = b.top_left_x < b.bottom_right_x ? b.top_left_x : b.bottom_right_x;
+  double b_x2 = b.top_left_x < b.bottom_right_x ? b.bottom_right_x : b.top_left_x;
+  double b_y1 = b.top_left_y < b.bottom_right_y ? b.top_left_y : b.bottom_right_y;
+  double b_y2 = b.top_left_y < b.bottom_right_y ? b.bottom_right_y : b.top_left_y;
+  double dx = 0, dy = 0;
+  if(a_x2 < b_x1)
+    dx = b_x1 - a_x2;
+  else if(b_x2 < a_x1)
+    dx = a_x1 - b_x2;
+  if(a_y2 < b_y1)
+    dy = b_y1 - a_y2;
+  else if(b_y2 < a_y1)
+    dy = a_y1 - b_y2;
+  return dx*dx + dy*dy;
+}
+
+// Area of an MBR
+static double area_mbr(const mbr &a){
+  return (double)abs(a.bottom_right_x - a.top_left_x) * abs(a.bottom_right_y - a.top_left_y);
+}
+
+// Margin of an MBR (half its perimeter), which the R*-tree split minimises
+static double margin_mbr(const mbr &a){
+  return (double)abs(a.bottom_right_x - a.top_left_x) + abs(a.bottom_right_y - a.top_left_y);
+}
+
+// Area of the intersection of two MBRs, 0 if they are disjoint
+static double overlap_mbr(const mbr &a, const mbr &b){
+  int a_x1 = a.top_left_x < a.bottom_right_x ? a.top_left_x : a.bottom_right_x;
+  int a_x2 = a.top_left_x < a.bottom_right_x ? a.bottom_right_x : a.top_left_x;
+  int a_y1 = a.top_left_y < a.bottom_right_y ? a.top_left_y : a.bottom_right_y;
+  int a_y2 = a.top_left_y < a.bottom_right_y ? a.bottom_right_y : a.top_left_y;
+  int b_x1 = b.top_left_x < b.bottom_right_x ? b.top_left_x : b.bottom_right_x;
+  int b_x2 = b.top_left_x < b.bottom_right_x ? b.bottom_right_x : b.top_left_x;
+  int b_y1 = b.top_left_y < b.bottom_right_y ? b.top_left_y : b.bottom_right_y;
+  int b_y2 = b.top_left_y < b.bottom_right_y ? b.bottom_right_y : b.top_left_y;
+  int x1 = a_x1 > b_x1 ? a_x1 : b_x1;
+  int x2 = a_x2 < b_x2 ? a_x2 : b_x2;
+  int y1 = a_y1 > b_y1 ? a_y1 : b_y1;
+  int y2 = a_y2 < b_y2 ? a_y2 : b_y2;
+  if(x1 >= x2 || y1 >= y2)
+    return 0;
+  return (double)(x2 - x1) * (y2 - y1);
+}
+
+// Grows cover so that it also encloses other. The result is normalised so
+// that top_left holds the minimum and bottom_right the maximum on each axis.
+static void expand_mbr(mbr &cover, const mbr &other){
+  int x1 = cover.top_left_x < cover.bottom_right_x ? cover.top_left_x : cover.bottom_right_x;
+  int x2 = cover.top_left_x < cover.bottom_right_x ? cover.bottom_right_x : cover.top_left_x;
+  int y1 = cover.top_left_y < cover.bottom_right_y ? cover.top_left_y : cover.bottom_right_y;
+  int y2 = cover.top_left_y < cover.bottom_right_y ? cover.bottom_right_y : cover.top_left_y;
+  int o_x1 = other.top_left_x < other.bottom_right_x ? other.top_left_x : other.bottom_right_x;
+  int o_x2 = other.top_left_x < other.bottom_right_x ? other.bottom_right_x : other.top_left_x;
+  int o_y1 = other.top_left_y < other.bottom_right_y ? other.top_left_y : other.bottom_right_y;
+  int o_y2 = other.top_left_y < other.bottom_right_y ? other.bottom_right_y : other.top_left_y;
+  cover.top_left_x = x1 < o_x1 ? x1 : o_x1;
+  cover.top_left_y = y1 < o_y1 ? y1 : o_y1;
+  cover.bottom_right_x = x2 > o_x2 ? x2 : o_x2;
+  cover.bottom_right_y = y2 > o_y2 ? y2 : o_y2;
+}
+
+// Plane sweep along x over two lists of rectangles sorted on x1. Rect is
+// any type with normalised x1 <= x2 and y1 <= y2 fields. The rectangle
+// with the smaller x1 is taken next, and paired with every rectangle of the
+// other list that starts before it ends and overlaps it in y. Every
+// intersecting pair is appended once, as (index in first, index in second).
+template <class Rect>
+static void plane_sweep(const std::vector<Rect> &first, const std::vector<Rect> &second,
+  std::vector<std::pair<int, int> > &pairs){
+  size_t i = 0;
+  size_t j = 0;
+  while(i < first.size() && j < second.size()){
+    if(first[i].x1 <= second[j].x1){
+      for(size_t k = j; k < second.size() && second[k].x1 <= first[i].x2; k++){
+        if(second[k].y1 <= first[i].y2 && first[i].y1 <= second[k].y2)
+          pairs.push_back(std::make_pair((int)i, (int)k));
+      }
+      i++;
+    }
+    else{
+      for(size_t k = i; k < first.size() && first[k].x1 <= second[j].x2; k++){
+        if(first[k].y1 <= second[j].y2 && second[j].y1 <= first[k].y2)
+          pairs.push_back(std::make_pair((int)k, (int)j));
+      }
+      j++;
+    }
+  }
+}
+
 static bool print_string(void *value, int attrLength){
   char * str = (char *)malloc(attrLength + 1);
   memcpy(str, value, attrLength+1);
@@ -11,9 +11,26 @@
 #include "rm_rid.h"  // Please don't change these lines
 #include "pf.h"
 #include <string>
+#include <vector>
+#include <queue>
+#include <functional>
 #include <cstdlib>
 #include <cstring>
 
+// How InsertEntry places new entries in an MBR index
+enum IX_InsertMode {
+    IX_LINEAR_INSERT,   // R*-tree choose-subtree and split at any level,
+                        // without forced reinsert
+    IX_RSTAR_INSERT     // R*-tree choose-subtree, split and forced reinsert
+};
+
+// How BulkLoad writes the nodes of an MBR index
+enum IX_NodeFormat {
+    IX_SLOTTED_NODES,   // an mbr and a Node_Entry per slot, as InsertEntry does
+    IX_PACKED_NODES     // dense arrays of offsets from the node's bounds,
+                        // see IX_PackedNode
+};
+
 // This is the header for the entire index. 
 struct IX_IndexHeader{
     AttrType attr_type; // attribute type and length
@@ -27,6 +44,39 @@ struct IX_IndexHeader{
     int maxKeys_N;      // Maximum number of entries in buckets and nodes
 
     PageNum rootPage;   // Page number associated with the root page
+
+    IX_InsertMode insertMode; // insertion policy chosen at creation
+    int height;         // number of levels, 1 when the root is a leaf
+
+    IX_NodeFormat nodeFormat; // node format BulkLoad writes, chosen at creation
+    int packedNodes;    // nodes written in the packed format; entries can
+                        // not be inserted or deleted while there are any
+};
+
+// The body of a packed node, which follows its IX_NodeHeader. Its num_keys
+// entries fill the arrays densely, with no slot list. Each key is stored
+// normalised, as its lower and upper x and y offsets from (minX, minY), in
+// four separate arrays so they can be compared several entries at a time.
+// Next come the RID pages, or child pages, as offsets from minPage, then
+// the slots of a leaf, each array in the fewest bytes that hold its
+// largest value. Two bits per entry, four entries to a byte, record
+// whether the key's corners were swapped on x and on y. Packed nodes set
+// freeSlotIndex to PACKED_SLOTS.
+struct IX_PackedNode{
+    int minX, minY;     // bounds of the entries in the node
+    int maxX, maxY;
+    PageNum minPage;    // lowest page the entries point to
+    char coordWidth;    // bytes per coordinate offset
+    char pageWidth;     // bytes per page offset
+    char slotWidth;     // bytes per slot, 0 in internal nodes
+};
+
+// An (MBR, RID) pair handed to the bulk loader. The upper levels of a
+// packed tree reuse it with page pointing at the child node.
+struct IX_BulkEntry{
+    mbr key;
+    PageNum page;
+    SlotNum slot;
 };
 
 //
@@ -35,8 +85,10 @@ struct IX_IndexHeader{
 class IX_IndexHandle {
     friend class IX_Manager;
     friend class IX_IndexScan;
+    friend class IX_JoinScan;
     static const int BEGINNING_OF_SLOTS = -2; // class constants
     static const int END_OF_SLOTS = -3;
+    static const int PACKED_SLOTS = -4;       // freeSlotIndex of a packed node
     static const char UNOCCUPIED = 'u';
     static const char OCCUPIED_NEW = 'n';
     static const char OCCUPIED_DUP = 'r';
@@ -54,6 +106,20 @@ public:
     // Force index files to disk
     RC ForcePages();
 
+    // Copy the header into the first page of the index if it changed, so
+    // that it is written or logged with the other pages
+    RC WriteHeader();
+
+    // Builds the tree bottom-up from numEntries entries using
+    // Sort-Tile-Recursive packing. The index must be empty, and the
+    // entries array is reordered in place. If the index was created with
+    // IX_PACKED_NODES, every node is written in the packed format.
+    RC BulkLoad(struct IX_BulkEntry *entries, int numEntries);
+
+    // Whether the index holds packed nodes, which cannot be updated, so
+    // that a command can be refused before it changes the relation
+    bool HasPackedNodes();
+
 private:
     // Given an attribute length, calculates the max number of entries
     // for the bucket and the nodes
@@ -101,7 +167,69 @@ private:
     RC DeleteFromNode(struct IX_NodeHeader *nHeader, void *pData, const RID &rid, bool &toDelete);
     RC DeleteFromLeaf(struct IX_NodeHeader_L *nHeader, void *pData, const RID &rid, bool &toDelete);
     RC FindPrevIndex(struct IX_NodeHeader *nHeader, int thisIndex, int &prevIndex);
-    RC FindNodeDeleteIndex(struct IX_NodeHeader *nHeader, void *pData, int& index);
+    RC FindNodeDeleteIndex(struct IX_NodeHeader *nHeader, void *pData, const RID &rid, int& index);
+
+    // Packs one level of the tree into nodes with room left for inserts,
+    // and returns the entries covering those nodes for the level above
+    RC PackLevel(struct IX_BulkEntry *items, int numItems, bool isLeaf,
+                 struct IX_BulkEntry *parents, int &numParents);
+    // Writes numItems entries into a node in slot order and returns the
+    // MBR covering all of them
+    void FillNode(struct IX_NodeHeader *nHeader, struct IX_BulkEntry *items, int numItems,
+                  bool isLeaf, mbr &cover);
+    // Packs one level into packed nodes, each holding as many entries as
+    // fit in a page
+    RC PackPackedLevel(struct IX_BulkEntry *items, int numItems, bool isLeaf,
+                       struct IX_BulkEntry *parents, int &numParents);
+    // Writes numItems entries into a packed node and returns their cover
+    void FillPackedNode(struct IX_NodeHeader *nHeader, struct IX_BulkEntry *items, int numItems,
+                        bool isLeaf, mbr &cover);
+
+    // Whether a node is in the packed format
+    static bool IsPackedNode(const struct IX_NodeHeader *nHeader);
+    // Appends to matches the positions of the entries of a packed node
+    // whose keys intersect window. The entries are compared on their
+    // offsets, with window moved into the node's frame, so no key is
+    // decoded.
+    static void SearchPackedNode(const struct IX_NodeHeader *nHeader, const mbr &window,
+                                 std::vector<int> &matches);
+    // Decodes the key of the entry at a position of a packed node
+    static void GetPackedKey(const struct IX_NodeHeader *nHeader, int pos, mbr &key);
+    // Decodes the RID of a leaf entry, or the child page of an internal
+    // entry, whose slot is then NO_MORE_SLOTS
+    static void GetPackedEntry(const struct IX_NodeHeader *nHeader, int pos, PageNum &page,
+                               SlotNum &slot);
+
+    // A node on the R*-tree insertion path, and the slot of its entry in
+    // the parent node
+    struct RStarFrame{
+        PageNum page;
+        struct IX_NodeHeader *nHeader;
+        int parentSlot;
+    };
+    // Inserts an entry into a node at the given level (0 for the leaves)
+    // following the R*-tree algorithm. reinserted records the levels on
+    // which an overflow has already been treated by forced reinsert.
+    RC RStarInsert(struct IX_BulkEntry &entry, int level, std::vector<bool> &reinserted);
+    // Picks the child of an internal node to descend into for key
+    void RStarChooseSubtree(struct IX_NodeHeader *nHeader, const mbr &key, bool childIsLeaf,
+                            int &slot);
+    // Splits an overflowing set of entries in two, leaving the first group
+    // in items and returning the second in second
+    void RStarSplit(std::vector<struct IX_BulkEntry> &items,
+                    std::vector<struct IX_BulkEntry> &second);
+    // Removes the entries to reinsert from an overflowing set of entries,
+    // closest to the centre first
+    void RStarPickReinsert(std::vector<struct IX_BulkEntry> &items,
+                           std::vector<struct IX_BulkEntry> &removed);
+    // Recomputes the keys of the path from path[from] up to the root
+    void RStarAdjustCovers(std::vector<struct RStarFrame> &path, int from);
+    // Marks the nodes on the path dirty, and unpins all but the root
+    RC RStarReleasePath(std::vector<struct RStarFrame> &path);
+    // Copies the occupied entries of a node into items
+    void ReadNodeEntries(struct IX_NodeHeader *nHeader, std::vector<struct IX_BulkEntry> &items);
+    // Places an entry in a free slot of a node that is not full
+    void InsertIntoFreeSlot(struct IX_NodeHeader *nHeader, const struct IX_BulkEntry &item);
 };
 
 //
@@ -122,6 +250,20 @@ public:
                 ClientHint  pinHint = NO_HINT);
 
 
+    // Open a best-first nearest neighbour scan on an MBR index. Entries
+    // are returned in increasing MINDIST from the MBR in value.
+    RC OpenNearestScan(const IX_IndexHandle &indexHandle,
+                       void *value,
+                       ClientHint pinHint = NO_HINT);
+
+    // Open a scan on an MBR index for the entries intersecting the MBR in
+    // value, whose subtrees are searched by numWorkers threads. Entries
+    // are returned in no particular order.
+    RC OpenParallelScan(const IX_IndexHandle &indexHandle,
+                        void *value,
+                        int numWorkers,
+                        ClientHint pinHint = NO_HINT);
+
     // Get the next matching entry return IX_EOF if no more matching
     // entries.
     RC GetNextEntry(RID &rid);
@@ -129,58 +271,149 @@ public:
     // Close index scan
     RC CloseScan();
 private:
+    // One level of the descent: a pinned node and the next slot to
+    // examine in it. A packed node is searched when it is pinned, and
+    // slot then indexes the positions of its matching entries.
+    struct ScanFrame{
+        PageNum page;
+        struct IX_NodeHeader *nHeader;
+        int slot;
+        std::vector<int> matches;
+    };
+
+    // A node or leaf entry waiting in the nearest neighbour queue, keyed on
+    // its MINDIST to the query. At equal distance entries come out first.
+    struct NearestItem{
+        double dist;
+        bool isEntry;
+        PageNum page;
+        SlotNum slot;
+        int level;      // of the node, 0 for leaves
+        bool operator>(const NearestItem &other) const {
+            if(dist != other.dist)
+                return dist > other.dist;
+            return isEntry < other.isEntry;
+        }
+    };
+
+    // A subtree still to be searched by a parallel scan
+    struct WindowTask{
+        PageNum page;
+        int level;      // of the node, 0 for leaves
+    };
+    // State shared with the worker threads of a parallel scan
+    struct ParallelScan;
+
     bool openScan;              // Indicator for whether the scan is being used
-    bool useFirstLeaf;
-    bool scanEnded;     // Indicators for whether the scan has started or 
-    bool scanStarted;   // ended
-    bool hasBucketPinned; // whether the scan has pinned a bucket or a leaf page
-    bool hasLeafPinned;
-    bool initializedValue; // Whether value variable has been initialized (malloced)
-    bool endOfIndexReached; // Whether the end of the scan has been reached
-    bool foundFirstValue;
-    bool foundLastValue;
-
-    int leafSlot;               // the current leaf and bucket slots of the scan
-    int bucketSlot;
-    PageNum currLeafNum;        // the current and next bucket slots of the scan
-    PageNum currBucketNum;
-    PageNum nextBucketNum;
-
-
-    char *currKey;              // the keys of the current record, and the following
-    char *nextKey;              // two records after that
-    char *nextNextKey;
-    char * leafKeys;
-
-    struct IX_NodeHeader_L *leafHeader;     // the scan's current leaf and bucket header
-    struct Node_Entry *leafEntries;
-
-    PF_PageHandle currLeafPH;   // Currently pinned Leaf and Bucket PageHandles
-    
+    bool scanEnded;             // Whether all matching entries have been returned
+    bool nearestScan;           // Whether this is a nearest neighbour scan
+
     IX_IndexHandle *indexHandle;// Pointer to the indexHandle that modifies the
                                 // file that the scan will try to traverse
-    void *value;
+    void *value;                // copy of the query key, NULL for NO_OP
     CompOp compOp;
 
-    // The comparison to determine whether a record satisfies given scan conditions
-    bool (*comparator) (void *, void*, AttrType, int);
-
     AttrType attrType;
     int attrLength;
+    ClientHint pinHint;         // hint for leaves; internal nodes are KEEP_HOT
+
+    // Pinned path from the root to the node currently being scanned
+    std::vector<struct ScanFrame> path;
+    // Priority queue of the nearest neighbour scan. No pages stay pinned
+    // between calls; a node is read when it reaches the front.
+    std::priority_queue<struct NearestItem, std::vector<struct NearestItem>,
+                        std::greater<struct NearestItem> > nearestQueue;
+    // Workers of a parallel scan, NULL for other scans
+    struct ParallelScan *parallel;
+
+    // Pins a node and pushes it on the path
+    RC PushNode(PageNum page);
+    // Unpins the node on top of the path and pops it
+    RC PopNode();
+    // Whether the subtree under an internal key can hold matching entries
+    bool SubtreeMayMatch(char *key);
+    // Whether a leaf key satisfies the scan condition
+    bool KeyMatches(char *key);
+    // Appends the positions of the entries of a packed node that satisfy
+    // the scan condition, or whose subtrees may hold entries that do
+    void PackedNodeMatches(const struct IX_NodeHeader *nHeader, std::vector<int> &matches);
+    // Returns the next entry of a nearest neighbour scan
+    RC GetNextNearest(RID &rid);
+    // Queues every entry of a node with its distance to the query
+    RC ExpandNearestNode(PageNum page, int level);
+    // The hint to read a node of the given level with
+    ClientHint NodeHint(int level);
+    // Reads a node of a parallel scan, adding its children that may hold
+    // matches to children, or its matching RIDs to found if it is a leaf
+    RC ExpandWindowNode(const struct WindowTask &task,
+                        std::vector<struct WindowTask> &children,
+                        std::vector<RID> &found);
+    // Searches subtrees until none is left; run by each worker thread
+    void RunWorker(int worker);
+    // Returns the next entry found by the workers of a parallel scan
+    RC GetNextParallel(RID &rid);
+    // Stops the workers of a parallel scan and waits for them
+    void StopWorkers();
+};
+
+//
+// IX_JoinScan: spatial join of two MBR indexes. Both R-trees are walked
+// at once, and only pairs of subtrees whose keys intersect are followed,
+// so the result is every pair of RIDs whose MBRs intersect.
+//
+class IX_JoinScan {
+    static const char UNOCCUPIED = 'u';
+public:
+    IX_JoinScan();
+    ~IX_JoinScan();
 
-    RID currRID;    // the current RID and the next RID in the scan
-    RID nextRID;
+    // Open a join scan over two MBR indexes
+    RC OpenScan(const IX_IndexHandle &indexHandle1,
+                const IX_IndexHandle &indexHandle2,
+                ClientHint pinHint = NO_HINT);
 
-    RC BeginScan(PF_PageHandle &leafPH, PageNum &pageNum);
-    // Sets up the scan private variables to the first entry within the given leaf
-    RC GetFirstEntryInLeaf(PF_PageHandle &leafPH);
-    // Sets up the scan private variables to the appropriate entry within the given leaf
-    RC GetAppropriateEntryInLeaf(PF_PageHandle &leafPH);
-    // Sets up the scan private variables to the next entry in the index
-    RC FindNextValue(); 
+    // Get the next pair of intersecting entries, rid1 from the first index
+    // and rid2 from the second. Returns IX_EOF when there are no more.
+    RC GetNextPair(RID &rid1, RID &rid2);
 
-    // Sets the RID
-    RC SetRID(bool setCurrent);
+    // Close join scan
+    RC CloseScan();
+private:
+    // A pair of nodes still to be joined
+    struct NodePair{
+        PageNum page1;
+        PageNum page2;
+    };
+
+    // An entry of a node being joined, with its key as (min, max) intervals
+    // on each axis and either its child page or its RID
+    struct JoinEntry{
+        int x1, x2, y1, y2;
+        PageNum page;
+        SlotNum slot;
+    };
+
+    bool openScan;              // Indicator for whether the scan is being used
+    IX_IndexHandle *indexHandle1;
+    IX_IndexHandle *indexHandle2;
+
+    // Node pairs waiting to be joined. No pages stay pinned between calls;
+    // both nodes of a pair are read when it is popped.
+    std::vector<struct NodePair> pending;
+    // RID pairs found in the last pair of leaves, not yet returned
+    std::vector<std::pair<RID, RID> > results;
+    size_t nextResult;
+
+    // Joins one pair of nodes, queueing child pairs or results
+    RC JoinNodes(const struct NodePair &nodes);
+    // Reads the entries of a node whose key intersects the window, and
+    // sorts them on their lower x coordinate
+    RC ReadEntries(IX_IndexHandle *ih, struct IX_NodeHeader *nHeader,
+                   const struct JoinEntry &window, std::vector<struct JoinEntry> &entries);
+    // Orders entries on their lower x coordinate
+    static bool LowerX(const struct JoinEntry &a, const struct JoinEntry &b);
+    // Computes the rectangle covering every entry of a node
+    void NodeCover(IX_IndexHandle *ih, struct IX_NodeHeader *nHeader, struct JoinEntry &cover);
 };
 
 //
@@ -196,7 +429,9 @@ public:
 
     // Create a new Index
     RC CreateIndex(const char *fileName, int indexNo,
-                   AttrType attrType, int attrLength);
+                   AttrType attrType, int attrLength,
+                   IX_InsertMode insertMode = IX_LINEAR_INSERT,
+                   IX_NodeFormat nodeFormat = IX_SLOTTED_NODES);
 
     // Destroy and Index
     RC DestroyIndex(const char *fileName, int indexNo);
@@ -207,8 +442,12 @@ public:
 
     // Close an Index
     RC CloseIndex(IX_IndexHandle &indexHandle);
+
+    // Makes the indexes opened from now on read-only mappings, or not
+    RC SetReadOnly(bool readOnly);
 private:
     PF_Manager &pfm; // The PF_Manager associated with this index.
+    bool readOnly; // whether indexes are opened as read-only mappings
 
     // Checks that the index parameters given (attrtype and length) make
     // a valid index
@@ -239,7 +478,9 @@ void IX_PrintError(RC rc);
 #define IX_INVALIDSCAN          (START_IX_WARN + 8) // Invalid IX_Indexscsan
 #define IX_INVALIDENTRY         (START_IX_WARN + 9) // Entry not in the index
 #define IX_EOF                  (START_IX_WARN + 10)// End of index file
-#define IX_LASTWARN             IX_EOF
+#define IX_NOTEMPTY             (START_IX_WARN + 11)// Bulk load into a non-empty index
+#define IX_PACKEDINDEX          (START_IX_WARN + 12)// Update of an index with packed nodes
+#define IX_LASTWARN             IX_PACKEDINDEX
 
 #define IX_ERROR                (START_IX_ERR - 0) // error
 #define IX_LASTERROR            IX_ERROR
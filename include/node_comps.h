@@ -74,8 +74,7 @@ bool nnot_equal(void * value1, void * value2, AttrType attrtype, int attrLength)
 
 bool nintersects(void * value1, void * value2, AttrType attrtype, int attrLength){
   switch(attrtype){
-    case MBR: if (compare_mbr(value1, value2, attrLength) == 0) return true;
-              else return false;
+    case MBR: return intersects_mbr(*(mbr *)value1, *(mbr *)value2);
     default:
       return (strncmp((char *) value1, (char *) value2, attrLength) != 0);
   }
@@ -47,6 +47,12 @@ struct Condition{
 
 };
 
+struct NearestClause{
+    RelAttr  attr;       /* MBR attribute to measure distance on  */
+    Value    value;      /* query MBR                             */
+    int      k;          /* number of tuples to return            */
+};
+
 std::ostream &operator<<(std::ostream &s, const CompOp &op);
 std::ostream &operator<<(std::ostream &s, const AttrType &at);
 
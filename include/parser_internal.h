@@ -62,6 +62,7 @@ typedef enum{
     N_ATTRTYPE,
     N_VALUE,
     N_RELATION,
+    N_NEAREST,
     N_STATISTICS,
     N_LIST
 } NODEKIND;
@@ -125,6 +126,7 @@ typedef struct node{
          struct node *relattrlist;
          struct node *rellist;
          struct node *conditionlist;
+         struct node *nearest;
       } QUERY;
 
       /* insert node */
@@ -188,6 +190,13 @@ typedef struct node{
          char *relname;
       } RELATION;
 
+      /* order by distance(relattr, value) limit k */
+      struct{
+         struct node *relattr;
+         struct node *value;
+         int k;
+      } NEAREST;
+
       /* list node */
       struct{
          struct node *curr;
@@ -209,7 +218,8 @@ NODE *load_node(char *relname, char *filename);
 NODE *set_node(char *paramName, char *string);
 NODE *help_node(char *relname);
 NODE *print_node(char *relname);
-NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist);
+NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist,
+                 NODE *nearest);
 NODE *insert_node(char *relname, NODE *valuelist);
 NODE *delete_node(char *relname, NODE *conditionlist);
 NODE *update_node(char *relname, NODE *relattr, NODE *value,
@@ -220,6 +230,7 @@ NODE *value_node(AttrType type, void *value);
 NODE *relattr_or_value_node(NODE *relattr, NODE *value);
 NODE *attrtype_node(char *attrname, char *type);
 NODE *relation_node(char *relname);
+NODE *nearest_node(NODE *relattr, NODE *value, int k);
 NODE *list_node(NODE *n);
 NODE *prepend(NODE *n, NODE *list);
 
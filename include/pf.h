@@ -23,14 +23,29 @@
 //
 typedef int PageNum;
 
+//
+// PF_LSN: log sequence number, the place of a record in the write-ahead
+// log.  LSNs keep growing when the log is truncated.
+//
+typedef long long PF_LSN;
+
 // Page Size
 //
 // Each page stores some header information.  The PF_PageHdr is defined
 // in pf_internal.h and contains the information that we would store.
 // Unfortunately, we cannot use sizeof(PF_PageHdr) here, but it is an
-// int and we simply use that.
+// LSN and two ints and we simply use that.
 //
-const int PF_PAGE_SIZE = 4096 - sizeof(int);
+const int PF_PAGE_SIZE = 4096 - sizeof(PF_LSN) - 2 * sizeof(int);
+
+//
+// PF_BufferPolicy: how the buffer pool picks an unpinned page to replace
+//
+enum PF_BufferPolicy {
+   PF_LRU,                  // least recently used page
+   PF_CLOCK,                // next page without its reference bit set
+   PF_LRU2                  // page whose second-to-last reference is oldest
+};
 
 //
 // PF_PageHandle: PF page interface
@@ -55,9 +70,17 @@ private:
 };
 
 //
-// PF_FileHdr: Header structure for files
+// PF_FileHdr: Header structure for files.  Files whose header does not
+// start with PF_FILE_MAGIC and PF_FILE_VERSION have another layout, and
+// are not opened.
 //
+const int PF_FILE_MAGIC = 0x46504252;   // "RBPF"
+const int PF_FILE_VERSION = 2;          // pages and header carry an LSN
+
 struct PF_FileHdr {
+   int magic;         // PF_FILE_MAGIC
+   int version;       // PF_FILE_VERSION of the file layout
+   PF_LSN lsn;        // LSN of the last logged change of the header
    int firstFree;     // first free page in the linked list
    int numPages;      // # of pages in the file
 };
@@ -65,7 +88,8 @@ struct PF_FileHdr {
 //
 // PF_FileHandle: PF File interface
 //
-class PF_BufferMgr;
+class PF_BufferPool;
+class PF_Log;
 
 class PF_FileHandle {
    friend class PF_Manager;
@@ -80,15 +104,20 @@ public:
    PF_FileHandle& operator=(const PF_FileHandle &fileHandle);
 
    // Get the first page
-   RC GetFirstPage(PF_PageHandle &pageHandle) const;
+   RC GetFirstPage(PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get the next page after current
-   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle) const;
+   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get a specific page
-   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle) const;
+   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle,
+                   ClientHint pinHint = NO_HINT) const;
    // Get the last page
    RC GetLastPage(PF_PageHandle &pageHandle) const;
    // Get the prev page after current
    RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
+   // Get the number of pages in the file, disposed ones included
+   RC GetNumPages (int &numPages) const;
 
    RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
    RC DisposePage (PageNum pageNum);              // Dispose of a page
@@ -101,17 +130,26 @@ public:
    // Force a page or pages to disk (but do not remove from the buffer pool)
    RC ForcePages  (PageNum pageNum=ALL_PAGES) const;
 
+   // Whether the file was opened as a read-only mapping
+   int IsReadOnly () const;
+
 private:
 
    // IsValidPageNum will return TRUE if page number is valid and FALSE
    // otherwise
    int IsValidPageNum (PageNum pageNum) const;
 
-   PF_BufferMgr *pBufferMgr;                      // pointer to buffer manager
+   PF_BufferPool *pBufferMgr;                     // pointer to buffer manager
+   PF_Log *pLog;                                  // write-ahead log, or NULL
    PF_FileHdr hdr;                                // file header
    int bFileOpen;                                 // file open flag
    int bHdrChanged;                               // dirty flag for file hdr
    int unixfd;                                    // OS file descriptor
+   char *pMapping;                                // read-only mapping of the
+                                                  // file, or NULL
+   long mappingSize;                              // length of the mapping
+   int  *pMappedPins;                             // # of mapped pages pinned,
+                                                  // shared by handle copies
 };
 
 //
@@ -124,16 +162,33 @@ public:
    RC CreateFile    (const char *fileName);       // Create a new file
    RC DestroyFile   (const char *fileName);       // Delete a file
 
-   // Open and close file methods
-   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle);
+   // Open and close file methods. A file opened mapped is read straight
+   // from the OS page cache, and can't be changed
+   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle,
+                     int bMapped = FALSE);
    RC CloseFile     (PF_FileHandle &fileHandle);
 
+   // Open and close the write-ahead log.  Opening it first brings the
+   // files it names back to their state after the last transaction that
+   // committed.  While it is open, the changes made to files between
+   // BeginTransaction and CommitTransaction survive a crash all together
+   // once committed, or not at all.
+   RC OpenLog       (const char *fileName);
+   RC CloseLog      ();
+   RC BeginTransaction  ();
+   RC CommitTransaction ();
+
    // Three methods that manipulate the buffer manager.  The calls are
-   // forwarded to the PF_BufferMgr instance and are called by parse.y
+   // forwarded to the PF_BufferPool instance and are called by parse.y
    // when the user types in a system command.
    RC ClearBuffer   ();
    RC PrintBuffer   ();
    RC ResizeBuffer  (int iNewSize);
+   // Sizes the buffer for numBlocks blocks plus numPages free pages in
+   // each of its shards
+   RC ReserveBuffer (int numBlocks, int numPages);
+   // Sets the page replacement policy of the buffer pool
+   RC SetBufferPolicy (PF_BufferPolicy policy);
 
    // Three Methods for manipulating raw memory buffers.  These memory
    // locations are handled by the buffer manager, but are not
@@ -155,7 +210,11 @@ public:
    RC DisposeBlock  (char *buffer);
 
 private:
-   PF_BufferMgr *pBufferMgr;                      // page-buffer manager
+   // Write every changed page and header to disk, and empty the log
+   RC Checkpoint    ();
+
+   PF_BufferPool *pBufferMgr;                     // page-buffer manager
+   PF_Log        *pLog;                           // write-ahead log, or NULL
 };
 
 //
@@ -172,7 +231,10 @@ void PF_PrintError(RC rc);
 #define PF_PAGEUNPINNED    (START_PF_WARN + 6) // page already unpinned
 #define PF_EOF             (START_PF_WARN + 7) // end of file
 #define PF_TOOSMALL        (START_PF_WARN + 8) // Resize buffer too small
-#define PF_LASTWARN        PF_TOOSMALL
+#define PF_READONLY        (START_PF_WARN + 9) // file is mapped read only
+#define PF_INTRANSACTION   (START_PF_WARN + 10) // transaction already begun
+#define PF_NOTRANSACTION   (START_PF_WARN + 11) // no transaction begun
+#define PF_LASTWARN        PF_NOTRANSACTION
 
 #define PF_NOMEM           (START_PF_ERR - 0)  // no memory
 #define PF_NOBUF           (START_PF_ERR - 1)  // no buffer space
@@ -186,9 +248,10 @@ void PF_PrintError(RC rc);
 #define PF_HASHNOTFOUND    (START_PF_ERR - 7) // hash table entry not found
 #define PF_HASHPAGEEXIST   (START_PF_ERR - 8) // page already in hash table
 #define PF_INVALIDNAME     (START_PF_ERR - 9) // invalid PC file name
+#define PF_BADFORMAT       (START_PF_ERR - 10) // unknown file format or version
 
 // Error in UNIX system call or library routine
-#define PF_UNIX            (START_PF_ERR - 10) // Unix error
+#define PF_UNIX            (START_PF_ERR - 11) // Unix error
 #define PF_LASTERROR       PF_UNIX
 
 #endif
@@ -15,6 +15,7 @@
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <aio.h>
 #include "pf_internal.h"
 #include "pf_hashtable.h"
 
@@ -28,6 +29,8 @@
 // next.
 #define INVALID_SLOT  (-1)
 
+class PF_Log;
+
 //
 // PF_BufPageDesc - struct containing data about a page in the buffer
 //
@@ -39,6 +42,39 @@ struct PF_BufPageDesc {
     short int  pinCount;    // pin count
     PageNum    pageNum;     // page number for this page
     int        fd;          // OS file descriptor of this page
+    int        bReferenced; // CLOCK: TRUE if referenced since the hand passed
+    long       lastRef;     // LRU-2: time of the last reference
+    long       prevRef;     // LRU-2: time of the reference before, or 0
+    int        bScanRing;   // TRUE if read by a sequential scan
+    int        ringNext;    // next in the scan ring, toward its oldest page
+    int        ringPrev;    // prev in the scan ring
+    int        bHot;        // TRUE if replaced only when no other page is
+    int        queuePos;    // LRU-2: place in the queue, or INVALID_SLOT
+    int        bReadAhead;  // TRUE if read ahead and not asked for yet
+    int        bInFlight;   // TRUE while the read ahead is under way
+    struct aiocb readReq;   // the read ahead request
+};
+
+//
+// PF_RefHistory: LRU-2 keeps the time of the last reference of pages
+// replaced recently, so that a page read again soon after being replaced
+// is known to have been referenced twice
+//
+struct PF_RefHistory {
+    int        fd;          // OS file descriptor of the page
+    PageNum    pageNum;     // page number
+    long       lastRef;     // time of the last reference, or 0 if unused
+};
+
+//
+// PF_ReadStream: a file being read in page order.  nextPage is the page
+// that continues the stream, and pages before readAhead have been read
+// ahead already.
+//
+struct PF_ReadStream {
+    int        fd;          // OS file descriptor, -1 if unused
+    PageNum    nextPage;    // page expected next
+    PageNum    readAhead;   // first page not read ahead yet
 };
 
 //
@@ -53,7 +89,8 @@ public:
 
     // Read pageNum into buffer, point *ppBuffer to location
     RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
-                      int bMultiplePins = TRUE);
+                      int bMultiplePins = TRUE,
+                      ClientHint pinHint = NO_HINT);
     // Allocate a new page in the buffer, point *ppBuffer to its location
     RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
 
@@ -64,6 +101,11 @@ public:
     // Force a page to the disk, but do not remove from the buffer pool
     RC ForcePages    (int fd, PageNum pageNum);
 
+    // Set the write-ahead log that pages are logged to before written
+    void SetLog      (PF_Log *pLog) { this->pLog = pLog; }
+    // Log a dirty page for the commit of a transaction
+    RC LogPage       (int fd, PageNum pageNum);
+
 
     // Remove all entries from the Buffer Manager.
     RC  ClearBuffer  ();
@@ -73,6 +115,12 @@ public:
     // Attempts to resize the buffer to the new size
     RC ResizeBuffer  (int iNewSize);
 
+    // Sets the policy used to choose the pages to replace
+    RC SetPolicy     (PF_BufferPolicy policy);
+
+    // TRUE if no page is in the buffer
+    int IsEmpty      () const { return (first == INVALID_SLOT); }
+
     // Three Methods for manipulating raw memory buffers.  These memory
     // locations are handled by the buffer manager, but are not
     // associated with a particular file.  These should be used if you
@@ -88,26 +136,80 @@ public:
 
 private:
     RC  InsertFree   (int slot);                 // Insert slot at head of free
+    void ReleaseSlot (int slot);                 // Forget the page of a slot
     RC  LinkHead     (int slot);                 // Insert slot at head of used
     RC  Unlink       (int slot);                 // Unlink slot
-    RC  InternalAlloc(int &slot);                // Get a slot to use
+    RC  InternalAlloc(int &slot,                 // Get a slot to use
+                      ClientHint pinHint = NO_HINT);
+    RC  ChooseVictim (int &slot, ClientHint pinHint); // Get an unpinned slot
+    RC  Reference    (int slot);                 // Note a hit on a slot
+    void ApplyHint   (int slot, ClientHint pinHint); // Mark a pinned slot
+    void JoinRing    (int slot);                 // Add slot to the scan ring
+    void LeaveRing   (int slot);                 // Take it out of the ring
+    // LRU-2: queue of the slots the first pass of ChooseVictim may take,
+    // ordered on their second-to-last and last references
+    void QueueSlot   (int slot);
+    void DequeueSlot (int slot);
+    void InitQueue   ();
+    int  QueueBefore (int slot1, int slot2) const;
+    void SiftUp      (int pos);
+    void SiftDown    (int pos);
+    void InitHistory ();                         // Forget replaced pages
+    long TakeHistory (int fd, PageNum pageNum);  // Last reference of a
+                                                 // replaced page, or 0
+
+    // Read ahead of a sequential reader, and wait for a read ahead
+    void ReadAhead   (int fd, PageNum pageNum, ClientHint pinHint);
+    RC  StartRead    (int slot);
+    RC  FinishRead   (int slot);
+    // Whether a slot may be replaced in the given pass of ChooseVictim
+    int Replaceable  (int slot, int pass) const;
 
     // Read a page
     RC  ReadPage     (int fd, PageNum pageNum, char *dest);
 
-    // Write a page
-    RC  WritePage    (int fd, PageNum pageNum, char *source);
+    // Write the pages of some slots of a file, sorted on page number
+    RC  WritePages   (int fd, const int *slots, int numSlots);
+    // Write the dirty pages of a file, all or only the unpinned ones
+    RC  WriteDirty   (int fd, PageNum pageNum, int bPinnedToo);
+    // Write a dirty page along with its dirty unpinned neighbours
+    RC  WriteRun     (int slot);
 
     // Init the page desc entry
     RC  InitPageDesc (int fd, PageNum pageNum, int slot);
 
+    // Map and unmap the memory holding the pages of the buffer
+    char *AllocArena (int numPages, size_t &size) const;
+    void FreeArena   (char *arena, size_t size) const;
+
     PF_BufPageDesc *bufTable;                     // info on buffer pages
+    char           *arena;                        // memory of buffer pages
+    size_t         arenaSize;                     // size of the arena
     PF_HashTable   hashTable;                     // Hash table object
     int            numPages;                      // # of pages in the buffer
     int            pageSize;                      // Size of pages in the buffer
+    int            frameSize;                     // Distance between pages
+                                                  // in the arena
     int            first;                         // MRU page slot
     int            last;                          // LRU page slot
     int            free;                          // head of free list
+    PF_BufferPolicy policy;                       // page replacement policy
+    int            clockHand;                     // CLOCK: next slot looked at
+    int            ringFirst;                     // newest page of the ring
+    int            ringLast;                      // oldest page of the ring
+    int            numRing;                       // # of pages in the ring
+    int            numHot;                        // # of hot pages
+    long           refTime;                       // LRU-2: # of references
+    PF_RefHistory  *history;                      // LRU-2: replaced pages
+    PF_HashTable   historyIndex;                  // LRU-2: where pages are
+                                                  // in the history
+    int            historyNext;                   // LRU-2: next entry used
+    int            *queue;                        // LRU-2: binary heap of
+                                                  // replaceable slots
+    int            queueSize;                     // LRU-2: # of slots in it
+    PF_ReadStream  streams[PF_READ_STREAMS];      // sequential readers
+    int            nextStream;                    // next stream replaced
+    PF_Log         *pLog;                         // write-ahead log, or NULL
 };
 
 #endif
@@ -0,0 +1,103 @@
+//
+// File:        pf_bufferpool.h
+// Description: PF_BufferPool class interface
+//
+// The buffer pool is split into shards, each a PF_BufferMgr with its own
+// latch, page table and replacement state.  A page always goes to the
+// shard chosen by hashing its file and the extent of PF_SHARD_EXTENT
+// pages it lies in, so that pages read ahead and pages written together
+// are in the same shard.  Calls for one page only take the latch of its
+// shard, so threads working on different pages seldom wait for each
+// other.
+//
+
+#ifndef PF_BUFFERPOOL_H
+#define PF_BUFFERPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include "pf_internal.h"
+#include "pf_buffermgr.h"
+
+//
+// PF_BufferShard - a part of the buffer pool and the latch guarding it
+//
+struct alignas(64) PF_BufferShard {
+    PF_BufferMgr *pBufferMgr;   // the pages of the shard
+    std::mutex   latch;         // held by calls on the shard
+};
+
+//
+// PF_BufferPool - manage the page buffer, from any number of threads
+//
+// ResizeBuffer may replace the shards, so it must not be called while
+// other threads use the pool.
+//
+class PF_BufferPool {
+public:
+
+    PF_BufferPool    (int numPages);             // Constructor - allocate
+                                                  // numPages buffer pages
+    ~PF_BufferPool   ();                         // Destructor
+
+    // Read pageNum into buffer, point *ppBuffer to location
+    RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
+                      int bMultiplePins = TRUE,
+                      ClientHint pinHint = NO_HINT);
+    // Allocate a new page in the buffer, point *ppBuffer to its location
+    RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
+
+    RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
+    RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
+    RC  FlushPages   (int fd);                   // Flush pages for file
+
+    // Force a page to the disk, but do not remove from the buffer pool
+    RC ForcePages    (int fd, PageNum pageNum);
+
+    // Set the write-ahead log of every shard
+    void SetLog      (PF_Log *pLog);
+    // Log a dirty page for the commit of a transaction
+    RC LogPage       (int fd, PageNum pageNum);
+
+    // Remove all entries from the Buffer Manager.
+    RC  ClearBuffer  ();
+    // Display all entries in the buffer
+    RC PrintBuffer   ();
+
+    // Attempts to resize the buffer to the new size
+    RC ResizeBuffer  (int iNewSize);
+    // Resize the buffer for numBlocks blocks and numPages more pages in
+    // every shard
+    RC ReserveBuffer (int numBlocks, int numPages);
+
+    // Sets the policy used to choose the pages to replace
+    RC SetPolicy     (PF_BufferPolicy policy);
+
+    // Return the size of the block that can be allocated.
+    RC GetBlockSize  (int &length) const;
+
+    // Allocate a memory chunk that lives in buffer manager
+    RC AllocateBlock (char *&buffer);
+    // Dispose of a memory chunk managed by the buffer manager.
+    RC DisposeBlock  (char *buffer);
+
+private:
+    // Shard holding a page
+    PF_BufferShard &Shard(int fd, PageNum pageNum);
+    // # of shards and # of pages of a shard for a pool of numPages
+    static int NumShards (int numPages);
+    int ShardPages   (int numPages, int shard) const;
+    // Create and destroy the shards
+    void CreateShards(int numPages);
+    void DestroyShards();
+
+    PF_BufferShard shards[PF_BUFFER_SHARDS];      // the shards in use come
+                                                  // first
+    int            numShards;                     // # of shards in use
+    std::atomic<unsigned int> nextBlockShard;     // shard tried first by
+                                                  // AllocateBlock
+    PF_BufferPolicy policy;                       // page replacement policy
+    PF_Log         *pLog;                         // write-ahead log, or NULL
+};
+
+#endif
@@ -11,22 +11,28 @@
 #include "pf_internal.h"
 
 //
-// HashEntry - Hash table bucket entries
+// HashEntry - Hash table entries, stored in one flat array
 //
 struct PF_HashEntry {
-    PF_HashEntry *next;   // next hash table element or NULL
-    PF_HashEntry *prev;   // prev hash table element or NULL
     int          fd;      // file descriptor
     PageNum      pageNum; // page number
-    int          slot;    // slot of this page in the buffer
+    int          slot;    // slot of this page in the buffer, or
+                          // PF_HASH_EMPTY if the entry is unused
 };
 
+#define PF_HASH_EMPTY  (-1)
+
 //
 // PF_HashTable - allow search, insertion, and deletion of hash table entries
 //
+// The table uses open addressing with linear probing: an entry is kept
+// in the first free place at or after the place its key hashes to.  It
+// has at least twice as many places as entries, so probes stay short, and
+// it only allocates memory when it is resized.
+//
 class PF_HashTable {
 public:
-    PF_HashTable (int numBuckets);           // Constructor
+    PF_HashTable (int maxEntries);           // Constructor
     ~PF_HashTable();                         // Destructor
     RC  Find     (int fd, PageNum pageNum, int &slot);
                                              // Set slot to the hash table
@@ -34,12 +40,19 @@ public:
     RC  Insert   (int fd, PageNum pageNum, int slot);
                                              // Insert a hash table entry
     RC  Delete   (int fd, PageNum pageNum);  // Delete a hash table entry
+    RC  Resize   (int maxEntries);           // Make room for maxEntries
+    void Clear   ();                         // Delete all entries
 
 private:
-    int Hash     (int fd, PageNum pageNum) const
-      { return ((fd + pageNum) % numBuckets); }   // Hash function
-    int numBuckets;                               // Number of hash table buckets
-    PF_HashEntry **hashTable;                     // Hash table
+    int Hash     (int fd, PageNum pageNum) const;  // Hash function
+    int Probe    (int fd, PageNum pageNum) const;  // Place of the entry or
+                                                   // of the free place
+                                                   // ending its probe
+    int numPlaces;                                // Size of the table, a
+                                                  // power of two
+    int maxEntries;                               // Max # of entries
+    int numEntries;                               // # of entries
+    PF_HashEntry *hashTable;                      // Hash table
 };
 
 #endif
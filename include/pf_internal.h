@@ -17,7 +17,18 @@
 // Constants and defines
 //
 const int PF_BUFFER_SIZE = 40;     // Number of pages in the buffer
-const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
+const int PF_FRAME_ALIGN = 64;     // Alignment of the pages in the buffer
+const int PF_HUGE_PAGE = 2 << 20;  // Size of a huge page; buffers this
+                                   // large are backed by huge pages
+const int PF_SCAN_RING = 16;       // # of pages recycled by sequential scans
+const int PF_READAHEAD_PAGES = 8;  // # of pages read ahead of a sequential
+                                   // reader
+const int PF_READ_STREAMS = 8;     // # of sequential readers tracked
+const int PF_WRITE_RUN = 64;       // max # of pages written by one call
+const int PF_BUFFER_SHARDS = 16;   // max # of shards of the buffer pool
+const int PF_SHARD_PAGES = 1024;   // min # of pages of a shard
+const int PF_SHARD_EXTENT = 64;    // # of consecutive pages of a file kept
+                                   // in the same shard
 
 #define CREATION_MASK      0600    // r/w privileges to owner only
 #define PF_PAGE_LIST_END  -1       // end of list of free pages
@@ -34,10 +45,12 @@ const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
 // PF_PageHdr: Header structure for pages
 //
 struct PF_PageHdr {
+    PF_LSN lsn;         // LSN of the last logged image of the page
     int nextFree;       // nextFree can be any of these values:
                         //  - the number of the next free page
                         //  - PF_PAGE_LIST_END if this is last free page
                         //  - PF_PAGE_USED if the page is not free
+    int unused;         // pads the header to a multiple of 8 bytes
 };
 
 // Justify the file header to the length of one page
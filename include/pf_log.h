@@ -0,0 +1,185 @@
+//
+// File:        pf_log.h
+// Description: PF_Log class interface
+//
+// The write-ahead log of the paged files.  A transaction changes pages
+// in the buffer pool, and the log keeps whole images of them:
+//
+//  - the image of a page the transaction wrote to disk before it
+//    committed, and the image that page had on disk before (its undo
+//    image), which reaches the log before the page reaches the file;
+//  - the image of every other page the transaction changed, taken when
+//    it commits, and the image of the headers of the files it changed.
+//
+// Each image carries the LSN of its record in its page header.  The
+// transaction is committed once its commit record is on disk; several
+// threads committing at once share a single sync of the log.
+//
+// After a crash, the undo images of a transaction that did not commit
+// are written back, latest first, which puts its pages back as they were
+// on disk before it.  Then the images of the transactions that did
+// commit are written again in log order, skipping those the file already
+// holds a later image of.  Undo comes first because undo images are
+// states of the disk, which can be older than what committed
+// transactions logged for the same pages.
+//
+// A checkpoint writes every changed page and header to disk, syncs the
+// files written since the last one, and empties the log.
+//
+
+#ifndef PF_LOG_H
+#define PF_LOG_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "pf_internal.h"
+
+//
+// Constants
+//
+const int PF_HDR_PAGE = -1;              // page number of a file header
+const int PF_LOG_MAGIC = 0x52424c47;     // first int of a log file
+const long PF_LOG_CHECKPOINT = 16 << 20; // size of the log past which a
+                                         // commit checkpoints
+
+//
+// PF_LogRecType: kinds of log records
+//
+enum PF_LogRecType {
+   PF_LOG_UNDO,         // image of a page on disk before it was written
+   PF_LOG_REDO,         // image of a page changed by the transaction
+   PF_LOG_COMMIT,       // the transaction committed
+   PF_LOG_CREATE,       // a file was created
+   PF_LOG_DESTROY       // a file was destroyed.  It is kept under the name
+                        // in the data until the transaction commits
+};
+
+//
+// PF_LogFileHdr: header of the log file.  The LSN of a record is base
+// plus its offset in the file.
+//
+struct PF_LogFileHdr {
+   int    magic;        // PF_LOG_MAGIC
+   int    unused;       // pads the header to a multiple of 8 bytes
+   PF_LSN base;         // LSN of the start of the file
+};
+
+//
+// PF_LogRecHdr: header of a log record.  It is followed by the name of
+// the file it is about and by its data.
+//
+struct PF_LogRecHdr {
+   PF_LSN  lsn;         // LSN of the record
+   int     type;        // PF_LogRecType
+   int     txn;         // transaction of the record
+   PageNum pageNum;     // page of an image, or PF_HDR_PAGE
+   int     nameLength;  // length of the file name
+   int     dataLength;  // length of the data
+   unsigned int checksum; // of the whole record, counting this as 0
+};
+
+//
+// PF_Log - the write-ahead log of the paged files
+//
+// Files are known to the log by the descriptor they are open with, and
+// logged by the name they were opened under.  Any thread may write pages,
+// so every call takes the latch of the log.  The buffer pool calls in
+// while holding the latch of a shard, so the log never calls the pool.
+//
+class PF_Log {
+public:
+   PF_Log  ();                                   // Constructor
+   ~PF_Log ();                                   // Destructor
+
+   // Open the log, creating it if needed, and recover the files it
+   // names.  The log must be checkpointed before it is closed.
+   RC Open         (const char *fileName);
+   RC Close        ();
+
+   // Note the name of a file when it is opened, and forget it once closed
+   void OpenFile   (int fd, const char *fileName);
+   void CloseFile  (int fd);
+   // The descriptors of the open files
+   void GetFiles   (std::vector<int> &fds);
+
+   // Begin and commit a transaction
+   RC Begin        ();
+   RC Commit       ();
+   int InTransaction ();
+
+   // Note a page changed by the transaction, and list them
+   void Touch      (int fd, PageNum pageNum);
+   void GetTouched (std::vector<std::pair<int, PageNum> > &pages);
+
+   // Log the header of a file changed by the transaction
+   RC LogHeader    (int fd, PF_FileHdr &hdr);
+
+   // Log the image of a page, or of a header if pageNum is PF_HDR_PAGE,
+   // that is about to be written.  If the transaction changed it, the
+   // image is logged, after its undo image the first time, and the LSN
+   // is set in it.  The log must then be forced up to the LSN of the
+   // image before it is written.
+   RC LogWrite     (int fd, PageNum pageNum, char *pData);
+
+   // Log the image of a page changed by the transaction, on commit
+   RC LogPage      (int fd, PageNum pageNum, char *pData);
+
+   // Log the creation of a file, and the destruction of a file which
+   // is then moved out of the way to keptName
+   RC LogCreate    (const char *fileName);
+   RC LogDestroy   (const char *fileName, std::string &keptName);
+
+   // Force the log to disk up to an LSN
+   RC Force        (PF_LSN lsn);
+
+   // Whether the log has grown enough to be checkpointed
+   int NeedsCheckpoint ();
+   // Write the headers logged for open files, sync the files written
+   // since the last checkpoint and empty the log.  Every page must have
+   // been written before.
+   RC Checkpoint   ();
+
+private:
+   // Append a record and return its LSN.  The latch must be held.
+   PF_LSN Append   (PF_LogRecType type, const std::string &fileName,
+                    PageNum pageNum, const char *pData, int length);
+   // Force the log to disk up to an LSN, with the latch held
+   RC ForceTail    (std::unique_lock<std::mutex> &lock, PF_LSN lsn);
+   // Read the image a page has on disk
+   RC ReadImage    (int fileFd, PageNum pageNum, char *pData);
+
+   // Bring the files back to the last committed state
+   RC Recover      ();
+
+   int         fd;                               // log file, or -1
+   PF_LSN      base;                             // LSN of the file start
+   PF_LSN      end;                              // LSN past the last record
+   PF_LSN      durable;                          // LSN up to which the log
+                                                 // is on disk
+   std::string tail;                             // records not written yet
+   int         bForcing;                         // TRUE while a thread
+                                                 // writes the tail
+   int         txn;                              // transaction, or 0
+   int         lastTxn;                          // last transaction begun
+   PF_LSN      txnStart;                         // end of the log when the
+                                                 // transaction began
+   std::map<int, std::string> names;             // names of open files
+   std::set<std::pair<int, PageNum> > touched;   // pages changed by txn
+   std::set<std::pair<std::string, PageNum> > undone; // pages whose undo
+                                                 // image is logged
+   std::map<int, PF_FileHdr> headers;            // headers logged but not
+                                                 // written
+   std::set<std::string> written;                // files written since the
+                                                 // last checkpoint
+   std::vector<std::string> kept;                // destroyed files kept
+                                                 // until commit
+   std::mutex  latch;                            // guards the log
+   std::condition_variable forced;               // signalled when a thread
+                                                 // is done forcing the log
+};
+
+#endif
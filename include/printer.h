@@ -14,6 +14,8 @@
 
 #define MAXPRINTSTRING  ((2*MAXNAME) + 5)
 
+class RM_RecordView;
+
 //
 // DataAttrInfo
 //
@@ -77,6 +79,8 @@ public:
     // RecData.  The second will be useful in the QL layer.
     void Print(std::ostream &c, const char * const data);
     void Print(std::ostream &c, const void * const data[]);
+    // Prints a record straight from the page it is on
+    void Print(std::ostream &c, const RM_RecordView &rec);
 
     void PrintFooter(std::ostream &c) const;
 
@@ -22,10 +22,21 @@
 #include "ql_node.h"
 
 
+// How a relation is joined with the relations before it in the plan
+enum QO_JoinMethod {
+  QO_NESTEDLOOP,    // nested loop, or index join if indexAttr is set
+  QO_SPATIALJOIN,   // both relations' R-trees walked together on indexCond
+  QO_PBSMJOIN,      // both inputs partitioned on a grid and joined on indexCond
+  QO_HASHJOIN,      // hash table built on one input, probed with the other
+  QO_MERGEJOIN      // outer already ordered on indexCond, merged with the sorted inner
+};
+
 typedef struct QO_Rel{
   int relIdx;
   int indexAttr;
   int indexCond;
+  QO_JoinMethod joinMethod;
+  bool buildOuter;  // hash join builds its table on the outer input
 } QO_Rel;
 
 //
@@ -38,6 +49,11 @@ class QL_Manager {
     friend class QL_NodeRel;
     friend class QL_NodeSel;
     friend class QL_NodeProj;
+    friend class QL_NodeNearest;
+    friend class QL_NodeSpatialJoin;
+    friend class QL_NodePBSMJoin;
+    friend class QL_NodeHashJoin;
+    friend class QL_NodeMergeJoin;
     friend class QO_Manager;
 public:
     QL_Manager (SM_Manager &smm, IX_Manager &ixm, RM_Manager &rmm);
@@ -48,7 +64,8 @@ public:
         int   nRelations,                // # relations in from clause
         const char * const relations[],  // relations in from clause
         int   nConditions,               // # conditions in where clause
-        const Condition conditions[]);   // conditions in where clause
+        const Condition conditions[],    // conditions in where clause
+        const NearestClause *nearest = NULL); // order by distance clause
 
     RC Insert  (const char *relName,     // relation to insert into
         int   nValues,                   // # values
@@ -104,18 +121,23 @@ private:
   RC InsertIntoRelation(const char *relName, int tupleLength, int nValues, const Value values[]);
   // Inserts a new record in all the indices belonging to that relation
   RC InsertIntoIndex(char *recbuf, RID recRID);
+  // Fails with IX_PACKEDINDEX if the index of the attribute at position
+  // index, or of any attribute if index is -1, holds packed nodes
+  RC CheckIndexesWritable(int index);
   // Creates a record from the values entered via the query command
   RC CreateRecord(char *recbuf, AttrCatEntry *aEntries, int nValues, const Value values[]);
 
 
-  // Used for update for keeping track of attributes that have indices.
-  RC CleanUpRun(Attr* attributes, RM_FileHandle &relFH);
-  RC SetUpRun(Attr* attributes, RM_FileHandle &relFH);
+  // Used for delete for retrieving the relation and the indices of its
+  // attributes
+  RC SetUpRun(std::vector<IX_IndexHandle *> &indexes, RM_FileHandle *&relFH);
 
   // Cleans up the nodes after a run
   RC CleanUpNodes(QL_Node *topNode);
   // Count the number of conditions associated with a relation
   RC CountNumConditions(int relIndex, int &numConds);
+  // Whether a condition can be answered by an index scan on its LHS attribute
+  bool IsIndexScanCond(const Condition &cond);
   // Set up the first node in creating the query tree
   RC SetUpFirstNode(QL_Node *&topNode);
   // Sets up the entire query tree and returns the top node in topNode
@@ -130,6 +152,31 @@ private:
   // Creates a join node and a relation node for the relation specified, and
   // returns the top node in topNode
   RC JoinRelation(QL_Node *&topNode, QL_Node *currNode, int relIndex);
+  // Joins two relations with a spatial join on an INTERSECTS condition
+  // between their indexed MBR attributes
+  RC SetUpSpatialJoin(QL_Node *&topNode, int relIdx1, int relIdx2, int joinCond);
+  // Whether a condition is an INTERSECTS between indexed MBR attributes of
+  // the two relations
+  bool IsSpatialJoinCond(const Condition &cond, int relIdx1, int relIdx2);
+  // Joins the relation at relIndex with currNode by partitioning both on
+  // the MBR attributes of the INTERSECTS condition joinCond
+  RC SetUpPBSMJoin(QL_Node *&topNode, QL_Node *currNode, int relIndex, int joinCond);
+  // Whether a condition is an INTERSECTS between MBR attributes of two
+  // relations, one of which is at relIndex
+  bool IsPBSMJoinCond(const Condition &cond, int relIndex);
+  // Joins the relation at relIndex with currNode with a hash join, or a
+  // merge join, on the equality condition joinCond
+  RC SetUpEquiJoin(QL_Node *&topNode, QL_Node *currNode, int relIndex, int joinCond,
+    QO_JoinMethod joinMethod, bool buildOuter);
+  // Whether a condition is an equality between INT, FLOAT or STRING
+  // attributes of two relations, one of which is at relIndex
+  bool IsEquiJoinCond(const Condition &cond, int relIndex);
+  // Checks that a nearest neighbour clause refers to an MBR attribute of
+  // the single relation queried
+  RC ParseNearest(const NearestClause &nearest);
+  // Sets up the query tree for a nearest neighbour query
+  RC SetUpNearestNodes(QL_Node *&topNode, const NearestClause &nearest,
+                       int nSelAttrs, const RelAttr selAttrs[]);
 
   // Set up the printing parameters
   RC SetUpPrinter(QL_Node *topNode, DataAttrInfo *attributes);
@@ -186,7 +233,9 @@ void QL_PrintError(RC rc);
 #define QL_EOI                  (START_QL_WARN + 8) // End of iterator
 #define QO_BADCONDITION         (START_QL_WARN + 9)
 #define QO_INVALIDBIT           (START_QL_WARN + 10)
-#define QL_LASTWARN             QL_EOI
+#define QL_BADNEAREST           (START_QL_WARN + 11) // Bad order by distance clause
+#define QL_TUPLETOOLONG         (START_QL_WARN + 12) // Tuples too long to partition
+#define QL_LASTWARN             QL_TUPLETOOLONG
 
 #define QL_INVALIDDB            (START_QL_ERR - 0)
 #define QL_ERROR                (START_QL_ERR - 1) // error
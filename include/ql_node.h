@@ -6,6 +6,8 @@
 #ifndef QL_NODE_H
 #define QL_NODE_H
 
+#include <vector>
+#include <utility>
 
 /*
  * This holds information about a condition to meet
@@ -22,6 +24,40 @@ typedef struct Cond{
   AttrType type; // attribute type
 } Cond;
 
+#define QL_BATCHSIZE 64 // max number of tuples in a batch
+#define QL_MORSEL_PAGES 16 // pages a worker of a parallel scan takes at once
+
+/*
+ * A batch of tuples passed up between nodes. data holds up to capacity
+ * tuples of tupleLength bytes, and sel lists, in order, the positions of
+ * the tuples in data that are still part of the result. A node can then
+ * filter a batch by shortening sel, without moving any tuple.
+ */
+class TupleBatch {
+public:
+  TupleBatch();
+  ~TupleBatch();
+
+  // Allocates space for QL_BATCHSIZE tuples of the given length
+  void Init(int tupleLength);
+  // Empties the batch
+  void Clear();
+  // Where the next tuple added goes
+  char *NextSlot();
+  // Keeps the tuple written at NextSlot, as selected
+  void AddTuple();
+  bool IsFull();
+  // The i-th selected tuple
+  char *SelectedTuple(int i);
+
+  char *data;
+  int *sel;
+  int tupleLength;
+  int capacity;
+  int numTuples; // tuples in data
+  int numSelected; // entries of sel
+};
+
 /*
  * The abstract class for nodes
  */
@@ -30,11 +66,18 @@ class QL_Node {
   friend class QL_NodeJoin;
 public:
   QL_Node(QL_Manager &qlm);
-  ~QL_Node();
+  virtual ~QL_Node();
 
   virtual RC OpenIt() = 0;
-  virtual RC GetNext(char * data) = 0;
+  // Fills batch, which holds tuples of this node's length, with the next
+  // tuples. Returns QL_EOI, with the batch empty, when there are no more.
+  virtual RC GetNextBatch(TupleBatch &batch) = 0;
+  // Returns the next tuple, taking them one at a time out of batches
+  RC GetNext(char * data);
   virtual RC GetNextRec(RM_Record &rec) = 0;
+  // Returns the next record in place, for nodes that pass up records. The
+  // view is valid until the next call, or until the node is closed.
+  virtual RC GetNextRec(RM_RecordView &rec);
   virtual RC CloseIt() = 0;
   virtual RC DeleteNodes() = 0;
   virtual RC PrintNode(int numTabs) = 0;
@@ -67,6 +110,18 @@ protected:
   int* condsInNode; // maps the condition from the index in this list, to the 
                     // index in the list in QL
    bool useIndexJoin;
+
+  // Drops the tuples GetNext has left from the last batch. Every node calls
+  // this when it is opened, since nodes can be reopened midway.
+  void ResetBatch();
+  // Produces the next tuple, for nodes that build their batches one tuple
+  // at a time
+  virtual RC NextTuple(char *data);
+  // Fills a batch with NextTuple until it is full or the node runs out
+  RC FillBatch(TupleBatch &batch);
+private:
+  TupleBatch nextBatch; // the batch GetNext returns tuples from
+  int batchPos; // the next selected tuple of nextBatch to return
 };
 
 /* Project nodes
@@ -78,7 +133,7 @@ public:
   ~QL_NodeProj();
 
   RC OpenIt();
-  RC GetNext(char *data);
+  RC GetNextBatch(TupleBatch &batch);
   RC CloseIt();
   RC GetNextRec(RM_Record &rec);
   RC DeleteNodes();
@@ -89,14 +144,15 @@ public:
 
   // Add a projection by specifying the index of the attribute to keep
   RC AddProj(int attrIndex);
-  RC ReconstructRec(char *data); // reconstruct the record, and put it in data
+  // reconstruct tuple of the previous node, and put it in data
+  RC ReconstructRec(char *tuple, char *data);
   RC SetUpNode(int numAttrToKeep); 
 private:
   QL_Node &prevNode; // previous node
 
   int numAttrsToKeep; // # of attributes to keep
 
-  char *buffer;
+  TupleBatch inBatch; // batch of tuples of the previous node
 };
 
 
@@ -109,9 +165,10 @@ public:
   ~QL_NodeSel();
 
   RC OpenIt();
-  RC GetNext(char *data);
+  RC GetNextBatch(TupleBatch &batch);
   RC CloseIt();
   RC GetNextRec(RM_Record &rec);
+  RC GetNextRec(RM_RecordView &rec);
   RC DeleteNodes();
   RC PrintNode(int numTabs);
   bool IsRelNode();
@@ -121,9 +178,15 @@ public:
   RC AddCondition(const Condition conditions, int condNum);
   RC SetUpNode(int numConds);
 private:
-  QL_Node& prevNode;
+  // Hands the scan of the relation below to worker threads, which check
+  // the conditions of this node, if that relation is read by a filescan
+  // and spans enough pages
+  RC StartParallelScan();
 
-  char *buffer;
+  QL_Node& prevNode;
+  RM_RecordView recView; // the record last read from the previous node
+  bool firstBatch; // whether no batch was read since the node was opened
+  bool parallelScan; // whether workers scan the relation below
 };
 
 /* Join nodes
@@ -135,7 +198,7 @@ public:
   ~QL_NodeJoin();
 
   RC OpenIt();
-  RC GetNext(char *data);
+  RC GetNextBatch(TupleBatch &batch);
   RC CloseIt();
   RC GetNextRec(RM_Record &rec);
   RC DeleteNodes();
@@ -148,6 +211,9 @@ public:
   RC AddCondition(const Condition conditions, int condNum);
   RC SetUpNode(int numConds);
 private:
+  // Returns the next tuple of the join, one at a time
+  RC NextTuple(char *data);
+
   QL_Node &node1;
   QL_Node &node2;
   int firstNodeSize;
@@ -159,19 +225,377 @@ private:
   int indexAttr;
 };
 
+class QL_NodeRel;
+
+/* Spatial join nodes
+ * Joins two relations on an INTERSECTS condition between MBR attributes
+ * that are both indexed, by walking the two R-trees together instead of
+ * looping over one relation for every tuple of the other
+ */
+class QL_NodeSpatialJoin: public QL_Node {
+  friend class QL_Manager;
+public:
+  QL_NodeSpatialJoin(QL_Manager &qlm, QL_NodeRel &node1, QL_NodeRel &node2);
+  ~QL_NodeSpatialJoin();
+
+  RC OpenIt();
+  RC GetNextBatch(TupleBatch &batch);
+  RC CloseIt();
+  RC GetNextRec(RM_Record &rec);
+  RC DeleteNodes();
+  RC PrintNode(int numTabs);
+  bool IsRelNode();
+  RC OpenIt(void *data);
+  RC UseIndex(int attrNum, int indexNumber, void *data);
+
+  RC SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond);
+private:
+  // Returns the next tuple of the join, one at a time
+  RC NextTuple(char *data);
+
+  QL_NodeRel &node1;
+  QL_NodeRel &node2;
+  int firstNodeSize;
+  char * buffer;
+
+  int joinCond; // the INTERSECTS condition the index traversal evaluates
+  IX_JoinScan js;
+};
+
+/* Partition based spatial merge join nodes
+ * Joins two inputs on an INTERSECTS condition between MBR attributes
+ * without using any index. Both inputs are split over a grid of tiles into
+ * partition files, and each partition is then joined in memory, a chunk
+ * at a time when it doesn't fit.
+ */
+class QL_NodePBSMJoin: public QL_Node {
+  friend class QL_Manager;
+public:
+  QL_NodePBSMJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2);
+  ~QL_NodePBSMJoin();
+
+  RC OpenIt();
+  RC GetNextBatch(TupleBatch &batch);
+  RC CloseIt();
+  RC GetNextRec(RM_Record &rec);
+  RC DeleteNodes();
+  RC PrintNode(int numTabs);
+  bool IsRelNode();
+  RC OpenIt(void *data);
+  RC UseIndex(int attrNum, int indexNumber, void *data);
+
+  RC SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond, int memoryKB);
+private:
+  // Returns the next tuple of the join, one at a time
+  RC NextTuple(char *data);
+  // An MBR normalised for the plane sweep, and the tuple it belongs to
+  struct SweepEntry{
+    int x1, x2, y1, y2;
+    int tuple;
+  };
+
+  // Reads both inputs once to find the area where they can intersect, and
+  // picks the number of partitions and tiles
+  RC ComputeUniverse();
+  // Reads one input again, and appends each tuple to the partition file of
+  // every tile its MBR overlaps, once per partition
+  RC PartitionInput(int side);
+  // Writes a full partition page out to its file
+  RC FlushPartitionPage(PF_FileHandle &fh, char *page);
+  // Opens the files of the next partition, and closes and destroys them
+  RC OpenPartition();
+  RC ClosePartition();
+  // Reads the next chunk of one input of the partition into memory
+  RC LoadChunk(int side);
+  // Loads the next pair of chunks of the partitions
+  RC NextChunks();
+  // Joins the chunks in memory, buffering the pairs of tuples it reports
+  void JoinChunks();
+  // Destroys the partition files that haven't been read yet
+  RC DestroyPartitionFiles();
+  // The tile column and row of a point of the universe
+  int TileX(int x);
+  int TileY(int y);
+  // The partition that a tile is assigned to
+  int TileToPartition(int tx, int ty);
+  void PartitionFileName(int side, int partition, std::string &name);
+
+  QL_Node &node1;
+  QL_Node &node2;
+  int firstNodeSize;
+  char * buffer;
+
+  int offset1; // offset of the MBR attribute in tuples of node1
+  int offset2; // offset of the MBR attribute in tuples of node2
+  int joinCond; // the INTERSECTS condition the partitioned join evaluates
+  int memoryBytes; // tuples of one partition kept in memory at most
+  int maxTuples1, maxTuples2; // tuples of a chunk of each input
+
+  PF_Manager pfm; // manager of the partition files, with its own buffer pool
+  int fileId; // tells apart the partition files of different nodes
+  bool filesCreated;
+
+  // Grid over the area where both inputs' MBRs can intersect
+  bool emptyUniverse;
+  int ux1, ux2, uy1, uy2;
+  int numTuples1, numTuples2;
+  int numPartitions;
+  int tilesPerSide;
+
+  // The partition whose results are being returned, and the chunks of
+  // its inputs in memory
+  int currPartition;
+  bool partitionOpen;
+  PF_FileHandle partFile1, partFile2;
+  char *partTuples1;
+  char *partTuples2;
+  int count1, count2; // tuples in the chunks
+  PageNum lastPage1, lastPage2; // last page read into the chunks
+  bool more1, more2; // whether pages follow the chunks
+  bool whole2; // whether the chunk of node2 is its whole partition
+  std::vector<std::pair<int, int> > results;
+  size_t nextResult;
+};
+
+/* Hash join nodes
+ * Joins two inputs on an equality between INT, FLOAT or STRING attributes.
+ * A hash table is built on one input in memory blocks of a buffer pool
+ * private to the node, and probed with the tuples of the other. When the
+ * build input doesn't fit in memory, both inputs are first split by hash
+ * into partition files, and the partitions are joined one at a time.
+ */
+class QL_NodeHashJoin: public QL_Node {
+  friend class QL_Manager;
+public:
+  QL_NodeHashJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2);
+  ~QL_NodeHashJoin();
+
+  RC OpenIt();
+  RC GetNextBatch(TupleBatch &batch);
+  RC CloseIt();
+  RC GetNextRec(RM_Record &rec);
+  RC DeleteNodes();
+  RC PrintNode(int numTabs);
+  bool IsRelNode();
+  RC OpenIt(void *data);
+  RC UseIndex(int attrNum, int indexNumber, void *data);
+
+  RC SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond, bool buildFirst,
+    int memoryKB);
+private:
+  // Returns the next tuple of the join, one at a time
+  RC NextTuple(char *data);
+  // Reads the build input into memory, and partitions both inputs if it
+  // doesn't fit
+  RC ReadBuildInput();
+  // Writes the tuples read so far and the rest of both inputs out to the
+  // partition files
+  RC PartitionInputs();
+  // Appends a tuple to the page of its partition, writing the page out
+  // when it is full
+  RC AddToPartition(PF_FileHandle &fh, char *page, char *tuple, int length);
+  RC FlushPartitionPage(PF_FileHandle &fh, char *page);
+  // Gets another memory block for build tuples. Returns false once the
+  // memory budget is used up.
+  bool AddBlock();
+  // Builds the hash table over the numBuilt tuples in memory
+  void BuildTable();
+  // Points probeTuple at the next probe tuple, moving on to the next chunk
+  // of build tuples when the probe partition has been read
+  RC NextProbeTuple();
+  // Loads the next chunk of the current build partition, or the first
+  // chunk of the next partition
+  RC NextChunk();
+  RC LoadBuildChunk();
+  RC ClosePartition();
+  RC DestroyPartitionFiles(int firstPartition);
+  unsigned int HashKey(char *key, int length);
+  char *BuildTuple(int index);
+  void PartitionFileName(int side, int partition, std::string &name);
+
+  QL_Node &node1;
+  QL_Node &node2;
+  int firstNodeSize;
+  char * buffer;
+
+  int joinCond; // the equality condition the hash table evaluates
+  AttrType keyType;
+  bool buildFirst; // whether the table is built on node1 rather than node2
+  QL_Node *buildInput;
+  QL_Node *probeInput;
+  int buildLength, probeLength; // tuple lengths of the two inputs
+  int buildOffset, probeOffset; // offsets of the keys in them
+  int buildKeyLength, probeKeyLength; // lengths of the keys in them
+
+  PF_Manager pfm; // buffer pool for the hash table and the partition files
+  int maxBlocks;
+  std::vector<char *> blocks; // build tuples, tuplesPerBlock per block
+  int tuplesPerBlock;
+  int numBuilt;
+  std::vector<int> bucketHeads; // first build tuple of each bucket
+  std::vector<int> bucketNext;  // next build tuple in the same bucket
+  unsigned int bucketMask;
+
+  // Partitioned join state
+  bool spilled;
+  int fileId;
+  int currPartition;
+  bool partitionOpen;
+  PF_FileHandle buildFile;
+  PF_FileHandle probeFile;
+  PageNum buildPageNum; // last page of the build partition loaded
+  bool buildDone; // whether the build partition has been loaded entirely
+  PageNum probePageNum; // page of the probe partition being read
+  char *probePage;
+  int probePos;
+
+  char *probeBuffer; // probe tuple read from the probe input
+  char *probeTuple; // current probe tuple
+  int match; // next build tuple in the probe tuple's bucket
+};
+
+/* Merge join nodes
+ * Joins two inputs on an equality between INT, FLOAT or STRING attributes
+ * by merging them in key order. The inner input is sorted, in memory if it
+ * fits, or else in runs merged through files. The outer is streamed, and
+ * must already come out ordered on its attribute. Results come out in the
+ * order of the outer.
+ */
+class QL_NodeMergeJoin: public QL_Node {
+  friend class QL_Manager;
+public:
+  QL_NodeMergeJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2);
+  ~QL_NodeMergeJoin();
+
+  RC OpenIt();
+  RC GetNextBatch(TupleBatch &batch);
+  RC CloseIt();
+  RC GetNextRec(RM_Record &rec);
+  RC DeleteNodes();
+  RC PrintNode(int numTabs);
+  bool IsRelNode();
+  RC OpenIt(void *data);
+  RC UseIndex(int attrNum, int indexNumber, void *data);
+
+  RC SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond, int memoryKB);
+private:
+  // Returns the next tuple of the join, one at a time
+  RC NextTuple(char *data);
+  // Sorts the inner, in memory or in runs merged through files
+  RC ReadInner();
+  void SortTuples(int numTuples);
+  RC WriteRun(int numTuples);
+  RC MergeRuns(int *runs, int count);
+  RC AppendToRun(PF_FileHandle &fh, char *&page, PageNum &pageNum, char *tuple);
+  // Points tuple at the inner tuple at index in key order
+  RC InnerTuple(int index, char *&tuple);
+  RC CloseInner();
+  int CompareKeys(char *key1, int length1, char *key2, int length2);
+  void RunFileName(int run, std::string &name);
+
+  QL_Node &node1;
+  QL_Node &node2;
+  int firstNodeSize;
+  char * buffer;
+
+  int offset1; // offset of the join attribute in tuples of node1
+  int offset2; // offset of the join attribute in tuples of node2
+  int joinCond; // the equality condition the merge evaluates
+  AttrType keyType;
+  int keyLength1; // length of the join attribute of node1
+  int keyLength2; // length of the join attribute of node2
+
+  PF_Manager pfm; // buffer pool for the sorted runs of the inner
+  int memoryKB; // memory the inner is sorted in
+  int maxTuples; // inner tuples sorted in memory at once
+  int fanIn; // runs merged at once
+  int tuplesPerPage; // inner tuples on a page of a run
+  int fileId;
+  int nextRun; // number of the next run file
+
+  char *innerTuples; // the inner, or the run being formed
+  int innerCapacity;
+  std::vector<int> innerOrder; // positions in innerTuples in key order
+  int numInner;
+  bool innerSpilled; // whether the sorted inner is in a run file
+  int innerRun; // run holding the sorted inner
+  PF_FileHandle innerFile;
+  PageNum innerPageNum; // page of the run pinned in innerPage, or -1
+  char *innerPage;
+
+  char *outerTuple; // current outer tuple
+  char *lastKey; // key of the previous outer tuple
+  bool haveOuter;
+  int lo; // first inner tuple whose key isn't less than the outer key
+  int match; // next inner tuple to pair with the outer tuple
+};
+
+/* Nearest neighbour nodes
+ * Returns the k tuples whose MBR attribute is closest to a query MBR, in
+ * increasing order of distance. If the previous node already produces
+ * tuples in that order, this node just stops after k of them; otherwise it
+ * keeps the k closest seen in a bounded heap and returns them at the end.
+ */
+class QL_NodeNearest: public QL_Node {
+  friend class QL_Manager;
+public:
+  QL_NodeNearest(QL_Manager &qlm, QL_Node &prevNode);
+  ~QL_NodeNearest();
+
+  RC OpenIt();
+  RC GetNextBatch(TupleBatch &batch);
+  RC CloseIt();
+  RC GetNextRec(RM_Record &rec);
+  RC GetNextRec(RM_RecordView &rec);
+  RC DeleteNodes();
+  RC PrintNode(int numTabs);
+  bool IsRelNode();
+  RC OpenIt(void *data);
+  RC UseIndex(int attrNum, int indexNumber, void *data);
+
+  RC SetUpNode(int attrIndex, void *value, int k, bool inputOrdered);
+private:
+  // Returns the next closest tuple, one at a time
+  RC NextTuple(char *data);
+  // Reads all of the previous node, keeping the k closest tuples
+  RC CollectNearest();
+  // Distance from the MBR attribute of a tuple to the query MBR
+  double Distance(char *tuple);
+
+  QL_Node &prevNode;
+
+  int attrIndex; // index of the MBR attribute
+  int attrOffset; // its offset in the tuple
+  mbr query;
+  int k;
+  bool inputOrdered; // whether the previous node returns tuples by distance
+  int numReturned; // tuples returned since the node was opened
+
+  // When the input is not ordered: the k closest tuples so far, and a heap
+  // of (distance, slot in tuples) with the farthest of them on top
+  char *tuples;
+  int tuplesCapacity;
+  std::vector<std::pair<double, int> > best;
+
+  char *buffer;
+};
+
 /* Relation nodes
  */
 class QL_NodeRel: public QL_Node {
   friend class QL_Manager;
   friend class QL_NodeJoin;
+  friend class QL_NodeSpatialJoin;
+  friend class QL_NodeSel;
 public:
   QL_NodeRel(QL_Manager &qlm, RelCatEntry *rEntry);
   ~QL_NodeRel();
 
   RC OpenIt();
-  RC GetNext(char *data);
+  RC GetNextBatch(TupleBatch &batch);
   RC CloseIt();
   RC GetNextRec(RM_Record &rec);
+  RC GetNextRec(RM_RecordView &rec);
   RC DeleteNodes();
   RC PrintNode(int numTabs);
   bool IsRelNode();
@@ -181,7 +605,16 @@ public:
   RC UseIndex(int attrNum, int indexNumber, void *data);
   RC OpenIt(void *data);
 private:
-  RC RetrieveNextRec(RM_Record &rec, char *&recData);
+  RC RetrieveNextRec(RM_RecordView &rec, char *&recData);
+
+  // Scans the relation with numWorkers threads, which take ranges of
+  // QL_MORSEL_PAGES pages in turn and keep the records meeting the
+  // conditions of filter. Records come in file order only if keepOrder is
+  // set. Called right after OpenIt, on a node using a filescan.
+  RC OpenParallelScan(QL_Node &filter, int numWorkers, bool keepOrder);
+  void RunScanWorker();
+  RC GetNextParallelBatch(TupleBatch &batch);
+  void StopScanWorkers();
   // relation name, and indicator for whether it's been malloced
   char *relName;
   bool relNameInitialized;
@@ -189,13 +622,18 @@ private:
   bool useIndex; // whether to use the index
   int indexNo;  // index number to use
   void *value;  // equality value for index
+  CompOp indexOp; // operator of the index scan (EQ_OP or INTERSECTS_OP)
+  bool nearestScan; // whether the index returns entries by distance to value
   int indexAttr; // index of attribute for the index
 
-  RM_FileHandle fh;  // filehandle/scans for retrieving records from relation
-  IX_IndexHandle ih;
+  RM_FileHandle *fh;  // filehandle/scans for retrieving records from relation,
+  IX_IndexHandle *ih; // the handles kept open by the SM_Manager
   RM_FileScan fs;
   IX_IndexScan is;
+  RM_RecordView recView; // the record the node last read
 
+  struct MorselScan;
+  struct MorselScan *morsels; // state of a parallel scan, if one is open
 };
 
 
@@ -39,6 +39,9 @@ typedef struct costElem{
   float cost;       // cost of joining (S-a) with a to get S
   int indexAttr;    // index attribute. is -1 if no index is used
   int indexCond;    // index condition. is -1 if no index is used
+  QO_JoinMethod joinMethod; // how newRelIndex is joined with (S-a)
+  bool buildOuter;  // whether a hash join builds on (S-a) instead of a
+  int orderAttr;    // attribute S comes out ordered on. is -1 if none
   std::map<int, attrStat> attrs;  // map of attribute statistics
 } costElem;
 
@@ -63,7 +66,17 @@ public:
 
   // calculates the cost/stats of joining relsInJoin and newRel
   RC CalculateJoin(int relsInJoin, int newRel, int relSize, float &cost, float &totalTuples, 
-       std::map<int, attrStat> &attrs,int &indexAttr, int &indexCond);
+       std::map<int, attrStat> &attrs,int &indexAttr, int &indexCond, QO_JoinMethod &joinMethod,
+       bool &buildOuter, int &orderAttr);
+
+  // Checks whether a condition is an INTERSECTS between an attribute of the
+  // relations in relsJoined and one of relIdx
+  bool IsIntersectsJoinCond(int relsJoined, int condIndex, int relIdx);
+
+  // Checks whether a condition is an equality between INT, FLOAT or STRING
+  // attributes of relsJoined and relIdx that a hash or merge join can
+  // evaluate, and returns the attribute of each side
+  bool IsEquiJoinCond(int relsJoined, int condIndex, int relIdx, int &outerAttr, int &innerAttr);
   
   // Checks whether a condition should be used for a given
   // set of (S-a) and a relation a
@@ -86,7 +86,12 @@ enum CompOp {
 // Pin Strategy Hint
 //
 enum ClientHint {
-    NO_HINT                                     // default value
+    NO_HINT,                                    // default value
+    SEQUENTIAL_SCAN,                            // pages read once, in order:
+                                                // recycled in a small ring
+    KEEP_HOT,                                   // pages read again and again,
+                                                // like R-tree internal nodes
+    RANDOM                                      // single pages fetched by RID
 };
 
 //
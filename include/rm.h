@@ -51,6 +51,41 @@ private:
     int size;       // size of the malloc
 };
 
+//
+// RM_RecordView: a record read in place. It holds the record RID and a
+// pointer into the buffer page the record is on, so nothing is copied.
+// The data stays valid only while that page is pinned: a view returned by
+// a scan is valid until the next GetNextRec or CloseScan call on the scan,
+// and a view returned by GetRec holds the pin itself, until it is released
+// or used for another record.
+//
+class RM_RecordView {
+    friend class RM_FileHandle;
+    friend class RM_FileScan;
+public:
+    RM_RecordView ();
+    ~RM_RecordView();
+
+    // Sets *pData to point to the record contents in the page
+    RC GetData(char *&pData) const;
+
+    // Return the RID associated with the record
+    RC GetRid (RID &rid) const;
+
+    // Unpins the page of the record, if this view holds the pin on it
+    RC Release();
+private:
+    // Views can't be copied, since the pin they hold can't be shared
+    RM_RecordView (const RM_RecordView &rec);
+    RM_RecordView& operator= (const RM_RecordView &rec);
+
+    RID rid;        // record RID
+    char * data;    // pointer to the record data in the buffer page
+    const PF_FileHandle *pinnedFile; // file of the page this view pinned
+    PageNum pinnedPage; // and that page, if pinnedFile is set
+    PF_PageHandle pinnedPH;
+};
+
 // RM_FileHeader: Header for each file
 struct RM_FileHeader {
   int recordSize;           // record size in file
@@ -77,6 +112,8 @@ public:
 
     // Given a RID, return the record
     RC GetRec     (const RID &rid, RM_Record &rec) const;
+    // Given a RID, return a view of the record, which keeps its page pinned
+    RC GetRec     (const RID &rid, RM_RecordView &rec) const;
 
     RC InsertRec  (const char *pData, RID &rid);       // Insert a new record
 
@@ -86,6 +123,14 @@ public:
     // Forces a page (along with any contents stored in this class)
     // from the buffer pool to disk.  Default value forces all pages.
     RC ForcePages (PageNum pageNum = ALL_PAGES);
+
+    // Returns the number of pages in the file, including the header page
+    // and pages that were disposed of
+    RC GetNumPages(int &numPages) const;
+
+    // Copies the header into the first page of the file if it changed, so
+    // that it is written or logged with the other pages
+    RC WriteHeader();
     //RC UnpinPage(PageNum page);
 private:
     // Converts from the number of bits to the appropriate char size
@@ -100,10 +145,13 @@ private:
     bool isValidFileHeader() const;
     int getRecordSize(); // returns the record size
 
-    // Returns the next record in rec, and the corresponding PF_PageHandle
-    // in ph, given the current page and slot number from where to start
-    // the search, and whether the next page should be used
-    RC GetNextRecord(PageNum page, SlotNum slot, RM_Record &rec, PF_PageHandle &ph, bool nextPage);
+    // Returns the RID of the next record and a pointer to its data in the
+    // page, and the corresponding PF_PageHandle in ph, given the current
+    // page and slot number from where to start the search, and whether the
+    // next page should be used. Pages are read with pinHint, and the
+    // search stops before endPage unless it is ALL_PAGES
+    RC GetNextRecord(PageNum page, SlotNum slot, RID &rid, char *&recData, PF_PageHandle &ph, bool nextPage,
+                     ClientHint pinHint, PageNum endPage = ALL_PAGES);
     
     // Allocates a new page, and returns its page number in page, and the
     // pinned PageHandle in ph
@@ -149,9 +197,20 @@ public:
                   void       *value,
                   ClientHint pinHint = NO_HINT); // Initialize a file scan
     RC GetNextRec(RM_Record &rec);               // Get next matching record
+    // Get next matching record in place. The view is valid until the next
+    // call to GetNextRec or CloseScan
+    RC GetNextRec(RM_RecordView &rec);
     RC CloseScan ();                             // Close the scan
 
+    // Restricts an open scan, before it returns any record, to the pages
+    // from firstPage up to but not including endPage
+    RC LimitPages(PageNum firstPage, PageNum endPage);
+
 private:
+    // Finds the next matching record, keeping its page pinned until the
+    // scan moves on
+    RC NextRecord(RID &rid, char *&recData);
+
     // Retrieves the number of records on ph's page, and returns it in
     // numRecords
     RC GetNumRecOnPage(PF_PageHandle& ph, int &numRecords);
@@ -166,6 +225,7 @@ private:
     void *value;
     AttrType attrType;
     CompOp compOp;
+    ClientHint pinHint; // passed on when reading the pages of the file
 
     // whether the scan has ended or not. This dictages whether to unpin the
     // page that the scan is on (currentPH)
@@ -174,6 +234,7 @@ private:
     // The current state of the scan. currentPH is the page that's pinned
     PageNum scanPage;
     SlotNum scanSlot;
+    PageNum endPage; // page the scan stops before, or ALL_PAGES
     PF_PageHandle currentPH;
     // Dictates whether to seek a record on the same page, or unpin it and
     // seek a record on the following page
@@ -197,6 +258,9 @@ public:
     RC OpenFile   (const char *fileName, RM_FileHandle &fileHandle);
 
     RC CloseFile  (RM_FileHandle &fileHandle);
+
+    // Makes the files opened from now on read-only mappings, or not
+    RC SetReadOnly(bool readOnly);
 private:
     // helper method for open scan which sets up private variables of
     // RM_FileHandle. 
@@ -206,6 +270,7 @@ private:
     RC CleanUpFH(RM_FileHandle &fileHandle);
 
     PF_Manager &pfm; // reference to program's PF_Manager
+    bool readOnly; // whether files are opened as read-only mappings
 };
 
 //
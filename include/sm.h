@@ -10,6 +10,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unordered_map> // before printer.h, whose max macro breaks it
 #include "redbase.h"  // Please don't change these lines
 #include "parser.h"
 #include "rm.h"
@@ -19,8 +20,10 @@
 #include <map>
 #include <string>
 #include <set>
+#include <vector>
 
 #define MAX_DB_NAME 255
+#define SM_LOGNAME "redbase.wal" // write-ahead log in the database directory
 
 // Define the catalog entry for a relation
 typedef struct RelCatEntry{
@@ -61,16 +64,63 @@ typedef struct Attr{
   float minValue;
 } Attr;
 
+//
+// SM_Catalog: the relcat and attrcat entries of the open database, read
+// into memory when it is opened and found by relation and attribute name.
+// Changes are written through to the catalog files.
+//
+class SM_Catalog {
+public:
+    SM_Catalog    ();
+    ~SM_Catalog   ();
+
+    // Read the entries of the catalog files, which stay open until Clear
+    RC Load       (RM_FileHandle &relcatFH, RM_FileHandle &attrcatFH);
+    void Clear    ();
+
+    // Find a relation, its attributes ordered by attrNum, or one of its
+    // attributes. The entries belong to the catalog: one changed in place
+    // must be written back with WriteRel or WriteAttr.
+    RC GetRel     (const char *relName, RelCatEntry *&entry);
+    RC GetAttrs   (const char *relName, AttrCatEntry *&entries);
+    RC GetAttr    (const char *relName, const char *attrName, AttrCatEntry *&entry);
+
+    // Insert a relation with its attributes, or delete one
+    RC AddRel     (const RelCatEntry &relEntry, const AttrCatEntry *attrEntries);
+    RC RemoveRel  (const char *relName);
+
+    // Write an entry changed in place back to its catalog file
+    RC WriteRel   (RelCatEntry *entry);
+    RC WriteAttr  (AttrCatEntry *entry);
+
+private:
+    // The entries of a relation, and where they are in the catalog files
+    struct SM_CatalogRel {
+      RID relRID;
+      RelCatEntry relEntry;
+      std::vector<RID> attrRIDs;                       // by attrNum
+      std::vector<AttrCatEntry> attrEntries;           // by attrNum
+      std::unordered_map<std::string, int> attrNums;   // by attrName
+    };
+
+    RM_FileHandle *relcatFH;
+    RM_FileHandle *attrcatFH;
+    std::unordered_map<std::string, SM_CatalogRel> rels;
+};
+
 //
 // SM_Manager: provides data management
 //
 class SM_Manager {
     friend class QL_Manager;
+    friend class QO_Manager;
+    friend class QL_NodeRel;
+    friend class QL_NodeSel;
     static const int NO_INDEXES = -1;
     static const PageNum INVALID_PAGE = -1;
     static const SlotNum INVALID_SLOT = -1;
 public:
-    SM_Manager    (IX_Manager &ixm, RM_Manager &rmm);
+    SM_Manager    (IX_Manager &ixm, RM_Manager &rmm, PF_Manager &pfm);
     ~SM_Manager   ();                             // Destructor
 
     RC OpenDb     (const char *dbName);           // Open the database
@@ -95,21 +145,38 @@ public:
     RC Set        (const char *paramName,         // set parameter to
                    const char *value);            //   value
 
+    // Begin and commit a transaction. The log is synced once for all
+    // the commands of a transaction.
+    RC BeginTransaction ();
+    RC CommitTransaction();
+
+    // Retrieve the open handle of a relation, or of one of its indexes,
+    // opening it the first time. Handles stay open across commands, until
+    // the relation or index is dropped or the database is closed, and
+    // must not be closed by the caller.
+    RC GetRelHandle  (const char *relName, RM_FileHandle *&fh);
+    RC GetIndexHandle(const char *relName, int indexNo, IX_IndexHandle *&ih);
+    // Close every open handle, which unpins the pages they hold
+    RC CloseHandles  ();
+
 private:
+  // Close the open handles of a relation and its indexes
+  RC CloseHandles(const char *relName);
+
   // Returns true if given attribute has valid/matching type and length
   bool isValidAttrType(AttrInfo attribute);
 
-  // Inserts an entry about specified relName relation into relcat
-  RC InsertRelCat(const char *relName, int attrCount, int recSize);
+  // Sets up the relcat entry of a new relation, and the attrcat entry of
+  // one of its attributes
+  void SetUpRelCat(const char *relName, int attrCount, int recSize, RelCatEntry &rEntry);
+  void SetUpAttrCat(const char *relName, AttrInfo attr, int offset, int attrNum, AttrCatEntry &aEntry);
 
-  // Insert an entry about specified attribute into attrcat
-  RC InsertAttrCat(const char *relName, AttrInfo attr, int offset, int attrNum);
-  // Retrieve the record and data associated with a relation entry. Return
-  // error if one doesnt' exist
-  RC GetRelEntry(const char *relName, RM_Record &relRec, RelCatEntry *&entry);
+  // Retrieve the catalog entry of a relation. Return error if one
+  // doesn't exist
+  RC GetRelEntry(const char *relName, RelCatEntry *&entry);
 
-  // Finds the entry associated with a particular attribute
-  RC FindAttr(const char *relName, const char *attrName, RM_Record &attrRec, AttrCatEntry *&entry);
+  // Finds the catalog entry of a particular attribute
+  RC FindAttr(const char *relName, const char *attrName, AttrCatEntry *&entry);
   
   // Sets up print for DataAttrInfo from a file, printing relcat and printing attrcat
   RC SetUpPrint(RelCatEntry* rEntry, DataAttrInfo *attributes);
@@ -128,9 +195,10 @@ private:
   RC GetAllRels(RelCatEntry *relEntries, int nRelations, const char * const relations[], 
     int &attrCount, std::map<std::string, int> &relToInt);
 
-  // Opens a file and loads it
+  // Opens a file and loads it. If bulkLoad is set, MBR indexes are built
+  // with a single bulk load after all records have been inserted
   RC OpenAndLoadFile(RM_FileHandle &relFH, const char *fileName, Attr* attributes, 
-    int attrCount, int recLength, int &loadedRecs);
+    int attrCount, int recLength, int &loadedRecs, bool bulkLoad);
   // Cleans up the Attr array after loading
   RC CleanUpAttr(Attr* attributes, int attrCount);
   float ConvertStrToFloat(char *string);
@@ -142,6 +210,7 @@ private:
 
   IX_Manager &ixm;
   RM_Manager &rmm;
+  PF_Manager &pfm; // for the log, transactions and the buffer policy
 
   RM_FileHandle relcatFH;
   RM_FileHandle attrcatFH;
@@ -149,9 +218,21 @@ private:
                    // help is called on a specific table
 
   bool useQO;
+  IX_InsertMode indexInsertMode; // how new MBR indexes place inserted entries
+  IX_NodeFormat indexNodeFormat; // how new MBR indexes write bulk loaded nodes
+  int joinMemory; // KB of tuples a partitioned, hash or merge join holds in memory
+  int scanWorkers; // threads searching an MBR index for a window query,
+                   // or scanning a table with conditions to check
+  bool orderedScans; // whether parallel table scans keep file order
 
   bool calcStats;
   bool printPageStats;
+
+  bool inTransaction; // whether a transaction has begun
+  std::map<std::string, RM_FileHandle *> relHandles; // open relations
+  std::map<std::pair<std::string, int>, IX_IndexHandle *> indexHandles;
+                                                     // and indexes
+  SM_Catalog catalog; // relcat and attrcat entries of the database
 };
 
 /*
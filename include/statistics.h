@@ -46,6 +46,7 @@ const int STAT_BASE = 9000;
 #endif
 
 // This include must come after the common defines
+#include <pthread.h>
 #include "linkedlist.h"    // Template class for the link list
 
 // A single statistic will be tracked by a Statistic class
@@ -89,8 +90,8 @@ enum Stat_Operation {
 class StatisticsMgr {
 
 public:
-    StatisticsMgr() {};
-    ~StatisticsMgr() {};
+    StatisticsMgr() { pthread_mutex_init(&latch, NULL); };
+    ~StatisticsMgr() { pthread_mutex_destroy(&latch); };
 
     // Add a new statistic or register a change to an existing statistic.
     // The piValue for can be NULL, except for those operations that require
@@ -117,6 +118,10 @@ public:
 
 private:
     LinkList<Statistic> llStats;
+
+    // Held by every method, since the shards of the buffer pool may
+    // register statistics from several threads at once
+    pthread_mutex_t latch;
 };
 
 //
@@ -134,6 +139,7 @@ extern const char *PF_GETPAGE;
 extern const char *PF_PAGEFOUND;
 extern const char *PF_PAGENOTFOUND;
 extern const char *PF_READPAGE;         // IO
+extern const char *PF_READAHEAD;        // IO, included in PF_READPAGE
 extern const char *PF_WRITEPAGE;        // IO
 extern const char *PF_FLUSHPAGES;
 
@@ -174,10 +174,20 @@ RC interp(NODE *n)
                break;
             }
 
+            /* Make the nearest neighbour clause, if there is one */
+            NearestClause nearest;
+            NODE *nn = n->u.QUERY.nearest;
+            if(nn != NULL){
+               mk_rel_attr(nn->u.NEAREST.relattr, nearest.attr);
+               mk_value(nn->u.NEAREST.value, nearest.value);
+               nearest.k = nn->u.NEAREST.k;
+            }
+
             /* Make the call to Select */
             errval = pQlm->Select(nSelAttrs, relAttrs,
                   nRelations, relations,
-                  nConditions, conditions);
+                  nConditions, conditions,
+                  nn != NULL ? &nearest : NULL);
             break;
          }   
 
@@ -629,6 +639,13 @@ static void echo_query(NODE *n)
             printf("where ");
             print_conditions(n->u.QUERY.conditionlist);
          }
+         if (n->u.QUERY.nearest) {
+            printf(" order by distance(");
+            print_relattr(n->u.QUERY.nearest->u.NEAREST.relattr);
+            printf(",");
+            print_value(n->u.QUERY.nearest->u.NEAREST.value);
+            printf(") limit %d", n->u.QUERY.nearest->u.NEAREST.k);
+         }
          printf(";\n");
          break;
       case N_INSERT:            /* for Insert() */
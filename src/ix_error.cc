@@ -27,6 +27,8 @@ static char *IX_WarnMsg[] = {
   (char*)"invalid scan instance",
   (char*)"invalid record entry",
   (char*)"end of file",
+  (char*)"bulk load requires an empty index",
+  (char*)"index with packed nodes cannot be updated",
   (char*)"IX warning"
 };
 
@@ -12,6 +12,10 @@
 #include <cstdio>
 #include "ix_internal.h"
 #include <math.h>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 IX_IndexHandle::IX_IndexHandle()
 {
@@ -30,9 +34,25 @@ RC IX_IndexHandle::InsertEntry(void *pData, const RID &rid)
     // check to see if the value is valid
     if(! isValidIndexHeader() || isOpenHandle == false)
         return (IX_INVALIDINDEXHANDLE);
+    if(pfh.IsReadOnly())
+        return (PF_READONLY);
+    if(header.packedNodes > 0)
+        return (IX_PACKEDINDEX);
 
-    // Retrieve the root header
     RC rc = 0;
+    // MBR entries are placed along a pinned path, which splits full nodes
+    // at any level and grows the covers of the parents. Linear insertion
+    // takes that path without forced reinsertion.
+    if(header.insertMode == IX_RSTAR_INSERT || header.attr_type == MBR){
+        struct IX_BulkEntry entry;
+        memcpy(&entry.key, pData, sizeof(mbr));
+        if((rc = rid.GetPageNum(entry.page)) || (rc = rid.GetSlotNum(entry.slot)))
+            return (rc);
+        std::vector<bool> reinserted(header.height, header.insertMode != IX_RSTAR_INSERT);
+        return RStarInsert(entry, 0, reinserted);
+    }
+
+    // Retrieve the root header
     struct IX_NodeHeader *rHeader;
     if((rc = rootPH.GetData((char *&)rHeader))){
         return (rc);
@@ -42,6 +62,8 @@ RC IX_IndexHandle::InsertEntry(void *pData, const RID &rid)
 
     //put nHeader as root node
     struct IX_NodeHeader *nHeader = rHeader;
+    PageNum nPage = header.rootPage;
+    std::vector<PageNum> pinned; // pages below the root, unpinned on return
 
     //check if we are in the leaf
     while(!nHeader->isLeafNode)
@@ -67,17 +89,21 @@ RC IX_IndexHandle::InsertEntry(void *pData, const RID &rid)
         // find next page to read from
         PF_PageHandle nextNodePH;
         struct IX_NodeHeader *nextNodeHeader;
-        if((rc = pfh.GetThisPage(nextNodePage, nextNodePH)) || (rc = nextNodePH.GetData((char *&)nextNodeHeader)))
-            return (rc);
+        if((rc = pfh.GetThisPage(nextNodePage, nextNodePH)))
+            break;
+        pinned.push_back(nextNodePage);
+        if((rc = nextNodePH.GetData((char *&)nextNodeHeader)))
+            break;
 
         nHeader = nextNodeHeader;
+        nPage = nextNodePage;
     }
 
 
     //Add Record to leaf node
 
     // If the node is full, create a new empty root node
-    if(nHeader->num_keys == header.maxKeys_N){
+    if(! rc && nHeader->num_keys == header.maxKeys_N){
         //Check if this is the Root node
         if(nHeader == rHeader)
         {
@@ -102,16 +128,27 @@ RC IX_IndexHandle::InsertEntry(void *pData, const RID &rid)
                 return (rc);
             rootPH = newInternalPH; // reset root PF_PageHandle
             header.rootPage = newInternalPage;
+            header.height++;
             header_modified = true; // New root page has been set, so the index header has been modified
         }
+        else // only MBR keys are split below the root
+            rc = IX_NODEFULL;
     }
-    else
+    else if(! rc)
     {
         // If node is not full, insert into it
 
-        if((rc = InsertIntoLeafNode(nHeader, header.rootPage, pData, rid)))
-            return (rc);
+        if(!(rc = InsertIntoLeafNode(nHeader, nPage, pData, rid)) && nPage != header.rootPage)
+            rc = pfh.MarkDirty(nPage);
+    }
+
+    for(unsigned int i = 0; i < pinned.size(); i++){
+        RC unpinRC = pfh.UnpinPage(pinned[i]);
+        if(! rc)
+            rc = unpinRC;
     }
+    if(rc)
+        return (rc);
 
     // Mark the root node as dirty
     if((rc = pfh.MarkDirty(header.rootPage)))
@@ -725,27 +762,30 @@ RC IX_IndexHandle::FindNodeInsertIndex(struct IX_NodeHeader *nHeader,
 }
 
 /*
- * This finds the index in a node in which to insert a key into, given the node
- * header and the key to insert. It returns the index to insert into, and whether
- * there already exists a key of this value in this particular node.
+ * This finds the index of the entry for a key and RID in a leaf, given the
+ * node header. Duplicate keys each have an entry of their own, so the RID
+ * tells them apart.
  */
 RC IX_IndexHandle::FindNodeDeleteIndex(struct IX_NodeHeader *nHeader,
-                                       void *pData, int& index){
+                                       void *pData, const RID &rid, int& index){
+    RC rc = 0;
+    PageNum ridPage;
+    SlotNum ridSlot;
+    if((rc = rid.GetPageNum(ridPage)) || (rc = rid.GetSlotNum(ridSlot)))
+        return (rc);
 
     // Setup
     struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
     char *keys = ((char *)nHeader + header.keysOffset_N);
-    mbr left_mbr = *(mbr*)pData;
 
     // Search until we reach a key which is unoccupied
     int prev_idx = BEGINNING_OF_SLOTS;
     int curr_idx = nHeader->firstSlotIndex;
-    //just return the matching mbr index
+    //just return the matching key index
     while(curr_idx != NO_MORE_SLOTS){
         char *value = keys + header.attr_length * curr_idx;
-        mbr right_mbr = *(mbr*) value;
-        if(left_mbr.top_left_x == right_mbr.top_left_x && left_mbr.top_left_y == right_mbr.top_left_y &&
-           left_mbr.bottom_right_x == right_mbr.bottom_right_x && left_mbr.bottom_right_y == right_mbr.bottom_right_y)
+        if(memcmp(value, pData, header.attr_length) == 0 &&
+           entries[curr_idx].page == ridPage && entries[curr_idx].slot == ridSlot)
         {
             index = curr_idx;
             break;
@@ -754,6 +794,8 @@ RC IX_IndexHandle::FindNodeDeleteIndex(struct IX_NodeHeader *nHeader,
         curr_idx = entries[prev_idx].nextSlot;
 
     }
+    if(curr_idx == NO_MORE_SLOTS) // No key matches, so the entry is not there
+        return (IX_INVALIDENTRY);
 
     return (0);
 }
@@ -825,6 +867,10 @@ RC IX_IndexHandle::DeleteEntry(void *pData, const RID &rid)
     RC rc = 0;
     if(! isValidIndexHeader() || isOpenHandle == false)
         return (IX_INVALIDINDEXHANDLE);
+    if(pfh.IsReadOnly())
+        return (PF_READONLY);
+    if(header.packedNodes > 0)
+        return (IX_PACKEDINDEX);
 
     // get root page
     struct IX_NodeHeader *rHeader;
@@ -845,8 +891,11 @@ RC IX_IndexHandle::DeleteEntry(void *pData, const RID &rid)
         return (rc);
 
     // If the tree is empty, set the current node to a leaf node.
-    if(toDelete)
+    if(toDelete){
         rHeader->isLeafNode = true;
+        header.height = 1;
+        header_modified = true;
+    }
 
     return (rc);
 }
@@ -1070,7 +1119,7 @@ RC IX_IndexHandle::DeleteFromNode(struct IX_NodeHeader *nHeader, void *pData, co
 RC IX_IndexHandle::DeleteFromLeaf(struct IX_NodeHeader_L *nHeader, void *pData, const RID &rid, bool &toDelete){
     RC rc = 0;
     int prevIndex, currIndex;
-    if((rc = FindNodeDeleteIndex((struct IX_NodeHeader *)nHeader, pData, currIndex)))
+    if((rc = FindNodeDeleteIndex((struct IX_NodeHeader *)nHeader, pData, rid, currIndex)))
         return (rc);
 
     // Setup
@@ -1132,7 +1181,995 @@ RC IX_IndexHandle::FindPrevIndex(struct IX_NodeHeader *nHeader, int thisIndex, i
     return (0);
 }
 
+/*
+ * Orderings used by the Sort-Tile-Recursive packing. Entries are compared
+ * on the (doubled) centre of their MBR along one axis.
+ */
+static bool STRLessX(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return ((long long)a.key.top_left_x + a.key.bottom_right_x) <
+           ((long long)b.key.top_left_x + b.key.bottom_right_x);
+}
+
+static bool STRLessY(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return ((long long)a.key.top_left_y + a.key.bottom_right_y) <
+           ((long long)b.key.top_left_y + b.key.bottom_right_y);
+}
+
+/*
+ * Sorts the entries of one level so that every run of maxKeys entries forms
+ * a node. The entries are sorted on x and cut into ceil(sqrt(P)) vertical
+ * slices of whole nodes, then each slice is sorted on y. Returns the number
+ * of entries in a slice.
+ */
+static int STRSort(struct IX_BulkEntry *items, int numItems, int maxKeys){
+    int numNodes = (numItems + maxKeys - 1) / maxKeys;
+    int numSlices = (int)ceil(sqrt((double)numNodes));
+    int sliceSize = numSlices * maxKeys;
+
+    std::sort(items, items + numItems, STRLessX);
+    for(int start = 0; start < numItems; start += sliceSize){
+        int end = std::min(start + sliceSize, numItems);
+        std::sort(items + start, items + end, STRLessY);
+    }
+    return (sliceSize);
+}
+
+// Running bounds of the entries that go into one packed node
+struct PackedBounds{
+    int minX, minY, maxX, maxY;
+    PageNum minPage, maxPage;
+    SlotNum maxSlot;
+};
+
+static void AddToBounds(struct PackedBounds &b, const struct IX_BulkEntry &item, bool first){
+    const mbr &k = item.key;
+    if(first){
+        b.minX = b.maxX = k.top_left_x;
+        b.minY = b.maxY = k.top_left_y;
+        b.minPage = b.maxPage = item.page;
+        b.maxSlot = item.slot;
+    }
+    b.minX = std::min(b.minX, std::min(k.top_left_x, k.bottom_right_x));
+    b.maxX = std::max(b.maxX, std::max(k.top_left_x, k.bottom_right_x));
+    b.minY = std::min(b.minY, std::min(k.top_left_y, k.bottom_right_y));
+    b.maxY = std::max(b.maxY, std::max(k.top_left_y, k.bottom_right_y));
+    b.minPage = std::min(b.minPage, item.page);
+    b.maxPage = std::max(b.maxPage, item.page);
+    b.maxSlot = std::max(b.maxSlot, item.slot);
+}
+
+// Bytes needed to store values up to maxValue
+static int PackedWidth(unsigned int maxValue){
+    if(maxValue <= 0xFF)
+        return (1);
+    if(maxValue <= 0xFFFF)
+        return (2);
+    return (4);
+}
+
+// Picks the widths for entries within bounds, and returns the size of a
+// packed node holding numItems of them
+static int PackedNodeSize(const struct PackedBounds &b, int numItems, bool isLeaf,
+                          int &coordWidth, int &pageWidth, int &slotWidth){
+    unsigned int rangeX = (unsigned int)((long long)b.maxX - b.minX);
+    unsigned int rangeY = (unsigned int)((long long)b.maxY - b.minY);
+    coordWidth = PackedWidth(std::max(rangeX, rangeY));
+    pageWidth = PackedWidth((unsigned int)(b.maxPage - b.minPage));
+    slotWidth = isLeaf ? PackedWidth((unsigned int)b.maxSlot) : 0;
+    return sizeof(struct IX_NodeHeader) + sizeof(struct IX_PackedNode)
+        + numItems * (4 * coordWidth + pageWidth + slotWidth) + (numItems + 3) / 4;
+}
+
+// Returns how many of the entries, taken in order, fit in one packed node
+static int PackedNodeCount(const struct IX_BulkEntry *items, int numItems, bool isLeaf){
+    struct PackedBounds b;
+    int coordWidth, pageWidth, slotWidth;
+    AddToBounds(b, items[0], true);
+    int count = 1;
+    while(count < numItems){
+        struct PackedBounds grown = b;
+        AddToBounds(grown, items[count], false);
+        if(PackedNodeSize(grown, count + 1, isLeaf, coordWidth, pageWidth, slotWidth) > PF_PAGE_SIZE)
+            break;
+        b = grown;
+        count++;
+    }
+    return (count);
+}
+
+static void PutPacked(unsigned char *p, int width, unsigned int value){
+    if(width == 1)
+        *p = (unsigned char)value;
+    else if(width == 2){
+        unsigned short v = (unsigned short)value;
+        memcpy(p, &v, sizeof(v));
+    }
+    else
+        memcpy(p, &value, sizeof(value));
+}
+
+static unsigned int GetPacked(const unsigned char *p, int width){
+    if(width == 1)
+        return (*p);
+    if(width == 2){
+        unsigned short v;
+        memcpy(&v, p, sizeof(v));
+        return (v);
+    }
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return (v);
+}
+
+// Fraction of the slots of a node filled by a bulk load, leaving room for
+// later inserts before the node has to be split
+static const double IX_BULK_FILL = 0.75;
+
+static int BulkNodeFill(int maxKeys){
+    return std::max(1, (int)(IX_BULK_FILL * maxKeys));
+}
+
+/*
+ * Builds the index bottom-up from the given entries. Each level is sorted with
+ * STRSort and packed into nodes filled to IX_BULK_FILL; the covering MBRs of
+ * those nodes become the entries of the next level, until one level fits in
+ * the root page.
+ */
+RC IX_IndexHandle::BulkLoad(struct IX_BulkEntry *entries, int numEntries)
+{
+    if(! isValidIndexHeader() || isOpenHandle == false)
+        return (IX_INVALIDINDEXHANDLE);
+    if(header.attr_type != MBR)
+        return (IX_BADINDEXSPEC);
+    if(pfh.IsReadOnly())
+        return (PF_READONLY);
+
+    RC rc = 0;
+    struct IX_NodeHeader *rHeader;
+    if((rc = rootPH.GetData((char *&)rHeader)))
+        return (rc);
+    if(! rHeader->isLeafNode || rHeader->num_keys != 0)
+        return (IX_NOTEMPTY);
+    if(numEntries <= 0)
+        return (0);
+
+    // Two buffers that alternate between holding the current level and
+    // the level above it. A packed node holds at least maxKeys_N entries,
+    // but may be cut short at the end of each of the sqrt(P) STR slices.
+    bool packNodes = (header.nodeFormat == IX_PACKED_NODES);
+    int nodeFill = BulkNodeFill(header.maxKeys_N);
+    int maxParents = (numEntries + nodeFill - 1) / nodeFill;
+    if(packNodes)
+        maxParents += (int)ceil(sqrt((double)numEntries)) + 1;
+    struct IX_BulkEntry *levels[2];
+    levels[0] = (struct IX_BulkEntry *)malloc(sizeof(struct IX_BulkEntry) * maxParents);
+    levels[1] = (struct IX_BulkEntry *)malloc(sizeof(struct IX_BulkEntry) * maxParents);
+
+    struct IX_BulkEntry *level = entries;
+    int levelSize = numEntries;
+    int nextBuf = 0;
+    bool isLeaf = true;
+    int height = 1;
+    while(packNodes ? PackedNodeCount(level, levelSize, isLeaf) < levelSize
+                    : levelSize > header.maxKeys_N){
+        int numParents = 0;
+        if(packNodes)
+            rc = PackPackedLevel(level, levelSize, isLeaf, levels[nextBuf], numParents);
+        else
+            rc = PackLevel(level, levelSize, isLeaf, levels[nextBuf], numParents);
+        if(rc){
+            free(levels[0]);
+            free(levels[1]);
+            return (rc);
+        }
+        level = levels[nextBuf];
+        levelSize = numParents;
+        nextBuf = 1 - nextBuf;
+        isLeaf = false;
+        height++;
+    }
+
+    // The remaining entries fit in a single node, which is written into the
+    // existing root page so the index header does not change
+    mbr cover;
+    if(packNodes)
+        FillPackedNode(rHeader, level, levelSize, isLeaf, cover);
+    else
+        FillNode(rHeader, level, levelSize, isLeaf, cover);
+    free(levels[0]);
+    free(levels[1]);
+    header.height = height;
+    header_modified = true;
+
+    if((rc = pfh.MarkDirty(header.rootPage)))
+        return (rc);
+    return (rc);
+}
+
+/*
+ * Packs numItems entries into the nodes of one level of the tree, each filled
+ * to IX_BULK_FILL. For each node created, an entry holding its page number
+ * and covering MBR is written to parents, and numParents returns how many
+ * were written.
+ */
+RC IX_IndexHandle::PackLevel(struct IX_BulkEntry *items, int numItems, bool isLeaf,
+                             struct IX_BulkEntry *parents, int &numParents){
+    RC rc = 0;
+    int nodeFill = BulkNodeFill(header.maxKeys_N);
+    STRSort(items, numItems, nodeFill);
+
+    numParents = 0;
+    for(int start = 0; start < numItems; start += nodeFill){
+        int count = std::min(nodeFill, numItems - start);
+        PF_PageHandle ph;
+        PageNum page;
+        char *nData;
+        if((rc = CreateNewNode(ph, page, nData, isLeaf)))
+            return (rc);
+
+        mbr cover;
+        FillNode((struct IX_NodeHeader *)nData, items + start, count, isLeaf, cover);
+        if((rc = pfh.MarkDirty(page)) || (rc = pfh.UnpinPage(page)))
+            return (rc);
+
+        parents[numParents].key = cover;
+        parents[numParents].page = page;
+        parents[numParents].slot = NO_MORE_SLOTS;
+        numParents++;
+    }
+    return (rc);
+}
+
+/*
+ * Overwrites a node with numItems entries placed in slots 0..numItems-1, and
+ * chains the remaining slots into the free list. In internal nodes the
+ * first child is also recorded in firstPage.
+ */
+void IX_IndexHandle::FillNode(struct IX_NodeHeader *nHeader, struct IX_BulkEntry *items, int numItems,
+                              bool isLeaf, mbr &cover){
+    struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
+    char *keys = (char *)nHeader + header.keysOffset_N;
+
+    nHeader->isLeafNode = isLeaf;
+    nHeader->isEmpty = false;
+    nHeader->num_keys = numItems;
+    nHeader->firstSlotIndex = 0;
+    nHeader->freeSlotIndex = (numItems < header.maxKeys_N) ? numItems : NO_MORE_SLOTS;
+    if(! isLeaf)
+        ((struct IX_NodeHeader_I *)nHeader)->firstPage = items[0].page;
+
+    cover = items[0].key;
+    for(int i = 0; i < header.maxKeys_N; i++){
+        if(i < numItems){
+            entries[i].isValid = OCCUPIED_NEW;
+            entries[i].page = items[i].page;
+            entries[i].slot = items[i].slot;
+            memcpy(keys + i * header.attr_length, (char *)&items[i].key, header.attr_length);
+            expand_mbr(cover, items[i].key);
+        }
+        else{
+            entries[i].isValid = UNOCCUPIED;
+            entries[i].page = NO_MORE_PAGES;
+        }
+        // the occupied slots and the free slots form two separate lists
+        if(i == numItems - 1 || i == header.maxKeys_N - 1)
+            entries[i].nextSlot = NO_MORE_SLOTS;
+        else
+            entries[i].nextSlot = i + 1;
+    }
+}
+
+/*
+ * Packs one level of a bulk load into packed nodes. The entries are put in
+ * STR order, with slices sized for nodes of 2 byte offsets; the nodes are
+ * then filled in that order with as many entries as fit, without crossing
+ * into the next slice, so each node covers a compact tile.
+ */
+RC IX_IndexHandle::PackPackedLevel(struct IX_BulkEntry *items, int numItems, bool isLeaf,
+                                   struct IX_BulkEntry *parents, int &numParents){
+    RC rc = 0;
+    int estimate = (PF_PAGE_SIZE - sizeof(struct IX_NodeHeader) - sizeof(struct IX_PackedNode))
+        / (4 * 2 + 2 + 2);
+    int sliceSize = STRSort(items, numItems, estimate);
+
+    numParents = 0;
+    int start = 0;
+    while(start < numItems){
+        int sliceEnd = std::min(numItems, (start / sliceSize + 1) * sliceSize);
+        int count = PackedNodeCount(items + start, sliceEnd - start, isLeaf);
+        PF_PageHandle ph;
+        PageNum page;
+        char *nData;
+        if((rc = CreateNewNode(ph, page, nData, isLeaf)))
+            return (rc);
+
+        mbr cover;
+        FillPackedNode((struct IX_NodeHeader *)nData, items + start, count, isLeaf, cover);
+        if((rc = pfh.MarkDirty(page)) || (rc = pfh.UnpinPage(page)))
+            return (rc);
+
+        parents[numParents].key = cover;
+        parents[numParents].page = page;
+        parents[numParents].slot = NO_MORE_SLOTS;
+        numParents++;
+        start += count;
+    }
+    return (rc);
+}
+
+/*
+ * Overwrites a node with a packed node holding numItems entries. The slot
+ * lists are left empty, so code that only knows slotted nodes finds none.
+ */
+void IX_IndexHandle::FillPackedNode(struct IX_NodeHeader *nHeader, struct IX_BulkEntry *items,
+                                    int numItems, bool isLeaf, mbr &cover){
+    struct PackedBounds b;
+    for(int i = 0; i < numItems; i++)
+        AddToBounds(b, items[i], i == 0);
+    int coordWidth, pageWidth, slotWidth;
+    PackedNodeSize(b, numItems, isLeaf, coordWidth, pageWidth, slotWidth);
+
+    nHeader->isLeafNode = isLeaf;
+    nHeader->isEmpty = false;
+    nHeader->num_keys = numItems;
+    nHeader->firstSlotIndex = NO_MORE_SLOTS;
+    nHeader->freeSlotIndex = PACKED_SLOTS;
+
+    struct IX_PackedNode *node = (struct IX_PackedNode *)((char *)nHeader + sizeof(struct IX_NodeHeader));
+    node->minX = b.minX;
+    node->minY = b.minY;
+    node->maxX = b.maxX;
+    node->maxY = b.maxY;
+    node->minPage = b.minPage;
+    node->coordWidth = coordWidth;
+    node->pageWidth = pageWidth;
+    node->slotWidth = slotWidth;
+
+    unsigned char *lowX = (unsigned char *)(node + 1);
+    unsigned char *lowY = lowX + numItems * coordWidth;
+    unsigned char *highX = lowY + numItems * coordWidth;
+    unsigned char *highY = highX + numItems * coordWidth;
+    unsigned char *pages = highY + numItems * coordWidth;
+    unsigned char *slots = pages + numItems * pageWidth;
+    unsigned char *swapped = slots + numItems * slotWidth;
+    memset(swapped, 0, (numItems + 3) / 4);
+    for(int i = 0; i < numItems; i++){
+        const mbr &k = items[i].key;
+        int offset = i * coordWidth;
+        PutPacked(lowX + offset, coordWidth, (unsigned int)((long long)std::min(k.top_left_x, k.bottom_right_x) - b.minX));
+        PutPacked(lowY + offset, coordWidth, (unsigned int)((long long)std::min(k.top_left_y, k.bottom_right_y) - b.minY));
+        PutPacked(highX + offset, coordWidth, (unsigned int)((long long)std::max(k.top_left_x, k.bottom_right_x) - b.minX));
+        PutPacked(highY + offset, coordWidth, (unsigned int)((long long)std::max(k.top_left_y, k.bottom_right_y) - b.minY));
+        PutPacked(pages + i * pageWidth, pageWidth, (unsigned int)(items[i].page - b.minPage));
+        if(isLeaf)
+            PutPacked(slots + i * slotWidth, slotWidth, (unsigned int)items[i].slot);
+        if(k.top_left_x > k.bottom_right_x)
+            swapped[i / 4] |= 1 << (2 * (i % 4));
+        if(k.top_left_y > k.bottom_right_y)
+            swapped[i / 4] |= 2 << (2 * (i % 4));
+    }
+
+    cover.top_left_x = b.minX;
+    cover.top_left_y = b.minY;
+    cover.bottom_right_x = b.maxX;
+    cover.bottom_right_y = b.maxY;
+    header.packedNodes++;
+    header_modified = true;
+}
+
+bool IX_IndexHandle::IsPackedNode(const struct IX_NodeHeader *nHeader){
+    return (nHeader->freeSlotIndex == PACKED_SLOTS);
+}
+
+bool IX_IndexHandle::HasPackedNodes(){
+    return (header.packedNodes > 0);
+}
+
+// The four offset arrays of a packed node, and the window to test them
+// against, moved into the same offsets
+struct PackedSearch{
+    const unsigned char *lowX, *lowY, *highX, *highY;
+    unsigned int x1, x2, y1, y2;
+};
+
+#if defined(__x86_64__)
+// The offsets are unsigned, while SSE2 and AVX2 only compare signed
+// integers, so both sides are biased by 2^31 before being compared
+
+// Widens four offsets stored in T to 32 bit lanes
+template <typename T>
+static inline __m128i LoadPacked4(const unsigned char *p){
+    __m128i zero = _mm_setzero_si128();
+    if(sizeof(T) == 1){
+        int v;
+        memcpy(&v, p, sizeof(v));
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+    }
+    if(sizeof(T) == 2)
+        return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), zero);
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+// Tests entries four at a time with SSE2, and returns how many were tested
+template <typename T>
+static int SearchPackedSSE2(const struct PackedSearch &s, int numKeys, std::vector<int> &matches){
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+    __m128i x1 = _mm_xor_si128(_mm_set1_epi32(s.x1), bias);
+    __m128i x2 = _mm_xor_si128(_mm_set1_epi32(s.x2), bias);
+    __m128i y1 = _mm_xor_si128(_mm_set1_epi32(s.y1), bias);
+    __m128i y2 = _mm_xor_si128(_mm_set1_epi32(s.y2), bias);
+    int i = 0;
+    for(; i + 4 <= numKeys; i += 4){
+        int offset = i * sizeof(T);
+        __m128i lowX = _mm_xor_si128(LoadPacked4<T>(s.lowX + offset), bias);
+        __m128i lowY = _mm_xor_si128(LoadPacked4<T>(s.lowY + offset), bias);
+        __m128i highX = _mm_xor_si128(LoadPacked4<T>(s.highX + offset), bias);
+        __m128i highY = _mm_xor_si128(LoadPacked4<T>(s.highY + offset), bias);
+        // An entry misses the window if it lies wholly past it on an axis
+        __m128i miss = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(lowX, x2), _mm_cmpgt_epi32(x1, highX)),
+                                    _mm_or_si128(_mm_cmpgt_epi32(lowY, y2), _mm_cmpgt_epi32(y1, highY)));
+        int hits = ~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xF;
+        for(; hits != 0; hits &= hits - 1)
+            matches.push_back(i + __builtin_ctz(hits));
+    }
+    return (i);
+}
+
+// Widens eight offsets stored in T to 32 bit lanes
+template <typename T>
+__attribute__((target("avx2")))
+static inline __m256i LoadPacked8(const unsigned char *p){
+    if(sizeof(T) == 1)
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+    if(sizeof(T) == 2)
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+// Tests entries eight at a time with AVX2, and returns how many were tested
+template <typename T>
+__attribute__((target("avx2")))
+static int SearchPackedAVX2(const struct PackedSearch &s, int numKeys, std::vector<int> &matches){
+    const __m256i bias = _mm256_set1_epi32(0x80000000);
+    __m256i x1 = _mm256_xor_si256(_mm256_set1_epi32(s.x1), bias);
+    __m256i x2 = _mm256_xor_si256(_mm256_set1_epi32(s.x2), bias);
+    __m256i y1 = _mm256_xor_si256(_mm256_set1_epi32(s.y1), bias);
+    __m256i y2 = _mm256_xor_si256(_mm256_set1_epi32(s.y2), bias);
+    int i = 0;
+    for(; i + 8 <= numKeys; i += 8){
+        int offset = i * sizeof(T);
+        __m256i lowX = _mm256_xor_si256(LoadPacked8<T>(s.lowX + offset), bias);
+        __m256i lowY = _mm256_xor_si256(LoadPacked8<T>(s.lowY + offset), bias);
+        __m256i highX = _mm256_xor_si256(LoadPacked8<T>(s.highX + offset), bias);
+        __m256i highY = _mm256_xor_si256(LoadPacked8<T>(s.highY + offset), bias);
+        __m256i miss = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(lowX, x2), _mm256_cmpgt_epi32(x1, highX)),
+                                       _mm256_or_si256(_mm256_cmpgt_epi32(lowY, y2), _mm256_cmpgt_epi32(y1, highY)));
+        int hits = ~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xFF;
+        for(; hits != 0; hits &= hits - 1)
+            matches.push_back(i + __builtin_ctz(hits));
+    }
+    return (i);
+}
+#endif
+
+// Tests the entries of a packed node whose offsets are stored in T: as
+// many as possible with the widest instructions the CPU has, the rest one
+// at a time
+template <typename T>
+static void SearchPackedArrays(const struct PackedSearch &s, int numKeys, std::vector<int> &matches){
+    int i = 0;
+#if defined(__x86_64__)
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if(hasAVX2)
+        i = SearchPackedAVX2<T>(s, numKeys, matches);
+    else
+        i = SearchPackedSSE2<T>(s, numKeys, matches);
+#endif
+    for(; i < numKeys; i++){
+        T lowX, lowY, highX, highY;
+        memcpy(&lowX, s.lowX + i * sizeof(T), sizeof(T));
+        memcpy(&lowY, s.lowY + i * sizeof(T), sizeof(T));
+        memcpy(&highX, s.highX + i * sizeof(T), sizeof(T));
+        memcpy(&highY, s.highY + i * sizeof(T), sizeof(T));
+        if(lowX <= s.x2 && s.x1 <= highX && lowY <= s.y2 && s.y1 <= highY)
+            matches.push_back(i);
+    }
+}
+
+/*
+ * Every entry lies within the node's bounds, so clamping the window to the
+ * bounds before moving it into offsets does not change which entries it
+ * intersects. A window missing the bounds altogether matches nothing.
+ */
+void IX_IndexHandle::SearchPackedNode(const struct IX_NodeHeader *nHeader, const mbr &window,
+                                      std::vector<int> &matches){
+    const struct IX_PackedNode *node =
+        (const struct IX_PackedNode *)((const char *)nHeader + sizeof(struct IX_NodeHeader));
+    long long wx1 = std::min(window.top_left_x, window.bottom_right_x);
+    long long wx2 = std::max(window.top_left_x, window.bottom_right_x);
+    long long wy1 = std::min(window.top_left_y, window.bottom_right_y);
+    long long wy2 = std::max(window.top_left_y, window.bottom_right_y);
+    if(wx1 > node->maxX || wx2 < node->minX || wy1 > node->maxY || wy2 < node->minY)
+        return;
+
+    struct PackedSearch s;
+    int numKeys = nHeader->num_keys;
+    int width = node->coordWidth;
+    s.lowX = (const unsigned char *)(node + 1);
+    s.lowY = s.lowX + numKeys * width;
+    s.highX = s.lowY + numKeys * width;
+    s.highY = s.highX + numKeys * width;
+    s.x1 = (unsigned int)(std::max(wx1, (long long)node->minX) - node->minX);
+    s.x2 = (unsigned int)(std::min(wx2, (long long)node->maxX) - node->minX);
+    s.y1 = (unsigned int)(std::max(wy1, (long long)node->minY) - node->minY);
+    s.y2 = (unsigned int)(std::min(wy2, (long long)node->maxY) - node->minY);
+    if(width == 1)
+        SearchPackedArrays<unsigned char>(s, numKeys, matches);
+    else if(width == 2)
+        SearchPackedArrays<unsigned short>(s, numKeys, matches);
+    else
+        SearchPackedArrays<unsigned int>(s, numKeys, matches);
+}
+
+void IX_IndexHandle::GetPackedKey(const struct IX_NodeHeader *nHeader, int pos, mbr &key){
+    const struct IX_PackedNode *node =
+        (const struct IX_PackedNode *)((const char *)nHeader + sizeof(struct IX_NodeHeader));
+    int numKeys = nHeader->num_keys;
+    int width = node->coordWidth;
+    const unsigned char *lowX = (const unsigned char *)(node + 1) + pos * width;
+    int x1 = (int)(node->minX + (long long)GetPacked(lowX, width));
+    int y1 = (int)(node->minY + (long long)GetPacked(lowX + numKeys * width, width));
+    int x2 = (int)(node->minX + (long long)GetPacked(lowX + 2 * numKeys * width, width));
+    int y2 = (int)(node->minY + (long long)GetPacked(lowX + 3 * numKeys * width, width));
+
+    const unsigned char *swapped = (const unsigned char *)(node + 1)
+        + numKeys * (4 * width + node->pageWidth + node->slotWidth);
+    int bits = swapped[pos / 4] >> (2 * (pos % 4));
+    key.top_left_x = (bits & 1) ? x2 : x1;
+    key.bottom_right_x = (bits & 1) ? x1 : x2;
+    key.top_left_y = (bits & 2) ? y2 : y1;
+    key.bottom_right_y = (bits & 2) ? y1 : y2;
+}
+
+void IX_IndexHandle::GetPackedEntry(const struct IX_NodeHeader *nHeader, int pos, PageNum &page,
+                                    SlotNum &slot){
+    const struct IX_PackedNode *node =
+        (const struct IX_PackedNode *)((const char *)nHeader + sizeof(struct IX_NodeHeader));
+    int numKeys = nHeader->num_keys;
+    const unsigned char *pages = (const unsigned char *)(node + 1) + numKeys * 4 * node->coordWidth;
+    const unsigned char *slots = pages + numKeys * node->pageWidth;
+    page = node->minPage + (PageNum)GetPacked(pages + pos * node->pageWidth, node->pageWidth);
+    if(node->slotWidth == 0)
+        slot = NO_MORE_SLOTS;
+    else
+        slot = (SlotNum)GetPacked(slots + pos * node->slotWidth, node->slotWidth);
+}
+
+// Lower and upper bounds of an MBR on each axis, whatever its corner
+// orientation
+static int MinX(const mbr &a){ return a.top_left_x < a.bottom_right_x ? a.top_left_x : a.bottom_right_x; }
+static int MaxX(const mbr &a){ return a.top_left_x < a.bottom_right_x ? a.bottom_right_x : a.top_left_x; }
+static int MinY(const mbr &a){ return a.top_left_y < a.bottom_right_y ? a.top_left_y : a.bottom_right_y; }
+static int MaxY(const mbr &a){ return a.top_left_y < a.bottom_right_y ? a.bottom_right_y : a.top_left_y; }
+
+static bool RStarLowerX(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return MinX(a.key) < MinX(b.key) || (MinX(a.key) == MinX(b.key) && MaxX(a.key) < MaxX(b.key));
+}
+static bool RStarUpperX(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return MaxX(a.key) < MaxX(b.key) || (MaxX(a.key) == MaxX(b.key) && MinX(a.key) < MinX(b.key));
+}
+static bool RStarLowerY(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return MinY(a.key) < MinY(b.key) || (MinY(a.key) == MinY(b.key) && MaxY(a.key) < MaxY(b.key));
+}
+static bool RStarUpperY(const struct IX_BulkEntry &a, const struct IX_BulkEntry &b){
+    return MaxY(a.key) < MaxY(b.key) || (MaxY(a.key) == MaxY(b.key) && MinY(a.key) < MinY(b.key));
+}
+
+// Covers of the first k+1 entries in prefix[k], and of the entries from k
+// on in suffix[k]
+static void RStarCovers(const std::vector<struct IX_BulkEntry> &sorted, std::vector<mbr> &prefix,
+                        std::vector<mbr> &suffix){
+    int n = sorted.size();
+    prefix[0] = sorted[0].key;
+    for(int k = 1; k < n; k++){
+        prefix[k] = prefix[k-1];
+        expand_mbr(prefix[k], sorted[k].key);
+    }
+    suffix[n-1] = sorted[n-1].key;
+    for(int k = n-2; k >= 0; k--){
+        suffix[k] = suffix[k+1];
+        expand_mbr(suffix[k], sorted[k].key);
+    }
+}
+
+// Minimum fill of a node after an R*-tree split, as a fraction of maxKeys_N
+static const double RSTAR_MIN_FILL = 0.4;
+// Fraction of an overflowing node's entries that are reinserted
+static const double RSTAR_REINSERT = 0.3;
+// Number of children, least area enlargement first, whose overlap
+// enlargement is computed when choosing a leaf
+static const int RSTAR_OVERLAP_CANDIDATES = 32;
+
+/*
+ * Inserts entry into a node on the given level. The path from the root is
+ * chosen with RStarChooseSubtree and kept pinned. If the node is full, the
+ * first overflow on a level below the root moves the entries farthest from
+ * the node's centre out and reinserts them; any other overflow splits the
+ * node, which adds an entry to the parent and may overflow it in turn.
+ * Splitting the root adds a level to the tree.
+ */
+RC IX_IndexHandle::RStarInsert(struct IX_BulkEntry &entry, int level, std::vector<bool> &reinserted){
+    RC rc = 0;
+    std::vector<struct RStarFrame> path;
+    struct RStarFrame frame;
+    frame.page = header.rootPage;
+    frame.parentSlot = NO_MORE_SLOTS;
+    if((rc = rootPH.GetData((char *&)frame.nHeader)))
+        return (rc);
+    path.push_back(frame);
+
+    // Descend to the level the entry belongs on
+    for(int nodeLevel = header.height - 1; nodeLevel > level; nodeLevel--){
+        struct IX_NodeHeader *nHeader = path.back().nHeader;
+        struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
+        int slot;
+        RStarChooseSubtree(nHeader, entry.key, nodeLevel == 1, slot);
+
+        PF_PageHandle ph;
+        frame.page = entries[slot].page;
+        frame.parentSlot = slot;
+        if((rc = pfh.GetThisPage(frame.page, ph)) || (rc = ph.GetData((char *&)frame.nHeader))){
+            RStarReleasePath(path);
+            return (rc);
+        }
+        path.push_back(frame);
+    }
+
+    int i = path.size() - 1;
+    struct IX_BulkEntry item = entry;
+    while(true){
+        struct IX_NodeHeader *nHeader = path[i].nHeader;
+        bool isLeaf = nHeader->isLeafNode;
+        if(nHeader->num_keys < header.maxKeys_N){
+            InsertIntoFreeSlot(nHeader, item);
+            break;
+        }
+
+        std::vector<struct IX_BulkEntry> items;
+        ReadNodeEntries(nHeader, items);
+        items.push_back(item);
+
+        // Forced reinsert, once per level and never at the root
+        int nodeLevel = level + (path.size() - 1 - i);
+        if(i > 0 && ! reinserted[nodeLevel]){
+            reinserted[nodeLevel] = true;
+            std::vector<struct IX_BulkEntry> removed;
+            RStarPickReinsert(items, removed);
+            mbr cover;
+            FillNode(nHeader, &items[0], items.size(), isLeaf, cover);
+            RStarAdjustCovers(path, i);
+            if((rc = RStarReleasePath(path)))
+                return (rc);
+            for(unsigned int j = 0; j < removed.size(); j++){
+                if((rc = RStarInsert(removed[j], nodeLevel, reinserted)))
+                    return (rc);
+            }
+            return (0);
+        }
+
+        // Split the node, keeping the first group in place
+        std::vector<struct IX_BulkEntry> second;
+        RStarSplit(items, second);
+        mbr cover1, cover2;
+        FillNode(nHeader, &items[0], items.size(), isLeaf, cover1);
+        PF_PageHandle newPH;
+        PageNum newPage;
+        char *newData;
+        if((rc = CreateNewNode(newPH, newPage, newData, isLeaf))){
+            RStarReleasePath(path);
+            return (rc);
+        }
+        FillNode((struct IX_NodeHeader *)newData, &second[0], second.size(), isLeaf, cover2);
+        if((rc = pfh.MarkDirty(newPage)) || (rc = pfh.UnpinPage(newPage))){
+            RStarReleasePath(path);
+            return (rc);
+        }
+
+        if(i == 0){
+            // The root was split: a new root points at both halves
+            PF_PageHandle rootNewPH;
+            PageNum rootNewPage;
+            char *rootData;
+            if((rc = CreateNewNode(rootNewPH, rootNewPage, rootData, false))){
+                RStarReleasePath(path);
+                return (rc);
+            }
+            struct IX_BulkEntry children[2];
+            children[0].key = cover1;
+            children[0].page = path[0].page;
+            children[0].slot = NO_MORE_SLOTS;
+            children[1].key = cover2;
+            children[1].page = newPage;
+            children[1].slot = NO_MORE_SLOTS;
+            mbr rootCover;
+            FillNode((struct IX_NodeHeader *)rootData, children, 2, false, rootCover);
+
+            if((rc = pfh.MarkDirty(path[0].page)) || (rc = pfh.UnpinPage(path[0].page))){
+                path.erase(path.begin());
+                RStarReleasePath(path);
+                return (rc);
+            }
+            rootPH = rootNewPH;
+            header.rootPage = rootNewPage;
+            header.height++;
+            header_modified = true;
+            reinserted.resize(header.height, false);
+            path[0].page = rootNewPage;
+            path[0].nHeader = (struct IX_NodeHeader *)rootData;
+            break;
+        }
+
+        // Point the parent's entry at the shrunk node, and add the new node
+        struct IX_NodeHeader *pHeader = path[i-1].nHeader;
+        char *pKeys = (char *)pHeader + header.keysOffset_N;
+        memcpy(pKeys + path[i].parentSlot * header.attr_length, (char *)&cover1, header.attr_length);
+        item.key = cover2;
+        item.page = newPage;
+        item.slot = NO_MORE_SLOTS;
+        i--;
+    }
+
+    RStarAdjustCovers(path, i);
+    return RStarReleasePath(path);
+}
+
+/*
+ * ChooseSubtree of the R*-tree. Above the leaves the child needing the
+ * least area enlargement is taken. When the children are leaves the child
+ * whose enlargement adds the least overlap with its siblings is taken
+ * instead, looking only at the RSTAR_OVERLAP_CANDIDATES children with the
+ * least area enlargement. Remaining ties go to the smaller area.
+ */
+void IX_IndexHandle::RStarChooseSubtree(struct IX_NodeHeader *nHeader, const mbr &key, bool childIsLeaf,
+                                        int &slot){
+    struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
+    char *keys = (char *)nHeader + header.keysOffset_N;
+
+    std::vector<std::pair<double, int> > byEnlargement;
+    for(int curr = nHeader->firstSlotIndex; curr != NO_MORE_SLOTS; curr = entries[curr].nextSlot){
+        if(entries[curr].isValid == UNOCCUPIED)
+            continue;
+        mbr childKey = *(mbr *)(keys + curr * header.attr_length);
+        mbr grown = childKey;
+        expand_mbr(grown, key);
+        byEnlargement.push_back(std::make_pair(area_mbr(grown) - area_mbr(childKey), curr));
+    }
+    std::sort(byEnlargement.begin(), byEnlargement.end());
+
+    int candidates = 1;
+    if(childIsLeaf)
+        candidates = std::min((int)byEnlargement.size(), RSTAR_OVERLAP_CANDIDATES);
+    else{
+        while(candidates < (int)byEnlargement.size() && byEnlargement[candidates].first == byEnlargement[0].first)
+            candidates++;
+    }
+
+    slot = byEnlargement[0].second;
+    double bestOverlap = -1, bestEnlargement = 0, bestArea = 0;
+    for(int c = 0; c < candidates; c++){
+        int curr = byEnlargement[c].second;
+        mbr childKey = *(mbr *)(keys + curr * header.attr_length);
+        double overlapInc = 0;
+        if(childIsLeaf){
+            mbr grown = childKey;
+            expand_mbr(grown, key);
+            for(unsigned int o = 0; o < byEnlargement.size(); o++){
+                if(byEnlargement[o].second == curr)
+                    continue;
+                // childKey lies within grown, so a sibling missing grown
+                // overlaps neither
+                mbr other = *(mbr *)(keys + byEnlargement[o].second * header.attr_length);
+                if(! intersects_mbr(grown, other))
+                    continue;
+                overlapInc += overlap_mbr(grown, other) - overlap_mbr(childKey, other);
+            }
+        }
+        double area = area_mbr(childKey);
+        if(bestOverlap < 0 || overlapInc < bestOverlap
+           || (overlapInc == bestOverlap && byEnlargement[c].first < bestEnlargement)
+           || (overlapInc == bestOverlap && byEnlargement[c].first == bestEnlargement && area < bestArea)){
+            slot = curr;
+            bestOverlap = overlapInc;
+            bestEnlargement = byEnlargement[c].first;
+            bestArea = area;
+        }
+    }
+}
+
+/*
+ * Split of the R*-tree. For each axis the entries are sorted by lower and
+ * by upper bound, and every distribution into two groups of at least
+ * RSTAR_MIN_FILL of a node is considered. The axis with the smallest sum of
+ * group margins is chosen, and along it the distribution with the least
+ * overlap between the groups, then the least total area.
+ */
+void IX_IndexHandle::RStarSplit(std::vector<struct IX_BulkEntry> &items,
+                                std::vector<struct IX_BulkEntry> &second){
+    int n = items.size();
+    int minFill = std::max(1, (int)(RSTAR_MIN_FILL * header.maxKeys_N));
+    if(2 * minFill > n)
+        minFill = n / 2;
+
+    bool (*sorts[2][2])(const struct IX_BulkEntry &, const struct IX_BulkEntry &) = {
+        {RStarLowerX, RStarUpperX}, {RStarLowerY, RStarUpperY}};
+    std::vector<struct IX_BulkEntry> sorted(items);
+    std::vector<mbr> prefix(n), suffix(n);
+
+    int bestAxis = 0;
+    double bestMargin = -1;
+    for(int axis = 0; axis < 2; axis++){
+        double margin = 0;
+        for(int s = 0; s < 2; s++){
+            std::sort(sorted.begin(), sorted.end(), sorts[axis][s]);
+            RStarCovers(sorted, prefix, suffix);
+            for(int k = minFill; k <= n - minFill; k++)
+                margin += margin_mbr(prefix[k-1]) + margin_mbr(suffix[k]);
+        }
+        if(bestMargin < 0 || margin < bestMargin){
+            bestMargin = margin;
+            bestAxis = axis;
+        }
+    }
+
+    int bestSort = 0, bestSplit = minFill;
+    double bestOverlap = -1, bestArea = 0;
+    for(int s = 0; s < 2; s++){
+        std::sort(sorted.begin(), sorted.end(), sorts[bestAxis][s]);
+        RStarCovers(sorted, prefix, suffix);
+        for(int k = minFill; k <= n - minFill; k++){
+            double overlap = overlap_mbr(prefix[k-1], suffix[k]);
+            double area = area_mbr(prefix[k-1]) + area_mbr(suffix[k]);
+            if(bestOverlap < 0 || overlap < bestOverlap || (overlap == bestOverlap && area < bestArea)){
+                bestOverlap = overlap;
+                bestArea = area;
+                bestSort = s;
+                bestSplit = k;
+            }
+        }
+    }
+
+    std::sort(items.begin(), items.end(), sorts[bestAxis][bestSort]);
+    second.assign(items.begin() + bestSplit, items.end());
+    items.resize(bestSplit);
+}
+
+/*
+ * Sorts the entries by the distance of their centre from the centre of the
+ * node, and moves the RSTAR_REINSERT fraction farthest away into removed,
+ * ordered closest first for reinsertion.
+ */
+void IX_IndexHandle::RStarPickReinsert(std::vector<struct IX_BulkEntry> &items,
+                                       std::vector<struct IX_BulkEntry> &removed){
+    mbr cover = items[0].key;
+    for(unsigned int i = 1; i < items.size(); i++)
+        expand_mbr(cover, items[i].key);
+    // centres are kept doubled to stay in integers
+    double cx = (double)MinX(cover) + MaxX(cover);
+    double cy = (double)MinY(cover) + MaxY(cover);
+
+    std::vector<std::pair<double, int> > byDistance;
+    for(unsigned int i = 0; i < items.size(); i++){
+        double dx = (double)MinX(items[i].key) + MaxX(items[i].key) - cx;
+        double dy = (double)MinY(items[i].key) + MaxY(items[i].key) - cy;
+        byDistance.push_back(std::make_pair(dx*dx + dy*dy, i));
+    }
+    std::sort(byDistance.begin(), byDistance.end());
+
+    int numRemoved = std::max(1, (int)(RSTAR_REINSERT * header.maxKeys_N));
+    int numKept = items.size() - numRemoved;
+    std::vector<struct IX_BulkEntry> kept;
+    for(int i = 0; i < numKept; i++)
+        kept.push_back(items[byDistance[i].second]);
+    removed.clear();
+    for(unsigned int i = numKept; i < byDistance.size(); i++)
+        removed.push_back(items[byDistance[i].second]);
+    items.swap(kept);
+}
+
+/*
+ * Walks up the path from path[from], setting each parent's key for the
+ * node below it to that node's covering MBR. It stops early once a key is
+ * already correct, as nothing above it can change then.
+ */
+void IX_IndexHandle::RStarAdjustCovers(std::vector<struct RStarFrame> &path, int from){
+    for(int j = from; j > 0; j--){
+        std::vector<struct IX_BulkEntry> items;
+        ReadNodeEntries(path[j].nHeader, items);
+        mbr cover = items[0].key;
+        for(unsigned int k = 1; k < items.size(); k++)
+            expand_mbr(cover, items[k].key);
+
+        char *key = (char *)path[j-1].nHeader + header.keysOffset_N + path[j].parentSlot * header.attr_length;
+        if(memcmp(key, (char *)&cover, header.attr_length) == 0)
+            break;
+        memcpy(key, (char *)&cover, header.attr_length);
+    }
+}
+
+/*
+ * Marks every node on the path dirty, and unpins all but the root, which
+ * stays pinned in rootPH
+ */
+RC IX_IndexHandle::RStarReleasePath(std::vector<struct RStarFrame> &path){
+    RC rc = 0;
+    for(unsigned int j = 0; j < path.size(); j++){
+        if((rc = pfh.MarkDirty(path[j].page)))
+            return (rc);
+        if(j > 0 && (rc = pfh.UnpinPage(path[j].page)))
+            return (rc);
+    }
+    path.clear();
+    return (rc);
+}
+
+void IX_IndexHandle::ReadNodeEntries(struct IX_NodeHeader *nHeader, std::vector<struct IX_BulkEntry> &items){
+    struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
+    char *keys = (char *)nHeader + header.keysOffset_N;
+    for(int curr = nHeader->firstSlotIndex; curr != NO_MORE_SLOTS; curr = entries[curr].nextSlot){
+        if(entries[curr].isValid == UNOCCUPIED)
+            continue;
+        struct IX_BulkEntry item;
+        memcpy((char *)&item.key, keys + curr * header.attr_length, header.attr_length);
+        item.page = entries[curr].page;
+        item.slot = entries[curr].slot;
+        items.push_back(item);
+    }
+}
+
+void IX_IndexHandle::InsertIntoFreeSlot(struct IX_NodeHeader *nHeader, const struct IX_BulkEntry &item){
+    struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + header.entryOffset_N);
+    char *keys = (char *)nHeader + header.keysOffset_N;
+    int index = nHeader->freeSlotIndex;
+    memcpy(keys + index * header.attr_length, (char *)&item.key, header.attr_length);
+    entries[index].isValid = OCCUPIED_NEW;
+    entries[index].page = item.page;
+    entries[index].slot = item.slot;
+    nHeader->freeSlotIndex = entries[index].nextSlot;
+    entries[index].nextSlot = nHeader->firstSlotIndex;
+    nHeader->firstSlotIndex = index;
+    nHeader->num_keys++;
+    nHeader->isEmpty = false;
+}
+
 RC IX_IndexHandle::ForcePages()
 {
   // Implement this
 }
+
+/*
+ * Copies the header of the index into its first page if it was
+ * modified since it was last copied
+ */
+RC IX_IndexHandle::WriteHeader()
+{
+    RC rc = 0;
+    PF_PageHandle ph;
+    PageNum page;
+    char *pData;
+
+    if(header_modified == false)
+        return (0);
+    if((rc = pfh.GetFirstPage(ph)) || (rc = ph.GetPageNum(page)))
+        return (rc);
+    if((rc = ph.GetData(pData))){
+        RC rc2;
+        if((rc2 = pfh.UnpinPage(page)))
+            return (rc2);
+        return (rc);
+    }
+    memcpy(pData, &header, sizeof(struct IX_IndexHeader));
+    if((rc = pfh.MarkDirty(page)) || (rc = pfh.UnpinPage(page)))
+        return (rc);
+    header_modified = false;
+    return (0);
+}
@@ -1,27 +1,94 @@
 //
 // File:        ix_indexscan.cc
-// Description: IX_IndexHandle handles scanning through the index for a 
+// Description: IX_IndexHandle handles scanning through the index for a
 //              certain value.
 // Author:      Mehrad Amin Eskadnari - mehradae
 //
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
 #include <unistd.h>
 #include <sys/types.h>
 #include "pf.h"
 #include "ix.h"
 #include <cstdio>
+#include "comparators.h"
 #include "ix_internal.h"
 
+using namespace std;
+
+/*
+ * Number of RIDs a worker of a parallel scan hands over at once, and
+ * number of such chunks queued before the workers wait for the consumer
+ */
+static const int IX_SCAN_CHUNK = 256;
+static const int IX_SCAN_QUEUE = 64;
+
+/*
+ * The state a parallel scan shares with its workers. Each worker has a
+ * deque of subtrees to search: it takes the last one of its own deque,
+ * and once that is empty steals the first one of another worker's.
+ * pendingTasks counts the subtrees queued or being searched, so the
+ * workers are done when it drops to zero. The RIDs found go to the
+ * consumer in chunks through a bounded queue.
+ */
+struct IX_IndexScan::ParallelScan{
+  struct WorkerDeque{
+    mutex latch;
+    deque<struct WindowTask> tasks;
+  };
+
+  ParallelScan(int numWorkers) : deques(numWorkers){
+    pendingTasks = 0;
+    stop = false;
+    runningWorkers = numWorkers;
+    rc = 0;
+    nextRid = 0;
+  }
+
+  vector<thread> workers;
+  vector<WorkerDeque> deques;
+  atomic<int> pendingTasks;
+  atomic<bool> stop;          // set when the scan is closed or a worker fails
+
+  mutex queueLatch;           // guards the queue, runningWorkers and rc
+  condition_variable notFull;
+  condition_variable notEmpty;
+  deque<vector<RID> > chunks;
+  int runningWorkers;
+  RC rc;                      // first error of a worker
+
+  vector<RID> current;        // chunk the consumer is returning
+  size_t nextRid;
+};
+
 IX_IndexScan::IX_IndexScan()
 {
-  // Implement this
+  openScan = false;
+  scanEnded = false;
+  nearestScan = false;
+  indexHandle = NULL;
+  value = NULL;
+  compOp = NO_OP;
+  pinHint = NO_HINT;
+  parallel = NULL;
 }
 
 IX_IndexScan::~IX_IndexScan()
 {
-  // Implement this
+  if(openScan == true)
+    CloseScan();
 }
 
+/*
+ * Opens a scan over the index. MBR indexes are searched as an R-tree:
+ * INTERSECTS_OP returns every entry whose key intersects value, and EQ_OP
+ * every entry whose key equals it. Subtrees whose keys cannot contain a
+ * match are never read. Other attribute types are filtered at the leaves.
+ */
 RC IX_IndexScan::OpenScan(const IX_IndexHandle &indexHandle,
                 CompOp compOp,
                 void *value,
@@ -35,242 +102,564 @@ RC IX_IndexScan::OpenScan(const IX_IndexHandle &indexHandle,
     this->indexHandle = const_cast<IX_IndexHandle*>(&indexHandle);
   else
     return (IX_INVALIDSCAN);
-  this->value = NULL;
-  useFirstLeaf = true;
-  compOp = NO_OP;
-  this->compOp = compOp; // sets up the comparator values, and the comparator
-
-  if(compOp==NO_OP)
-    comparator = NULL;
+  if(compOp != NO_OP && value == NULL)
+    return (IX_INVALIDSCAN);
+  if(compOp == INTERSECTS_OP && indexHandle.header.attr_type != MBR)
+    return (IX_INVALIDSCAN);
 
   // sets up attribute length and type
   this->attrType = (indexHandle.header).attr_type;
-  attrLength = ((this->indexHandle)->header).attr_length;
+  attrLength = (indexHandle.header).attr_length;
+  this->compOp = compOp;
+  this->pinHint = pinHint;
 
-  openScan = true; // sets up all indicators
+  // keep a private copy of the query key
+  this->value = NULL;
+  if(compOp != NO_OP){
+    this->value = malloc(attrLength);
+    memcpy(this->value, value, attrLength);
+  }
+
+  // start the descent at the root
+  path.clear();
+  if((rc = PushNode(indexHandle.header.rootPage))){
+    free(this->value);
+    this->value = NULL;
+    return (rc);
+  }
+
+  openScan = true;
   scanEnded = false;
-  hasLeafPinned = false;
-  scanStarted = false;
-  endOfIndexReached = false;
-  foundFirstValue = false;
-  foundLastValue = false;
+  nearestScan = false;
   return (rc);
 }
 
-RC IX_IndexScan::BeginScan(PF_PageHandle &leafPH, PageNum &pageNum){
+/*
+ * Opens a best-first k nearest neighbour scan. The queue starts out with
+ * the root node; GetNextEntry keeps expanding the closest node until a leaf
+ * entry is at the front, so entries come out in increasing distance and the
+ * caller stops after as many as it needs.
+ */
+RC IX_IndexScan::OpenNearestScan(const IX_IndexHandle &indexHandle,
+                void *value,
+                ClientHint pinHint)
+{
+  if(openScan == true || value == NULL)
+    return (IX_INVALIDSCAN);
+  if(! indexHandle.isValidIndexHeader() || indexHandle.header.attr_type != MBR)
+    return (IX_INVALIDSCAN);
+  this->indexHandle = const_cast<IX_IndexHandle*>(&indexHandle);
+
+  this->attrType = (indexHandle.header).attr_type;
+  attrLength = (indexHandle.header).attr_length;
+  this->compOp = NO_OP;
+  this->pinHint = pinHint;
+  this->value = malloc(attrLength);
+  memcpy(this->value, value, attrLength);
+
+  while(! nearestQueue.empty())
+    nearestQueue.pop();
+  struct NearestItem root = {0.0, false, (indexHandle.header).rootPage, NO_MORE_SLOTS,
+    (indexHandle.header).height - 1};
+  nearestQueue.push(root);
+
+  openScan = true;
+  scanEnded = false;
+  nearestScan = true;
+  return (0);
+}
+
+/*
+ * Opens a window scan searched by worker threads. The top of the tree is
+ * read here, a level at a time, until there are as many subtrees that may
+ * hold matches as workers, or the leaves are reached. The subtrees are
+ * dealt out to the workers, which steal from each other once they run out.
+ */
+RC IX_IndexScan::OpenParallelScan(const IX_IndexHandle &indexHandle,
+                void *value,
+                int numWorkers,
+                ClientHint pinHint)
+{
   RC rc = 0;
-  if(useFirstLeaf){
-    if((rc = indexHandle->GetFirstLeafPage(leafPH, pageNum)))
-      return (rc);
-    if((rc = GetFirstEntryInLeaf(currLeafPH))){
-      if(rc == IX_EOF){
-        scanEnded = true;
+  if(openScan == true || value == NULL || numWorkers < 1)
+    return (IX_INVALIDSCAN);
+  if(! indexHandle.isValidIndexHeader() || indexHandle.header.attr_type != MBR)
+    return (IX_INVALIDSCAN);
+  this->indexHandle = const_cast<IX_IndexHandle*>(&indexHandle);
+
+  this->attrType = (indexHandle.header).attr_type;
+  attrLength = (indexHandle.header).attr_length;
+  this->compOp = INTERSECTS_OP;
+  this->pinHint = pinHint;
+  this->value = malloc(attrLength);
+  memcpy(this->value, value, attrLength);
+
+  vector<struct WindowTask> frontier, children;
+  vector<RID> found;
+  struct WindowTask root = {(indexHandle.header).rootPage, (indexHandle.header).height - 1};
+  frontier.push_back(root);
+  while(! frontier.empty() && (int)frontier.size() < numWorkers && frontier[0].level > 0){
+    children.clear();
+    for(size_t i = 0; i < frontier.size(); i++){
+      if((rc = ExpandWindowNode(frontier[i], children, found))){
+        free(this->value);
+        this->value = NULL;
+        return (rc);
       }
-      return (rc);
     }
+    frontier.swap(children);
   }
-  else{
-    if((rc = indexHandle->FindRecordPage(leafPH, pageNum, value)))
-      return (rc);
-    if((rc = GetAppropriateEntryInLeaf(currLeafPH))){
-      if(rc == IX_EOF){
-        scanEnded = true;
-      }
-      return (rc);
-    }
-  }
-  return (rc);
+
+  parallel = new ParallelScan(numWorkers);
+  for(size_t i = 0; i < frontier.size(); i++)
+    parallel->deques[i % numWorkers].tasks.push_back(frontier[i]);
+  parallel->pendingTasks = frontier.size();
+  for(int w = 0; w < numWorkers; w++)
+    parallel->workers.push_back(thread(&IX_IndexScan::RunWorker, this, w));
+
+  openScan = true;
+  scanEnded = false;
+  nearestScan = false;
+  return (0);
 }
 
 /*
- * This function returns the next RID that meets the requirements of the scan
+ * This function returns the next RID that meets the requirements of the scan.
+ * The scan is a depth-first walk over an explicit stack of pinned nodes;
+ * each frame remembers the next slot to look at in its node.
  */
 RC IX_IndexScan::GetNextEntry(RID &rid)
 {
   RC rc = 0;
-  if(scanEnded == true && openScan == true) // return end of file if the scan has ended
-    return (IX_EOF);
-  if(foundLastValue == true)
-    return (IX_EOF);
-
-  if(scanEnded == true || openScan == false) // if the scan is false, then return IX_INVALIDSCAN
+  if(openScan == false)
     return (IX_INVALIDSCAN);
-
-  bool notFound = true; // indicator for whether the next value has been found
-  while(notFound){
-    // In the first iteration of the scan, retrieve the first entry
-    if(scanEnded == false && openScan == true && scanStarted == false){
-      //if((rc = indexHandle->GetFirstLeafPage(currLeafPH, currLeafNum)))
-      //  return (rc);
-      if((rc = BeginScan(currLeafPH, currLeafNum)))
+  if(scanEnded == true)
+    return (IX_EOF);
+  if(nearestScan == true)
+    return GetNextNearest(rid);
+  if(parallel != NULL)
+    return GetNextParallel(rid);
+
+  while(! path.empty()){
+    struct IX_NodeHeader *nHeader = path.back().nHeader;
+    if(IX_IndexHandle::IsPackedNode(nHeader)){
+      struct ScanFrame &frame = path.back();
+      if(frame.slot < (int)frame.matches.size()){
+        PageNum page;
+        SlotNum slot;
+        IX_IndexHandle::GetPackedEntry(nHeader, frame.matches[frame.slot++], page, slot);
+        if(nHeader->isLeafNode){
+          RID found(page, slot);
+          rid = found;
+          return (0);
+        }
+        if((rc = PushNode(page)))
+          return (rc);
+      }
+      else if((rc = PopNode()))
         return (rc);
-      currKey = nextNextKey; // store the current key. 
-      scanStarted = true; // scan has now started. set the indicator
-      SetRID(true);       // Set the current RID
-      // Get the next value. If none exist, mark the end of the scan has been reached.
-      if((IX_EOF == FindNextValue())) 
-        endOfIndexReached = true;
-    }
-    else{
-      currKey = nextKey; // Otherwise, continue the scan by updating the current value
-      currRID = nextRID; // to the one in the buffer (nextRID/nextKey)
-    }
-    SetRID(false); // Set the element in the buffer to the current state of the scan
-    nextKey = nextNextKey; 
-
-    if((IX_EOF == FindNextValue())){ // advance the scan by one step
-      endOfIndexReached = true;
+      continue;
     }
 
-    PageNum thisRIDPage;
-    if((rc = currRID.GetPageNum(thisRIDPage))) // check that the current RID is not 
-      return (rc);                             // invalid values. If so, then the
-    if(thisRIDPage == -1){                     // end of the scan has been reached, so return IX_EOF
-      scanEnded = true;
-      return (IX_EOF);
+    struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + (indexHandle->header).entryOffset_N);
+    char *keys = (char *)nHeader + (indexHandle->header).keysOffset_N;
+
+    PageNum child = NO_MORE_PAGES;
+    while(path.back().slot != NO_MORE_SLOTS){
+      int slot = path.back().slot;
+      path.back().slot = entries[slot].nextSlot;
+      if(entries[slot].isValid == UNOCCUPIED)
+        continue;
+
+      char *key = keys + slot * attrLength;
+      if(nHeader->isLeafNode){
+        if(KeyMatches(key)){
+          RID found(entries[slot].page, entries[slot].slot);
+          rid = found;
+          return (0);
+        }
+      }
+      else if(SubtreeMayMatch(key)){
+        child = entries[slot].page;
+        break;
+      }
     }
 
-    // If found the next satisfying value, then set the RID to return, and break
-    if(compOp == NO_OP){
-      rid = currRID;
-      notFound = false;
-      foundFirstValue = true;
-    }
-    else if((comparator((void *)currKey, value, attrType, attrLength))){
-      rid = currRID; 
-      notFound = false;
-      foundFirstValue = true;
-    }
-    else if(foundFirstValue == true){
-      foundLastValue = true;
-      return (IX_EOF);
+    // Either descend into the child that was found, or this node has been
+    // exhausted and the scan moves back up to its parent
+    if(child != NO_MORE_PAGES){
+      if((rc = PushNode(child)))
+        return (rc);
     }
-
+    else if((rc = PopNode()))
+      return (rc);
   }
-  SlotNum thisRIDpage;
-  currRID.GetSlotNum(thisRIDpage);
-  return (rc);
+
+  scanEnded = true;
+  return (IX_EOF);
 }
 
+/*
+ * Unpins every page still on the path, and frees the query key
+ */
 RC IX_IndexScan::CloseScan()
 {
-
   RC rc = 0;
   if(openScan == false)
     return (IX_INVALIDSCAN);
-  if(scanEnded == false && hasBucketPinned == true)
-    indexHandle->pfh.UnpinPage(currBucketNum);
-  if(scanEnded == false && hasLeafPinned == true && (currLeafNum != (indexHandle->header).rootPage))
-    indexHandle->pfh.UnpinPage(currLeafNum);
-  if(initializedValue == true){
+  if(parallel != NULL)
+    StopWorkers();
+  while(! path.empty()){
+    if((rc = PopNode()))
+      return (rc);
+  }
+  while(! nearestQueue.empty())
+    nearestQueue.pop();
+  if(value != NULL){
     free(value);
-    initializedValue = false;
+    value = NULL;
   }
   openScan = false;
-  scanStarted = false;
+  scanEnded = false;
 
   return (rc);
 }
 
 /*
- * This function retrieves the first entry in an open leafPH.
+ * Pins the given node, and pushes it on the path positioned at its first slot.
+ * Its level follows from the length of the path, since all leaves are at
+ * the same depth. A packed node is searched right away, and positioned at
+ * its first match instead.
  */
-RC IX_IndexScan::GetFirstEntryInLeaf(PF_PageHandle &leafPH){
+RC IX_IndexScan::PushNode(PageNum page){
   RC rc = 0;
-  hasLeafPinned = true;
-  if((rc = leafPH.GetData((char *&) leafHeader)))
+  PF_PageHandle ph;
+  struct ScanFrame frame;
+  int level = (indexHandle->header).height - 1 - (int)path.size();
+  if((rc = (indexHandle->pfh).GetThisPage(page, ph, NodeHint(level))) || (rc = ph.GetData((char *&)frame.nHeader)))
     return (rc);
-
-  if(leafHeader->num_keys == 0) // no keys in the leaf... return IX_EOF
-    return (IX_EOF);
-
-  leafEntries = (struct Node_Entry *)((char *)leafHeader + (indexHandle->header).entryOffset_N);
-  leafKeys = (char *)leafHeader + (indexHandle->header).keysOffset_N;
-
-  leafSlot = leafHeader->firstSlotIndex;
-  if((leafSlot != NO_MORE_SLOTS)){
-    nextNextKey = leafKeys + attrLength*leafSlot; // set the key to the first value
+  frame.page = page;
+  frame.slot = frame.nHeader->firstSlotIndex;
+  if(IX_IndexHandle::IsPackedNode(frame.nHeader)){
+    PackedNodeMatches(frame.nHeader, frame.matches);
+    frame.slot = 0;
   }
-  else
-    return (IX_INVALIDSCAN);
-  return (0);
+  path.push_back(frame);
+  return (rc);
 }
 
-RC IX_IndexScan::GetAppropriateEntryInLeaf(PF_PageHandle &leafPH){
+/*
+ * Unpins the node on top of the path and removes it
+ */
+RC IX_IndexScan::PopNode(){
   RC rc = 0;
-  hasLeafPinned = true;
-  if((rc = leafPH.GetData((char *&) leafHeader)))
+  PageNum page = path.back().page;
+  path.pop_back();
+  if((rc = (indexHandle->pfh).UnpinPage(page)))
     return (rc);
+  return (rc);
+}
 
-  if(leafHeader->num_keys == 0)
-    return (IX_EOF);
+/*
+ * Internal nodes are read on every descent, so they are kept hot in the
+ * buffer pool. Leaves are read with the hint the scan was opened with.
+ */
+ClientHint IX_IndexScan::NodeHint(int level){
+  if(level > 0)
+    return (KEEP_HOT);
+  return (pinHint);
+}
 
-  leafEntries = (struct Node_Entry *)((char *)leafHeader + (indexHandle->header).entryOffset_N);
-  leafKeys = (char *)leafHeader + (indexHandle->header).keysOffset_N;
-  int index = 0;
-  if((rc = indexHandle->FindNodeInsertIndex((struct IX_NodeHeader *)leafHeader, value, index)))
-    return (rc);
+/*
+ * An internal key covers every entry below it, so for MBR indexes a subtree
+ * can only hold matches if its key intersects the query rectangle. The
+ * entries of other index types are not ordered, so no subtree is pruned.
+ */
+bool IX_IndexScan::SubtreeMayMatch(char *key){
+  if(compOp == NO_OP || attrType != MBR)
+    return true;
+  return intersects_mbr(*(mbr *)key, *(mbr *)value);
+}
 
-  leafSlot = index;
-  if((leafSlot != NO_MORE_SLOTS))
-    nextNextKey = leafKeys + attrLength* leafSlot;
-  else
-    return (IX_INVALIDSCAN);
+/*
+ * Checks a leaf key against the scan condition
+ */
+bool IX_IndexScan::KeyMatches(char *key){
+  if(compOp == NO_OP)
+    return true;
+  if(attrType == MBR){
+    if(compOp == INTERSECTS_OP)
+      return intersects_mbr(*(mbr *)key, *(mbr *)value);
+    if(compOp == EQ_OP)
+      return (memcmp(key, value, sizeof(mbr)) == 0);
+    return false;
+  }
 
-  return (0);
+  int compared = indexHandle->comparator((void *)key, value, attrLength);
+  switch(compOp){
+    case EQ_OP: return (compared == 0);
+    case LT_OP: return (compared < 0);
+    case GT_OP: return (compared > 0);
+    case LE_OP: return (compared <= 0);
+    case GE_OP: return (compared >= 0);
+    default: return false;
+  }
 }
 
 /*
- * This sets one of the private variable RIDs. If setCurrent is true, it sets
- * currRID. If setCurrent is false, it sets nextRID.
+ * Finds the positions of the entries of a packed node that satisfy the scan
+ * condition, following the same rules as SubtreeMayMatch and KeyMatches.
+ * Only MBR indexes have packed nodes, so a leaf entry can only match
+ * INTERSECTS_OP, or EQ_OP, whose candidates must intersect the key too.
  */
-RC IX_IndexScan::SetRID(bool setCurrent){
-  if(endOfIndexReached && setCurrent == false){
-    RID rid1(-1,-1); // If we have reached the end of the scan, set the nextRID
-    nextRID = rid1;  // to an invalid value.
-    return (0);
+void IX_IndexScan::PackedNodeMatches(const struct IX_NodeHeader *nHeader, vector<int> &matches){
+  if(compOp == NO_OP){
+    for(int i = 0; i < nHeader->num_keys; i++)
+      matches.push_back(i);
+    return;
   }
+  if(nHeader->isLeafNode && compOp != INTERSECTS_OP && compOp != EQ_OP)
+    return;
+  IX_IndexHandle::SearchPackedNode(nHeader, *(mbr *)value, matches);
+  if(nHeader->isLeafNode && compOp == EQ_OP){
+    size_t kept = 0;
+    for(size_t i = 0; i < matches.size(); i++){
+      mbr key;
+      IX_IndexHandle::GetPackedKey(nHeader, matches[i], key);
+      if(memcmp(&key, value, sizeof(mbr)) == 0)
+        matches[kept++] = matches[i];
+    }
+    matches.resize(kept);
+  }
+}
 
-  if(setCurrent){
-    if(hasLeafPinned){ // otherwise, use the leaf value to set page/slot of RID
-      RID rid1(leafEntries[leafSlot].page, leafEntries[leafSlot].slot);
-      currRID = rid1;
+/*
+ * Pops the queue until a leaf entry comes out, expanding every node popped
+ * on the way. A node is only popped once no closer entry is left, so the
+ * nodes read are exactly those nearer to the query than the result.
+ */
+RC IX_IndexScan::GetNextNearest(RID &rid){
+  RC rc = 0;
+  while(! nearestQueue.empty()){
+    struct NearestItem item = nearestQueue.top();
+    nearestQueue.pop();
+    if(item.isEntry){
+      RID found(item.page, item.slot);
+      rid = found;
+      return (0);
     }
+    if((rc = ExpandNearestNode(item.page, item.level)))
+      return (rc);
   }
-  else{
-    if(hasLeafPinned){
-      RID rid1(leafEntries[leafSlot].page, leafEntries[leafSlot].slot);
-      nextRID = rid1;
+  scanEnded = true;
+  return (IX_EOF);
+}
+
+/*
+ * Reads a node and queues its children, or its RIDs if it is a leaf, with
+ * their MINDIST to the query MBR
+ */
+RC IX_IndexScan::ExpandNearestNode(PageNum page, int level){
+  RC rc = 0;
+  PF_PageHandle ph;
+  struct IX_NodeHeader *nHeader;
+  if((rc = (indexHandle->pfh).GetThisPage(page, ph, NodeHint(level))) || (rc = ph.GetData((char *&)nHeader)))
+    return (rc);
+
+  if(IX_IndexHandle::IsPackedNode(nHeader)){
+    for(int i = 0; i < nHeader->num_keys; i++){
+      struct NearestItem item;
+      mbr key;
+      IX_IndexHandle::GetPackedKey(nHeader, i, key);
+      item.dist = mindist_mbr(key, *(mbr *)value);
+      item.isEntry = nHeader->isLeafNode;
+      IX_IndexHandle::GetPackedEntry(nHeader, i, item.page, item.slot);
+      item.level = level - 1;
+      nearestQueue.push(item);
     }
+    return (indexHandle->pfh).UnpinPage(page);
   }
 
-  return (0);
+  struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + (indexHandle->header).entryOffset_N);
+  char *keys = (char *)nHeader + (indexHandle->header).keysOffset_N;
+  for(int slot = nHeader->firstSlotIndex; slot != NO_MORE_SLOTS; slot = entries[slot].nextSlot){
+    if(entries[slot].isValid == UNOCCUPIED)
+      continue;
+    struct NearestItem item;
+    item.dist = mindist_mbr(*(mbr *)(keys + slot * attrLength), *(mbr *)value);
+    item.isEntry = nHeader->isLeafNode;
+    item.page = entries[slot].page;
+    item.slot = entries[slot].slot;
+    item.level = level - 1;
+    nearestQueue.push(item);
+  }
+
+  if((rc = (indexHandle->pfh).UnpinPage(page)))
+    return (rc);
+  return (rc);
 }
 
 /*
- * This function adavances the state of the search by one element. It updates all the
- * private variables assocaited with this scan. 
+ * Pins a node of a parallel scan, and collects its children whose keys
+ * intersect the query, or its matching RIDs if it is a leaf. Only the
+ * key and the index header are read, so workers can run this at once.
  */
-RC IX_IndexScan::FindNextValue(){ 
+RC IX_IndexScan::ExpandWindowNode(const struct WindowTask &task,
+  vector<struct WindowTask> &children, vector<RID> &found){
   RC rc = 0;
-  // otherwise, deal with leaf level. 
-  int prevLeafSlot = leafSlot;
-  leafSlot = leafEntries[prevLeafSlot].nextSlot; // update to the next leaf slot
-
-  // Otherwise, stay update the key.
-  if(leafSlot != NO_MORE_SLOTS && leafEntries[leafSlot].isValid == OCCUPIED_NEW){
-    nextNextKey = leafKeys + leafSlot * attrLength;
-    return (0);
+  PF_PageHandle ph;
+  struct IX_NodeHeader *nHeader;
+  if((rc = (indexHandle->pfh).GetThisPage(task.page, ph, NodeHint(task.level))) || (rc = ph.GetData((char *&)nHeader)))
+    return (rc);
+
+  if(IX_IndexHandle::IsPackedNode(nHeader)){
+    vector<int> matches;
+    PackedNodeMatches(nHeader, matches);
+    for(size_t i = 0; i < matches.size(); i++){
+      PageNum page;
+      SlotNum slot;
+      IX_IndexHandle::GetPackedEntry(nHeader, matches[i], page, slot);
+      if(nHeader->isLeafNode)
+        found.push_back(RID(page, slot));
+      else{
+        struct WindowTask child = {page, task.level - 1};
+        children.push_back(child);
+      }
+    }
+    return (indexHandle->pfh).UnpinPage(task.page);
   }
 
-  // if it's not the root page, unpin it:
-  if((currLeafNum != (indexHandle->header).rootPage)){
-    if((rc = (indexHandle->pfh).UnpinPage(currLeafNum))){
-      return (rc);
+  struct Node_Entry *entries = (struct Node_Entry *)((char *)nHeader + (indexHandle->header).entryOffset_N);
+  char *keys = (char *)nHeader + (indexHandle->header).keysOffset_N;
+  for(int slot = nHeader->firstSlotIndex; slot != NO_MORE_SLOTS; slot = entries[slot].nextSlot){
+    if(entries[slot].isValid == UNOCCUPIED)
+      continue;
+    char *key = keys + slot * attrLength;
+    if(nHeader->isLeafNode){
+      if(KeyMatches(key))
+        found.push_back(RID(entries[slot].page, entries[slot].slot));
+    }
+    else if(SubtreeMayMatch(key)){
+      struct WindowTask child = {entries[slot].page, task.level - 1};
+      children.push_back(child);
+    }
+  }
+
+  if((rc = (indexHandle->pfh).UnpinPage(task.page)))
+    return (rc);
+  return (rc);
+}
+
+/*
+ * The loop of a worker thread. The children of a node searched go on the
+ * worker's own deque, and are counted as pending before the node stops
+ * being so. RIDs are handed over once a chunk is full, and when the worker
+ * is done. The first error of any worker stops them all.
+ */
+void IX_IndexScan::RunWorker(int worker){
+  RC rc = 0;
+  ParallelScan *ps = parallel;
+  int numWorkers = ps->deques.size();
+  vector<struct WindowTask> children;
+  vector<RID> found;
+
+  // Hands the RIDs found to the consumer, waiting while the queue is full
+  auto handOver = [&](){
+    unique_lock<mutex> lock(ps->queueLatch);
+    ps->notFull.wait(lock, [ps]{ return ps->stop || (int)ps->chunks.size() < IX_SCAN_QUEUE; });
+    if(! ps->stop){
+      ps->chunks.push_back(found);
+      ps->notEmpty.notify_one();
+    }
+    found.clear();
+  };
+
+  while(! ps->stop && ps->pendingTasks > 0){
+    struct WindowTask task;
+    bool haveTask = false;
+    for(int i = 0; i < numWorkers && ! haveTask; i++){
+      ParallelScan::WorkerDeque &d = ps->deques[(worker + i) % numWorkers];
+      lock_guard<mutex> guard(d.latch);
+      if(d.tasks.empty())
+        continue;
+      if(i == 0){
+        task = d.tasks.back();
+        d.tasks.pop_back();
+      }
+      else{
+        task = d.tasks.front();
+        d.tasks.pop_front();
+      }
+      haveTask = true;
+    }
+    // Another worker is still searching, and may queue more subtrees
+    if(! haveTask){
+      this_thread::yield();
+      continue;
     }
+
+    children.clear();
+    if((rc = ExpandWindowNode(task, children, found)))
+      break;
+    if(! children.empty()){
+      ps->pendingTasks += children.size();
+      lock_guard<mutex> guard(ps->deques[worker].latch);
+      ps->deques[worker].tasks.insert(ps->deques[worker].tasks.end(), children.begin(), children.end());
+    }
+    ps->pendingTasks--;
+
+    if((int)found.size() >= IX_SCAN_CHUNK)
+      handOver();
+  }
+  if(rc == 0 && ! found.empty())
+    handOver();
+
+  lock_guard<mutex> guard(ps->queueLatch);
+  if(rc != 0 && ps->rc == 0){
+    ps->rc = rc;
+    ps->stop = true;
+    ps->notFull.notify_all();
   }
-  hasLeafPinned = false;
+  ps->runningWorkers--;
+  ps->notEmpty.notify_all();
+}
 
-  return (IX_EOF); // Otherwise, no more elements
+/*
+ * Returns the RIDs of the current chunk, and then waits for the next one.
+ * The scan ends once every worker is done and no chunk is left.
+ */
+RC IX_IndexScan::GetNextParallel(RID &rid){
+  ParallelScan *ps = parallel;
+  if(ps->nextRid == ps->current.size()){
+    unique_lock<mutex> lock(ps->queueLatch);
+    ps->notEmpty.wait(lock, [ps]{ return ! ps->chunks.empty() || ps->runningWorkers == 0; });
+    if(ps->rc != 0)
+      return (ps->rc);
+    if(ps->chunks.empty()){
+      scanEnded = true;
+      return (IX_EOF);
+    }
+    ps->current.swap(ps->chunks.front());
+    ps->chunks.pop_front();
+    ps->nextRid = 0;
+    ps->notFull.notify_one();
+  }
+  rid = ps->current[ps->nextRid++];
+  return (0);
+}
 
+/*
+ * Tells the workers to stop, wakes those waiting for room in the queue,
+ * and waits for all of them to finish
+ */
+void IX_IndexScan::StopWorkers(){
+  {
+    lock_guard<mutex> guard(parallel->queueLatch);
+    parallel->stop = true;
+    parallel->notFull.notify_all();
+  }
+  for(size_t i = 0; i < parallel->workers.size(); i++)
+    parallel->workers[i].join();
+  delete parallel;
+  parallel = NULL;
 }
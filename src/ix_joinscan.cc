@@ -0,0 +1,248 @@
+//
+// File:        ix_joinscan.cc
+// Description: IX_JoinScan joins two MBR indexes by walking both R-trees
+//              at once, returning the RID pairs whose keys intersect.
+//
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <climits>
+#include "pf.h"
+#include "ix.h"
+#include <cstdio>
+#include "comparators.h"
+#include "ix_internal.h"
+
+using namespace std;
+
+IX_JoinScan::IX_JoinScan()
+{
+  openScan = false;
+  indexHandle1 = NULL;
+  indexHandle2 = NULL;
+  nextResult = 0;
+}
+
+IX_JoinScan::~IX_JoinScan()
+{
+  if(openScan == true)
+    CloseScan();
+}
+
+/*
+ * Opens a join scan over two MBR indexes. The traversal starts from the
+ * pair of roots; each pair of nodes popped is only expanded into the
+ * pairs of children whose keys intersect.
+ */
+RC IX_JoinScan::OpenScan(const IX_IndexHandle &indexHandle1,
+                const IX_IndexHandle &indexHandle2,
+                ClientHint pinHint)
+{
+  if(openScan == true)
+    return (IX_INVALIDSCAN);
+  if(! indexHandle1.isValidIndexHeader() || ! indexHandle2.isValidIndexHeader())
+    return (IX_INVALIDSCAN);
+  if(indexHandle1.header.attr_type != MBR || indexHandle2.header.attr_type != MBR)
+    return (IX_INVALIDSCAN);
+  this->indexHandle1 = const_cast<IX_IndexHandle*>(&indexHandle1);
+  this->indexHandle2 = const_cast<IX_IndexHandle*>(&indexHandle2);
+
+  pending.clear();
+  results.clear();
+  nextResult = 0;
+  struct NodePair roots = {indexHandle1.header.rootPage, indexHandle2.header.rootPage};
+  pending.push_back(roots);
+
+  openScan = true;
+  return (0);
+}
+
+/*
+ * Returns the next pair of RIDs whose keys intersect. Results of a pair of
+ * leaves are buffered; once they run out, node pairs are joined until one
+ * produces more results or none are left.
+ */
+RC IX_JoinScan::GetNextPair(RID &rid1, RID &rid2)
+{
+  RC rc = 0;
+  if(openScan == false)
+    return (IX_INVALIDSCAN);
+  while(nextResult >= results.size()){
+    results.clear();
+    nextResult = 0;
+    if(pending.empty())
+      return (IX_EOF);
+    struct NodePair nodes = pending.back();
+    pending.pop_back();
+    if((rc = JoinNodes(nodes)))
+      return (rc);
+  }
+  rid1 = results[nextResult].first;
+  rid2 = results[nextResult].second;
+  nextResult++;
+  return (0);
+}
+
+/*
+ * Drops all pending work. No pages are pinned between calls, so there is
+ * nothing to unpin.
+ */
+RC IX_JoinScan::CloseScan()
+{
+  if(openScan == false)
+    return (IX_INVALIDSCAN);
+  pending.clear();
+  results.clear();
+  nextResult = 0;
+  openScan = false;
+  return (0);
+}
+
+/*
+ * Joins a pair of nodes. Each node's entries are first restricted to those
+ * intersecting the other node's cover, since no others can be part of a
+ * result. When both nodes are at the same level the restricted entries are
+ * paired with a plane sweep: pairs of leaf entries are results, pairs of
+ * children are queued. When the trees have different heights, the leaf is
+ * kept and paired with each child of the other node.
+ */
+RC IX_JoinScan::JoinNodes(const struct NodePair &nodes){
+  RC rc = 0;
+  PF_PageHandle ph1, ph2;
+  struct IX_NodeHeader *nHeader1;
+  struct IX_NodeHeader *nHeader2;
+  if((rc = (indexHandle1->pfh).GetThisPage(nodes.page1, ph1)) || (rc = ph1.GetData((char *&)nHeader1)))
+    return (rc);
+  if((rc = (indexHandle2->pfh).GetThisPage(nodes.page2, ph2)) || (rc = ph2.GetData((char *&)nHeader2))){
+    (indexHandle1->pfh).UnpinPage(nodes.page1);
+    return (rc);
+  }
+
+  struct JoinEntry cover1, cover2;
+  NodeCover(indexHandle1, nHeader1, cover1);
+  NodeCover(indexHandle2, nHeader2, cover2);
+
+  vector<struct JoinEntry> entries1, entries2;
+  if(nHeader1->isLeafNode == nHeader2->isLeafNode){
+    if((rc = ReadEntries(indexHandle1, nHeader1, cover2, entries1)) ||
+      (rc = ReadEntries(indexHandle2, nHeader2, cover1, entries2)))
+      return (rc);
+    vector<pair<int, int> > pairs;
+    plane_sweep(entries1, entries2, pairs);
+    for(size_t i = 0; i < pairs.size(); i++){
+      struct JoinEntry &e1 = entries1[pairs[i].first];
+      struct JoinEntry &e2 = entries2[pairs[i].second];
+      if(nHeader1->isLeafNode){
+        RID r1(e1.page, e1.slot);
+        RID r2(e2.page, e2.slot);
+        results.push_back(make_pair(r1, r2));
+      }
+      else{
+        struct NodePair child = {e1.page, e2.page};
+        pending.push_back(child);
+      }
+    }
+  }
+  else if(nHeader1->isLeafNode){
+    if((rc = ReadEntries(indexHandle2, nHeader2, cover1, entries2)))
+      return (rc);
+    for(size_t i = 0; i < entries2.size(); i++){
+      struct NodePair child = {nodes.page1, entries2[i].page};
+      pending.push_back(child);
+    }
+  }
+  else{
+    if((rc = ReadEntries(indexHandle1, nHeader1, cover2, entries1)))
+      return (rc);
+    for(size_t i = 0; i < entries1.size(); i++){
+      struct NodePair child = {entries1[i].page, nodes.page2};
+      pending.push_back(child);
+    }
+  }
+
+  if((rc = (indexHandle1->pfh).UnpinPage(nodes.page1)) || (rc = (indexHandle2->pfh).UnpinPage(nodes.page2)))
+    return (rc);
+  return (rc);
+}
+
+bool IX_JoinScan::LowerX(const struct JoinEntry &a, const struct JoinEntry &b){
+  return a.x1 < b.x1;
+}
+
+/*
+ * Reads the valid entries of a node that intersect window, normalising
+ * each key so that x1 <= x2 and y1 <= y2, and sorts them on x1. Only the
+ * entries of a packed node that intersect window are decoded.
+ */
+RC IX_JoinScan::ReadEntries(IX_IndexHandle *ih, struct IX_NodeHeader *nHeader,
+  const struct JoinEntry &window, vector<struct JoinEntry> &entries){
+  if(IX_IndexHandle::IsPackedNode(nHeader)){
+    if(window.x1 > window.x2 || window.y1 > window.y2)
+      return (0);
+    mbr windowKey = {window.x1, window.y1, window.x2, window.y2};
+    vector<int> matches;
+    IX_IndexHandle::SearchPackedNode(nHeader, windowKey, matches);
+    for(size_t i = 0; i < matches.size(); i++){
+      mbr key;
+      struct JoinEntry entry;
+      IX_IndexHandle::GetPackedKey(nHeader, matches[i], key);
+      entry.x1 = min(key.top_left_x, key.bottom_right_x);
+      entry.x2 = max(key.top_left_x, key.bottom_right_x);
+      entry.y1 = min(key.top_left_y, key.bottom_right_y);
+      entry.y2 = max(key.top_left_y, key.bottom_right_y);
+      IX_IndexHandle::GetPackedEntry(nHeader, matches[i], entry.page, entry.slot);
+      entries.push_back(entry);
+    }
+    sort(entries.begin(), entries.end(), LowerX);
+    return (0);
+  }
+  struct Node_Entry *nodeEntries = (struct Node_Entry *)((char *)nHeader + (ih->header).entryOffset_N);
+  char *keys = (char *)nHeader + (ih->header).keysOffset_N;
+  for(int slot = nHeader->firstSlotIndex; slot != NO_MORE_SLOTS; slot = nodeEntries[slot].nextSlot){
+    if(nodeEntries[slot].isValid == UNOCCUPIED)
+      continue;
+    mbr *key = (mbr *)(keys + slot * (ih->header).attr_length);
+    struct JoinEntry entry;
+    entry.x1 = min(key->top_left_x, key->bottom_right_x);
+    entry.x2 = max(key->top_left_x, key->bottom_right_x);
+    entry.y1 = min(key->top_left_y, key->bottom_right_y);
+    entry.y2 = max(key->top_left_y, key->bottom_right_y);
+    if(entry.x1 > window.x2 || window.x1 > entry.x2 || entry.y1 > window.y2 || window.y1 > entry.y2)
+      continue;
+    entry.page = nodeEntries[slot].page;
+    entry.slot = nodeEntries[slot].slot;
+    entries.push_back(entry);
+  }
+  sort(entries.begin(), entries.end(), LowerX);
+  return (0);
+}
+
+/*
+ * Computes the rectangle covering all entries of a node. An empty node
+ * gets an inverted rectangle, which intersects nothing. A packed node
+ * stores its cover.
+ */
+void IX_JoinScan::NodeCover(IX_IndexHandle *ih, struct IX_NodeHeader *nHeader, struct JoinEntry &cover){
+  if(IX_IndexHandle::IsPackedNode(nHeader)){
+    struct IX_PackedNode *node = (struct IX_PackedNode *)((char *)nHeader + sizeof(struct IX_NodeHeader));
+    cover.x1 = node->minX;
+    cover.x2 = node->maxX;
+    cover.y1 = node->minY;
+    cover.y2 = node->maxY;
+    return;
+  }
+  cover.x1 = cover.y1 = INT_MAX;
+  cover.x2 = cover.y2 = INT_MIN;
+  struct Node_Entry *nodeEntries = (struct Node_Entry *)((char *)nHeader + (ih->header).entryOffset_N);
+  char *keys = (char *)nHeader + (ih->header).keysOffset_N;
+  for(int slot = nHeader->firstSlotIndex; slot != NO_MORE_SLOTS; slot = nodeEntries[slot].nextSlot){
+    if(nodeEntries[slot].isValid == UNOCCUPIED)
+      continue;
+    mbr *key = (mbr *)(keys + slot * (ih->header).attr_length);
+    cover.x1 = min(cover.x1, min(key->top_left_x, key->bottom_right_x));
+    cover.x2 = max(cover.x2, max(key->top_left_x, key->bottom_right_x));
+    cover.y1 = min(cover.y1, min(key->top_left_y, key->bottom_right_y));
+    cover.y2 = max(cover.y2, max(key->top_left_y, key->bottom_right_y));
+  }
+}
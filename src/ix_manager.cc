@@ -17,6 +17,16 @@
 
 
 IX_Manager::IX_Manager(PF_Manager &pfm) : pfm(pfm){
+  readOnly = false;
+}
+
+/*
+ * Makes the indexes opened from now on read-only mappings, whose pages
+ * are read from the OS page cache instead of the buffer pool, or not
+ */
+RC IX_Manager::SetReadOnly(bool readOnly){
+  this->readOnly = readOnly;
+  return (0);
 }
 
 IX_Manager::~IX_Manager()
@@ -62,15 +72,21 @@ RC IX_Manager::GetIndexFileName(const char *fileName, int indexNo, std::string &
 
 /*
  * Creates a new index given the filename, the index number, attribute type and length.
+ * insertMode picks how InsertEntry grows the tree, and nodeFormat how BulkLoad
+ * writes its nodes; both only apply to MBR indexes.
  */
 RC IX_Manager::CreateIndex(const char *fileName, int indexNo,
-                           AttrType attrType, int attrLength)
+                           AttrType attrType, int attrLength,
+                           IX_InsertMode insertMode,
+                           IX_NodeFormat nodeFormat)
 {
     if(fileName == NULL || indexNo < 0) // Check that the file name and index number are valid
         return (IX_BADFILENAME);
     RC rc = 0;
     if(! IsValidIndex(attrType, attrLength)) // check that attribute length and type are valid
         return (IX_BADINDEXSPEC);
+    if(readOnly)
+        return (PF_READONLY);
 
     // Create index file:
     std::string indexname;
@@ -114,6 +130,10 @@ RC IX_Manager::CreateIndex(const char *fileName, int indexNo,
     header->entryOffset_N = sizeof(struct IX_NodeHeader_I);
     header->keysOffset_N = header->entryOffset_N + numKeys_N*sizeof(struct Node_Entry);
     header->rootPage = rootpage;
+    header->insertMode = (attrType == MBR) ? insertMode : IX_LINEAR_INSERT;
+    header->height = 1;
+    header->nodeFormat = (attrType == MBR) ? nodeFormat : IX_SLOTTED_NODES;
+    header->packedNodes = 0;
 
 
     // Set up the root node
@@ -150,7 +170,16 @@ RC IX_Manager::CreateIndex(const char *fileName, int indexNo,
  */
 RC IX_Manager::DestroyIndex(const char *fileName, int indexNo)
 {
-
+    if(fileName == NULL || indexNo < 0)
+        return (IX_BADFILENAME);
+    if(readOnly)
+        return (PF_READONLY);
+    RC rc = 0;
+    std::string indexname;
+    if((rc = GetIndexFileName(fileName, indexNo, indexname)) ||
+       (rc = pfm.DestroyFile(indexname.c_str())))
+        return (rc);
+    return (0);
 }
 
 /*
@@ -216,7 +245,7 @@ RC IX_Manager::OpenIndex(const char *fileName, int indexNo,
     PF_FileHandle fh;
     std::string indexname;
     if((rc = GetIndexFileName(fileName, indexNo, indexname)) ||
-       (rc = pfm.OpenFile(indexname.c_str(), fh)))
+       (rc = pfm.OpenFile(indexname.c_str(), fh, readOnly)))
         return (rc);
 
     // Get first page, and set up the indexHandle
@@ -247,33 +276,21 @@ RC IX_Manager::OpenIndex(const char *fileName, int indexNo,
 RC IX_Manager::CloseIndex(IX_IndexHandle &indexHandle)
 {
     RC rc = 0;
-    PF_PageHandle ph;
-    PageNum page;
-    char *pData;
 
     if(indexHandle.isOpenHandle == false){ // checks that it's a valid index handle
         return (IX_INVALIDINDEXHANDLE);
     }
 
-    // rewrite the root page and unpin it
+    // rewrite the root page and unpin it. A read-only index wasn't changed
     PageNum root = indexHandle.header.rootPage;
-    if((rc = indexHandle.pfh.MarkDirty(root)) || (rc = indexHandle.pfh.UnpinPage(root)))
+    if(! indexHandle.pfh.IsReadOnly() && (rc = indexHandle.pfh.MarkDirty(root)))
+        return (rc);
+    if((rc = indexHandle.pfh.UnpinPage(root)))
         return (rc);
 
     // Check that the header is modified. If so, write that too.
-    if(indexHandle.header_modified == true){
-        if((rc = indexHandle.pfh.GetFirstPage(ph)) || ph.GetPageNum(page))
-            return (rc);
-        if((rc = ph.GetData(pData))){
-            RC rc2;
-            if((rc2 = indexHandle.pfh.UnpinPage(page)))
-                return (rc2);
-            return (rc);
-        }
-        memcpy(pData, &indexHandle.header, sizeof(struct IX_IndexHeader));
-        if((rc = indexHandle.pfh.MarkDirty(page)) || (rc = indexHandle.pfh.UnpinPage(page)))
-            return (rc);
-    }
+    if((rc = indexHandle.WriteHeader()))
+        return (rc);
 
     // Close the file
     if((rc = pfm.CloseFile(indexHandle.pfh)))
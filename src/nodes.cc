@@ -183,13 +183,15 @@ NODE *print_node(char *relname)
  * query_node: allocates, initializes, and returns a pointer to a new
  * query node having the indicated values.
  */
-NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist)
+NODE *query_node(NODE *relattrlist, NODE *rellist, NODE *conditionlist,
+                 NODE *nearest)
 {
     NODE *n = newnode(N_QUERY);
 
     n->u.QUERY.relattrlist = relattrlist;
     n->u.QUERY.rellist = rellist;
     n->u.QUERY.conditionlist = conditionlist;
+    n->u.QUERY.nearest = nearest;
     return n;
 }
 
@@ -330,6 +332,20 @@ NODE *relation_node(char *relname)
     return n;
 }
 
+/*
+ * nearest_node: allocates, initializes, and returns a pointer to a new
+ * nearest neighbour clause node having the indicated values.
+ */
+NODE *nearest_node(NODE *relattr, NODE *value, int k)
+{
+    NODE *n = newnode(N_NEAREST);
+
+    n->u.NEAREST.relattr = relattr;
+    n->u.NEAREST.value = value;
+    n->u.NEAREST.k = k;
+    return n;
+}
+
 /*
  * list_node: allocates, initializes, and returns a pointer to a new
  * list node having the indicated values.
@@ -13,6 +13,8 @@
  * 1998: Added "reset buffer", "resize buffer [int]", "queryplans on",
  * and "queryplans off".
  * 2000: Added "const" to yyerror-header
+ * Added "begin" and "commit", which run the commands between them as
+ * one transaction.
  *
  */
 
@@ -62,6 +64,9 @@ int bExit;                 // when to return from RBparse
 
 int bQueryPlans;           // When to print the query plans
 
+int bBatch;                // whether the commands run in a transaction
+                           // begun by the user
+
 PF_Manager *pPfm;          // PF component manager
 SM_Manager *pSmm;          // SM component manager
 QL_Manager *pQlm;          // QL component manager
@@ -112,6 +117,12 @@ QL_Manager *pQlm;          // QL component manager
       RW_QUERY_PLAN
       RW_ON
       RW_OFF
+      RW_ORDER
+      RW_BY
+      RW_DISTANCE
+      RW_LIMIT
+      RW_BEGIN
+      RW_COMMIT
 
 %token   <ival>   T_INT
 
@@ -152,6 +163,7 @@ QL_Manager *pQlm;          // QL component manager
       non_mt_relation_list
       relation
       opt_where_clause
+      opt_nearest_clause
       non_mt_cond_list
       condition
       relattr_or_value
@@ -160,6 +172,7 @@ QL_Manager *pQlm;          // QL component manager
       buffer
       statistics
       queryplans
+      transaction
 %%
 
 start
@@ -225,6 +238,39 @@ utility
    | buffer
    | statistics 
    | queryplans 
+   | transaction
+   ;
+
+transaction
+   : RW_BEGIN
+   {
+      RC rc;
+      if ((rc = pSmm->BeginTransaction()))
+         PrintError(rc);
+      else {
+         bBatch = 1;
+         cout << "Transaction begun.\n";
+      }
+      $$ = NULL;
+   }
+   | RW_COMMIT
+   {
+      RC rc;
+      if (!bBatch)
+         rc = PF_NOTRANSACTION;
+      else {
+         bBatch = 0;
+         rc = pSmm->CommitTransaction();
+      }
+      if (rc) {
+         PrintError(rc);
+         if (rc < 0)
+            bExit = 1;
+      }
+      else
+         cout << "Transaction committed.\n";
+      $$ = NULL;
+   }
    ;
 
 queryplans
@@ -247,7 +293,7 @@ queryplans
 buffer
    : RW_RESET RW_BUFFER
    {
-      if (pPfm->ClearBuffer())
+      if (pSmm->CloseHandles() || pPfm->ClearBuffer())
          cout << "Trouble clearing buffer!  Things may be pinned.\n";
       else 
          cout << "Everything kicked out of Buffer!\n";
@@ -260,6 +306,7 @@ buffer
    }
    | RW_RESIZE RW_BUFFER T_INT
    {
+      pSmm->CloseHandles();
       pPfm->ResizeBuffer($3);
       $$ = NULL;
    }
@@ -355,9 +402,9 @@ exit
    ;
 
 query
-   : RW_SELECT non_mt_select_clause RW_FROM non_mt_relation_list opt_where_clause
+   : RW_SELECT non_mt_select_clause RW_FROM non_mt_relation_list opt_where_clause opt_nearest_clause
    {
-      $$ = query_node($2, $4, $5);
+      $$ = query_node($2, $4, $5, $6);
    }
    ;
 
@@ -459,6 +506,17 @@ opt_where_clause
    }
    ;
 
+opt_nearest_clause
+   : RW_ORDER RW_BY RW_DISTANCE '(' relattr ',' value ')' RW_LIMIT T_INT
+   {
+      $$ = nearest_node($5, $7, $10);
+   }
+   | nothing
+   {
+      $$ = NULL;
+   }
+   ;
+
 non_mt_cond_list
    : condition RW_AND non_mt_cond_list
    {
@@ -604,6 +662,7 @@ void RBparse(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm)
    pQlm  = &qlm;
    bExit = 0;
    bQueryPlans = 0;
+   bBatch = 0;
 
    /* Do forever */
    while (!bExit) {
@@ -617,13 +676,26 @@ void RBparse(PF_Manager &pfm, SM_Manager &smm, QL_Manager &qlm)
       /* Get the prompt to actually show up on the screen */
       cout.flush(); 
 
-      /* If a query was successfully read, interpret it */
-      if(yyparse() == 0 && parse_tree != NULL)
-         if ((rc = interp(parse_tree))) {
+      /* If a query was successfully read, interpret it.  Outside of a
+         transaction begun by the user, it runs as one transaction of
+         its own, which is committed even if the command fails halfway,
+         as the changes it made are kept */
+      if(yyparse() == 0 && parse_tree != NULL) {
+         RC rcCommit;
+         if (bBatch)
+            rc = interp(parse_tree);
+         else {
+            if ((rc = pSmm->BeginTransaction()) == 0)
+               rc = interp(parse_tree);
+            if ((rcCommit = pSmm->CommitTransaction()) && !rc)
+               rc = rcCommit;
+         }
+         if (rc) {
             PrintError(rc);
             if (rc < 0)
                bExit = TRUE;
          }
+      }
    }
 }
 
@@ -16,9 +16,15 @@
 //
 
 #include <cstdio>
+#include <cerrno>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <iostream>
+#include <algorithm>
 #include "pf_buffermgr.h"
+#include "pf_log.h"
 
 using namespace std;
 
@@ -85,25 +91,23 @@ void WriteLog(const char *psMessage)
 //       can be pinned multiple times).  If not, it reads it from the file
 //       and pins it.  If the buffer is full and a new page needs to be
 //       inserted, an unpinned page is replaced according to an LRU
+//       policy, or to CLOCK or LRU-2 once they are chosen with SetPolicy
 // In:   numPages - the number of pages in the buffer
 //
-// Note: The constructor will initialize the global pStatisticsMgr.  We
-//       make it global so that other components may use it and to allow
-//       easy access.
+// Note: The global pStatisticsMgr is made global so that other
+//       components may use it and to allow easy access.  It is created
+//       by PF_BufferPool, since all the shards of the pool share it.
 //
 // Aut2003
 // numPages changed to _numPages for to eliminate CC warnings
 
-PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
+PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(_numPages),
+   historyIndex(_numPages)
 {
    // Initialize local variables
    this->numPages = _numPages;
    pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
-
-#ifdef PF_STATS
-   // Initialize the global variable for the statistics manager
-   pStatisticsMgr = new StatisticsMgr();
-#endif
+   frameSize = (pageSize + PF_FRAME_ALIGN - 1) / PF_FRAME_ALIGN * PF_FRAME_ALIGN;
 
 #ifdef PF_LOG
    char psMessage[100];
@@ -115,22 +119,38 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
    // Allocate memory for buffer page description table
    bufTable = new PF_BufPageDesc[numPages];
 
-   // Initialize the buffer table and allocate memory for buffer pages.
-   // Initially, the free list contains all pages
-   for (int i = 0; i < numPages; i++) {
-      if ((bufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
+   // Allocate memory for buffer pages, which comes zeroed
+   if ((arena = AllocArena(numPages, arenaSize)) == NULL) {
+      cerr << "Not enough memory for buffer\n";
+      exit(1);
+   }
 
-      memset ((void *)bufTable[i].pData, 0, pageSize);
+   // Initialize the buffer table.  Initially, the free list contains
+   // all pages
+   for (int i = 0; i < numPages; i++) {
+      bufTable[i].pData = arena + (size_t)i * frameSize;
 
       bufTable[i].prev = i - 1;
       bufTable[i].next = i + 1;
+      bufTable[i].bScanRing = bufTable[i].bHot = FALSE;
+      bufTable[i].queuePos = INVALID_SLOT;
    }
    bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;
    free = 0;
    first = last = INVALID_SLOT;
+   policy = PF_LRU;
+   clockHand = 0;
+   ringFirst = ringLast = INVALID_SLOT;
+   numRing = numHot = 0;
+   refTime = 0;
+   history = NULL;
+   InitHistory();
+   queue = NULL;
+   InitQueue();
+   for (int i = 0; i < PF_READ_STREAMS; i++)
+      streams[i].fd = -1;
+   nextStream = 0;
+   pLog = NULL;
 
 #ifdef PF_LOG
    WriteLog("Succesfully created the buffer manager.\n");
@@ -144,16 +164,17 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 //
 PF_BufferMgr::~PF_BufferMgr()
 {
+   // Wait for the reads ahead still under way
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].bInFlight)
+         FinishRead(slot);
+
    // Free up buffer pages and tables
-   for (int i = 0; i < this->numPages; i++)
-      delete [] bufTable[i].pData;
+   FreeArena(arena, arenaSize);
 
    delete [] bufTable;
-
-#ifdef PF_STATS
-   // Destroy the global statistics manager
-   delete pStatisticsMgr;
-#endif
+   delete [] history;
+   delete [] queue;
 
 #ifdef PF_LOG
    WriteLog("Destroyed the buffer manager.\n");
@@ -172,11 +193,19 @@ PF_BufferMgr::~PF_BufferMgr()
 //       pageNum - number of the page to read
 //       bMultiplePins - if FALSE, it is an error to ask for a page that is
 //                       already pinned in the buffer.
+//       pinHint - how the page will be used.  A page read by a
+//                 SEQUENTIAL_SCAN joins the scan ring, and once the ring
+//                 is full the scan replaces its own pages rather than
+//                 those of other clients.  KEEP_HOT pages are replaced
+//                 only when no other page is unpinned.  A page of the ring
+//                 asked for with any other hint leaves the ring.  Pages
+//                 asked for in order, other than RANDOM and KEEP_HOT
+//                 ones, are read ahead of the reader.
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
 // Ret:  PF return code
 //
 RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
-      int bMultiplePins)
+      int bMultiplePins, ClientHint pinHint)
 {
    RC  rc;     // return code
    int slot;   // buffer slot where page is located
@@ -197,6 +226,16 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
          (rc != PF_HASHNOTFOUND))
       return (rc);                // unexpected error
 
+   // Wait for a page that is being read ahead.  If the read failed, the
+   // page is dropped and read again, to report the error
+   if (!rc && bufTable[slot].bInFlight && FinishRead(slot)) {
+      if ((rc = hashTable.Delete(fd, pageNum)) ||
+            (rc = Unlink(slot)) ||
+            (rc = InsertFree(slot)))
+         return (rc);
+      rc = PF_HASHNOTFOUND;
+   }
+
    // If page not in buffer...
    if (rc == PF_HASHNOTFOUND) {
 
@@ -206,7 +245,7 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
 
       // Allocate an empty page, this will also promote the newly allocated
       // page to the MRU slot
-      if ((rc = InternalAlloc(slot)))
+      if ((rc = InternalAlloc(slot, pinHint)))
          return (rc);
 
       // read the page, insert it into the hash table,
@@ -220,6 +259,10 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
          InsertFree(slot);
          return (rc);
       }
+
+      // A page read by a sequential scan joins the scan ring
+      if (pinHint == SEQUENTIAL_SCAN)
+         JoinRing(slot);
 #ifdef PF_LOG
    WriteLog("Page not found in buffer. Loaded.\n");
 #endif
@@ -234,6 +277,23 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
       if (!bMultiplePins && bufTable[slot].pinCount > 0)
          return (PF_PAGEPINNED);
 
+      // A pinned page cannot be replaced, so it leaves the LRU-2 queue
+      DequeueSlot(slot);
+
+      // Note the reference for the replacement policy.  The first use of
+      // a page read ahead is its first reference, like the read of a page
+      // that was not in the buffer.
+      if (bufTable[slot].bReadAhead) {
+         bufTable[slot].bReadAhead = FALSE;
+         bufTable[slot].lastRef = ++refTime;
+         if (policy == PF_LRU &&
+               ((rc = Unlink(slot)) ||
+               (rc = LinkHead (slot))))
+            return (rc);
+      }
+      else if ((rc = Reference(slot)))
+         return (rc);
+
       // Page is alredy in memory, just increment pin count
       bufTable[slot].pinCount++;
 #ifdef PF_LOG
@@ -241,13 +301,11 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
             bufTable[slot].pinCount);
       WriteLog(psMessage);
 #endif
-
-      // Make this page the most recently used page
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
-         return (rc);
    }
 
+   ApplyHint(slot, pinHint);
+   ReadAhead(fd, pageNum, pinHint);
+
    // Point ppBuffer to page
    *ppBuffer = bufTable[slot].pData;
 
@@ -275,9 +333,18 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
    WriteLog(psMessage);
 #endif
 
-   // If page is already in buffer, return an error
-   if (!(rc = hashTable.Find(fd, pageNum, slot)))
-      return (PF_PAGEINBUF);
+   // If page is already in buffer, return an error.  A page that was
+   // only read ahead is dropped instead.
+   if (!(rc = hashTable.Find(fd, pageNum, slot))) {
+      if (!bufTable[slot].bReadAhead)
+         return (PF_PAGEINBUF);
+      if (bufTable[slot].bInFlight)
+         FinishRead(slot);
+      if ((rc = hashTable.Delete(fd, pageNum)) ||
+            (rc = Unlink(slot)) ||
+            (rc = InsertFree(slot)))
+         return (rc);
+   }
    else if (rc != PF_HASHNOTFOUND)
       return (rc);              // unexpected error
 
@@ -342,8 +409,9 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
    bufTable[slot].bDirty = TRUE;
 
    // Make this page the most recently used page
-   if ((rc = Unlink(slot)) ||
-         (rc = LinkHead (slot)))
+   if (policy == PF_LRU &&
+         ((rc = Unlink(slot)) ||
+         (rc = LinkHead (slot))))
       return (rc);
 
    // Return ok
@@ -382,12 +450,16 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
 #endif
 
    // If unpinning the last pin, make it the most recently used page
-   if (--(bufTable[slot].pinCount) == 0) {
+   if (--(bufTable[slot].pinCount) == 0 && policy == PF_LRU) {
       if ((rc = Unlink(slot)) ||
             (rc = LinkHead (slot)))
          return (rc);
    }
 
+   // An unpinned page may be replaced by LRU-2 again
+   if (bufTable[slot].pinCount == 0)
+      QueueSlot(slot);
+
    // Return ok
    return (0);
 }
@@ -416,6 +488,10 @@ RC PF_BufferMgr::FlushPages(int fd)
    pStatisticsMgr->Register(PF_FLUSHPAGES, STAT_ADDONE);
 #endif
 
+   // Write the dirty pages that are unpinned, in file order
+   if ((rc = WriteDirty(fd, ALL_PAGES, FALSE)))
+      return (rc);
+
    // Do a linear scan of the buffer to find pages belonging to the file
    int slot = first;
    while (slot != INVALID_SLOT) {
@@ -434,16 +510,10 @@ RC PF_BufferMgr::FlushPages(int fd)
             rcWarn = PF_PAGEPINNED;
          }
          else {
-            // Write the page if dirty
-            if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-               if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-                  return (rc);
-               bufTable[slot].bDirty = FALSE;
-            }
+            // Wait for a read ahead, which must not land after the slot
+            // is reused or the file is closed
+            if (bufTable[slot].bInFlight)
+               FinishRead(slot);
 
             // Remove page from the hash table and add the slot to the free list
             if ((rc = hashTable.Delete(fd, bufTable[slot].pageNum)) ||
@@ -475,44 +545,71 @@ RC PF_BufferMgr::FlushPages(int fd)
 //
 RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
 {
-   RC rc;  // return codes
-
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Forcing page %d for (%d).\n", pageNum, fd);
    WriteLog(psMessage);
 #endif
 
-   // Do a linear scan of the buffer to find the page for the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
+   // I don't care if the page is pinned or not, just write it if
+   // it is dirty.
+   return (WriteDirty(fd, pageNum, TRUE));
+}
 
-      int next = bufTable[slot].next;
+//
+// LogPage
+//
+// Desc: Log the image of a page for the commit of a transaction, if it is
+//       in the buffer and dirty.  A page that is not has been logged when
+//       it was written.
+// In:   fd - file descriptor
+//       pageNum - the page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LogPage(int fd, PageNum pageNum)
+{
+   int slot;
+   RC rc = hashTable.Find(fd, pageNum, slot);
+   if (rc == PF_HASHNOTFOUND)
+      return (0);
+   if (rc)
+      return (rc);
 
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd &&
-            (pageNum==ALL_PAGES || bufTable[slot].pageNum == pageNum)) {
+   if (pLog == NULL || !bufTable[slot].bDirty)
+      return (0);
+   return (pLog->LogPage(fd, pageNum, bufTable[slot].pData));
+}
 
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer pool.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-         // I don't care if the page is pinned or not, just write it if
-         // it is dirty.
-         if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
-sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
-WriteLog(psMessage);
-#endif
-            if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-               return (rc);
-            bufTable[slot].bDirty = FALSE;
-         }
-      }
-      slot = next;
+//
+// WriteDirty
+//
+// Desc: Internal.  Write the dirty pages of a file in the order of their
+//       page numbers, so that runs of consecutive pages each go out in
+//       one call.
+// In:   fd - OS file descriptor of the file
+//       pageNum - the page to write, or ALL_PAGES
+//       bPinnedToo - if FALSE, pinned pages are left alone
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WriteDirty(int fd, PageNum pageNum, int bPinnedToo)
+{
+   RC rc;
+   int numSlots = 0;
+   int *slots = new int[numPages];
+
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      if (bufTable[slot].fd == fd && bufTable[slot].bDirty &&
+            (pageNum == ALL_PAGES || bufTable[slot].pageNum == pageNum) &&
+            (bPinnedToo || bufTable[slot].pinCount == 0))
+         slots[numSlots++] = slot;
    }
+   sort(slots, slots + numSlots, [this](int a, int b) {
+      return bufTable[a].pageNum < bufTable[b].pageNum;
+   });
 
-   return 0;
+   rc = WritePages(fd, slots, numSlots);
+   delete [] slots;
+   return (rc);
 }
 
 
@@ -529,8 +626,12 @@ RC PF_BufferMgr::PrintBuffer()
 {
    cout << "Buffer contains " << numPages << " pages of size "
       << pageSize <<".\n";
-   cout << "Contents in order from most recently used to "
-      << "least recently used.\n";
+   if (policy == PF_LRU)
+      cout << "Contents in order from most recently used to "
+         << "least recently used.\n";
+   else
+      cout << "Contents in order from most recently loaded to "
+         << "least recently loaded.\n";
 
    int slot, next;
    slot = first;
@@ -572,6 +673,8 @@ RC PF_BufferMgr::ClearBuffer()
    slot = first;
    while (slot != INVALID_SLOT) {
       next = bufTable[slot].next;
+      if (bufTable[slot].pinCount == 0 && bufTable[slot].bInFlight)
+         FinishRead(slot);
       if (bufTable[slot].pinCount == 0)
          if ((rc = hashTable.Delete(bufTable[slot].fd,
                bufTable[slot].pageNum)) ||
@@ -606,21 +709,24 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
    // First try and clear out the old buffer!
    ClearBuffer();
 
-   // Allocate memory for a new buffer table
+   // Allocate memory for a new buffer table and its pages
    PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[iNewSize];
+   size_t newArenaSize;
+   char *pNewArena = AllocArena(iNewSize, newArenaSize);
+   if (pNewArena == NULL) {
+      delete [] pNewBufTable;
+      return (PF_NOMEM);
+   }
 
-   // Initialize the new buffer table and allocate memory for buffer
-   // pages.  Initially, the free list contains all pages
+   // Initialize the new buffer table.  Initially, the free list contains
+   // all pages
    for (i = 0; i < iNewSize; i++) {
-      if ((pNewBufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
-
-      memset ((void *)pNewBufTable[i].pData, 0, pageSize);
+      pNewBufTable[i].pData = pNewArena + (size_t)i * frameSize;
 
       pNewBufTable[i].prev = i - 1;
       pNewBufTable[i].next = i + 1;
+      pNewBufTable[i].bScanRing = pNewBufTable[i].bHot = FALSE;
+      pNewBufTable[i].queuePos = INVALID_SLOT;
    }
    pNewBufTable[0].prev = pNewBufTable[iNewSize - 1].next = INVALID_SLOT;
 
@@ -629,14 +735,23 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
    // each of the entries into the new buffertable
    int oldFirst = first;
    PF_BufPageDesc *pOldBufTable = bufTable;
+   char *pOldArena = arena;
+   size_t oldArenaSize = arenaSize;
 
    // Setup the new number of pages,  first, last and free
    numPages = iNewSize;
    first = last = INVALID_SLOT;
    free = 0;
+   clockHand = 0;
+   ringFirst = ringLast = INVALID_SLOT;
+   numRing = numHot = 0;
+   InitHistory();
+   InitQueue();
 
    // Setup the new buffer table
    bufTable = pNewBufTable;
+   arena = pNewArena;
+   arenaSize = newArenaSize;
 
    // We must first remove from the hashtable any possible entries
    int slot, next, newSlot;
@@ -650,6 +765,10 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
       slot = next;
    }
 
+   // The hash table is empty now; size it for the new buffer
+   if ((rc = hashTable.Resize(iNewSize)))
+      return (rc);
+
    // Now we traverse through the old buffer table and copy any old
    // entries into the new one
    slot = oldFirst;
@@ -675,12 +794,66 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
       slot = next;
    }
 
-   // Finally, delete the old buffer table
+   // Finally, delete the old buffer table.  The old pages are freed too
+   // unless some were still pinned, since their clients point into them.
    delete [] pOldBufTable;
+   if (oldFirst == INVALID_SLOT)
+      FreeArena(pOldArena, oldArenaSize);
 
    return 0;
 }
 
+//
+// AllocArena
+//
+// Desc: Internal.  Map zeroed memory for numPages buffer pages laid out
+//       frameSize bytes apart.  Buffers of a huge page or more are taken
+//       from the huge pages reserved by the system if there are enough,
+//       and otherwise advised to be backed by transparent huge pages.
+// In:   numPages - the number of pages
+// Out:  size - the size of the memory mapped
+// Ret:  the memory, or NULL if there is not enough
+//
+char *PF_BufferMgr::AllocArena(int numPages, size_t &size) const
+{
+   void *mem = MAP_FAILED;
+   size = (size_t)numPages * frameSize;
+
+#ifdef MAP_HUGETLB
+   if (size >= (size_t)PF_HUGE_PAGE) {
+      size_t hugeSize = (size + PF_HUGE_PAGE - 1) / PF_HUGE_PAGE * PF_HUGE_PAGE;
+      mem = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (mem != MAP_FAILED)
+         size = hugeSize;
+   }
+#endif
+
+   if (mem == MAP_FAILED) {
+      mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED)
+         return (NULL);
+#ifdef MADV_HUGEPAGE
+      if (size >= (size_t)PF_HUGE_PAGE)
+         madvise(mem, size, MADV_HUGEPAGE);
+#endif
+   }
+
+   return ((char *)mem);
+}
+
+//
+// FreeArena
+//
+// Desc: Internal.  Unmap memory mapped by AllocArena
+// In:   arena - the memory
+//       size - its size, as set by AllocArena
+//
+void PF_BufferMgr::FreeArena(char *arena, size_t size) const
+{
+   munmap(arena, size);
+}
 
 //
 // InsertFree
@@ -691,6 +864,7 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
 //
 RC PF_BufferMgr::InsertFree(int slot)
 {
+   ReleaseSlot(slot);
    bufTable[slot].next = free;
    free = slot;
 
@@ -769,10 +943,11 @@ RC PF_BufferMgr::Unlink(int slot)
 //       If there is something on the free list, then use it.
 //       Otherwise, choose a victim to replace.  If a victim cannot be
 //       chosen (because all the pages are pinned), then return an error.
+// In:   pinHint - how the page that will be read into the slot is used
 // Out:  slot - set to newly-allocated slot
 // Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
 //
-RC PF_BufferMgr::InternalAlloc(int &slot)
+RC PF_BufferMgr::InternalAlloc(int &slot, ClientHint pinHint)
 {
    RC  rc;       // return code
 
@@ -783,26 +958,31 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
    }
    else {
 
-      // Choose the least-recently used page that is unpinned
-      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
-         if (bufTable[slot].pinCount == 0)
-            break;
-      }
+      // Choose an unpinned page to replace
+      if ((rc = ChooseVictim(slot, pinHint)))
+         return (rc);
 
-      // Return error if all buffers were pinned
-      if (slot == INVALID_SLOT)
-         return (PF_NOBUF);
+      // A read ahead of the page is no longer needed, but must land first
+      if (bufTable[slot].bInFlight)
+         FinishRead(slot);
 
       // Write out the page if it is dirty
-      if (bufTable[slot].bDirty) {
-         if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
-               bufTable[slot].pData)))
-            return (rc);
+      if (bufTable[slot].bDirty && (rc = WriteRun(slot)))
+         return (rc);
 
-         bufTable[slot].bDirty = FALSE;
-      }
+      // Remember when the page was last referenced
+      if (history[historyNext].lastRef != 0)
+         TakeHistory(history[historyNext].fd, history[historyNext].pageNum);
+      TakeHistory(bufTable[slot].fd, bufTable[slot].pageNum);
+      historyIndex.Insert(bufTable[slot].fd, bufTable[slot].pageNum,
+                          historyNext);
+      history[historyNext].fd = bufTable[slot].fd;
+      history[historyNext].pageNum = bufTable[slot].pageNum;
+      history[historyNext].lastRef = bufTable[slot].lastRef;
+      historyNext = (historyNext + 1) % numPages;
 
       // Remove page from the hash table and slot from the used buffer list
+      ReleaseSlot(slot);
       if ((rc = hashTable.Delete(bufTable[slot].fd, bufTable[slot].pageNum)) ||
             (rc = Unlink(slot)))
          return (rc);
@@ -816,6 +996,407 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
    return (0);
 }
 
+//
+// ChooseVictim
+//
+// Desc: Internal.  Choose the unpinned slot to replace, according to the
+//       replacement policy.  Only called when there are no free slots, so
+//       every slot holds a page.
+//       LRU takes the unpinned page nearest the end of the used list.
+//       CLOCK sweeps the slots from the hand, clearing reference bits,
+//       until it finds an unpinned page whose bit is clear.  Two turns
+//       are enough, since the first clears every bit.
+//       LRU-2 takes the unpinned page whose second-to-last reference is
+//       the oldest.  Pages referenced only once have none, so they go
+//       first, oldest first; a large scan then only replaces its own
+//       pages rather than pages used over and over, like upper index
+//       levels.
+//       The pages it may take in the first pass are kept in a queue
+//       ordered that way, so that it only looks at the head.
+//       A sequential scan whose ring is full takes the oldest unpinned
+//       ring page instead, leaving alone the pages read ahead for it.
+//       Every policy passes over hot pages and pages read ahead but not
+//       used yet while it can, see Replaceable.
+// In:   pinHint - how the page that will be read into the slot is used
+// Out:  slot - set to the chosen slot
+// Ret:  PF_NOBUF if all pages are pinned
+//
+RC PF_BufferMgr::ChooseVictim(int &slot, ClientHint pinHint)
+{
+   if (pinHint == SEQUENTIAL_SCAN && numRing >= PF_SCAN_RING) {
+      for (slot = ringLast; slot != INVALID_SLOT;
+            slot = bufTable[slot].ringPrev) {
+         if (bufTable[slot].pinCount == 0 && !bufTable[slot].bReadAhead)
+            return (0);
+      }
+   }
+
+   for (int pass = 0; pass < 3; pass++) {
+      slot = INVALID_SLOT;
+      switch (policy) {
+      case PF_LRU:
+         for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
+            if (Replaceable(slot, pass))
+               break;
+         }
+         break;
+
+      case PF_CLOCK:
+         for (int i = 0; i < 2 * numPages; i++) {
+            int hand = clockHand;
+            clockHand = (clockHand + 1) % numPages;
+            if (!Replaceable(hand, pass))
+               continue;
+            if (bufTable[hand].bReferenced) {
+               bufTable[hand].bReferenced = FALSE;
+               continue;
+            }
+            slot = hand;
+            break;
+         }
+         break;
+
+      case PF_LRU2:
+         if (pass == 0) {
+            if (queueSize > 0)
+               slot = queue[0];
+            break;
+         }
+         for (int i = 0; i < numPages; i++) {
+            if (!Replaceable(i, pass))
+               continue;
+            if (slot == INVALID_SLOT ||
+                  bufTable[i].prevRef < bufTable[slot].prevRef ||
+                  (bufTable[i].prevRef == bufTable[slot].prevRef &&
+                  bufTable[i].lastRef < bufTable[slot].lastRef))
+               slot = i;
+         }
+         break;
+      }
+
+      // Return ok
+      if (slot != INVALID_SLOT)
+         return (0);
+   }
+
+   // Return error if all buffers were pinned
+   return (PF_NOBUF);
+}
+
+//
+// Replaceable
+//
+// Desc: Internal.  Whether ChooseVictim may replace a slot in the given
+//       pass.  The first pass keeps hot pages and pages read ahead that
+//       have not been used yet, the second only pages still being read,
+//       and the last takes any unpinned page.
+// In:   slot - the slot
+//       pass - 0, 1 or 2
+// Ret:  TRUE if the slot may be replaced
+//
+int PF_BufferMgr::Replaceable(int slot, int pass) const
+{
+   if (bufTable[slot].pinCount > 0)
+      return (FALSE);
+   if (pass == 0)
+      return (!bufTable[slot].bHot && !bufTable[slot].bReadAhead);
+   if (pass == 1)
+      return (!bufTable[slot].bInFlight);
+   return (TRUE);
+}
+
+//
+// ApplyHint
+//
+// Desc: Internal.  Apply the hint a page was pinned with.  A page of the
+//       scan ring that is used other than by a sequential scan leaves the
+//       ring, and one used by the scan again becomes its newest page.  A
+//       KEEP_HOT page becomes hot, unless half of the buffer is hot
+//       already, so that the other pages always have room.
+// In:   slot - slot of the page, which is pinned
+//       pinHint - the hint the page was pinned with
+//
+void PF_BufferMgr::ApplyHint(int slot, ClientHint pinHint)
+{
+   if (bufTable[slot].bScanRing) {
+      LeaveRing(slot);
+      if (pinHint == SEQUENTIAL_SCAN)
+         JoinRing(slot);
+   }
+
+   if (pinHint == KEEP_HOT && !bufTable[slot].bHot && numHot < numPages / 2) {
+      bufTable[slot].bHot = TRUE;
+      numHot++;
+   }
+}
+
+//
+// ReleaseSlot
+//
+// Desc: Internal.  Forget the page of a slot that is freed or replaced:
+//       take it out of the LRU-2 queue and the scan ring, and out of the
+//       count of hot pages.  Slots without a page are never in them.
+// In:   slot - the slot
+//
+void PF_BufferMgr::ReleaseSlot(int slot)
+{
+   DequeueSlot(slot);
+   if (bufTable[slot].bScanRing)
+      LeaveRing(slot);
+   if (bufTable[slot].bHot) {
+      bufTable[slot].bHot = FALSE;
+      numHot--;
+   }
+}
+
+//
+// JoinRing
+//
+// Desc: Internal.  Add the page of a slot to the scan ring as its newest
+//       page
+// In:   slot - the slot, which is not in the ring
+//
+void PF_BufferMgr::JoinRing(int slot)
+{
+   bufTable[slot].bScanRing = TRUE;
+   bufTable[slot].ringPrev = INVALID_SLOT;
+   bufTable[slot].ringNext = ringFirst;
+   if (ringFirst != INVALID_SLOT)
+      bufTable[ringFirst].ringPrev = slot;
+   ringFirst = slot;
+   if (ringLast == INVALID_SLOT)
+      ringLast = slot;
+   numRing++;
+}
+
+//
+// LeaveRing
+//
+// Desc: Internal.  Take the page of a slot out of the scan ring
+// In:   slot - the slot, which is in the ring
+//
+void PF_BufferMgr::LeaveRing(int slot)
+{
+   int next = bufTable[slot].ringNext;
+   int prev = bufTable[slot].ringPrev;
+   if (prev != INVALID_SLOT)
+      bufTable[prev].ringNext = next;
+   else
+      ringFirst = next;
+   if (next != INVALID_SLOT)
+      bufTable[next].ringPrev = prev;
+   else
+      ringLast = prev;
+   bufTable[slot].bScanRing = FALSE;
+   numRing--;
+}
+
+//
+// QueueSlot
+//
+// Desc: Internal.  Add a slot to the LRU-2 queue if LRU-2 is the policy
+//       and the first pass of ChooseVictim may replace its page: it is
+//       unpinned, not hot, and not read ahead without being used.
+// In:   slot - the slot, which holds a page
+//
+void PF_BufferMgr::QueueSlot(int slot)
+{
+   if (policy != PF_LRU2 || bufTable[slot].queuePos != INVALID_SLOT ||
+         !Replaceable(slot, 0))
+      return;
+   bufTable[slot].queuePos = queueSize;
+   queue[queueSize++] = slot;
+   SiftUp(queueSize - 1);
+}
+
+//
+// DequeueSlot
+//
+// Desc: Internal.  Take a slot out of the LRU-2 queue, if it is in it.
+//       The last slot of the heap takes its place.
+// In:   slot - the slot
+//
+void PF_BufferMgr::DequeueSlot(int slot)
+{
+   int pos = bufTable[slot].queuePos;
+   if (pos == INVALID_SLOT)
+      return;
+   bufTable[slot].queuePos = INVALID_SLOT;
+   if (pos == --queueSize)
+      return;
+   queue[pos] = queue[queueSize];
+   bufTable[queue[pos]].queuePos = pos;
+   SiftUp(pos);
+   SiftDown(bufTable[queue[pos]].queuePos);
+}
+
+//
+// InitQueue
+//
+// Desc: Internal.  Allocate an empty LRU-2 queue for as many slots as
+//       there are pages in the buffer, and fill it from the used list
+//       if LRU-2 is the policy
+//
+void PF_BufferMgr::InitQueue()
+{
+   delete [] queue;
+   queue = new int[numPages];
+   queueSize = 0;
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      bufTable[slot].queuePos = INVALID_SLOT;
+      QueueSlot(slot);
+   }
+}
+
+//
+// QueueBefore
+//
+// Desc: Internal.  Whether LRU-2 replaces the page of slot1 before that of
+//       slot2: its second-to-last reference is older, or it is as old and
+//       its last reference is older
+//
+int PF_BufferMgr::QueueBefore(int slot1, int slot2) const
+{
+   return (bufTable[slot1].prevRef < bufTable[slot2].prevRef ||
+           (bufTable[slot1].prevRef == bufTable[slot2].prevRef &&
+           bufTable[slot1].lastRef < bufTable[slot2].lastRef));
+}
+
+//
+// SiftUp
+//
+// Desc: Internal.  Move the slot at pos of the LRU-2 queue up the heap
+//       until its parent comes before it
+//
+void PF_BufferMgr::SiftUp(int pos)
+{
+   int slot = queue[pos];
+   while (pos > 0 && QueueBefore(slot, queue[(pos - 1) / 2])) {
+      queue[pos] = queue[(pos - 1) / 2];
+      bufTable[queue[pos]].queuePos = pos;
+      pos = (pos - 1) / 2;
+   }
+   queue[pos] = slot;
+   bufTable[slot].queuePos = pos;
+}
+
+//
+// SiftDown
+//
+// Desc: Internal.  Move the slot at pos of the LRU-2 queue down the heap
+//       until it comes before its children
+//
+void PF_BufferMgr::SiftDown(int pos)
+{
+   int slot = queue[pos];
+   while (2 * pos + 1 < queueSize) {
+      int child = 2 * pos + 1;
+      if (child + 1 < queueSize && QueueBefore(queue[child + 1], queue[child]))
+         child++;
+      if (!QueueBefore(queue[child], slot))
+         break;
+      queue[pos] = queue[child];
+      bufTable[queue[pos]].queuePos = pos;
+      pos = child;
+   }
+   queue[pos] = slot;
+   bufTable[slot].queuePos = pos;
+}
+
+//
+// Reference
+//
+// Desc: Internal.  Note a reference to a page found in the buffer, before
+//       it is pinned again.  Only LRU moves the page in the used list;
+//       CLOCK sets its reference bit, and LRU-2 records the time.  With
+//       LRU-2, a reference to a page that is still pinned is taken to be
+//       part of the same use of the page as the one that pinned it, so
+//       it only moves the time of the last reference.
+// In:   slot - slot of the page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Reference(int slot)
+{
+   RC rc;
+
+   switch (policy) {
+   case PF_LRU:
+      // Make this page the most recently used page
+      if ((rc = Unlink(slot)) ||
+            (rc = LinkHead (slot)))
+         return (rc);
+      break;
+
+   case PF_CLOCK:
+      bufTable[slot].bReferenced = TRUE;
+      break;
+
+   case PF_LRU2:
+      if (bufTable[slot].pinCount == 0)
+         bufTable[slot].prevRef = bufTable[slot].lastRef;
+      bufTable[slot].lastRef = ++refTime;
+      break;
+   }
+
+   // Return ok
+   return (0);
+}
+
+//
+// InitHistory
+//
+// Desc: Internal.  Allocate an empty history of replaced pages, with as
+//       many entries as there are pages in the buffer
+//
+void PF_BufferMgr::InitHistory()
+{
+   delete [] history;
+   history = new PF_RefHistory[numPages];
+   for (int i = 0; i < numPages; i++)
+      history[i].lastRef = 0;
+   historyNext = 0;
+   historyIndex.Clear();
+   historyIndex.Resize(numPages);
+}
+
+//
+// TakeHistory
+//
+// Desc: Internal.  Look up a page in the history of replaced pages, and
+//       remove it from the history
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  time of the last reference of the page, or 0 if it is not in
+//       the history
+//
+long PF_BufferMgr::TakeHistory(int fd, PageNum pageNum)
+{
+   int i;
+   if (historyIndex.Find(fd, pageNum, i))
+      return (0);
+   historyIndex.Delete(fd, pageNum);
+   long lastRef = history[i].lastRef;
+   history[i].lastRef = 0;
+   return (lastRef);
+}
+
+//
+// SetPolicy
+//
+// Desc: Set the page replacement policy.  Pages already in the buffer
+//       keep their place; their reference bits and times were kept up
+//       to date whatever the policy was.  The LRU-2 queue is only kept
+//       under LRU-2, so it is rebuilt.
+// In:   policy - the new policy
+// Ret:  Always returns 0
+//
+RC PF_BufferMgr::SetPolicy(PF_BufferPolicy policy)
+{
+   this->policy = policy;
+   InitQueue();
+   return (0);
+}
+
 //
 // ReadPage
 //
@@ -840,14 +1421,151 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
    pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
+   // Read the data at the place of the page (cast to long for PC's)
    long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
+   int numBytes = pread(fd, dest, pageSize, offset);
+   if (numBytes < 0)
       return (PF_UNIX);
+   else if (numBytes != pageSize)
+      return (PF_INCOMPLETEREAD);
+   else
+      return (0);
+}
 
-   // Read the data
-   int numBytes = read(fd, dest, pageSize);
-   if (numBytes < 0)
+//
+// ReadAhead
+//
+// Desc: Internal.  Note that a page has been asked for, and read ahead if
+//       it continues a sequential stream of pages of its file.  Up to
+//       PF_READAHEAD_PAGES pages past it are started reading in the
+//       background, once half of those read ahead before have been used.
+//       Only pages that are in the file and not in the buffer are read,
+//       and the slots for them are taken as for pages of the reader.
+//       Reading ahead is only a hint, so it gives up quietly on errors;
+//       the read of the page itself reports them.
+// In:   fd - OS file descriptor of the page
+//       pageNum - the page asked for
+//       pinHint - the hint it was asked for with
+//
+void PF_BufferMgr::ReadAhead(int fd, PageNum pageNum, ClientHint pinHint)
+{
+   if (fd < 0 || pinHint == RANDOM || pinHint == KEEP_HOT)
+      return;
+
+   // Find the stream this page continues.  Asking for the last page
+   // again leaves the stream as it is.
+   int i;
+   for (i = 0; i < PF_READ_STREAMS; i++) {
+      if (streams[i].fd != fd)
+         continue;
+      if (streams[i].nextPage == pageNum + 1)
+         return;
+      if (streams[i].nextPage == pageNum)
+         break;
+   }
+
+   // Otherwise start a new stream in place of the oldest one
+   if (i == PF_READ_STREAMS) {
+      i = nextStream;
+      nextStream = (nextStream + 1) % PF_READ_STREAMS;
+      streams[i].fd = fd;
+      streams[i].nextPage = pageNum + 1;
+      streams[i].readAhead = pageNum + 1;
+      return;
+   }
+   streams[i].nextPage = pageNum + 1;
+   if (streams[i].readAhead > pageNum + PF_READAHEAD_PAGES / 2)
+      return;
+
+   // Pages past the end of the file on disk have never been written
+   struct stat fileStat;
+   if (fstat(fd, &fileStat) < 0)
+      return;
+   PageNum filePages = (fileStat.st_size - PF_FILE_HDR_SIZE) / pageSize;
+   PageNum lastPage = min(pageNum + PF_READAHEAD_PAGES, filePages - 1);
+
+   // Pages of the next extent may belong to another shard of the pool
+   lastPage = min(lastPage, (pageNum / PF_SHARD_EXTENT + 1) * PF_SHARD_EXTENT - 1);
+
+   PageNum page;
+   for (page = max(streams[i].readAhead, pageNum + 1); page <= lastPage;
+         page++) {
+      int slot;
+      RC rc = hashTable.Find(fd, page, slot);
+      if (rc != PF_HASHNOTFOUND) {
+         if (rc)
+            break;
+         continue;
+      }
+
+      if (InternalAlloc(slot, pinHint))
+         break;
+      if (hashTable.Insert(fd, page, slot)) {
+         Unlink(slot);
+         InsertFree(slot);
+         break;
+      }
+      InitPageDesc(fd, page, slot);
+      bufTable[slot].pinCount = 0;
+      if (pinHint == SEQUENTIAL_SCAN)
+         JoinRing(slot);
+      if (StartRead(slot)) {
+         hashTable.Delete(fd, page);
+         Unlink(slot);
+         InsertFree(slot);
+         break;
+      }
+   }
+   streams[i].readAhead = page;
+}
+
+//
+// StartRead
+//
+// Desc: Internal.  Start reading the page of a slot in the background.
+//       The page stays marked in flight until FinishRead.
+// In:   slot - the slot, whose fd and pageNum are set
+// Ret:  PF_UNIX if the read could not be started
+//
+RC PF_BufferMgr::StartRead(int slot)
+{
+#ifdef PF_STATS
+   pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+   pStatisticsMgr->Register(PF_READAHEAD, STAT_ADDONE);
+#endif
+
+   struct aiocb *req = &bufTable[slot].readReq;
+   memset(req, 0, sizeof(struct aiocb));
+   req->aio_fildes = bufTable[slot].fd;
+   req->aio_offset = bufTable[slot].pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
+   req->aio_buf = bufTable[slot].pData;
+   req->aio_nbytes = pageSize;
+   if (aio_read(req) < 0)
+      return (PF_UNIX);
+
+   bufTable[slot].bReadAhead = TRUE;
+   bufTable[slot].bInFlight = TRUE;
+   return (0);
+}
+
+//
+// FinishRead
+//
+// Desc: Internal.  Wait for the background read of a slot to complete.
+// In:   slot - the slot, which is in flight
+// Ret:  PF_UNIX or PF_INCOMPLETEREAD if the read failed
+//
+RC PF_BufferMgr::FinishRead(int slot)
+{
+   struct aiocb *req = &bufTable[slot].readReq;
+   const struct aiocb *reqs[1] = { req };
+   int error;
+   while ((error = aio_error(req)) == EINPROGRESS)
+      aio_suspend(reqs, 1, NULL);
+   bufTable[slot].bInFlight = FALSE;
+
+   ssize_t numBytes = aio_return(req);
+   if (error != 0 || numBytes < 0)
       return (PF_UNIX);
    else if (numBytes != pageSize)
       return (PF_INCOMPLETEREAD);
@@ -856,41 +1574,116 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 }
 
 //
-// WritePage
+// WritePages
 //
-// Desc: Write a page to disk
+// Desc: Write pages to disk and mark them clean.  Each run of consecutive
+//       page numbers, up to PF_WRITE_RUN pages long, is written with one
+//       call.  The pages are logged first, and the log is forced up to
+//       their LSNs before the run is written.
 //
 // In:   fd - OS file descriptor
-//       pageNum - number of page to write
-//       dest - pointer to buffer containing page contents
+//       slots - slots of the pages to write, sorted on page number
+//       numSlots - number of slots
 // Ret:  PF return code
 //
-RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+RC PF_BufferMgr::WritePages(int fd, const int *slots, int numSlots)
 {
+   RC rc;
+   struct iovec iov[PF_WRITE_RUN];
+
+   int start = 0;
+   while (start < numSlots) {
+
+      // Find the end of the run of consecutive pages
+      int end = start + 1;
+      while (end < numSlots && end - start < PF_WRITE_RUN &&
+            bufTable[slots[end]].pageNum == bufTable[slots[end - 1]].pageNum + 1)
+         end++;
 
 #ifdef PF_LOG
-   char psMessage[100];
-   sprintf (psMessage, "Writing (%d,%d).\n", fd, pageNum);
-   WriteLog(psMessage);
+      char psMessage[100];
+      sprintf (psMessage, "Writing (%d,%d) to (%d,%d).\n", fd,
+            bufTable[slots[start]].pageNum, fd, bufTable[slots[end - 1]].pageNum);
+      WriteLog(psMessage);
 #endif
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
+      int numWritten = end - start;
+      pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDVALUE, &numWritten);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
+      if (pLog != NULL) {
+         PF_LSN lsn = 0;
+         for (int i = start; i < end; i++) {
+            char *pData = bufTable[slots[i]].pData;
+            if ((rc = pLog->LogWrite(fd, bufTable[slots[i]].pageNum, pData)))
+               return (rc);
+            lsn = max(lsn, ((PF_PageHdr *)pData)->lsn);
+         }
+         if ((rc = pLog->Force(lsn)))
+            return (rc);
+      }
 
-   // Read the data
-   int numBytes = write(fd, source, pageSize);
-   if (numBytes < 0)
-      return (PF_UNIX);
-   else if (numBytes != pageSize)
-      return (PF_INCOMPLETEWRITE);
-   else
-      return (0);
+      for (int i = start; i < end; i++) {
+         iov[i - start].iov_base = bufTable[slots[i]].pData;
+         iov[i - start].iov_len = pageSize;
+      }
+
+      // Write the run at the place of its first page (cast to long for PC's)
+      long offset = bufTable[slots[start]].pageNum * (long)pageSize +
+            PF_FILE_HDR_SIZE;
+      long numBytes = pwritev(fd, iov, end - start, offset);
+      if (numBytes < 0)
+         return (PF_UNIX);
+      else if (numBytes != (end - start) * (long)pageSize)
+         return (PF_INCOMPLETEWRITE);
+
+      for (int i = start; i < end; i++)
+         bufTable[slots[i]].bDirty = FALSE;
+      start = end;
+   }
+
+   // Return ok
+   return (0);
+}
+
+//
+// WriteRun
+//
+// Desc: Internal.  Write a dirty page that is being replaced, along with
+//       the dirty unpinned pages of its file just before and after it in
+//       the buffer, which are likely to be replaced soon too.  The
+//       neighbours stay in the buffer, only clean.  Pinned pages are left
+//       alone, since they may still be changing.
+// In:   slot - the slot of the dirty page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WriteRun(int slot)
+{
+   int fd = bufTable[slot].fd;
+   PageNum pageNum = bufTable[slot].pageNum;
+   int run[PF_WRITE_RUN];
+   int neighbour;
+
+   // Go back to the first page of the run
+   PageNum firstPage = pageNum;
+   while (pageNum - firstPage < PF_WRITE_RUN - 1 &&
+         !hashTable.Find(fd, firstPage - 1, neighbour) &&
+         bufTable[neighbour].bDirty && bufTable[neighbour].pinCount == 0)
+      firstPage--;
+
+   // Then collect the run forward from there
+   int numSlots = 0;
+   for (PageNum page = firstPage; numSlots < PF_WRITE_RUN; page++) {
+      if (page == pageNum)
+         neighbour = slot;
+      else if (hashTable.Find(fd, page, neighbour) ||
+            !bufTable[neighbour].bDirty || bufTable[neighbour].pinCount > 0)
+         break;
+      run[numSlots++] = neighbour;
+   }
+
+   return (WritePages(fd, run, numSlots));
 }
 
 //
@@ -910,6 +1703,15 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
    bufTable[slot].bDirty   = FALSE;
    bufTable[slot].pinCount = 1;
 
+   // A newly read page has no reference bit set, so that CLOCK replaces
+   // it at the next turn unless it is referenced again.  For LRU-2 it has
+   // only been referenced once, unless it was replaced recently.
+   bufTable[slot].bReferenced = FALSE;
+   bufTable[slot].lastRef  = ++refTime;
+   bufTable[slot].bReadAhead = FALSE;
+   bufTable[slot].bInFlight = FALSE;
+   bufTable[slot].prevRef  = TakeHistory(fd, pageNum);
+
    // Return ok
    return (0);
 }
@@ -950,8 +1752,10 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
    if ((rc = InternalAlloc(slot)) != OK_RC)
       return rc;
 
-   // Create artificial page number (just needs to be unique for hash table)
-   PageNum pageNum = PageNum(atoi(bufTable[slot].pData));
+   // Create artificial page number (just needs to be unique for hash table).
+   // No other page can be held in this slot, so the slot number is unique.
+   // It is offset by one so that it hashes to a valid bucket with MEMORY_FD.
+   PageNum pageNum = PageNum(slot + 1);
 
    // Insert the page into the hash table, and initialize the page description entry
    if ((rc = hashTable.Insert(MEMORY_FD, pageNum, slot) != OK_RC) ||
@@ -976,5 +1780,12 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
 //
 RC PF_BufferMgr::DisposeBlock(char* buffer)
 {
-   return UnpinPage(MEMORY_FD, PageNum(atoi(buffer)));
+   // The slot holding the block follows from where it is in the arena,
+   // and gives back its page number
+   if (buffer < arena || buffer >= arena + (size_t)numPages * frameSize)
+      return (PF_PAGENOTINBUF);
+   int slot = (buffer - arena) / frameSize;
+   if (bufTable[slot].pData != buffer || bufTable[slot].fd != MEMORY_FD)
+      return (PF_PAGENOTINBUF);
+   return UnpinPage(MEMORY_FD, bufTable[slot].pageNum);
 }
@@ -0,0 +1,431 @@
+//
+// File:        pf_bufferpool.cc
+// Description: PF_BufferPool class implementation
+//
+
+#include <iostream>
+#include <algorithm>
+#include "pf_bufferpool.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"   // For StatisticsMgr interface
+
+extern StatisticsMgr *pStatisticsMgr;
+
+// Number of pools alive. Besides the pool of the main PF_Manager, query
+// nodes make private pools for their temporary files, which must neither
+// replace nor delete the statistics the main pool is counting into.
+static int numPools = 0;
+static mutex poolsLatch;
+#endif
+
+//
+// PF_BufferPool
+//
+// Desc: Constructor - called by PF_Manager::PF_Manager
+//       The pool is split into as many shards as it has PF_SHARD_PAGES
+//       pages, up to PF_BUFFER_SHARDS.
+// In:   numPages - the number of pages in the buffer
+//
+// Note: The first pool constructed will initialize the global
+//       pStatisticsMgr, which the shards of all pools share.
+//
+PF_BufferPool::PF_BufferPool(int numPages)
+{
+#ifdef PF_STATS
+   // Initialize the global variable for the statistics manager
+   {
+      lock_guard<mutex> guard(poolsLatch);
+      if (numPools++ == 0)
+         pStatisticsMgr = new StatisticsMgr();
+   }
+#endif
+
+   policy = PF_LRU;
+   pLog = NULL;
+   nextBlockShard = 0;
+   CreateShards(numPages);
+}
+
+//
+// ~PF_BufferPool
+//
+// Desc: Destructor - called by PF_Manager::~PF_Manager
+//
+PF_BufferPool::~PF_BufferPool()
+{
+   DestroyShards();
+
+#ifdef PF_STATS
+   // Destroy the global statistics manager with the last pool
+   lock_guard<mutex> guard(poolsLatch);
+   if (--numPools == 0) {
+      delete pStatisticsMgr;
+      pStatisticsMgr = NULL;
+   }
+#endif
+}
+
+//
+// GetPage
+//
+// Desc: Get a pointer to a page pinned in the buffer.  See
+//       PF_BufferMgr::GetPage.
+//
+RC PF_BufferPool::GetPage(int fd, PageNum pageNum, char **ppBuffer,
+                          int bMultiplePins, ClientHint pinHint)
+{
+   PF_BufferShard &shard = Shard(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+   return (shard.pBufferMgr->GetPage(fd, pageNum, ppBuffer, bMultiplePins,
+                                     pinHint));
+}
+
+//
+// AllocatePage
+//
+// Desc: Allocate a new page in the buffer.  See
+//       PF_BufferMgr::AllocatePage.
+//
+RC PF_BufferPool::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
+{
+   PF_BufferShard &shard = Shard(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+   return (shard.pBufferMgr->AllocatePage(fd, pageNum, ppBuffer));
+}
+
+//
+// MarkDirty
+//
+// Desc: Mark a page dirty.  See PF_BufferMgr::MarkDirty.
+//
+RC PF_BufferPool::MarkDirty(int fd, PageNum pageNum)
+{
+   PF_BufferShard &shard = Shard(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+   return (shard.pBufferMgr->MarkDirty(fd, pageNum));
+}
+
+//
+// UnpinPage
+//
+// Desc: Unpin a page.  See PF_BufferMgr::UnpinPage.
+//
+RC PF_BufferPool::UnpinPage(int fd, PageNum pageNum)
+{
+   PF_BufferShard &shard = Shard(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+   return (shard.pBufferMgr->UnpinPage(fd, pageNum));
+}
+
+//
+// FlushPages
+//
+// Desc: Release all pages of a file from every shard, writing the dirty
+//       ones.  See PF_BufferMgr::FlushPages.
+// In:   fd - file descriptor
+// Ret:  PF_PAGEPINNED if some pages were pinned, other PF return code
+//       otherwise
+//
+RC PF_BufferPool::FlushPages(int fd)
+{
+   RC rc, rcWarn = 0;
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->FlushPages(fd))) {
+         if (rc != PF_PAGEPINNED)
+            return (rc);
+         rcWarn = rc;
+      }
+   }
+
+   // Return warning or ok
+   return (rcWarn);
+}
+
+//
+// ForcePages
+//
+// Desc: Write a dirty page, or all dirty pages of a file, to disk.  See
+//       PF_BufferMgr::ForcePages.
+//
+RC PF_BufferPool::ForcePages(int fd, PageNum pageNum)
+{
+   RC rc;
+
+   if (pageNum != ALL_PAGES) {
+      PF_BufferShard &shard = Shard(fd, pageNum);
+      lock_guard<mutex> guard(shard.latch);
+      return (shard.pBufferMgr->ForcePages(fd, pageNum));
+   }
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->ForcePages(fd, pageNum)))
+         return (rc);
+   }
+   return (0);
+}
+
+//
+// SetLog
+//
+// Desc: Set the write-ahead log that every shard logs pages to before
+//       writing them, or NULL.  Shards created later get it too.
+//
+void PF_BufferPool::SetLog(PF_Log *pLog)
+{
+   this->pLog = pLog;
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      shards[i].pBufferMgr->SetLog(pLog);
+   }
+}
+
+//
+// LogPage
+//
+// Desc: Log a dirty page for a commit.  See PF_BufferMgr::LogPage.
+//
+RC PF_BufferPool::LogPage(int fd, PageNum pageNum)
+{
+   PF_BufferShard &shard = Shard(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+   return (shard.pBufferMgr->LogPage(fd, pageNum));
+}
+
+//
+// ClearBuffer
+//
+// Desc: Remove all unpinned pages from every shard
+//
+RC PF_BufferPool::ClearBuffer()
+{
+   RC rc;
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->ClearBuffer()))
+         return (rc);
+   }
+   return (0);
+}
+
+//
+// PrintBuffer
+//
+// Desc: Display the pages of every shard
+//
+RC PF_BufferPool::PrintBuffer()
+{
+   RC rc;
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if (numShards > 1)
+         cout << "Shard " << i << ":\n";
+      if ((rc = shards[i].pBufferMgr->PrintBuffer()))
+         return (rc);
+   }
+   return (0);
+}
+
+//
+// ResizeBuffer
+//
+// Desc: Resize the pool.  If the new size calls for another number of
+//       shards, the shards are replaced, which is only possible once no
+//       page is left pinned in them; otherwise each shard is resized.
+// In:   iNewSize - the new number of pages
+// Ret:  PF return code
+//
+RC PF_BufferPool::ResizeBuffer(int iNewSize)
+{
+   RC rc;
+
+   if (NumShards(iNewSize) != numShards) {
+      int bEmpty = TRUE;
+      for (int i = 0; i < numShards; i++) {
+         if ((rc = shards[i].pBufferMgr->ClearBuffer()))
+            return (rc);
+         if (!shards[i].pBufferMgr->IsEmpty())
+            bEmpty = FALSE;
+      }
+      if (bEmpty) {
+         DestroyShards();
+         CreateShards(iNewSize);
+         return (0);
+      }
+   }
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->ResizeBuffer(ShardPages(iNewSize, i))))
+         return (rc);
+   }
+   return (0);
+}
+
+//
+// ReserveBuffer
+//
+// Desc: Resize the pool so that numBlocks blocks, spread over the shards
+//       by AllocateBlock, leave numPages pages in every shard.  The size
+//       depends on the number of shards, which depends on the size, so
+//       the first number of shards that the resulting size calls for is
+//       taken.  Each shard is given one block more than its share, as
+//       the round robin may start anywhere.
+// In:   numBlocks - the number of blocks
+//       numPages - the pages every shard must keep besides
+// Ret:  PF return code
+//
+RC PF_BufferPool::ReserveBuffer(int numBlocks, int numPages)
+{
+   int size = 0;
+
+   for (int n = 1; n <= PF_BUFFER_SHARDS; n++) {
+      size = n * ((numBlocks + n - 1) / n + 1 + numPages);
+      if (NumShards(size) == n)
+         break;
+   }
+   return (ResizeBuffer(size));
+}
+
+//
+// SetPolicy
+//
+// Desc: Set the page replacement policy of every shard
+// In:   policy - the new policy
+// Ret:  PF return code
+//
+RC PF_BufferPool::SetPolicy(PF_BufferPolicy policy)
+{
+   RC rc;
+
+   this->policy = policy;
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->SetPolicy(policy)))
+         return (rc);
+   }
+   return (0);
+}
+
+//
+// GetBlockSize
+//
+// Desc: Return the size of the block that can be allocated
+//
+RC PF_BufferPool::GetBlockSize(int &length) const
+{
+   return (shards[0].pBufferMgr->GetBlockSize(length));
+}
+
+//
+// AllocateBlock
+//
+// Desc: Allocate a block in the pool.  Blocks are taken from the shards
+//       in turn, so that they are spread evenly, and a full shard is
+//       passed over.
+// Out:  buffer - the block
+// Ret:  PF_NOBUF if every shard is full, other PF return code otherwise
+//
+RC PF_BufferPool::AllocateBlock(char *&buffer)
+{
+   RC rc = PF_NOBUF;
+   int first = nextBlockShard++ % numShards;
+
+   for (int i = 0; i < numShards && rc == PF_NOBUF; i++) {
+      PF_BufferShard &shard = shards[(first + i) % numShards];
+      lock_guard<mutex> guard(shard.latch);
+      rc = shard.pBufferMgr->AllocateBlock(buffer);
+   }
+   return (rc);
+}
+
+//
+// DisposeBlock
+//
+// Desc: Free a block allocated by AllocateBlock, in whichever shard
+//       holds it
+// In:   buffer - the block
+// Ret:  PF return code
+//
+RC PF_BufferPool::DisposeBlock(char *buffer)
+{
+   RC rc;
+
+   for (int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].latch);
+      if ((rc = shards[i].pBufferMgr->DisposeBlock(buffer)) != PF_PAGENOTINBUF)
+         return (rc);
+   }
+   return (PF_PAGENOTINBUF);
+}
+
+//
+// Shard
+//
+// Desc: Internal.  Return the shard holding a page.  The file and the
+//       extent of the page are mixed as in PF_HashTable, and the top bits
+//       of the result are scaled to the number of shards.
+//
+PF_BufferShard &PF_BufferPool::Shard(int fd, PageNum pageNum)
+{
+   unsigned long long key = ((unsigned long long)(unsigned int)fd << 32) |
+      (unsigned int)(pageNum / PF_SHARD_EXTENT);
+   key *= 0x9E3779B97F4A7C15ULL;
+   return (shards[((key >> 32) * numShards) >> 32]);
+}
+
+//
+// NumShards
+//
+// Desc: Internal.  Return the number of shards of a pool of numPages
+//
+int PF_BufferPool::NumShards(int numPages)
+{
+   return (max(1, min(PF_BUFFER_SHARDS, numPages / PF_SHARD_PAGES)));
+}
+
+//
+// ShardPages
+//
+// Desc: Internal.  Return the number of pages of a shard when the pool
+//       has numPages pages, shared out evenly between the shards in use
+//
+int PF_BufferPool::ShardPages(int numPages, int shard) const
+{
+   return (max(1, numPages / numShards + (shard < numPages % numShards)));
+}
+
+//
+// CreateShards
+//
+// Desc: Internal.  Create the shards of a pool of numPages
+//
+void PF_BufferPool::CreateShards(int numPages)
+{
+   numShards = NumShards(numPages);
+   for (int i = 0; i < numShards; i++) {
+      shards[i].pBufferMgr = new PF_BufferMgr(ShardPages(numPages, i));
+      shards[i].pBufferMgr->SetPolicy(policy);
+      shards[i].pBufferMgr->SetLog(pLog);
+   }
+}
+
+//
+// DestroyShards
+//
+// Desc: Internal.  Destroy the shards
+//
+void PF_BufferPool::DestroyShards()
+{
+   for (int i = 0; i < numShards; i++) {
+      delete shards[i].pBufferMgr;
+      shards[i].pBufferMgr = NULL;
+   }
+}
@@ -25,7 +25,9 @@ static char *PF_WarnMsg[] = {
   (char*)"page already unpinned",
   (char*)"end of file",
   (char*)"attempting to resize the buffer too small",
-  (char*)"invalid filename"
+  (char*)"file is opened read only",
+  (char*)"a transaction has already begun",
+  (char*)"no transaction has begun"
 };
 
 static char *PF_ErrorMsg[] = {
@@ -38,7 +40,8 @@ static char *PF_ErrorMsg[] = {
   (char*)"new page to be allocated already in buffer",
   (char*)"hash table entry not found",
   (char*)"page already in hash table",
-  (char*)"invalid file name"
+  (char*)"invalid file name",
+  (char*)"file has an unknown format or version"
 };
 
 //
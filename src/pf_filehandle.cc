@@ -7,8 +7,10 @@
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include "pf_internal.h"
-#include "pf_buffermgr.h"
+#include "pf_bufferpool.h"
+#include "pf_log.h"
 
 //
 // PF_FileHandle
@@ -28,6 +30,10 @@ PF_FileHandle::PF_FileHandle()
    // Initialize local variables
    bFileOpen = FALSE;
    pBufferMgr = NULL;
+   pLog = NULL;
+   pMapping = NULL;
+   mappingSize = 0;
+   pMappedPins = NULL;
 }
 
 //
@@ -52,10 +58,14 @@ PF_FileHandle::PF_FileHandle(const PF_FileHandle &fileHandle)
 {
    // Just copy the data members since there is no memory allocation involved
    this->pBufferMgr  = fileHandle.pBufferMgr;
+   this->pLog        = fileHandle.pLog;
    this->hdr         = fileHandle.hdr;
    this->bFileOpen   = fileHandle.bFileOpen;
    this->bHdrChanged = fileHandle.bHdrChanged;
    this->unixfd      = fileHandle.unixfd;
+   this->pMapping    = fileHandle.pMapping;
+   this->mappingSize = fileHandle.mappingSize;
+   this->pMappedPins = fileHandle.pMappedPins;
 }
 
 //
@@ -74,10 +84,14 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 
       // Just copy the members since there is no memory allocation involved
       this->pBufferMgr  = fileHandle.pBufferMgr;
+      this->pLog        = fileHandle.pLog;
       this->hdr         = fileHandle.hdr;
       this->bFileOpen   = fileHandle.bFileOpen;
       this->bHdrChanged = fileHandle.bHdrChanged;
       this->unixfd      = fileHandle.unixfd;
+      this->pMapping    = fileHandle.pMapping;
+      this->mappingSize = fileHandle.mappingSize;
+      this->pMappedPins = fileHandle.pMappedPins;
    }
 
    // Return a reference to this
@@ -89,13 +103,15 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 //
 // Desc: Get the first page in a file
 //       The file handle must refer to an open file
+// In:   pinHint - how the page will be used, see GetThisPage
 // Out:  pageHandle - becomes a handle to the first page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
-   return (GetNextPage((PageNum)-1, pageHandle));
+   return (GetNextPage((PageNum)-1, pageHandle, pinHint));
 }
 
 //
@@ -112,6 +128,25 @@ RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
    return (GetPrevPage((PageNum)hdr.numPages, pageHandle));
 }
 
+//
+// GetNumPages
+//
+// Desc: Get the number of pages in the file, disposed pages included,
+//       so that page numbers range from 0 up to but not including it
+//       The file handle must refer to an open file
+// Out:  numPages - the number of pages
+// Ret:  PF return code
+//
+RC PF_FileHandle::GetNumPages(int &numPages) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   numPages = hdr.numPages;
+   return (0);
+}
+
 //
 // GetNextPage
 //
@@ -119,11 +154,13 @@ RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the next valid page after this page number
 //       current can refer to a page that has been disposed
+//       pinHint - how the page will be used, see GetThisPage
 // Out:  pageHandle - becomes a handle to the next page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
    int rc;               // return code
 
@@ -139,7 +176,7 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
    for (current++; current < hdr.numPages; current++) {
 
       // If this is a valid (used) page, we're done
-      if (!(rc = GetThisPage(current, pageHandle)))
+      if (!(rc = GetThisPage(current, pageHandle, pinHint)))
          return (0);
 
       // If unexpected error, return it
@@ -196,12 +233,19 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // Desc: Get a specific page in a file
 //       The file handle must refer to an open file
 // In:   pageNum - the number of the page to get
+//       pinHint - how the page will be used.  SEQUENTIAL_SCAN pages are
+//                 read into a small ring of buffer pages, KEEP_HOT pages
+//                 are the last to be replaced, and NO_HINT and RANDOM
+//                 pages are replaced according to the buffer policy.
 // Out:  pageHandle - becomes a handle to the this page of the file
 //                    this function modifies local var's in pageHandle
-//       The referenced page is pinned in the buffer pool.
+//       The referenced page is pinned in the buffer pool.  The pages of a
+//       mapped file are not copied: the handle points into the mapping,
+//       and pinning only counts the page as in use.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle,
+      ClientHint pinHint) const
 {
    int  rc;               // return code
    char *pPageBuf;        // address of page in buffer pool
@@ -214,8 +258,20 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // Point into the mapping of a mapped file
+   if (pMapping != NULL) {
+      pPageBuf = pMapping + PF_FILE_HDR_SIZE +
+         pageNum * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr));
+      if (((PF_PageHdr*)pPageBuf)->nextFree != PF_PAGE_USED)
+         return (PF_INVALIDPAGE);
+      __sync_fetch_and_add(pMappedPins, 1);
+      pageHandle.pageNum = pageNum;
+      pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+      return (0);
+   }
+
    // Get this page from the buffer manager
-   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf)))
+   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf, TRUE, pinHint)))
       return (rc);
 
    // If the page is valid, then set pageHandle to this page and return ok
@@ -256,6 +312,10 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // A mapped file can't grow
+   if (pMapping != NULL)
+      return (PF_READONLY);
+
    // If the free list isn't empty...
    if (hdr.firstFree != PF_PAGE_LIST_END) {
       pageNum = hdr.firstFree;
@@ -282,10 +342,15 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
 
       // Increment the number of pages for this file
       hdr.numPages++;
+
+      // A new page has not been logged yet
+      memset(pPageBuf, 0, sizeof(PF_PageHdr));
    }
 
    // Mark the header as changed
    bHdrChanged = TRUE;
+   if (pLog && (rc = pLog->LogHeader(unixfd, hdr)))
+      return (rc);
 
    // Mark this page as used
    ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
@@ -328,6 +393,10 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped file can't be changed
+   if (pMapping != NULL)
+      return (PF_READONLY);
+
    // Get the page (but don't re-pin it if it's already pinned)
    if ((rc = pBufferMgr->GetPage(unixfd,
          pageNum,
@@ -350,6 +419,8 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
    ((PF_PageHdr *)pPageBuf)->nextFree = hdr.firstFree;
    hdr.firstFree = pageNum;
    bHdrChanged = TRUE;
+   if (pLog && (rc = pLog->LogHeader(unixfd, hdr)))
+      return (rc);
 
    // Mark the page dirty because we changed the next pointer
    if ((rc = MarkDirty(pageNum)))
@@ -383,8 +454,19 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped file can't be changed
+   if (pMapping != NULL)
+      return (PF_READONLY);
+
    // Tell the buffer manager to mark the page dirty
-   return (pBufferMgr->MarkDirty(unixfd, pageNum));
+   RC rc;
+   if ((rc = pBufferMgr->MarkDirty(unixfd, pageNum)))
+      return (rc);
+
+   // Note the change for the transaction
+   if (pLog)
+      pLog->Touch(unixfd, pageNum);
+   return (0);
 }
 
 //
@@ -408,6 +490,15 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // Pages of a mapped file are only counted as pinned
+   if (pMapping != NULL) {
+      if (__sync_fetch_and_sub(pMappedPins, 1) <= 0) {
+         __sync_fetch_and_add(pMappedPins, 1);
+         return (PF_PAGEUNPINNED);
+      }
+      return (0);
+   }
+
    // Tell the buffer manager to unpin the page
    return (pBufferMgr->UnpinPage(unixfd, pageNum));
 }
@@ -426,9 +517,19 @@ RC PF_FileHandle::FlushPages() const
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Nothing of a mapped file is in the buffer pool
+   if (pMapping != NULL)
+      return (0);
+
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {
 
+      // Log it first, and force the log up to it
+      RC rc;
+      if (pLog && ((rc = pLog->LogWrite(unixfd, PF_HDR_PAGE, (char *)&hdr)) ||
+            (rc = pLog->Force(hdr.lsn))))
+         return (rc);
+
       // First seek to the appropriate place
       if (lseek(unixfd, 0, L_SET) < 0)
          return (PF_UNIX);
@@ -468,9 +569,19 @@ RC PF_FileHandle::ForcePages(PageNum pageNum) const
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Nothing of a mapped file is in the buffer pool
+   if (pMapping != NULL)
+      return (0);
+
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {
 
+      // Log it first, and force the log up to it
+      RC rc;
+      if (pLog && ((rc = pLog->LogWrite(unixfd, PF_HDR_PAGE, (char *)&hdr)) ||
+            (rc = pLog->Force(hdr.lsn))))
+         return (rc);
+
       // First seek to the appropriate place
       if (lseek(unixfd, 0, L_SET) < 0)
          return (PF_UNIX);
@@ -495,6 +606,19 @@ RC PF_FileHandle::ForcePages(PageNum pageNum) const
 }
 
 
+//
+// IsReadOnly
+//
+// Desc: Return TRUE if the file was opened as a read-only mapping, in
+//       which case pages can be read but not allocated, disposed of or
+//       marked dirty
+// Ret:  TRUE or FALSE
+//
+int PF_FileHandle::IsReadOnly() const
+{
+   return (pMapping != NULL);
+}
+
 //
 // IsValidPageNum
 //
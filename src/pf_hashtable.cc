@@ -13,19 +13,14 @@
 //
 // Desc: Constructor for PF_HashTable object, which allows search, insert,
 //       and delete of hash table entries.
-// In:   numBuckets - number of hash table buckets
+// In:   maxEntries - the most entries the table will hold
 //
-PF_HashTable::PF_HashTable(int _numBuckets)
+PF_HashTable::PF_HashTable(int _maxEntries)
 {
-  // Initialize numBuckets local variable from parameter
-  this->numBuckets = _numBuckets;
-
-  // Allocate memory for hash table
-  hashTable = new PF_HashEntry* [numBuckets];
-
-  // Initialize all buckets to empty
-  for (int i = 0; i < numBuckets; i++)
-    hashTable[i] = NULL;
+  numPlaces = 0;
+  numEntries = 0;
+  hashTable = NULL;
+  Resize(_maxEntries);
 }
 
 //
@@ -35,20 +30,87 @@ PF_HashTable::PF_HashTable(int _numBuckets)
 //
 PF_HashTable::~PF_HashTable()
 {
-  // Clear out all buckets
-  for (int i = 0; i < numBuckets; i++) {
-
-    // Delete all entries in the bucket
-    PF_HashEntry *entry = hashTable[i];
-    while (entry != NULL) {
-      PF_HashEntry *next = entry->next;
-      delete entry;
-      entry = next;
-    }
+  delete[] hashTable;
+}
+
+//
+// Hash
+//
+// Desc: Hash fd and pageNum to a place in the table.  Both are packed into
+//       one 64 bit key, which is multiplied by 2^64 divided by the golden
+//       ratio; the top bits of the product mix in every bit of the key.
+//
+int PF_HashTable::Hash(int fd, PageNum pageNum) const
+{
+  unsigned long long key = ((unsigned long long)(unsigned int)fd << 32) |
+    (unsigned int)pageNum;
+  key *= 0x9E3779B97F4A7C15ULL;
+  return ((int)(key >> 32) & (numPlaces - 1));
+}
+
+//
+// Probe
+//
+// Desc: Find the place of the entry for fd and pageNum, or if there is
+//       none, the free place where its probe sequence ends
+//
+int PF_HashTable::Probe(int fd, PageNum pageNum) const
+{
+  int place = Hash(fd, pageNum);
+  while (hashTable[place].slot != PF_HASH_EMPTY &&
+         (hashTable[place].fd != fd || hashTable[place].pageNum != pageNum))
+    place = (place + 1) & (numPlaces - 1);
+  return (place);
+}
+
+//
+// Resize
+//
+// Desc: Make the table hold up to maxEntries entries, keeping the entries
+//       it has.  The table is given at least twice as many places.
+// In:   maxEntries - the most entries the table will hold
+// Ret:  PF_NOMEM if it already holds more entries
+//
+RC PF_HashTable::Resize(int _maxEntries)
+{
+  if (_maxEntries < numEntries)
+    return (PF_NOMEM);
+
+  int newPlaces = 16;
+  while (newPlaces < 2 * _maxEntries)
+    newPlaces *= 2;
+
+  PF_HashEntry *oldTable = hashTable;
+  int oldPlaces = numPlaces;
+
+  // Allocate memory for hash table, with all places empty
+  hashTable = new PF_HashEntry[newPlaces];
+  numPlaces = newPlaces;
+  maxEntries = _maxEntries;
+  for (int i = 0; i < numPlaces; i++)
+    hashTable[i].slot = PF_HASH_EMPTY;
+
+  // Put back the entries of the old table
+  for (int i = 0; i < oldPlaces; i++) {
+    if (oldTable[i].slot != PF_HASH_EMPTY)
+      hashTable[Probe(oldTable[i].fd, oldTable[i].pageNum)] = oldTable[i];
   }
+  delete[] oldTable;
 
-  // Finally delete the hash table
-  delete[] hashTable;
+  // Return ok
+  return (0);
+}
+
+//
+// Clear
+//
+// Desc: Delete all hash table entries
+//
+void PF_HashTable::Clear()
+{
+  for (int i = 0; i < numPlaces; i++)
+    hashTable[i].slot = PF_HASH_EMPTY;
+  numEntries = 0;
 }
 
 //
@@ -62,26 +124,15 @@ PF_HashTable::~PF_HashTable()
 //
 RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  if (bucket<0)
-     return (PF_HASHNOTFOUND);
-
-  // Go through the linked list of this bucket
-  for (PF_HashEntry *entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum) {
-
-      // Found it
-      slot = entry->slot;
-      return (0);
-    }
-  }
+  int place = Probe(fd, pageNum);
 
   // Didn't find it
-  return (PF_HASHNOTFOUND);
+  if (hashTable[place].slot == PF_HASH_EMPTY)
+    return (PF_HASHNOTFOUND);
+
+  // Found it
+  slot = hashTable[place].slot;
+  return (0);
 }
 
 //
@@ -95,31 +146,20 @@ RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 //
 RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Check entry doesn't already exist in the bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      return (PF_HASHPAGEEXIST);
-  }
+  // Check entry doesn't already exist
+  int place = Probe(fd, pageNum);
+  if (hashTable[place].slot != PF_HASH_EMPTY)
+    return (PF_HASHPAGEEXIST);
 
-  // Allocate memory for new hash entry
-  if ((entry = new PF_HashEntry) == NULL)
+  // The table never holds more than it was sized for
+  if (numEntries == maxEntries)
     return (PF_NOMEM);
 
-  // Insert entry at head of list for this bucket
-  entry->fd = fd;
-  entry->pageNum = pageNum;
-  entry->slot = slot;
-  entry->next = hashTable[bucket];
-  entry->prev = NULL;
-  if (hashTable[bucket] != NULL)
-    hashTable[bucket]->prev = entry;
-  hashTable[bucket] = entry;
+  // Fill the free place that ended the probe
+  hashTable[place].fd = fd;
+  hashTable[place].pageNum = pageNum;
+  hashTable[place].slot = slot;
+  numEntries++;
 
   // Return ok
   return (0);
@@ -128,40 +168,37 @@ RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 //
 // Delete
 //
-// Desc: Delete a hash table entry
+// Desc: Delete a hash table entry.  The entries after it in its run of
+//       used places are shifted back into the hole where they can, so
+//       that no probe stops early at the hole.
 // In:   fd - file descriptor
 //       pagenum - page number
 // Ret:  PF return code
 //
 RC PF_HashTable::Delete(int fd, PageNum pageNum)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Find the entry is in this bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      break;
-  }
+  int hole = Probe(fd, pageNum);
 
   // Did we find hash entry?
-  if (entry == NULL)
+  if (hashTable[hole].slot == PF_HASH_EMPTY)
     return (PF_HASHNOTFOUND);
 
-  // Remove this entry
-  if (entry == hashTable[bucket])
-    hashTable[bucket] = entry->next;
-  if (entry->prev != NULL)
-    entry->prev->next = entry->next;
-  if (entry->next != NULL)
-    entry->next->prev = entry->prev;
-  delete entry;
+  // An entry can move into the hole unless its own place lies
+  // (cyclically) after the hole and no later than where it is now
+  int place = hole;
+  while (true) {
+    place = (place + 1) & (numPlaces - 1);
+    if (hashTable[place].slot == PF_HASH_EMPTY)
+      break;
+    int home = Hash(hashTable[place].fd, hashTable[place].pageNum);
+    if (((place - home) & (numPlaces - 1)) >= ((place - hole) & (numPlaces - 1))) {
+      hashTable[hole] = hashTable[place];
+      hole = place;
+    }
+  }
+  hashTable[hole].slot = PF_HASH_EMPTY;
+  numEntries--;
 
-  // Return ook
+  // Return ok
   return (0);
 }
-
-
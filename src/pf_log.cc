@@ -0,0 +1,779 @@
+//
+// File:        pf_log.cc
+// Description: PF_Log class implementation
+//
+
+#include <cstdio>
+#include <cstddef>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "pf_log.h"
+
+using namespace std;
+
+//
+// PageOffset
+//
+// Desc: Internal.  Return where a page, or the header, lies in a file
+//
+static long PageOffset(PageNum pageNum)
+{
+   if (pageNum == PF_HDR_PAGE)
+      return (0);
+   return (pageNum * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr)) +
+         PF_FILE_HDR_SIZE);
+}
+
+//
+// ImageSize
+//
+// Desc: Internal.  Return the size of the image of a page, or of the
+//       header
+//
+static int ImageSize(PageNum pageNum)
+{
+   if (pageNum == PF_HDR_PAGE)
+      return (sizeof(PF_FileHdr));
+   return (PF_PAGE_SIZE + sizeof(PF_PageHdr));
+}
+
+//
+// Checksum
+//
+// Desc: Internal.  Fold bytes into a FNV-1a checksum
+//
+static unsigned int Checksum(unsigned int sum, const char *pData, int length)
+{
+   for (int i = 0; i < length; i++)
+      sum = (sum ^ (unsigned char)pData[i]) * 16777619u;
+   return (sum);
+}
+
+//
+// RecordChecksum
+//
+// Desc: Internal.  Return the checksum of a record, whose header has its
+//       checksum field set to 0
+//
+static unsigned int RecordChecksum(const PF_LogRecHdr &recHdr,
+      const char *pName, const char *pData)
+{
+   unsigned int sum = 2166136261u;
+   sum = Checksum(sum, (const char *)&recHdr, sizeof(PF_LogRecHdr));
+   sum = Checksum(sum, pName, recHdr.nameLength);
+   return (Checksum(sum, pData, recHdr.dataLength));
+}
+
+//
+// PF_Log
+//
+// Desc: Constructor - the log is opened with Open
+//
+PF_Log::PF_Log()
+{
+   fd = -1;
+   base = end = durable = 0;
+   bForcing = FALSE;
+   txn = lastTxn = 0;
+   txnStart = 0;
+}
+
+//
+// ~PF_Log
+//
+// Desc: Destructor - close the log file if it is still open
+//
+PF_Log::~PF_Log()
+{
+   if (fd >= 0)
+      close(fd);
+}
+
+//
+// Open
+//
+// Desc: Open the log file, creating it if it doesn't exist, and recover
+//       the files it names.  The log is empty afterwards.
+// In:   fileName - name of the log file
+// Ret:  PF_FILEOPEN if the log is open, PF_HDRREAD if the file is not a
+//       log, or other PF return code
+//
+RC PF_Log::Open(const char *fileName)
+{
+   RC rc;
+   PF_LogFileHdr fileHdr;
+
+   if (fd >= 0)
+      return (PF_FILEOPEN);
+
+   if ((fd = open(fileName, O_CREAT | O_RDWR, CREATION_MASK)) < 0)
+      return (PF_UNIX);
+
+   // A new log starts at the LSN of its first record
+   int numBytes = pread(fd, &fileHdr, sizeof(PF_LogFileHdr), 0);
+   if (numBytes == 0) {
+      fileHdr.magic = PF_LOG_MAGIC;
+      fileHdr.unused = 0;
+      fileHdr.base = 0;
+      if (pwrite(fd, &fileHdr, sizeof(PF_LogFileHdr), 0) !=
+            sizeof(PF_LogFileHdr) || fdatasync(fd) < 0) {
+         rc = PF_UNIX;
+         goto err;
+      }
+   }
+   else if (numBytes != sizeof(PF_LogFileHdr) ||
+         fileHdr.magic != PF_LOG_MAGIC) {
+      rc = (numBytes < 0) ? PF_UNIX : PF_HDRREAD;
+      goto err;
+   }
+   base = fileHdr.base;
+   end = durable = base + sizeof(PF_LogFileHdr);
+
+   // Recover the files and empty the log
+   if ((rc = Recover()) || (rc = Checkpoint()))
+      goto err;
+
+   // Return ok
+   return (0);
+
+err:
+   close(fd);
+   fd = -1;
+   return (rc);
+}
+
+//
+// Close
+//
+// Desc: Close the log file.  It should have been checkpointed.
+// Ret:  PF_CLOSEDFILE if the log isn't open, or PF_UNIX
+//
+RC PF_Log::Close()
+{
+   if (fd < 0)
+      return (PF_CLOSEDFILE);
+   if (close(fd) < 0)
+      return (PF_UNIX);
+   fd = -1;
+   return (0);
+}
+
+//
+// OpenFile
+//
+// Desc: Note the name a file is opened under, which its pages are
+//       logged by
+// In:   fd - descriptor of the open file
+//       fileName - its name
+//
+void PF_Log::OpenFile(int fd, const char *fileName)
+{
+   lock_guard<mutex> guard(latch);
+   names[fd] = fileName;
+}
+
+//
+// CloseFile
+//
+// Desc: Forget a file once closed.  Its pages have been written.
+// In:   fd - descriptor of the file
+//
+void PF_Log::CloseFile(int fd)
+{
+   lock_guard<mutex> guard(latch);
+   names.erase(fd);
+   headers.erase(fd);
+   touched.erase(touched.lower_bound(make_pair(fd, PF_HDR_PAGE)),
+         touched.lower_bound(make_pair(fd + 1, PF_HDR_PAGE)));
+}
+
+//
+// GetFiles
+//
+// Desc: Return the descriptors of the open files
+// Out:  fds - the descriptors
+//
+void PF_Log::GetFiles(vector<int> &fds)
+{
+   lock_guard<mutex> guard(latch);
+   fds.clear();
+   for (map<int, string>::iterator it = names.begin(); it != names.end(); ++it)
+      fds.push_back(it->first);
+}
+
+//
+// Begin
+//
+// Desc: Begin a transaction
+// Ret:  PF_INTRANSACTION if one has begun already
+//
+RC PF_Log::Begin()
+{
+   lock_guard<mutex> guard(latch);
+   if (txn)
+      return (PF_INTRANSACTION);
+   txn = ++lastTxn;
+   txnStart = end;
+   return (0);
+}
+
+//
+// Commit
+//
+// Desc: Commit the transaction once the images of its pages are logged.
+//       The commit record is forced to disk along with any other commit
+//       in progress, and the files the transaction destroyed are then
+//       removed.
+// Ret:  PF_NOTRANSACTION if none has begun, or other PF return code
+//
+RC PF_Log::Commit()
+{
+   RC rc;
+   unique_lock<mutex> lock(latch);
+
+   if (!txn)
+      return (PF_NOTRANSACTION);
+
+   // A transaction that logged nothing changed nothing
+   PF_LSN lsn = 0;
+   if (end != txnStart)
+      lsn = Append(PF_LOG_COMMIT, string(), PF_HDR_PAGE, NULL, 0);
+   txn = 0;
+   touched.clear();
+   undone.clear();
+   vector<string> destroyed;
+   destroyed.swap(kept);
+
+   if ((rc = ForceTail(lock, lsn)))
+      return (rc);
+
+   for (size_t i = 0; i < destroyed.size(); i++)
+      unlink(destroyed[i].c_str());
+   return (0);
+}
+
+//
+// InTransaction
+//
+// Desc: Return TRUE if a transaction has begun
+//
+int PF_Log::InTransaction()
+{
+   lock_guard<mutex> guard(latch);
+   return (txn != 0);
+}
+
+//
+// Touch
+//
+// Desc: Note that the transaction changed a page, so that it is logged
+//       when written or committed
+// In:   fd - descriptor of the file
+//       pageNum - the page
+//
+void PF_Log::Touch(int fd, PageNum pageNum)
+{
+   lock_guard<mutex> guard(latch);
+   if (txn && names.count(fd))
+      touched.insert(make_pair(fd, pageNum));
+}
+
+//
+// GetTouched
+//
+// Desc: Return the pages the transaction changed
+// Out:  pages - file descriptors and page numbers of the pages
+//
+void PF_Log::GetTouched(vector<pair<int, PageNum> > &pages)
+{
+   lock_guard<mutex> guard(latch);
+   pages.assign(touched.begin(), touched.end());
+}
+
+//
+// LogHeader
+//
+// Desc: Log the header of a file, which the transaction just changed.
+//       The handle of the file writes it back later, so its image is
+//       logged right away.
+// In:   fd - descriptor of the file
+//       hdr - the header
+// Out:  hdr - the LSN of the image is set in it
+// Ret:  0
+//
+RC PF_Log::LogHeader(int fd, PF_FileHdr &hdr)
+{
+   lock_guard<mutex> guard(latch);
+   map<int, string>::iterator it = names.find(fd);
+   if (!txn || it == names.end())
+      return (0);
+
+   touched.insert(make_pair(fd, PF_HDR_PAGE));
+   hdr.lsn = end;
+   Append(PF_LOG_REDO, it->second, PF_HDR_PAGE, (char *)&hdr,
+         sizeof(PF_FileHdr));
+   headers[fd] = hdr;
+   return (0);
+}
+
+//
+// LogWrite
+//
+// Desc: Log a page, or a header, about to be written to its file.  If the
+//       transaction changed it, the image it has on disk is logged first
+//       to undo the write, unless the transaction wrote it before, and
+//       then its new image.  The log must be forced up to the LSN of the
+//       page before it is written.
+// In:   fd - descriptor of the file
+//       pageNum - the page, or PF_HDR_PAGE
+//       pData - the page, header included, or the file header
+// Out:  pData - the LSN of the new image is set in it
+// Ret:  PF return code
+//
+RC PF_Log::LogWrite(int fd, PageNum pageNum, char *pData)
+{
+   RC rc;
+   lock_guard<mutex> guard(latch);
+   map<int, string>::iterator it = names.find(fd);
+   if (it == names.end())
+      return (0);
+
+   written.insert(it->second);
+   if (pageNum == PF_HDR_PAGE)
+      headers.erase(fd);
+   if (!txn || !touched.count(make_pair(fd, pageNum)))
+      return (0);
+
+   if (undone.insert(make_pair(it->second, pageNum)).second) {
+      vector<char> image(ImageSize(pageNum));
+      if ((rc = ReadImage(fd, pageNum, &image[0])))
+         return (rc);
+      Append(PF_LOG_UNDO, it->second, pageNum, &image[0], image.size());
+   }
+
+   // The header was logged when it changed
+   if (pageNum != PF_HDR_PAGE) {
+      ((PF_PageHdr *)pData)->lsn = end;
+      Append(PF_LOG_REDO, it->second, pageNum, pData, ImageSize(pageNum));
+   }
+   return (0);
+}
+
+//
+// LogPage
+//
+// Desc: Log the image of a page still in the buffer when the
+//       transaction commits, if the transaction changed it
+// In:   fd - descriptor of the file
+//       pageNum - the page
+//       pData - the page, header included
+// Out:  pData - the LSN of the image is set in it
+// Ret:  0
+//
+RC PF_Log::LogPage(int fd, PageNum pageNum, char *pData)
+{
+   lock_guard<mutex> guard(latch);
+   map<int, string>::iterator it = names.find(fd);
+   if (!txn || it == names.end() || !touched.count(make_pair(fd, pageNum)))
+      return (0);
+
+   ((PF_PageHdr *)pData)->lsn = end;
+   Append(PF_LOG_REDO, it->second, pageNum, pData, ImageSize(pageNum));
+   return (0);
+}
+
+//
+// LogCreate
+//
+// Desc: Log the creation of a file by the transaction, which removes the
+//       file if it does not commit
+// In:   fileName - name of the file, which has just been created
+// Ret:  PF return code
+//
+RC PF_Log::LogCreate(const char *fileName)
+{
+   unique_lock<mutex> lock(latch);
+   if (!txn)
+      return (0);
+   return (ForceTail(lock, Append(PF_LOG_CREATE, fileName, PF_HDR_PAGE,
+         NULL, 0)));
+}
+
+//
+// LogDestroy
+//
+// Desc: Log the destruction of a file by the transaction.  The file is
+//       to be renamed rather than removed, so that it can be put back if
+//       the transaction does not commit.
+// In:   fileName - name of the file
+// Out:  keptName - the name to rename it to, or "" if no transaction has
+//       begun and the file can be removed
+// Ret:  PF return code
+//
+RC PF_Log::LogDestroy(const char *fileName, string &keptName)
+{
+   unique_lock<mutex> lock(latch);
+   keptName.clear();
+   if (!txn)
+      return (0);
+
+   char suffix[32];
+   sprintf(suffix, ".%lld.dropped", end);
+   keptName = string(fileName) + suffix;
+   kept.push_back(keptName);
+   return (ForceTail(lock, Append(PF_LOG_DESTROY, fileName, PF_HDR_PAGE,
+         keptName.c_str(), keptName.size())));
+}
+
+//
+// Force
+//
+// Desc: Force the log to disk up to an LSN
+// In:   lsn - the LSN
+// Ret:  PF return code
+//
+RC PF_Log::Force(PF_LSN lsn)
+{
+   unique_lock<mutex> lock(latch);
+   return (ForceTail(lock, lsn));
+}
+
+//
+// NeedsCheckpoint
+//
+// Desc: Return TRUE if the log has grown past PF_LOG_CHECKPOINT
+//
+int PF_Log::NeedsCheckpoint()
+{
+   lock_guard<mutex> guard(latch);
+   return (end - base > PF_LOG_CHECKPOINT);
+}
+
+//
+// Checkpoint
+//
+// Desc: Write the headers logged for open files that their handles have
+//       not written yet, sync every file written since the last
+//       checkpoint, and empty the log.  Every page has to be written
+//       before, and no transaction may be under way.
+// Ret:  PF_INTRANSACTION if a transaction has begun, or other PF return
+//       code
+//
+RC PF_Log::Checkpoint()
+{
+   RC rc;
+   unique_lock<mutex> lock(latch);
+
+   if (txn)
+      return (PF_INTRANSACTION);
+   if ((rc = ForceTail(lock, end)))
+      return (rc);
+
+   for (map<int, PF_FileHdr>::iterator it = headers.begin();
+         it != headers.end(); ++it) {
+      if (pwrite(it->first, &it->second, sizeof(PF_FileHdr), 0) !=
+            sizeof(PF_FileHdr))
+         return (PF_HDRWRITE);
+      written.insert(names[it->first]);
+   }
+   headers.clear();
+
+   for (set<string>::iterator it = written.begin(); it != written.end();
+         ++it) {
+      int fileFd = open(it->c_str(), O_RDWR);
+      if (fileFd < 0) {
+         if (errno == ENOENT)
+            continue;
+         return (PF_UNIX);
+      }
+      int error = fsync(fileFd);
+      close(fileFd);
+      if (error < 0)
+         return (PF_UNIX);
+   }
+   written.clear();
+
+   // The next record goes right after the header, with the next LSN
+   PF_LogFileHdr fileHdr;
+   fileHdr.magic = PF_LOG_MAGIC;
+   fileHdr.unused = 0;
+   fileHdr.base = end - sizeof(PF_LogFileHdr);
+   if (pwrite(fd, &fileHdr, sizeof(PF_LogFileHdr), 0) !=
+         sizeof(PF_LogFileHdr) ||
+         ftruncate(fd, sizeof(PF_LogFileHdr)) < 0 || fdatasync(fd) < 0)
+      return (PF_UNIX);
+   base = fileHdr.base;
+   return (0);
+}
+
+//
+// Append
+//
+// Desc: Internal.  Append a record for the transaction to the tail of the
+//       log.  The latch must be held.
+// In:   type - kind of record
+//       fileName - the file it is about
+//       pageNum - the page of an image
+//       pData - the data
+//       length - its length
+// Ret:  LSN of the record
+//
+PF_LSN PF_Log::Append(PF_LogRecType type, const string &fileName,
+      PageNum pageNum, const char *pData, int length)
+{
+   PF_LogRecHdr recHdr;
+   memset(&recHdr, 0, sizeof(PF_LogRecHdr));
+   recHdr.lsn = end;
+   recHdr.type = type;
+   recHdr.txn = txn;
+   recHdr.pageNum = pageNum;
+   recHdr.nameLength = fileName.size();
+   recHdr.dataLength = length;
+   recHdr.checksum = RecordChecksum(recHdr, fileName.data(), pData);
+
+   tail.append((const char *)&recHdr, sizeof(PF_LogRecHdr));
+   tail.append(fileName);
+   if (length > 0)
+      tail.append(pData, length);
+   end += sizeof(PF_LogRecHdr) + fileName.size() + length;
+   return (recHdr.lsn);
+}
+
+//
+// ForceTail
+//
+// Desc: Internal.  Force the log to disk up to an LSN.  The first thread
+//       to find the log short of the LSN writes out the whole tail and
+//       syncs it, while threads coming after it wait for it to finish,
+//       so that commits arriving together share one sync.
+// In:   lock - holds the latch, which is released while writing
+//       lsn - the LSN
+// Ret:  PF return code
+//
+RC PF_Log::ForceTail(unique_lock<mutex> &lock, PF_LSN lsn)
+{
+   while (durable <= lsn && durable < end) {
+      if (bForcing) {
+         forced.wait(lock);
+         continue;
+      }
+
+      string data;
+      data.swap(tail);
+      PF_LSN upTo = end;
+      bForcing = TRUE;
+      lock.unlock();
+
+      long offset = (upTo - data.size()) - base;
+      int error = pwrite(fd, data.data(), data.size(), offset) !=
+         (long)data.size() || fdatasync(fd) < 0;
+
+      lock.lock();
+      bForcing = FALSE;
+      forced.notify_all();
+      if (error)
+         return (PF_UNIX);
+      durable = upTo;
+   }
+   return (0);
+}
+
+//
+// ReadImage
+//
+// Desc: Internal.  Read the image a page, or the header, has on disk.
+//       Whatever lies past the end of the file reads as zeros.
+// In:   fileFd - descriptor of the file
+//       pageNum - the page, or PF_HDR_PAGE
+// Out:  pData - the image
+// Ret:  PF return code
+//
+RC PF_Log::ReadImage(int fileFd, PageNum pageNum, char *pData)
+{
+   int size = ImageSize(pageNum);
+   memset(pData, 0, size);
+   if (pread(fileFd, pData, size, PageOffset(pageNum)) < 0)
+      return (PF_UNIX);
+   return (0);
+}
+
+//
+// PF_LogRecovery: the records read back from the log, and the files they
+// are written to
+//
+struct PF_LogRecovery {
+   vector<PF_LogRecHdr> recHdrs;                 // the records
+   vector<long>         offsets;                 // where their data are
+   map<string, int>     files;                   // open files by name
+
+   // Open a file by name, or return -1 if it doesn't exist
+   int Open(const string &fileName);
+   // Close a file, before it is renamed or removed
+   void Close(const string &fileName);
+};
+
+int PF_LogRecovery::Open(const string &fileName)
+{
+   map<string, int>::iterator it = files.find(fileName);
+   if (it != files.end())
+      return (it->second);
+   int fileFd = open(fileName.c_str(), O_RDWR);
+   if (fileFd >= 0)
+      files[fileName] = fileFd;
+   return (fileFd);
+}
+
+void PF_LogRecovery::Close(const string &fileName)
+{
+   map<string, int>::iterator it = files.find(fileName);
+   if (it != files.end()) {
+      close(it->second);
+      files.erase(it);
+   }
+}
+
+//
+// Recover
+//
+// Desc: Internal.  Read the log, up to the first record that was cut
+//       short or damaged by the crash, and bring the files back to the
+//       state the last committed transaction left them in.  The undo
+//       images of transactions that did not commit are written back
+//       first, latest first, and the files they created or destroyed are
+//       removed or put back.  Then the images of the committed
+//       transactions are written again in log order, unless the page on
+//       disk holds a later one.  The files written are synced.
+// Ret:  PF return code
+//
+RC PF_Log::Recover()
+{
+   PF_LogRecovery recovery;
+   set<int> committed;
+   vector<char> data;
+   PF_LogRecHdr recHdr;
+   RC rc = 0;
+
+   // Read the records
+   long offset = sizeof(PF_LogFileHdr);
+   while (pread(fd, &recHdr, sizeof(PF_LogRecHdr), offset) ==
+         sizeof(PF_LogRecHdr)) {
+      if (recHdr.lsn != base + offset || recHdr.nameLength < 0 ||
+            recHdr.dataLength < 0 || recHdr.nameLength > MAXNAME * 4)
+         break;
+      long length = recHdr.nameLength + recHdr.dataLength;
+      data.resize(length + 1);
+      if (pread(fd, &data[0], length, offset + sizeof(PF_LogRecHdr)) != length)
+         break;
+      unsigned int checksum = recHdr.checksum;
+      recHdr.checksum = 0;
+      if (RecordChecksum(recHdr, &data[0], &data[recHdr.nameLength]) !=
+            checksum)
+         break;
+
+      if (recHdr.type == PF_LOG_COMMIT)
+         committed.insert(recHdr.txn);
+      recovery.recHdrs.push_back(recHdr);
+      recovery.offsets.push_back(offset + sizeof(PF_LogRecHdr));
+      offset += sizeof(PF_LogRecHdr) + length;
+   }
+   end = durable = base + offset;
+   if (recovery.recHdrs.empty())
+      return (0);
+
+   // Undo the transactions that did not commit, and redo the others
+   for (int pass = 0; pass < 2 && !rc; pass++) {
+      int numRecs = recovery.recHdrs.size();
+      for (int j = 0; j < numRecs && !rc; j++) {
+         int i = (pass == 0) ? numRecs - 1 - j : j;
+         PF_LogRecHdr &recHdr = recovery.recHdrs[i];
+         if (committed.count(recHdr.txn) != (size_t)pass ||
+               recHdr.type == PF_LOG_COMMIT ||
+               recHdr.type == (pass == 0 ? PF_LOG_REDO : PF_LOG_UNDO))
+            continue;
+
+         long length = recHdr.nameLength + recHdr.dataLength;
+         data.resize(length + 1);
+         if (pread(fd, &data[0], length, recovery.offsets[i]) != length) {
+            rc = PF_INCOMPLETEREAD;
+            break;
+         }
+         string fileName(&data[0], recHdr.nameLength);
+         char *pData = &data[recHdr.nameLength];
+         string keptName(pData, recHdr.dataLength);
+
+         switch (recHdr.type) {
+         case PF_LOG_CREATE:
+            if (pass == 0) {
+               recovery.Close(fileName);
+               unlink(fileName.c_str());
+            }
+            else if (recovery.Open(fileName) < 0) {
+               // Create it again, with the header PF_Manager gives it
+               char hdrBuf[PF_FILE_HDR_SIZE];
+               memset(hdrBuf, 0, PF_FILE_HDR_SIZE);
+               ((PF_FileHdr *)hdrBuf)->firstFree = PF_PAGE_LIST_END;
+               int fileFd = open(fileName.c_str(), O_CREAT | O_RDWR,
+                     CREATION_MASK);
+               if (fileFd < 0)
+                  rc = PF_UNIX;
+               else if (write(fileFd, hdrBuf, PF_FILE_HDR_SIZE) !=
+                     PF_FILE_HDR_SIZE)
+                  rc = PF_HDRWRITE;
+               if (fileFd >= 0)
+                  recovery.files[fileName] = fileFd;
+            }
+            break;
+
+         case PF_LOG_DESTROY:
+            // A file created again afterwards is rebuilt from the log
+            recovery.Close(fileName);
+            if (pass == 0)
+               rename(keptName.c_str(), fileName.c_str());
+            else {
+               unlink(keptName.c_str());
+               unlink(fileName.c_str());
+            }
+            break;
+
+         case PF_LOG_UNDO:
+         case PF_LOG_REDO:
+            {
+               int fileFd = recovery.Open(fileName);
+               if (fileFd < 0)
+                  break;
+
+               // A page torn by the crash may hold the LSN of the image
+               // already, so that image is written again
+               PF_LSN lsn = 0;
+               long lsnOffset = PageOffset(recHdr.pageNum);
+               if (recHdr.pageNum == PF_HDR_PAGE)
+                  lsnOffset += offsetof(PF_FileHdr, lsn);
+               if (pass == 1 && pread(fileFd, &lsn, sizeof(PF_LSN),
+                     lsnOffset) != sizeof(PF_LSN))
+                  lsn = 0;
+               if (pass == 1 && recHdr.lsn < lsn)
+                  break;
+
+               if (pwrite(fileFd, pData, recHdr.dataLength,
+                     PageOffset(recHdr.pageNum)) != recHdr.dataLength)
+                  rc = PF_INCOMPLETEWRITE;
+            }
+            break;
+         }
+      }
+   }
+
+   // Sync the files
+   for (map<string, int>::iterator it = recovery.files.begin();
+         it != recovery.files.end(); ++it) {
+      if (fsync(it->second) < 0 && !rc)
+         rc = PF_UNIX;
+      close(it->second);
+   }
+
+   // Return ok
+   return (rc);
+}
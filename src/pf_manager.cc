@@ -10,21 +10,28 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include "pf_internal.h"
-#include "pf_buffermgr.h"
+#include "pf_bufferpool.h"
+#include "pf_log.h"
+
+using namespace std;
 
 //
 // PF_Manager
 //
 // Desc: Constructor - intended to be called once at begin of program
 //       Handles creation, deletion, opening and closing of files.
-//       It is associated with a PF_BufferMgr that manages the page
+//       It is associated with a PF_BufferPool that manages the page
 //       buffer and executes the page replacement policies.
 //
 PF_Manager::PF_Manager()
 {
    // Create Buffer Manager
-   pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE);
+   pBufferMgr = new PF_BufferPool(PF_BUFFER_SIZE);
+
+   // The log is opened with OpenLog
+   pLog = NULL;
 }
 
 //
@@ -38,6 +45,7 @@ PF_Manager::~PF_Manager()
 {
    // Destroy the buffer manager objects
    delete pBufferMgr;
+   delete pLog;
 }
 
 //
@@ -69,6 +77,8 @@ RC PF_Manager::CreateFile (const char *fileName)
    memset(hdrBuf, 0, PF_FILE_HDR_SIZE);
 
    PF_FileHdr *hdr = (PF_FileHdr*)hdrBuf;
+   hdr->magic = PF_FILE_MAGIC;
+   hdr->version = PF_FILE_VERSION;
    hdr->firstFree = PF_PAGE_LIST_END;
    hdr->numPages = 0;
 
@@ -91,6 +101,10 @@ RC PF_Manager::CreateFile (const char *fileName)
    if(close(fd) < 0)
       return (PF_UNIX);
 
+   // Log it, to remove it if the transaction does not commit
+   if (pLog)
+      return (pLog->LogCreate(fileName));
+
    // Return ok
    return (0);
 }
@@ -99,11 +113,25 @@ RC PF_Manager::CreateFile (const char *fileName)
 // DestroyFile
 //
 // Desc: Delete a PF file named fileName (fileName must exist and not be open)
+//       During a transaction, the file is only renamed, and removed once
+//       the transaction commits.
 // In:   fileName - name of file to delete
 // Ret:  PF return code
 //
 RC PF_Manager::DestroyFile (const char *fileName)
 {
+   RC rc;
+   string keptName;
+
+   // Log it, and keep it out of the way during a transaction
+   if (pLog && (rc = pLog->LogDestroy(fileName, keptName)))
+      return (rc);
+   if (!keptName.empty()) {
+      if (rename(fileName, keptName.c_str()) < 0)
+         return (PF_UNIX);
+      return (0);
+   }
+
    // Remove the file
    if (unlink(fileName) < 0)
       return (PF_UNIX);
@@ -122,14 +150,19 @@ RC PF_Manager::DestroyFile (const char *fileName)
 //       circumstances, crash the PF layer. Note that even if only one instance
 //       of a file is for writing, problems may occur because some writes may
 //       not be seen by a reader of another instance of the file.
+//       A mapped file is opened read only, and mapped whole into memory.
+//       Its pages are read from the mapping instead of being copied into
+//       the buffer pool, so any change to the file is refused.
 // In:   fileName - name of file to open
+//       bMapped - whether to map the file read only
 // Out:  fileHandle - refer to the open file
 //                    this function modifies local var's in fileHandle
 //       to point to the file data in the file table, and to point to the
 //       buffer manager object
 // Ret:  PF_FILEOPEN or other PF return code
 //
-RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
+RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle,
+      int bMapped)
 {
    int rc;                   // return code
 
@@ -142,7 +175,7 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
 #ifdef PC
          O_BINARY |
 #endif
-         O_RDWR)) < 0)
+         (bMapped ? O_RDONLY : O_RDWR))) < 0)
       return (PF_UNIX);
 
    // Read the file header
@@ -155,13 +188,51 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
       }
    }
 
+   // Refuse files written with another layout, such as files from before
+   // pages carried an LSN, rather than misread their pages
+   if (fileHandle.hdr.magic != PF_FILE_MAGIC ||
+         fileHandle.hdr.version != PF_FILE_VERSION) {
+      rc = PF_BADFORMAT;
+      goto err;
+   }
+
    // Set file header to be not changed
    fileHandle.bHdrChanged = FALSE;
 
+   // Map the whole file, which must hold every page the header counts
+   fileHandle.pMapping = NULL;
+   fileHandle.pMappedPins = NULL;
+   if (bMapped) {
+      struct stat fileStat;
+      if (fstat(fileHandle.unixfd, &fileStat) < 0) {
+         rc = PF_UNIX;
+         goto err;
+      }
+      fileHandle.mappingSize = fileStat.st_size;
+      if (fileHandle.mappingSize < PF_FILE_HDR_SIZE +
+            fileHandle.hdr.numPages * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr))) {
+         rc = PF_INCOMPLETEREAD;
+         goto err;
+      }
+      void *pMapping = mmap(NULL, fileHandle.mappingSize, PROT_READ,
+            MAP_SHARED, fileHandle.unixfd, 0);
+      if (pMapping == MAP_FAILED) {
+         rc = PF_UNIX;
+         goto err;
+      }
+      fileHandle.pMapping = (char *)pMapping;
+      fileHandle.pMappedPins = new int(0);
+   }
+
    // Set local variables in file handle object to refer to open file
    fileHandle.pBufferMgr = pBufferMgr;
    fileHandle.bFileOpen = TRUE;
 
+   // Changes to the file are logged by its name
+   fileHandle.pLog = bMapped ? NULL : pLog;
+   if (fileHandle.pLog)
+      pLog->OpenFile(fileHandle.unixfd, fileName);
+
    // Return ok
    return 0;
 
@@ -194,10 +265,26 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    if (!fileHandle.bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Unmap a mapped file, once none of its pages are in use
+   if (fileHandle.pMapping != NULL) {
+      if (*fileHandle.pMappedPins != 0)
+         return (PF_PAGEPINNED);
+      if (munmap(fileHandle.pMapping, fileHandle.mappingSize) < 0)
+         return (PF_UNIX);
+      delete fileHandle.pMappedPins;
+      fileHandle.pMapping = NULL;
+      fileHandle.pMappedPins = NULL;
+   }
+
    // Flush all buffers for this file and write out the header
    if ((rc = fileHandle.FlushPages()))
       return (rc);
 
+   // The log no longer knows the file by its descriptor
+   if (fileHandle.pLog)
+      fileHandle.pLog->CloseFile(fileHandle.unixfd);
+   fileHandle.pLog = NULL;
+
    // Close the file
    if (close(fileHandle.unixfd) < 0)
       return (PF_UNIX);
@@ -210,6 +297,133 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    return 0;
 }
 
+//
+// OpenLog
+//
+// Desc: Open the write-ahead log of the files, which is created if it
+//       doesn't exist.  The files named in the log are first brought back
+//       to the state the last committed transaction left them in.  Files
+//       opened from then on are logged, and so are files created and
+//       destroyed during a transaction.
+// In:   fileName - name of the log file
+// Ret:  PF_FILEOPEN if a log is open, or other PF return code
+//
+RC PF_Manager::OpenLog(const char *fileName)
+{
+   RC rc;
+
+   if (pLog)
+      return (PF_FILEOPEN);
+
+   pLog = new PF_Log();
+   if ((rc = pLog->Open(fileName))) {
+      delete pLog;
+      pLog = NULL;
+      return (rc);
+   }
+   pBufferMgr->SetLog(pLog);
+
+   // Return ok
+   return (0);
+}
+
+//
+// CloseLog
+//
+// Desc: Checkpoint and close the log.  A transaction under way is
+//       committed first.
+// Ret:  PF_CLOSEDFILE if no log is open, or other PF return code
+//
+RC PF_Manager::CloseLog()
+{
+   RC rc;
+
+   if (!pLog)
+      return (PF_CLOSEDFILE);
+
+   if ((pLog->InTransaction() && (rc = CommitTransaction())) ||
+         (rc = Checkpoint()) ||
+         (rc = pLog->Close()))
+      return (rc);
+
+   pBufferMgr->SetLog(NULL);
+   delete pLog;
+   pLog = NULL;
+
+   // Return ok
+   return (0);
+}
+
+//
+// BeginTransaction
+//
+// Desc: Begin a transaction.  Nothing is done if no log is open.
+// Ret:  PF_INTRANSACTION if one has begun already
+//
+RC PF_Manager::BeginTransaction()
+{
+   if (!pLog)
+      return (0);
+   return (pLog->Begin());
+}
+
+//
+// CommitTransaction
+//
+// Desc: Commit the transaction.  The pages it changed that are still in
+//       the buffer are logged, without being written, and the log is
+//       forced up to the commit record.  The log is checkpointed once it
+//       has grown past PF_LOG_CHECKPOINT.
+// Ret:  PF_NOTRANSACTION if none has begun, or other PF return code
+//
+RC PF_Manager::CommitTransaction()
+{
+   RC rc;
+
+   if (!pLog)
+      return (0);
+   if (!pLog->InTransaction())
+      return (PF_NOTRANSACTION);
+
+   vector<pair<int, PageNum> > pages;
+   pLog->GetTouched(pages);
+   for (size_t i = 0; i < pages.size(); i++) {
+      if (pages[i].second != PF_HDR_PAGE &&
+            (rc = pBufferMgr->LogPage(pages[i].first, pages[i].second)))
+         return (rc);
+   }
+
+   if ((rc = pLog->Commit()))
+      return (rc);
+
+   if (pLog->NeedsCheckpoint())
+      return (Checkpoint());
+
+   // Return ok
+   return (0);
+}
+
+//
+// Checkpoint
+//
+// Desc: Internal.  Write the dirty pages of the open files, pinned or
+//       not, and let the log write their headers, sync the files and
+//       empty itself.  No transaction may be under way.
+// Ret:  PF return code
+//
+RC PF_Manager::Checkpoint()
+{
+   RC rc;
+
+   vector<int> fds;
+   pLog->GetFiles(fds);
+   for (size_t i = 0; i < fds.size(); i++) {
+      if ((rc = pBufferMgr->ForcePages(fds[i], ALL_PAGES)))
+         return (rc);
+   }
+   return (pLog->Checkpoint());
+}
+
 //
 // ClearBuffer
 //
@@ -219,7 +433,7 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
 //       comparison starting with an clean buffer.
 // In:   Nothing
 // Out:  Nothing
-// Ret:  Returns the result of PF_BufferMgr::ClearBuffer
+// Ret:  Returns the result of PF_BufferPool::ClearBuffer
 //       It is a code: 0 for success, something else for a PF error.
 //
 RC PF_Manager::ClearBuffer()
@@ -234,7 +448,7 @@ RC PF_Manager::ClearBuffer()
 //       This routine will be called via the system command.
 // In:   Nothing
 // Out:  Nothing
-// Ret:  Returns the result of PF_BufferMgr::PrintBuffer
+// Ret:  Returns the result of PF_BufferPool::PrintBuffer
 //       It is a code: 0 for success, something else for a PF error.
 //
 RC PF_Manager::PrintBuffer()
@@ -249,7 +463,7 @@ RC PF_Manager::PrintBuffer()
 //       This routine will be called via the system command.
 // In:   The new buffer size
 // Out:  Nothing
-// Ret:  Returns the result of PF_BufferMgr::ResizeBuffer
+// Ret:  Returns the result of PF_BufferPool::ResizeBuffer
 //       It is a code: 0 for success, PF_TOOSMALL when iNewSize
 //       would be too small.
 //
@@ -258,6 +472,35 @@ RC PF_Manager::ResizeBuffer(int iNewSize)
    return pBufferMgr->ResizeBuffer(iNewSize);
 }
 
+//
+// ReserveBuffer
+//
+// Desc: Resizes the buffer manager so that numBlocks blocks can be
+//       allocated and every shard still has numPages pages for files.
+//       Query nodes keeping their work memory in blocks use it, since
+//       any shard may be asked for the pages of a file.
+// In:   numBlocks - the number of blocks to allocate
+//       numPages - the pages each shard must keep besides
+// Ret:  Returns the result of PF_BufferPool::ReserveBuffer
+//
+RC PF_Manager::ReserveBuffer(int numBlocks, int numPages)
+{
+   return pBufferMgr->ReserveBuffer(numBlocks, numPages);
+}
+
+//
+// SetBufferPolicy
+//
+// Desc: Sets how the buffer manager picks the pages to replace.
+//       This routine will be called via the set command.
+// In:   The new replacement policy
+// Ret:  Returns the result of PF_BufferPool::SetPolicy
+//
+RC PF_Manager::SetBufferPolicy(PF_BufferPolicy policy)
+{
+   return pBufferMgr->SetPolicy(policy);
+}
+
 //------------------------------------------------------------------------------
 // Three Methods for manipulating raw memory buffers.  These memory
 // locations are handled by the buffer manager, but are not
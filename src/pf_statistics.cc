@@ -28,6 +28,7 @@ void PF_Statistics()
    int *piPF = pStatisticsMgr->Get(PF_PAGEFOUND);
    int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
    int *piRP = pStatisticsMgr->Get(PF_READPAGE);
+   int *piRA = pStatisticsMgr->Get(PF_READAHEAD);
    int *piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
    int *piFP = pStatisticsMgr->Get(PF_FLUSHPAGES);
 
@@ -44,6 +45,8 @@ void PF_Statistics()
 
    cout << "Number of read requests: ";
    if (piRP) cout << *piRP; else cout << "None";
+   cout << "\n  Number read ahead: ";
+   if (piRA) cout << *piRA; else cout << "None";
    cout << "\nNumber of write requests: ";
    if (piWP) cout << *piWP; else cout << "None";
    cout << "\n-------------------\n";
@@ -56,6 +59,7 @@ void PF_Statistics()
    delete piPF;
    delete piPNF;
    delete piRP;
+   delete piRA;
    delete piWP;
    delete piFP;
 }
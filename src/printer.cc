@@ -9,6 +9,7 @@
 #include <cstring>
 #include <cstdlib>
 #include "printer.h"
+#include "rm.h"
 
 using namespace std;
 
@@ -294,3 +295,16 @@ void Printer::Print(ostream &c, const char * const data)
     c << "\n";
 }
 
+//
+// Print
+//
+//  rec - a view of the record to be printed, which is printed straight
+//  from its page
+//
+void Printer::Print(ostream &c, const RM_RecordView &rec)
+{
+    char *data;
+    if (rec.GetData(data))
+        return;
+    Print(c, data);
+}
@@ -25,7 +25,11 @@ static char *QL_WarnMsg[] = {
   (char*)"bad call",
   (char*)"condition not met",
   (char*)"bad update value",
-  (char*)"end of iterator"
+  (char*)"end of iterator",
+  (char*)"bad condition for optimizer",
+  (char*)"invalid optimizer bit",
+  (char*)"order by distance needs an MBR attribute and value of one relation, and a positive limit",
+  (char*)"joined tuples are too long to partition"
 };
 
 static char *QL_ErrorMsg[] = {
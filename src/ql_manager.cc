@@ -67,7 +67,8 @@ RC QL_Manager::Reset(){
 //
 RC QL_Manager::Select(int nSelAttrs, const RelAttr selAttrs[],
                       int nRelations, const char * const relations[],
-                      int nConditions, const Condition conditions[])
+                      int nConditions, const Condition conditions[],
+                      const NearestClause *nearest)
 {
   int i;
   RC rc = 0;
@@ -132,16 +133,27 @@ RC QL_Manager::Select(int nSelAttrs, const RelAttr selAttrs[],
     free(attrEntries);
     return (rc);
   }
+  if(nearest != NULL && (rc = ParseNearest(*nearest))){
+    free(relEntries);
+    free(attrEntries);
+    return (rc);
+  }
 
   QL_Node *topNode;
   float cost, tupleEst;
-  if(smm.useQO){
+  bool usedQO = false;
+  if(nearest != NULL){
+    // Only one relation is involved, so there is nothing to optimize
+    if((rc = SetUpNearestNodes(topNode, *nearest, nSelAttrs, selAttrs)))
+      return (rc);
+  }
+  else if(smm.useQO){
     //cout << "using QO" << endl;
     QO_Manager *qom = new QO_Manager(*this, nRels, relEntries, nAttrs, attrEntries,
       nConds, condptr);
     QO_Rel * qorels = (QO_Rel*)(malloc(sizeof(QO_Rel)*nRels));
     for(int i=0; i < nRels; i++){
-      *(qorels + i) = (QO_Rel){ 0, -1, -1};
+      *(qorels + i) = (QO_Rel){ 0, -1, -1, QO_NESTEDLOOP, false};
     }
     qom->Compute(qorels, cost, tupleEst);
     qom->PrintRels();
@@ -152,6 +164,7 @@ RC QL_Manager::Select(int nSelAttrs, const RelAttr selAttrs[],
 
     delete qom;
     free(qorels);
+    usedQO = true;
   }
   else{
     // Construct the query tree
@@ -166,7 +179,7 @@ RC QL_Manager::Select(int nSelAttrs, const RelAttr selAttrs[],
   if((rc = RunSelect(topNode)))
     return (rc);
 
-  if(smm.useQO){
+  if(usedQO){
     cout << "estimated cost: " << cost << endl;
     cout << "estimated # tuples: " << tupleEst << endl;
   }
@@ -216,19 +229,18 @@ RC QL_Manager::RunSelect(QL_Node *topNode){
   Printer printer(attributes, attrListSize);
   printer.PrintHeader(cout);
 
-  // Open the iterator of the top node, and keep retrieving elements until
-  // there are no more
+  // Open the iterator of the top node, and keep retrieving batches until
+  // there are no more, printing the tuples selected in each
   if((rc = topNode->OpenIt()))
     return (rc);
   RC it_rc = 0;
-  char *buffer = (char *)malloc(finalTupLength);
-  it_rc = topNode->GetNext(buffer);
-  while(it_rc == 0){
-    printer.Print(cout, buffer);
-    it_rc = topNode->GetNext(buffer);
+  TupleBatch batch;
+  batch.Init(finalTupLength);
+  while((it_rc = topNode->GetNextBatch(batch)) == 0){
+    for(int i = 0; i < batch.numSelected; i++)
+      printer.Print(cout, batch.SelectedTuple(i));
   }
 
-  free(buffer);
   if((rc = topNode->CloseIt()))
     return (rc);
 
@@ -290,15 +302,29 @@ bool QL_Manager::IsValidAttr(const RelAttr attr){
  */
 RC QL_Manager::SetUpNodes(QL_Node *&topNode, int nSelAttrs, const RelAttr selAttrs[]){
   RC rc = 0;
-  // Set up node 1:
-  if((rc = SetUpFirstNode(topNode)))
+  // If the first two relations are joined on their indexed MBR attributes,
+  // join them with a spatial join. Otherwise, set up node 1:
+  int firstRel = 1;
+  int joinCond = -1;
+  for(int i = 0; i < nConds && nRels > 1; i++){
+    if(IsSpatialJoinCond(condptr[i], 0, 1)){
+      joinCond = i;
+      break;
+    }
+  }
+  if(joinCond != -1){
+    if((rc = SetUpSpatialJoin(topNode, 0, 1, joinCond)))
+      return (rc);
+    firstRel = 2;
+  }
+  else if((rc = SetUpFirstNode(topNode)))
     return (rc);
 
   // For all other relations, join it, left-deep style, with the previously
   // seen relations
   QL_Node* currNode;
   currNode = topNode;
-  for(int i = 1; i < nRels; i++){
+  for(int i = firstRel; i < nRels; i++){
     if((rc = JoinRelation(topNode, currNode, i)))
       return (rc);
     currNode = topNode;
@@ -322,16 +348,107 @@ RC QL_Manager::SetUpNodes(QL_Node *&topNode, int nSelAttrs, const RelAttr selAtt
   return (rc);
 }
 
+/*
+ * Makes sure that the order by distance clause refers to an MBR attribute
+ * of the queried relation, with an MBR value and a positive limit. Nearest
+ * neighbour queries are only supported over a single relation.
+ */
+RC QL_Manager::ParseNearest(const NearestClause &nearest){
+  RC rc = 0;
+  if(nRels != 1 || nearest.k <= 0 || nearest.value.type != MBR)
+    return (QL_BADNEAREST);
+  if(! IsValidAttr(nearest.attr))
+    return (QL_ATTRNOTFOUND);
+  AttrCatEntry *entry;
+  if((rc = GetAttrCatEntry(nearest.attr, entry)))
+    return (rc);
+  if(entry->attrType != MBR)
+    return (QL_BADNEAREST);
+  return (0);
+}
+
+/*
+ * Sets up the query tree for an order by distance query. If the MBR
+ * attribute is indexed, the relation node scans the R-tree best-first so
+ * that tuples come out closest first, the conditions are checked by a
+ * select node above it, and the nearest node stops after k tuples.
+ * Otherwise the relation is read as usual (using an index for one of the
+ * conditions if possible), and the nearest node keeps the k closest.
+ */
+RC QL_Manager::SetUpNearestNodes(QL_Node *&topNode, const NearestClause &nearest,
+                                 int nSelAttrs, const RelAttr selAttrs[]){
+  RC rc = 0;
+  int attrIndex = 0;
+  if((rc = GetAttrCatEntryPos(nearest.attr, attrIndex)))
+    return (rc);
+
+  bool inputOrdered = (attrEntries[attrIndex].indexNo != -1);
+  if(inputOrdered){
+    QL_NodeRel *relNode = new QL_NodeRel(*this, relEntries);
+    topNode = relNode;
+    int *attrList = (int *)malloc(relEntries[0].attrCount * sizeof(int));
+    for(int i = 0;  i < relEntries[0].attrCount ; i++){
+      attrList[i] = i;
+    }
+    relNode->SetUpNode(attrList, relEntries[0].attrCount);
+    free(attrList);
+    if((rc = relNode->UseIndex(attrIndex, attrEntries[attrIndex].indexNo, nearest.value.data)))
+      return (rc);
+    relNode->nearestScan = true;
+
+    if(nConds > 0){
+      QL_NodeSel *selNode = new QL_NodeSel(*this, *relNode);
+      if((rc = selNode->SetUpNode(nConds)))
+        return (rc);
+      topNode = selNode;
+      for(int i = 0; i < nConds; i++){
+        if((rc = topNode->AddCondition(condptr[i], i)))
+          return (rc);
+      }
+    }
+  }
+  else if((rc = SetUpFirstNode(topNode)))
+    return (rc);
+
+  QL_NodeNearest *nearestNode = new QL_NodeNearest(*this, *topNode);
+  if((rc = nearestNode->SetUpNode(attrIndex, nearest.value.data, nearest.k, inputOrdered)))
+    return (rc);
+  topNode = nearestNode;
+
+  // If select *, don't add project nodes
+  if((nSelAttrs == 1 && strncmp(selAttrs[0].attrName, "*", strlen(selAttrs[0].attrName)) == 0))
+    return (0);
+  QL_NodeProj *projNode = new QL_NodeProj(*this, *nearestNode);
+  projNode->SetUpNode(nSelAttrs);
+  for(int i= 0 ; i < nSelAttrs; i++){
+    int selIndex = 0;
+    if((rc = GetAttrCatEntryPos(selAttrs[i], selIndex)))
+      return (rc);
+    if((rc = projNode->AddProj(selIndex)))
+      return (rc);
+  }
+  topNode = projNode;
+
+  return (rc);
+}
+
 RC QL_Manager::SetUpNodesWithQO(QL_Node *&topNode, QO_Rel* qorels, int nSelAttrs, const RelAttr selAttrs[]){
   RC rc = 0;
-  if((rc = SetUpFirstNodeWithQO(topNode, qorels)))
+  // The optimizer only picks a spatial join for the first two relations
+  int firstRel = 1;
+  if(nRels > 1 && qorels[1].joinMethod == QO_SPATIALJOIN){
+    if((rc = SetUpSpatialJoin(topNode, qorels[0].relIdx, qorels[1].relIdx, qorels[1].indexCond)))
+      return (rc);
+    firstRel = 2;
+  }
+  else if((rc = SetUpFirstNodeWithQO(topNode, qorels)))
     return (rc);
 
   // For all other relations, join it, left-deep style, with the previously
   // seen relations
   QL_Node* currNode;
   currNode = topNode;
-  for(int i = 1; i < nRels; i++){
+  for(int i = firstRel; i < nRels; i++){
     if((rc = JoinRelationWithQO(topNode, qorels, currNode, i)))
       return (rc);
     currNode = topNode;
@@ -362,6 +479,30 @@ RC QL_Manager::SetUpNodesWithQO(QL_Node *&topNode, QO_Rel* qorels, int nSelAttrs
 RC QL_Manager::JoinRelation(QL_Node *&topNode, QL_Node *currNode, int relIndex){
   RC rc = 0;
   bool useIndex = false;
+  // An INTERSECTS join is never run as a nested loop; partition both sides
+  for(int i = 0; i < nConds; i++){
+    if(conditionToRel[i] == relIndex && IsPBSMJoinCond(condptr[i], relIndex))
+      return SetUpPBSMJoin(topNode, currNode, relIndex, i);
+  }
+  // An equality join that can't use an index on this relation is run as a
+  // hash join, with the table built on this relation
+  int hashCond = -1;
+  for(int i = 0; i < nConds; i++){
+    if(conditionToRel[i] != relIndex || ! IsEquiJoinCond(condptr[i], relIndex))
+      continue;
+    int index1, index2, condRel1;
+    GetAttrCatEntryPos(condptr[i].lhsAttr, index1);
+    GetAttrCatEntryPos(condptr[i].rhsAttr, index2);
+    AttrToRelIndex(condptr[i].lhsAttr, condRel1);
+    if(attrEntries[(condRel1 == relIndex) ? index1 : index2].indexNo != -1){
+      hashCond = -1;
+      break;
+    }
+    if(hashCond == -1)
+      hashCond = i;
+  }
+  if(hashCond != -1)
+    return SetUpEquiJoin(topNode, currNode, relIndex, hashCond, QO_HASHJOIN, false);
   // create new relation node, providing the relation entry
   QL_NodeRel *relNode = new QL_NodeRel(*this, relEntries + relIndex);
 
@@ -395,16 +536,17 @@ RC QL_Manager::JoinRelation(QL_Node *&topNode, QL_Node *currNode, int relIndex){
     // For each condition, associated with this node
     if(conditionToRel[i] == relIndex){
       bool added = false;
-      // if it is a R.A=v condition, consider adding it to the relation node
-      // by specifying a index scan, but only if there exists an index on
-      // this attribute
-      if(condptr[i].op == EQ_OP && !condptr[i].bRhsIsAttr && useIndex == false){
+      // if it is a R.A=v or R.A INTERSECTS v condition, consider adding it
+      // to the relation node by specifying a index scan, but only if there
+      // exists an index on this attribute
+      if(IsIndexScanCond(condptr[i]) && useIndex == false){
         int index = 0;
         if((rc = GetAttrCatEntryPos(condptr[i].lhsAttr, index) ))
           return (rc);
         if((attrEntries[index].indexNo != -1)){
           if((rc = relNode->UseIndex(index, attrEntries[index].indexNo, condptr[i].rhsValue.data) ))
             return (rc);
+          relNode->indexOp = condptr[i].op;
           added = true;
           useIndex = true;
         }
@@ -486,6 +628,11 @@ RC QL_Manager::AttrToRelIndex(const RelAttr attr, int& relIndex){
 RC QL_Manager::JoinRelationWithQO(QL_Node *&topNode, QO_Rel* qorels, QL_Node *currNode, int qoIdx){
   RC rc = 0;
   int relIndex = qorels[qoIdx].relIdx;
+  if(qorels[qoIdx].joinMethod == QO_PBSMJOIN)
+    return SetUpPBSMJoin(topNode, currNode, relIndex, qorels[qoIdx].indexCond);
+  if(qorels[qoIdx].joinMethod == QO_HASHJOIN || qorels[qoIdx].joinMethod == QO_MERGEJOIN)
+    return SetUpEquiJoin(topNode, currNode, relIndex, qorels[qoIdx].indexCond,
+      qorels[qoIdx].joinMethod, qorels[qoIdx].buildOuter);
   // create new relation node, providing the relation entry
   QL_NodeRel *relNode = new QL_NodeRel(*this, relEntries + relIndex);
 
@@ -531,6 +678,7 @@ RC QL_Manager::JoinRelationWithQO(QL_Node *&topNode, QO_Rel* qorels, QL_Node *cu
       //cout << "adding index join on attr " << index; 
       if((rc = relNode->UseIndex(index, attrEntries[index].indexNo, condptr[condIdx].rhsValue.data) ))
         return (rc);
+      relNode->indexOp = condptr[condIdx].op;
     }
     else if((attrEntries[index].indexNo != -1) && condptr[condIdx].bRhsIsAttr){
       //cout << "adding, lhs attr: " << otherAttr << ", rhsATtr: " << index << endl;
@@ -583,15 +731,16 @@ RC QL_Manager::SetUpFirstNode(QL_Node *&topNode){
   for(int i = 0 ; i < nConds; i++){
     if(conditionToRel[i] == 0){
       bool added = false;
-      // If it is a R.A=v condition, make the relation use index scan if there isn't already
-      // an index, and if this isn't a update operation
-      if(condptr[i].op == EQ_OP && !condptr[i].bRhsIsAttr && useIndex == false && isUpdate == false){
+      // If it is a R.A=v or R.A INTERSECTS v condition, make the relation use index scan
+      // if there isn't already an index, and if this isn't a update operation
+      if(IsIndexScanCond(condptr[i]) && useIndex == false && isUpdate == false){
         int index = 0;
         if((rc = GetAttrCatEntryPos(condptr[i].lhsAttr, index) ))
           return (rc);
         if((attrEntries[index].indexNo != -1)){ // add only if there is an index on this attribute
           if((rc = relNode->UseIndex(index, attrEntries[index].indexNo, condptr[i].rhsValue.data) ))
             return (rc);
+          relNode->indexOp = condptr[i].op;
           added = true;
           useIndex = true;
         }
@@ -645,6 +794,7 @@ RC QL_Manager::SetUpFirstNodeWithQO(QL_Node *&topNode, QO_Rel* qorels){
       //cout << "using index" << endl;
       if((rc = relNode->UseIndex(index, attrEntries[index].indexNo, condptr[condIdx].rhsValue.data) ))
         return (rc);
+      relNode->indexOp = condptr[condIdx].op;
     }
   }
   if(numConds > 0){
@@ -662,6 +812,218 @@ RC QL_Manager::SetUpFirstNodeWithQO(QL_Node *&topNode, QO_Rel* qorels){
   return (0);
 }
 
+/*
+ * Joins the relations at relIdx1 and relIdx2 with a spatial join on the
+ * condition joinCond, and returns the join node in topNode. All other
+ * conditions on these two relations are checked by the join node.
+ */
+RC QL_Manager::SetUpSpatialJoin(QL_Node *&topNode, int relIdx1, int relIdx2, int joinCond){
+  RC rc = 0;
+  int relIndices[2] = {relIdx1, relIdx2};
+  QL_NodeRel *relNodes[2];
+  for(int r = 0; r < 2; r++){
+    int relIndex = relIndices[r];
+    relNodes[r] = new QL_NodeRel(*this, relEntries + relIndex);
+    int *attrList = (int *)malloc(relEntries[relIndex].attrCount * sizeof(int));
+    string relString(relEntries[relIndex].relName);
+    int start = relToAttrIndex[relString];
+    for(int i = 0;  i < relEntries[relIndex].attrCount ; i++){
+      attrList[i] = start + i;
+    }
+    relNodes[r]->SetUpNode(attrList, relEntries[relIndex].attrCount);
+    free(attrList);
+  }
+
+  // Find which side of the condition belongs to which relation
+  int index1, index2, condRel1;
+  if((rc = GetAttrCatEntryPos(condptr[joinCond].lhsAttr, index1)) ||
+    (rc = GetAttrCatEntryPos(condptr[joinCond].rhsAttr, index2)))
+    return (rc);
+  AttrToRelIndex(condptr[joinCond].lhsAttr, condRel1);
+  if(condRel1 != relIdx1){
+    int temp = index1;
+    index1 = index2;
+    index2 = temp;
+  }
+
+  int numConds1, numConds2;
+  CountNumConditions(relIdx1, numConds1);
+  CountNumConditions(relIdx2, numConds2);
+  QL_NodeSpatialJoin *joinNode = new QL_NodeSpatialJoin(*this, *relNodes[0], *relNodes[1]);
+  if((rc = joinNode->SetUpNode(numConds1 + numConds2, index1, index2, joinCond)))
+    return (rc);
+  topNode = joinNode;
+
+  for(int i = 0; i < nConds; i++){
+    if(i != joinCond && (conditionToRel[i] == relIdx1 || conditionToRel[i] == relIdx2)){
+      if((rc = topNode->AddCondition(condptr[i], i)))
+        return (rc);
+    }
+  }
+  return (0);
+}
+
+/*
+ * Returns true if the condition is R.A INTERSECTS S.B, with R.A in the
+ * relation at relIdx1 and S.B in the one at relIdx2 or the other way
+ * round, and both attributes are MBRs with an index
+ */
+bool QL_Manager::IsSpatialJoinCond(const Condition &cond, int relIdx1, int relIdx2){
+  if(cond.op != INTERSECTS_OP || !cond.bRhsIsAttr)
+    return false;
+  int rel1, rel2;
+  AttrToRelIndex(cond.lhsAttr, rel1);
+  AttrToRelIndex(cond.rhsAttr, rel2);
+  if(!((rel1 == relIdx1 && rel2 == relIdx2) || (rel1 == relIdx2 && rel2 == relIdx1)))
+    return false;
+  int index1, index2;
+  if(GetAttrCatEntryPos(cond.lhsAttr, index1) || GetAttrCatEntryPos(cond.rhsAttr, index2))
+    return false;
+  return (attrEntries[index1].attrType == MBR && attrEntries[index1].indexNo != -1 &&
+    attrEntries[index2].attrType == MBR && attrEntries[index2].indexNo != -1);
+}
+
+/*
+ * Joins the relation at relIndex with currNode with a partition based
+ * spatial merge join on the condition joinCond, and returns the join node
+ * in topNode. All other conditions on this relation are checked by the
+ * join node.
+ */
+RC QL_Manager::SetUpPBSMJoin(QL_Node *&topNode, QL_Node *currNode, int relIndex, int joinCond){
+  RC rc = 0;
+  QL_NodeRel *relNode = new QL_NodeRel(*this, relEntries + relIndex);
+  int *attrList = (int *)malloc(relEntries[relIndex].attrCount * sizeof(int));
+  string relString(relEntries[relIndex].relName);
+  int start = relToAttrIndex[relString];
+  for(int i = 0;  i < relEntries[relIndex].attrCount ; i++){
+    attrList[i] = start + i;
+  }
+  relNode->SetUpNode(attrList, relEntries[relIndex].attrCount);
+  free(attrList);
+
+  // The attribute of relIndex is read from the new relation node, the
+  // other one from currNode
+  int index1, index2, condRel1;
+  if((rc = GetAttrCatEntryPos(condptr[joinCond].lhsAttr, index1)) ||
+    (rc = GetAttrCatEntryPos(condptr[joinCond].rhsAttr, index2)))
+    return (rc);
+  AttrToRelIndex(condptr[joinCond].lhsAttr, condRel1);
+  if(condRel1 == relIndex){
+    int temp = index1;
+    index1 = index2;
+    index2 = temp;
+  }
+
+  int numConds;
+  CountNumConditions(relIndex, numConds);
+  QL_NodePBSMJoin *joinNode = new QL_NodePBSMJoin(*this, *currNode, *relNode);
+  if((rc = joinNode->SetUpNode(numConds, index1, index2, joinCond, smm.joinMemory)))
+    return (rc);
+  topNode = joinNode;
+
+  for(int i = 0; i < nConds; i++){
+    if(i != joinCond && conditionToRel[i] == relIndex){
+      if((rc = topNode->AddCondition(condptr[i], i)))
+        return (rc);
+    }
+  }
+  return (0);
+}
+
+/*
+ * Returns true if the condition is R.A INTERSECTS S.B between MBR
+ * attributes of two different relations, one of them at relIndex
+ */
+bool QL_Manager::IsPBSMJoinCond(const Condition &cond, int relIndex){
+  if(cond.op != INTERSECTS_OP || !cond.bRhsIsAttr)
+    return false;
+  int rel1, rel2;
+  AttrToRelIndex(cond.lhsAttr, rel1);
+  AttrToRelIndex(cond.rhsAttr, rel2);
+  if(rel1 == rel2 || (rel1 != relIndex && rel2 != relIndex))
+    return false;
+  int index1, index2;
+  if(GetAttrCatEntryPos(cond.lhsAttr, index1) || GetAttrCatEntryPos(cond.rhsAttr, index2))
+    return false;
+  return (attrEntries[index1].attrType == MBR && attrEntries[index2].attrType == MBR);
+}
+
+/*
+ * Joins the relation at relIndex with currNode on the equality condition
+ * joinCond, with a hash join built on the outer or on the relation, or with
+ * a merge join of the ordered outer and the relation. Returns the join node
+ * in topNode. All other conditions on this relation are checked by the
+ * join node.
+ */
+RC QL_Manager::SetUpEquiJoin(QL_Node *&topNode, QL_Node *currNode, int relIndex, int joinCond,
+  QO_JoinMethod joinMethod, bool buildOuter){
+  RC rc = 0;
+  QL_NodeRel *relNode = new QL_NodeRel(*this, relEntries + relIndex);
+  int *attrList = (int *)malloc(relEntries[relIndex].attrCount * sizeof(int));
+  string relString(relEntries[relIndex].relName);
+  int start = relToAttrIndex[relString];
+  for(int i = 0;  i < relEntries[relIndex].attrCount ; i++){
+    attrList[i] = start + i;
+  }
+  relNode->SetUpNode(attrList, relEntries[relIndex].attrCount);
+  free(attrList);
+
+  // The attribute of relIndex is read from the new relation node, the
+  // other one from currNode
+  int index1, index2, condRel1;
+  if((rc = GetAttrCatEntryPos(condptr[joinCond].lhsAttr, index1)) ||
+    (rc = GetAttrCatEntryPos(condptr[joinCond].rhsAttr, index2)))
+    return (rc);
+  AttrToRelIndex(condptr[joinCond].lhsAttr, condRel1);
+  if(condRel1 == relIndex){
+    int temp = index1;
+    index1 = index2;
+    index2 = temp;
+  }
+
+  int numConds;
+  CountNumConditions(relIndex, numConds);
+  if(joinMethod == QO_MERGEJOIN){
+    QL_NodeMergeJoin *joinNode = new QL_NodeMergeJoin(*this, *currNode, *relNode);
+    topNode = joinNode;
+    if((rc = joinNode->SetUpNode(numConds, index1, index2, joinCond, smm.joinMemory)))
+      return (rc);
+  }
+  else{
+    QL_NodeHashJoin *joinNode = new QL_NodeHashJoin(*this, *currNode, *relNode);
+    topNode = joinNode;
+    if((rc = joinNode->SetUpNode(numConds, index1, index2, joinCond, buildOuter, smm.joinMemory)))
+      return (rc);
+  }
+
+  for(int i = 0; i < nConds; i++){
+    if(i != joinCond && conditionToRel[i] == relIndex){
+      if((rc = topNode->AddCondition(condptr[i], i)))
+        return (rc);
+    }
+  }
+  return (0);
+}
+
+/*
+ * Returns true if the condition is R.A = S.B between INT, FLOAT or STRING
+ * attributes of two different relations, one of them at relIndex
+ */
+bool QL_Manager::IsEquiJoinCond(const Condition &cond, int relIndex){
+  if(cond.op != EQ_OP || !cond.bRhsIsAttr)
+    return false;
+  int rel1, rel2;
+  AttrToRelIndex(cond.lhsAttr, rel1);
+  AttrToRelIndex(cond.rhsAttr, rel2);
+  if(rel1 == rel2 || (rel1 != relIndex && rel2 != relIndex))
+    return false;
+  int index1, index2;
+  if(GetAttrCatEntryPos(cond.lhsAttr, index1) || GetAttrCatEntryPos(cond.rhsAttr, index2))
+    return false;
+  return (attrEntries[index1].attrType != MBR &&
+    attrEntries[index1].attrType == attrEntries[index2].attrType);
+}
+
 /*
  * Counts the number of conditions associated with an relation index, and returns
  * that number in numConds. It does this by accessing the condition-to-relation-index map
@@ -676,6 +1038,19 @@ RC QL_Manager::CountNumConditions(int relIndex, int &numConds){
   return (0);
 }
 
+/*
+ * Returns true if the condition compares an attribute with a value using an
+ * operator that the index scan supports: R.A=v, or R.A INTERSECTS v for
+ * an MBR value, which runs as an R-tree window search
+ */
+bool QL_Manager::IsIndexScanCond(const Condition &cond){
+  if(cond.bRhsIsAttr)
+    return false;
+  if(cond.op == EQ_OP)
+    return true;
+  return (cond.op == INTERSECTS_OP && cond.rhsValue.type == MBR);
+}
+
 /*
  * Returns the pointer to a given attribute specified by a RelAttr. This
  * pointer is returned as one to an AttrCatEntry in entry.
@@ -863,6 +1238,12 @@ RC QL_Manager::Insert(const char *relName,
     free(attrEntries);
     return (QL_BADINSERT);
   }
+  // Refuse the insert before the tuple is written if an index can't take it
+  if((rc = CheckIndexesWritable(-1))){
+    free(relEntries);
+    free(attrEntries);
+    return (rc);
+  }
   // Insert this record into the relation
   rc = InsertIntoRelation(relName, relEntries->tupleLength, nValues, values);
 
@@ -887,9 +1268,10 @@ RC QL_Manager::InsertIntoRelation(const char *relName, int tupleLength, int nVal
   Printer printer(printAttributes, relEntries->attrCount);
   printer.PrintHeader(cout);
 
-  // Open the appropriate file
-  RM_FileHandle relFH;
-  if((rc = rmm.OpenFile(relName, relFH))){
+  // Retrieve the appropriate file, which stays open until the
+  // transaction commits
+  RM_FileHandle *relFH;
+  if((rc = smm.GetRelHandle(relName, relFH))){
     return (rc);
   }
   char *recbuf = (char *)malloc(tupleLength);
@@ -899,13 +1281,15 @@ RC QL_Manager::InsertIntoRelation(const char *relName, int tupleLength, int nVal
 
   // Insert into relation
   RID recRID;
-  if((rc = relFH.InsertRec(recbuf, recRID))){
+  if((rc = relFH->InsertRec(recbuf, recRID))){
     free(recbuf);
     return (rc);
   }
   printer.Print(cout, recbuf);
-  // Insert into any indices in the relation
+  // Insert into any indices in the relation. If one fails, the tuple is
+  // removed again so the relation and its indices still agree
   if((rc = InsertIntoIndex(recbuf, recRID))){
+    relFH->DeleteRec(recRID);
     free(recbuf);
     return (rc);
   }
@@ -913,8 +1297,6 @@ RC QL_Manager::InsertIntoRelation(const char *relName, int tupleLength, int nVal
   printer.PrintFooter(cout);
   free(recbuf);
   free(printAttributes);
-  // Close relation, clean up
-  rc = rmm.CloseFile(relFH);
   return (rc);
 
 }
@@ -927,17 +1309,43 @@ RC QL_Manager::InsertIntoRelation(const char *relName, int tupleLength, int nVal
  */
 RC QL_Manager::InsertIntoIndex(char *recbuf, RID recRID){
   RC rc = 0;
+  vector<IX_IndexHandle *> indexes;
   for(int i = 0; i < relEntries->attrCount; i++){
     AttrCatEntry aEntry = attrEntries[i];
+    IX_IndexHandle *ih = NULL;
     if(aEntry.indexNo != -1){
-      IX_IndexHandle ih;
-      if((rc = ixm.OpenIndex(relEntries->relName, aEntry.indexNo, ih)))
-        return (rc);
-      if((rc = ih.InsertEntry((void *)(recbuf + aEntry.offset), recRID)))
-        return (rc);
-      if((rc = ixm.CloseIndex(ih)))
-        return (rc);
+      if(! (rc = smm.GetIndexHandle(relEntries->relName, aEntry.indexNo, ih)))
+        rc = ih->InsertEntry((void *)(recbuf + aEntry.offset), recRID);
+    }
+    if(rc){
+      // Take the tuple back out of the indices it already went into
+      for(unsigned int j = 0; j < indexes.size(); j++){
+        if(indexes[j] != NULL)
+          indexes[j]->DeleteEntry((void *)(recbuf + attrEntries[j].offset), recRID);
+      }
+      return (rc);
     }
+    indexes.push_back(ih);
+  }
+  return (0);
+}
+
+/*
+ * Used by Insert, Delete and Update before the relation is changed. Packed
+ * index nodes can't be updated, so a command that would have to update
+ * such an index is refused up front instead of failing once the tuples
+ * were already changed.
+ */
+RC QL_Manager::CheckIndexesWritable(int index){
+  RC rc = 0;
+  for(int i = 0; i < relEntries->attrCount; i++){
+    if((index != -1 && i != index) || attrEntries[i].indexNo == -1)
+      continue;
+    IX_IndexHandle *ih;
+    if((rc = smm.GetIndexHandle(relEntries->relName, attrEntries[i].indexNo, ih)))
+      return (rc);
+    if(ih->HasPackedNodes())
+      return (IX_PACKEDINDEX);
   }
   return (0);
 }
@@ -961,8 +1369,7 @@ RC QL_Manager::CreateRecord(char *recbuf, AttrCatEntry *aEntries, int nValues, c
 RC QL_Manager::SetUpOneRelation(const char *relName){
   RC rc = 0;
   RelCatEntry *rEntry;
-  RM_Record relRec;
-  if((rc = smm.GetRelEntry(relName, relRec, rEntry))){
+  if((rc = smm.GetRelEntry(relName, rEntry))){
     return (rc);
   }
   memcpy(relEntries, rEntry, sizeof(RelCatEntry));
@@ -1022,6 +1429,12 @@ RC QL_Manager::Delete(const char *relName,
     free(attrEntries);
     return (rc);
   }
+  // Every index loses the deleted tuples, so none may be packed
+  if((rc = CheckIndexesWritable(-1))){
+    free(relEntries);
+    free(attrEntries);
+    return (rc);
+  }
 
    // Create the query tree nodes
     QL_Node *topNode;
@@ -1047,38 +1460,21 @@ RC QL_Manager::Delete(const char *relName,
 }
 
 /*
- * This is used by RunUpdate. It creates an array of Attr, with one Attr
- * element per attribute given the relation used in the delete command.
- * Each Attr element holds a reference to an IX_IndexHandle element that 
- * can be used to facilitate delete in relations with indices.
- * Delete touches the indices of multiple attributes, so we need to keep
- * a list of all IX_IndexHandles. 
- * It also opens up the specified relation with the passed in RM_FileHandle.
+ * This is used by RunDelete. It retrieves one IX_IndexHandle per attribute
+ * of the relation used in the delete command, or NULL if the attribute
+ * has no index. Delete touches the indices of multiple attributes, so we
+ * need to keep a list of all IX_IndexHandles. 
+ * It also retrieves the handle of the specified relation in relFH.
  */
-RC QL_Manager::SetUpRun(Attr* attributes, RM_FileHandle &relFH){
+RC QL_Manager::SetUpRun(vector<IX_IndexHandle *> &indexes, RM_FileHandle *&relFH){
   RC rc = 0;
+  indexes.assign(relEntries->attrCount, NULL);
   for(int i=0; i < relEntries->attrCount; i++){
-    memset((void*)&attributes[i], 0, sizeof(attributes[i]));
-    IX_IndexHandle ih;
-    attributes[i] = (Attr) {0, 0, 0, 0, ih, NULL};
+    if(attrEntries[i].indexNo != -1 &&
+      (rc = smm.GetIndexHandle(relEntries->relName, attrEntries[i].indexNo, indexes[i])))
+      return (rc);
   }
-  if((rc = smm.PrepareAttr(relEntries, attributes)))
-    return (rc);
-  if((rc = rmm.OpenFile(relEntries->relName, relFH)))
-    return (rc);
-  return (0);
-}
-
-/*
- * Cleans up the Attr list mentioned in SetUpRun. Also used by update
- */
-RC QL_Manager::CleanUpRun(Attr* attributes, RM_FileHandle &relFH){
-  RC rc = 0;
-  if( (rc = rmm.CloseFile(relFH)))
-    return (rc);
-
-  // Destroy and close the pointers in Attr struct
-  if((rc = smm.CleanUpAttr(attributes, relEntries->attrCount)))
+  if((rc = smm.GetRelHandle(relEntries->relName, relFH)))
     return (rc);
   return (0);
 }
@@ -1102,21 +1498,22 @@ RC QL_Manager::RunDelete(QL_Node *topNode){
   Printer printer(printAttributes, attrListSize);
   printer.PrintHeader(cout);
 
-  // Open the appropriate file, and Attr* list for holding IX_IndexHandles
-  // for efficient index updates
-  RM_FileHandle relFH;
-  Attr* attributes = (Attr *)malloc(sizeof(Attr)*relEntries->attrCount);
-  if((rc = SetUpRun(attributes, relFH))){
-    smm.CleanUpAttr(attributes, relEntries->attrCount);
+  // Retrieve the appropriate file, and the IX_IndexHandles of its
+  // attributes for efficient index updates
+  RM_FileHandle *relFH;
+  vector<IX_IndexHandle *> indexes;
+  if((rc = SetUpRun(indexes, relFH)))
     return (rc);
-  } 
   
-  // Retrieves records
+  // Retrieves records. The scan shares the handles of the relation and
+  // its indices, so the records are only deleted once it is closed
   if((rc = topNode->OpenIt() ))
     return (rc);
 
   RM_Record rec;
   RID rid;
+  vector<RID> rids;
+  vector<char> tuples;
   while(true){
     if((rc = topNode->GetNextRec(rec))){
       if (rc == QL_EOI){
@@ -1128,24 +1525,26 @@ RC QL_Manager::RunDelete(QL_Node *topNode){
     if((rc = rec.GetRid(rid)) || (rc = rec.GetData(pData)) )
       return (rc);
     printer.Print(cout, pData); // print out info about the attribute to delete
-    if((rc = relFH.DeleteRec(rid))) // delete it
+    rids.push_back(rid);
+    tuples.insert(tuples.end(), pData, pData + finalTupLength);
+  }
+  
+  if((rc = topNode->CloseIt()))
+    return (rc);
+
+  for(size_t r = 0; r < rids.size(); r++){
+    char *pData = &tuples[r * finalTupLength];
+    if((rc = relFH->DeleteRec(rids[r]))) // delete it
       return (rc);
     
     // Delete it from any index as well
     for(int i=0; i < relEntries->attrCount ; i++){
-      if(attributes[i].indexNo != -1){
-        if((rc = attributes[i].ih.DeleteEntry((void *)(pData + attributes[i].offset), rid)))
+      if(indexes[i] != NULL){
+        if((rc = indexes[i]->DeleteEntry((void *)(pData + attrEntries[i].offset), rids[r])))
           return (rc);
       }
     }
   }
-  
-  if((rc = topNode->CloseIt()))
-    return (rc);
-
-
-  if((rc = CleanUpRun(attributes, relFH)))
-    return (rc);
 
   printer.PrintFooter(cout);
   free(printAttributes);
@@ -1228,9 +1627,9 @@ RC QL_Manager::RunUpdate(QL_Node *topNode, const RelAttr &updAttr,
   printer.PrintHeader(cout);
 
 
-  // Open the file
-  RM_FileHandle relFH;
-  if((rc = rmm.OpenFile(relEntries->relName, relFH)))
+  // Retrieve the file
+  RM_FileHandle *relFH;
+  if((rc = smm.GetRelHandle(relEntries->relName, relFH)))
     return (rc);
 
   int index1, index2; // Get the attrEntries indices to the RHS and LHS attributes
@@ -1242,9 +1641,9 @@ RC QL_Manager::RunUpdate(QL_Node *topNode, const RelAttr &updAttr,
   }
 
   // Get the index to the attribute to be update, if there is one
-  IX_IndexHandle ih;
+  IX_IndexHandle *ih;
   if((attrEntries[index1].indexNo != -1)){
-    if((rc = ixm.OpenIndex(relEntries->relName, attrEntries[index1].indexNo, ih)))
+    if((rc = smm.GetIndexHandle(relEntries->relName, attrEntries[index1].indexNo, ih)))
       return (rc);
   }
 
@@ -1264,7 +1663,7 @@ RC QL_Manager::RunUpdate(QL_Node *topNode, const RelAttr &updAttr,
     if((rc = rec.GetRid(rid)) || (rc = rec.GetData(pData)) )
       return (rc);
     if(attrEntries[index1].indexNo != -1){ // Delete this value from the index
-      if((ih.DeleteEntry(pData + attrEntries[index1].offset, rid)))
+      if((rc = ih->DeleteEntry(pData + attrEntries[index1].offset, rid)))
         return (rc);
     }
     
@@ -1290,26 +1689,19 @@ RC QL_Manager::RunUpdate(QL_Node *topNode, const RelAttr &updAttr,
     }
 
     // Upate this record in the file
-    if((rc = relFH.UpdateRec(rec)))
+    if((rc = relFH->UpdateRec(rec)))
       return (rc);
     printer.Print(cout, pData);
     
     // Update the record in the index
     if(attrEntries[index1].indexNo != -1){
-      if((ih.InsertEntry(pData + attrEntries[index1].offset, rid)))
+      if((rc = ih->InsertEntry(pData + attrEntries[index1].offset, rid)))
         return (rc);
     }
 
   }
   if((rc = topNode->CloseIt()))
     return (rc);
-    
-  if((attrEntries[index1].indexNo != -1)){ // Close file and indices
-    if((rc = ixm.CloseIndex(ih)))
-      return (rc);
-  }
-  if((rc = rmm.CloseFile(relFH)))
-    return (rc);
 
   printer.PrintFooter(cout);
   free(attributes);
@@ -1381,6 +1773,13 @@ RC QL_Manager::Update(const char *relName,
     free(relEntries);
     free(attrEntries);
     return (rc);
+  }
+  // Only the index of the updated attribute changes
+  int updIndex;
+  if((rc = GetAttrCatEntryPos(updAttr, updIndex)) || (rc = CheckIndexesWritable(updIndex))){
+    free(relEntries);
+    free(attrEntries);
+    return (rc);
   }
    // Create query tree
   QL_Node *topNode;
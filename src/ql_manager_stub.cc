@@ -45,7 +45,8 @@ QL_Manager::~QL_Manager()
 //
 RC QL_Manager::Select(int nSelAttrs, const RelAttr selAttrs[],
                       int nRelations, const char * const relations[],
-                      int nConditions, const Condition conditions[])
+                      int nConditions, const Condition conditions[],
+                      const NearestClause *nearest)
 {
     int i;
 
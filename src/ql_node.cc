@@ -20,7 +20,7 @@
 using namespace std;
 
 QL_Node::QL_Node(QL_Manager &qlm) : qlm(qlm) {
-
+  batchPos = 0;
 }
 
 QL_Node::~QL_Node(){
@@ -241,4 +241,97 @@ RC QL_Node::GetAttrList(int *&attrList, int &attrListSize){
 RC QL_Node::GetTupleLength(int &tupleLength){
   tupleLength = this->tupleLength;
   return (0);
-}
\ No newline at end of file
+}
+/*
+ * Returns the next tuple out of the batch kept for GetNext, asking the
+ * node for another batch once all of its selected tuples were returned
+ */
+RC QL_Node::GetNext(char *data){
+  RC rc = 0;
+  while(batchPos >= nextBatch.numSelected){
+    if(nextBatch.data == NULL)
+      nextBatch.Init(tupleLength);
+    if((rc = GetNextBatch(nextBatch)))
+      return (rc);
+    batchPos = 0;
+  }
+  memcpy(data, nextBatch.SelectedTuple(batchPos), tupleLength);
+  batchPos++;
+  return (0);
+}
+
+void QL_Node::ResetBatch(){
+  nextBatch.Clear();
+  batchPos = 0;
+}
+
+RC QL_Node::NextTuple(char *data){
+  return (QL_BADCALL);
+}
+
+RC QL_Node::GetNextRec(RM_RecordView &rec){
+  return (QL_BADCALL);
+}
+
+/*
+ * Fills the batch with tuples from NextTuple. A batch that ends up with
+ * some tuples is returned even if the node ran out while filling it; the
+ * end is reported by the next call.
+ */
+RC QL_Node::FillBatch(TupleBatch &batch){
+  RC rc = 0;
+  batch.Clear();
+  while(! batch.IsFull()){
+    if((rc = NextTuple(batch.NextSlot())))
+      break;
+    batch.AddTuple();
+  }
+  if(rc == QL_EOI && batch.numSelected > 0)
+    return (0);
+  return (rc);
+}
+
+TupleBatch::TupleBatch(){
+  data = NULL;
+  sel = NULL;
+  tupleLength = 0;
+  capacity = 0;
+  numTuples = 0;
+  numSelected = 0;
+}
+
+TupleBatch::~TupleBatch(){
+  free(data);
+  free(sel);
+}
+
+void TupleBatch::Init(int tupleLength){
+  free(data);
+  free(sel);
+  this->tupleLength = tupleLength;
+  capacity = QL_BATCHSIZE;
+  data = (char *)malloc(capacity * tupleLength);
+  sel = (int *)malloc(capacity * sizeof(int));
+  Clear();
+}
+
+void TupleBatch::Clear(){
+  numTuples = 0;
+  numSelected = 0;
+}
+
+char *TupleBatch::NextSlot(){
+  return data + numTuples * tupleLength;
+}
+
+void TupleBatch::AddTuple(){
+  sel[numSelected++] = numTuples++;
+}
+
+bool TupleBatch::IsFull(){
+  return numTuples >= capacity;
+}
+
+char *TupleBatch::SelectedTuple(int i){
+  return data + sel[i] * tupleLength;
+}
@@ -0,0 +1,645 @@
+//
+// File:          ql_nodehashjoin.cc
+// Description:   Hash join node: joins two inputs on equal INT, FLOAT or
+//                STRING attributes, partitioning them when the build input
+//                doesn't fit in memory
+//
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <algorithm>
+#include "redbase.h"
+#include "sm.h"
+#include "rm.h"
+#include "ql.h"
+#include "ix.h"
+#include <string>
+#include "ql_node.h"
+#include "comparators.h"
+
+using namespace std;
+
+// Number of partitions both inputs are split into when the build input
+// doesn't fit in memory
+static const int HASH_PARTITIONS = 16;
+
+static int hashNextFileId = 0;
+
+/*
+ * Create the node by constructing with the two nodes referring to
+ * nodes to join.
+ */
+QL_NodeHashJoin::QL_NodeHashJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2) :
+  QL_Node(qlm), node1(node1), node2(node2){
+  isOpen = false;
+  listsInitialized = false;
+  attrsInRecSize = 0;
+  tupleLength = 0;
+  condIndex = 0;
+  firstNodeSize = 0;
+  joinCond = 0;
+  keyType = INT;
+  buildFirst = false;
+  buildInput = probeInput = NULL;
+  buildLength = probeLength = 0;
+  buildOffset = probeOffset = 0;
+  buildKeyLength = probeKeyLength = 0;
+  maxBlocks = 0;
+  tuplesPerBlock = 0;
+  numBuilt = 0;
+  bucketMask = 0;
+  spilled = false;
+  fileId = hashNextFileId++;
+  currPartition = HASH_PARTITIONS;
+  partitionOpen = false;
+  buildPageNum = -1;
+  buildDone = true;
+  probePageNum = -1;
+  probePage = NULL;
+  probePos = 0;
+  probeBuffer = NULL;
+  probeTuple = NULL;
+  match = -1;
+}
+
+/*
+ * delete all memory. The inputs may already be deleted, so a join left
+ * open only drops its partition files; the blocks go with the pool.
+ */
+QL_NodeHashJoin::~QL_NodeHashJoin(){
+  if(isOpen && spilled){
+    ClosePartition();
+    DestroyPartitionFiles(currPartition + 1);
+  }
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(buffer);
+    free(condsInNode);
+    free(probeBuffer);
+  }
+  listsInitialized = false;
+}
+
+/*
+ * Set up the node with a max number of other conditions that the joined
+ * tuples must meet, the indices of the attributes of node1 and node2 that
+ * must be equal, the number of that condition, which input to build the
+ * hash table on, and the memory that the hash table may take
+ */
+RC QL_NodeHashJoin::SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond,
+  bool buildFirst, int memoryKB){
+  RC rc = 0;
+  int *attrList1;
+  int *attrList2;
+  int attrListSize1;
+  int attrListSize2;
+  if((rc = node1.GetAttrList(attrList1, attrListSize1)) ||
+    (rc = node2.GetAttrList(attrList2, attrListSize2)))
+    return (rc);
+  attrsInRecSize = attrListSize1 + attrListSize2;
+  attrsInRec = (int*)malloc(attrsInRecSize*sizeof(int));
+  for(int i = 0; i < attrListSize1; i++){
+    attrsInRec[i] = attrList1[i];
+  }
+  for(int i=0; i < attrListSize2; i++){
+    attrsInRec[attrListSize1+i] = attrList2[i];
+  }
+
+  condList = (Cond *)malloc(numConds * sizeof(Cond));
+  for(int i= 0; i < numConds; i++){
+    condList[i] = {0, NULL, true, NULL, 0, 0, INT};
+  }
+  condsInNode = (int*)malloc(numConds * sizeof(int));
+
+  int tupleLength1, tupleLength2;
+  node1.GetTupleLength(tupleLength1);
+  node2.GetTupleLength(tupleLength2);
+  tupleLength = tupleLength1 + tupleLength2;
+  firstNodeSize = tupleLength1;
+  buffer = (char *)malloc(tupleLength);
+  memset((void*)buffer, 0, tupleLength);
+
+  // Offsets of the keys in the joined tuple, made relative to each input
+  int offset1, offset2, length1, length2;
+  if((rc = IndexToOffset(attrIndex1, offset1, length1)) ||
+    (rc = IndexToOffset(attrIndex2, offset2, length2)))
+    return (rc);
+  offset2 -= firstNodeSize;
+  keyType = qlm.attrEntries[attrIndex1].attrType;
+
+  this->buildFirst = buildFirst;
+  buildInput = buildFirst ? &node1 : &node2;
+  probeInput = buildFirst ? &node2 : &node1;
+  buildLength = buildFirst ? tupleLength1 : tupleLength2;
+  probeLength = buildFirst ? tupleLength2 : tupleLength1;
+  buildOffset = buildFirst ? offset1 : offset2;
+  probeOffset = buildFirst ? offset2 : offset1;
+  buildKeyLength = buildFirst ? length1 : length2;
+  probeKeyLength = buildFirst ? length2 : length1;
+  probeBuffer = (char *)malloc(probeLength);
+  listsInitialized = true;
+
+  // The pool holds the hash table and a block for each partition being
+  // written. Every shard keeps room for the page being flushed, or the
+  // pages pinned while reading partitions back, wherever they hash.
+  int blockSize;
+  pfm.GetBlockSize(blockSize);
+  maxBlocks = max(1, memoryKB * 1024 / blockSize);
+  tuplesPerBlock = blockSize / buildLength;
+  if(sizeof(int) + max(buildLength, probeLength) > PF_PAGE_SIZE)
+    return (QL_TUPLETOOLONG);
+  if((rc = pfm.ReserveBuffer(maxBlocks + HASH_PARTITIONS, 2)))
+    return (rc);
+
+  this->joinCond = joinCond;
+  return (0);
+}
+
+/*
+ * Reads the build input into the hash table. When it doesn't fit, both
+ * inputs are partitioned, and the first partition is loaded.
+ */
+RC QL_NodeHashJoin::OpenIt(){
+  RC rc = 0;
+  ResetBatch();
+  spilled = false;
+  match = -1;
+  probeTuple = NULL;
+  isOpen = true;
+  if((rc = ReadBuildInput()))
+    return (rc);
+  if(spilled){
+    currPartition = -1;
+    if((rc = NextChunk()) && rc != QL_EOI)
+      return (rc);
+  }
+  else{
+    BuildTable();
+    if((rc = probeInput->OpenIt()))
+      return (rc);
+  }
+  return (0);
+}
+
+/*
+ * Fills the batch with the next pairs of tuples the hash table matches
+ */
+RC QL_NodeHashJoin::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
+/*
+ * Returns the next pair of tuples with equal keys that meet the other
+ * conditions of this node
+ */
+RC QL_NodeHashJoin::NextTuple(char *data){
+  RC rc = 0;
+  while(true){
+    while(match != -1){
+      char *buildTuple = BuildTuple(match);
+      match = bucketNext[match];
+      if(compare_key(buildTuple + buildOffset, buildKeyLength, probeTuple + probeOffset,
+        probeKeyLength, keyType) != 0)
+        continue;
+      char *first = buildFirst ? buildTuple : probeTuple;
+      char *second = buildFirst ? probeTuple : buildTuple;
+      memcpy(buffer, first, firstNodeSize);
+      memcpy(buffer + firstNodeSize, second, tupleLength - firstNodeSize);
+      if(CheckConditions(buffer) == 0){
+        memcpy(data, buffer, tupleLength);
+        return (0);
+      }
+    }
+    if((rc = NextProbeTuple()))
+      return (rc);
+    match = (numBuilt == 0) ? -1 : bucketHeads[HashKey(probeTuple + probeOffset, probeKeyLength) & bucketMask];
+  }
+}
+
+/*
+ * Don't allow join nodes to retrieve records
+ */
+RC QL_NodeHashJoin::GetNextRec(RM_Record &rec){
+  return (QL_BADCALL);
+}
+
+/*
+ * Closes the probe input or the partition files still left, and gives the
+ * memory blocks back to the pool
+ */
+RC QL_NodeHashJoin::CloseIt(){
+  RC rc = 0;
+  if(! isOpen)
+    return (0);
+  if(spilled){
+    if((rc = ClosePartition()) || (rc = DestroyPartitionFiles(currPartition + 1)))
+      return (rc);
+    currPartition = HASH_PARTITIONS;
+  }
+  else if((rc = probeInput->CloseIt()))
+    return (rc);
+  for(unsigned int i = 0; i < blocks.size(); i++){
+    if((rc = pfm.DisposeBlock(blocks[i])))
+      return (rc);
+  }
+  blocks.clear();
+  bucketHeads.clear();
+  bucketNext.clear();
+  numBuilt = 0;
+  isOpen = false;
+  return (0);
+}
+
+/*
+ * Reads build tuples straight into the memory blocks until the input ends,
+ * or the blocks are full and the join has to be partitioned
+ */
+RC QL_NodeHashJoin::ReadBuildInput(){
+  RC rc = 0;
+  numBuilt = 0;
+  if((rc = buildInput->OpenIt()))
+    return (rc);
+  while(true){
+    if(numBuilt == (int)blocks.size() * tuplesPerBlock && ! AddBlock()){
+      spilled = true;
+      return PartitionInputs();
+    }
+    if((rc = buildInput->GetNext(BuildTuple(numBuilt)))){
+      if(rc == QL_EOI)
+        break;
+      return (rc);
+    }
+    numBuilt++;
+  }
+  if((rc = buildInput->CloseIt()))
+    return (rc);
+  return (0);
+}
+
+/*
+ * Splits both inputs by the hash of their keys. The build tuples already in
+ * memory go first, then the rest of the build input, which is still open,
+ * and then the whole probe input. Tuples with equal keys land in the
+ * partitions of the same number.
+ */
+RC QL_NodeHashJoin::PartitionInputs(){
+  RC rc = 0;
+  vector<PF_FileHandle> files(2 * HASH_PARTITIONS);
+  vector<char *> pages(HASH_PARTITIONS);
+  for(int side = 0; side < 2; side++){
+    for(int p = 0; p < HASH_PARTITIONS; p++){
+      string name;
+      PartitionFileName(side, p, name);
+      int i = side * HASH_PARTITIONS + p;
+      if((rc = pfm.CreateFile(name.c_str())) || (rc = pfm.OpenFile(name.c_str(), files[i])))
+        return (rc);
+    }
+  }
+  currPartition = -1;
+
+  // Writing one input at a time, the pages of the other are not needed
+  for(int side = 0; side < 2; side++){
+    QL_Node *input = (side == 0) ? buildInput : probeInput;
+    int length = (side == 0) ? buildLength : probeLength;
+    int offset = (side == 0) ? buildOffset : probeOffset;
+    int keyLength = (side == 0) ? buildKeyLength : probeKeyLength;
+    for(int p = 0; p < HASH_PARTITIONS; p++){
+      if((rc = pfm.AllocateBlock(pages[p])))
+        return (rc);
+      *(int *)pages[p] = 0;
+    }
+
+    if(side == 0){
+      for(int i = 0; i < numBuilt; i++){
+        char *tuple = BuildTuple(i);
+        int p = ((HashKey(tuple + offset, keyLength) * 2654435761u) >> 16) % HASH_PARTITIONS;
+        if((rc = AddToPartition(files[p], pages[p], tuple, length)))
+          return (rc);
+      }
+    }
+    else if((rc = input->OpenIt()))
+      return (rc);
+
+    char *tuple = (side == 0) ? BuildTuple(0) : probeBuffer;
+    while((rc = input->GetNext(tuple)) == 0){
+      int p = ((HashKey(tuple + offset, keyLength) * 2654435761u) >> 16) % HASH_PARTITIONS;
+      if((rc = AddToPartition(files[side * HASH_PARTITIONS + p], pages[p], tuple, length)))
+        return (rc);
+    }
+    if(rc != QL_EOI)
+      return (rc);
+    if((rc = input->CloseIt()))
+      return (rc);
+
+    for(int p = 0; p < HASH_PARTITIONS; p++){
+      PF_FileHandle &fh = files[side * HASH_PARTITIONS + p];
+      if(*(int *)pages[p] > 0 && (rc = FlushPartitionPage(fh, pages[p])))
+        return (rc);
+      if((rc = pfm.DisposeBlock(pages[p])) || (rc = pfm.CloseFile(fh)))
+        return (rc);
+    }
+  }
+  numBuilt = 0;
+  return (0);
+}
+
+/*
+ * Appends a tuple to a partition page, writing the page out when full
+ */
+RC QL_NodeHashJoin::AddToPartition(PF_FileHandle &fh, char *page, char *tuple, int length){
+  RC rc = 0;
+  int *count = (int *)page;
+  memcpy(page + sizeof(int) + (*count) * length, tuple, length);
+  (*count)++;
+  if(sizeof(int) + (*count + 1) * length > PF_PAGE_SIZE){
+    if((rc = FlushPartitionPage(fh, page)))
+      return (rc);
+    *count = 0;
+  }
+  return (0);
+}
+
+/*
+ * Copies a partition page into a new page of its file
+ */
+RC QL_NodeHashJoin::FlushPartitionPage(PF_FileHandle &fh, char *page){
+  RC rc = 0;
+  PF_PageHandle ph;
+  PageNum pageNum;
+  char *pData;
+  if((rc = fh.AllocatePage(ph)) || (rc = ph.GetPageNum(pageNum)) || (rc = ph.GetData(pData)))
+    return (rc);
+  memcpy(pData, page, PF_PAGE_SIZE);
+  if((rc = fh.MarkDirty(pageNum)) || (rc = fh.UnpinPage(pageNum)))
+    return (rc);
+  return (0);
+}
+
+/*
+ * Takes another block from the pool, unless the budget is used up
+ */
+bool QL_NodeHashJoin::AddBlock(){
+  if((int)blocks.size() >= maxBlocks)
+    return false;
+  char *block;
+  if(pfm.AllocateBlock(block))
+    return false;
+  blocks.push_back(block);
+  return true;
+}
+
+/*
+ * Chains the tuples in memory into buckets. There are at least as many
+ * buckets as tuples, so that chains stay short.
+ */
+void QL_NodeHashJoin::BuildTable(){
+  unsigned int numBuckets = 1;
+  while(numBuckets < (unsigned int)numBuilt)
+    numBuckets <<= 1;
+  bucketMask = numBuckets - 1;
+  bucketHeads.assign(numBuckets, -1);
+  bucketNext.resize(numBuilt);
+  for(int i = numBuilt - 1; i >= 0; i--){
+    unsigned int bucket = HashKey(BuildTuple(i) + buildOffset, buildKeyLength) & bucketMask;
+    bucketNext[i] = bucketHeads[bucket];
+    bucketHeads[bucket] = i;
+  }
+}
+
+/*
+ * Gets the next probe tuple, from the probe input itself, or from the
+ * current probe partition
+ */
+RC QL_NodeHashJoin::NextProbeTuple(){
+  RC rc = 0;
+  if(! spilled){
+    if((rc = probeInput->GetNext(probeBuffer)))
+      return (rc);
+    probeTuple = probeBuffer;
+    return (0);
+  }
+  while(true){
+    if(currPartition >= HASH_PARTITIONS)
+      return (QL_EOI);
+    if(probePage != NULL){
+      if(probePos < *(int *)probePage){
+        probeTuple = probePage + sizeof(int) + probePos * probeLength;
+        probePos++;
+        return (0);
+      }
+      if((rc = probeFile.UnpinPage(probePageNum)))
+        return (rc);
+      probePage = NULL;
+    }
+    PF_PageHandle ph;
+    if((rc = probeFile.GetNextPage(probePageNum, ph)) == 0){
+      if((rc = ph.GetPageNum(probePageNum)) || (rc = ph.GetData(probePage)))
+        return (rc);
+      probePos = 0;
+      continue;
+    }
+    if(rc != PF_EOF)
+      return (rc);
+    if((rc = NextChunk()))
+      return (rc);
+  }
+}
+
+/*
+ * Moves on to the next chunk of build tuples that has any, and rewinds the
+ * probe partition. Once a partition's build tuples have all been loaded,
+ * its files are destroyed and the next partition is opened.
+ */
+RC QL_NodeHashJoin::NextChunk(){
+  RC rc = 0;
+  numBuilt = 0;
+  while(numBuilt == 0){
+    if(! partitionOpen || buildDone){
+      if((rc = ClosePartition()))
+        return (rc);
+      currPartition++;
+      if(currPartition >= HASH_PARTITIONS)
+        return (QL_EOI);
+      string buildName, probeName;
+      PartitionFileName(0, currPartition, buildName);
+      PartitionFileName(1, currPartition, probeName);
+      if((rc = pfm.OpenFile(buildName.c_str(), buildFile)) ||
+        (rc = pfm.OpenFile(probeName.c_str(), probeFile)))
+        return (rc);
+      partitionOpen = true;
+      buildPageNum = -1;
+      buildDone = false;
+    }
+    if((rc = LoadBuildChunk()))
+      return (rc);
+  }
+  BuildTable();
+  probePageNum = -1;
+  probePage = NULL;
+  probePos = 0;
+  return (0);
+}
+
+/*
+ * Loads as many pages of the build partition as the memory blocks hold.
+ * A block holds at least as many tuples as a partition page.
+ */
+RC QL_NodeHashJoin::LoadBuildChunk(){
+  RC rc = 0;
+  int pagesLoaded = 0;
+  while(pagesLoaded < maxBlocks){
+    PF_PageHandle ph;
+    char *pData;
+    if((rc = buildFile.GetNextPage(buildPageNum, ph))){
+      if(rc != PF_EOF)
+        return (rc);
+      buildDone = true;
+      break;
+    }
+    if((rc = ph.GetPageNum(buildPageNum)) || (rc = ph.GetData(pData)))
+      return (rc);
+    int count = *(int *)pData;
+    for(int i = 0; i < count; i++){
+      if(numBuilt == (int)blocks.size() * tuplesPerBlock && ! AddBlock()){
+        buildFile.UnpinPage(buildPageNum);
+        return (QL_ERROR);
+      }
+      memcpy(BuildTuple(numBuilt), pData + sizeof(int) + i * buildLength, buildLength);
+      numBuilt++;
+    }
+    if((rc = buildFile.UnpinPage(buildPageNum)))
+      return (rc);
+    pagesLoaded++;
+  }
+  return (0);
+}
+
+/*
+ * Closes and destroys the files of the current partition
+ */
+RC QL_NodeHashJoin::ClosePartition(){
+  RC rc = 0;
+  if(! partitionOpen)
+    return (0);
+  if(probePage != NULL && (rc = probeFile.UnpinPage(probePageNum)))
+    return (rc);
+  probePage = NULL;
+  if((rc = pfm.CloseFile(buildFile)) || (rc = pfm.CloseFile(probeFile)))
+    return (rc);
+  partitionOpen = false;
+  for(int side = 0; side < 2; side++){
+    string name;
+    PartitionFileName(side, currPartition, name);
+    if((rc = pfm.DestroyFile(name.c_str())))
+      return (rc);
+  }
+  return (0);
+}
+
+/*
+ * Destroys the files of the partitions from firstPartition on, which have
+ * not been opened
+ */
+RC QL_NodeHashJoin::DestroyPartitionFiles(int firstPartition){
+  RC rc = 0;
+  for(int p = firstPartition; p < HASH_PARTITIONS; p++){
+    for(int side = 0; side < 2; side++){
+      string name;
+      PartitionFileName(side, p, name);
+      if((rc = pfm.DestroyFile(name.c_str())))
+        return (rc);
+    }
+  }
+  return (0);
+}
+
+/*
+ * FNV-1a hash of a key of the given length. Equal keys must hash alike:
+ * strings are hashed up to their end, which is the end of the attribute
+ * when no null comes first, and both zeroes hash as +0.0.
+ */
+unsigned int QL_NodeHashJoin::HashKey(char *key, int length){
+  unsigned int hash = 2166136261u;
+  float zero = 0.0;
+  if(keyType == FLOAT && *(float *)key == 0.0)
+    key = (char *)&zero;
+  if(keyType == STRING)
+    length = strnlen(key, length);
+  for(int i = 0; i < length; i++){
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+char *QL_NodeHashJoin::BuildTuple(int index){
+  return blocks[index / tuplesPerBlock] + (index % tuplesPerBlock) * buildLength;
+}
+
+void QL_NodeHashJoin::PartitionFileName(int side, int partition, string &name){
+  stringstream ss;
+  ss << "hashjoin." << getpid() << "." << fileId << "." << side << "." << partition;
+  name = ss.str();
+}
+
+/*
+ * Print the node, and instruct it to print its previous nodes
+ */
+RC QL_NodeHashJoin::PrintNode(int numTabs){
+  for(int i=0; i < numTabs; i++){
+    cout << "\t";
+  }
+  cout << "--HASH JOIN: \n";
+  for(int j=0; j <numTabs; j++){
+    cout << "\t";
+  }
+  PrintCondition(qlm.condptr[joinCond]);
+  int blockSize;
+  pfm.GetBlockSize(blockSize);
+  cout << " (built on " << (buildFirst ? "first" : "second") << " input, "
+    << maxBlocks * blockSize / 1024 << " KB)\n";
+  for(int i = 0; i < condIndex; i++){
+    for(int j=0; j <numTabs; j++){
+      cout << "\t";
+    }
+    PrintCondition(qlm.condptr[condsInNode[i]]);
+    cout << "\n";
+  }
+  node1.PrintNode(numTabs + 1);
+  node2.PrintNode(numTabs + 1);
+  return (0);
+}
+
+/*
+ * Free all memory associated with this node, and delete the previous nodes
+ */
+RC QL_NodeHashJoin::DeleteNodes(){
+  node1.DeleteNodes();
+  node2.DeleteNodes();
+  delete &node1;
+  delete &node2;
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(condsInNode);
+    free(buffer);
+    free(probeBuffer);
+  }
+  listsInitialized = false;
+  return (0);
+}
+
+bool QL_NodeHashJoin::IsRelNode(){
+  return false;
+}
+
+RC QL_NodeHashJoin::OpenIt(void *data){
+  return (QL_BADCALL);
+}
+
+RC QL_NodeHashJoin::UseIndex(int attrNum, int indexNumber, void *data){
+  return (QL_BADCALL);
+}
@@ -38,7 +38,7 @@ QL_NodeJoin::QL_NodeJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2) :
  * delete all memory
  */
 QL_NodeJoin::~QL_NodeJoin(){
-  if(listsInitialized = true){
+  if(listsInitialized == true){
     free(attrsInRec);
     free(condList);
     free(buffer);
@@ -98,6 +98,7 @@ RC QL_NodeJoin::SetUpNode(int numConds){
  */
 RC QL_NodeJoin::OpenIt(){
   RC rc = 0;
+  ResetBatch();
   if(!useIndexJoin){
     if((rc = node1.OpenIt()) || (rc = node2.OpenIt()))
       return (rc);
@@ -111,10 +112,17 @@ RC QL_NodeJoin::OpenIt(){
   return (0);
 }
 
+/*
+ * Fills the batch with the next joined tuples that meet the conditions
+ */
+RC QL_NodeJoin::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
 /*
  * Returns the next tuple join that satisfies the conditions
  */
-RC QL_NodeJoin::GetNext(char *data){
+RC QL_NodeJoin::NextTuple(char *data){
   RC rc = 0;
   // Retrieve the first tuple, marking the start of the iterator
   if(gotFirstTuple == false && ! useIndexJoin){
@@ -0,0 +1,552 @@
+//
+// File:          ql_nodemergejoin.cc
+// Description:   Merge join node: joins two inputs on equal INT, FLOAT or
+//                STRING attributes by merging them in key order
+//
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <algorithm>
+#include <queue>
+#include "redbase.h"
+#include "sm.h"
+#include "rm.h"
+#include "ql.h"
+#include "ix.h"
+#include <string>
+#include "ql_node.h"
+#include "comparators.h"
+
+using namespace std;
+
+// Largest number of runs merged at once. It keeps the pool of the runs
+// in one shard, where every page pinned by the merge finds a frame.
+static const int MERGE_MAX_FANIN = 512;
+
+static int mergeNextFileId = 0;
+
+/*
+ * Create the node by constructing with the two nodes referring to
+ * nodes to join.
+ */
+QL_NodeMergeJoin::QL_NodeMergeJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2) :
+  QL_Node(qlm), node1(node1), node2(node2){
+  isOpen = false;
+  listsInitialized = false;
+  attrsInRecSize = 0;
+  tupleLength = 0;
+  condIndex = 0;
+  firstNodeSize = 0;
+  offset1 = offset2 = 0;
+  joinCond = 0;
+  keyType = INT;
+  keyLength1 = keyLength2 = 0;
+  memoryKB = 0;
+  maxTuples = 0;
+  fanIn = 0;
+  tuplesPerPage = 0;
+  fileId = mergeNextFileId++;
+  nextRun = 0;
+  innerTuples = NULL;
+  innerCapacity = 0;
+  numInner = 0;
+  innerSpilled = false;
+  innerRun = -1;
+  innerPageNum = -1;
+  innerPage = NULL;
+  outerTuple = NULL;
+  lastKey = NULL;
+  haveOuter = false;
+  lo = 0;
+  match = 0;
+}
+
+/*
+ * delete all memory. The inputs may already be deleted, so only the file
+ * of the sorted inner is dropped.
+ */
+QL_NodeMergeJoin::~QL_NodeMergeJoin(){
+  if(innerSpilled)
+    CloseInner();
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(buffer);
+    free(condsInNode);
+    free(outerTuple);
+    free(lastKey);
+  }
+  listsInitialized = false;
+  free(innerTuples);
+}
+
+/*
+ * Set up the node with a max number of other conditions that the joined
+ * tuples must meet, the indices of the attributes of node1 and node2 that
+ * must be equal, the number of that condition, and the memory that the
+ * inner may take while it is sorted. node1 must come out ordered on its
+ * attribute.
+ */
+RC QL_NodeMergeJoin::SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond, int memoryKB){
+  RC rc = 0;
+  int *attrList1;
+  int *attrList2;
+  int attrListSize1;
+  int attrListSize2;
+  if((rc = node1.GetAttrList(attrList1, attrListSize1)) ||
+    (rc = node2.GetAttrList(attrList2, attrListSize2)))
+    return (rc);
+  attrsInRecSize = attrListSize1 + attrListSize2;
+  attrsInRec = (int*)malloc(attrsInRecSize*sizeof(int));
+  for(int i = 0; i < attrListSize1; i++){
+    attrsInRec[i] = attrList1[i];
+  }
+  for(int i=0; i < attrListSize2; i++){
+    attrsInRec[attrListSize1+i] = attrList2[i];
+  }
+
+  condList = (Cond *)malloc(numConds * sizeof(Cond));
+  for(int i= 0; i < numConds; i++){
+    condList[i] = {0, NULL, true, NULL, 0, 0, INT};
+  }
+  condsInNode = (int*)malloc(numConds * sizeof(int));
+
+  int tupleLength1, tupleLength2;
+  node1.GetTupleLength(tupleLength1);
+  node2.GetTupleLength(tupleLength2);
+  tupleLength = tupleLength1 + tupleLength2;
+  firstNodeSize = tupleLength1;
+  buffer = (char *)malloc(tupleLength);
+  memset((void*)buffer, 0, tupleLength);
+
+  // Offsets of the keys in the joined tuple, made relative to each input
+  if((rc = IndexToOffset(attrIndex1, offset1, keyLength1)) ||
+    (rc = IndexToOffset(attrIndex2, offset2, keyLength2)))
+    return (rc);
+  offset2 -= firstNodeSize;
+  keyType = qlm.attrEntries[attrIndex1].attrType;
+  outerTuple = (char *)malloc(firstNodeSize);
+  lastKey = (char *)malloc(keyLength1);
+  listsInitialized = true;
+
+  // The inner is sorted in runs of up to memoryKB, which are merged
+  // fanIn at a time through a pool of as many pages, and an output page
+  int innerLength = tupleLength2;
+  this->memoryKB = memoryKB;
+  maxTuples = max(1, memoryKB * 1024 / innerLength);
+  fanIn = max(2, min(memoryKB * 1024 / PF_PAGE_SIZE - 1, MERGE_MAX_FANIN));
+  tuplesPerPage = (PF_PAGE_SIZE - sizeof(int)) / innerLength;
+  if(tuplesPerPage == 0)
+    return (QL_TUPLETOOLONG);
+  if((rc = pfm.ResizeBuffer(fanIn + 2)))
+    return (rc);
+
+  this->joinCond = joinCond;
+  return (0);
+}
+
+/*
+ * Sorts the inner input, and opens the outer to be streamed
+ */
+RC QL_NodeMergeJoin::OpenIt(){
+  RC rc = 0;
+  ResetBatch();
+  if((rc = ReadInner()))
+    return (rc);
+  if((rc = node1.OpenIt()))
+    return (rc);
+  haveOuter = false;
+  lo = 0;
+  match = numInner;
+  isOpen = true;
+  return (0);
+}
+
+/*
+ * Fills the batch with the next pairs of tuples the merge matches
+ */
+RC QL_NodeMergeJoin::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
+/*
+ * Returns the next pair of tuples with equal keys that meet the other
+ * conditions of this node. The inner tuples with the outer tuple's key
+ * form a run starting at lo. Since the outer keys come in order, lo only
+ * moves forward, and outer tuples with the same key pair with the same run.
+ */
+RC QL_NodeMergeJoin::NextTuple(char *data){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  while(true){
+    while(match < numInner){
+      char *innerTuple;
+      if((rc = InnerTuple(match, innerTuple)))
+        return (rc);
+      if(CompareKeys(innerTuple + offset2, keyLength2, outerTuple + offset1, keyLength1) != 0){
+        match = numInner;
+        break;
+      }
+      match++;
+      memcpy(buffer, outerTuple, firstNodeSize);
+      memcpy(buffer + firstNodeSize, innerTuple, innerLength);
+      if(CheckConditions(buffer) == 0){
+        memcpy(data, buffer, tupleLength);
+        return (0);
+      }
+    }
+
+    bool hadOuter = haveOuter;
+    if((rc = node1.GetNext(outerTuple)))
+      return (rc);
+    haveOuter = true;
+    char *key = outerTuple + offset1;
+    // An outer that goes back in key order is searched for from the start
+    if(hadOuter && CompareKeys(key, keyLength1, lastKey, keyLength1) < 0)
+      lo = 0;
+    for(; lo < numInner; lo++){
+      char *innerTuple;
+      if((rc = InnerTuple(lo, innerTuple)))
+        return (rc);
+      if(CompareKeys(innerTuple + offset2, keyLength2, key, keyLength1) >= 0)
+        break;
+    }
+    match = lo;
+    memcpy(lastKey, key, keyLength1);
+  }
+}
+
+/*
+ * Don't allow join nodes to retrieve records
+ */
+RC QL_NodeMergeJoin::GetNextRec(RM_Record &rec){
+  return (QL_BADCALL);
+}
+
+/*
+ * Closes the outer input, and drops the sorted inner
+ */
+RC QL_NodeMergeJoin::CloseIt(){
+  RC rc = 0;
+  if((rc = node1.CloseIt()))
+    return (rc);
+  if(innerSpilled && (rc = CloseInner()))
+    return (rc);
+  innerOrder.clear();
+  numInner = 0;
+  isOpen = false;
+  return (0);
+}
+
+/*
+ * Reads the inner input in runs of maxTuples, and sorts the list of their
+ * positions on the key. If the whole input fits in one run, it stays in
+ * memory. Otherwise every run is written to a file, and the runs are
+ * merged fanIn at a time, until one file holds the sorted inner.
+ */
+RC QL_NodeMergeJoin::ReadInner(){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  vector<int> runs;
+  int numTuples = 0;
+  numInner = 0;
+  if((rc = node2.OpenIt()))
+    return (rc);
+  while(true){
+    if(numTuples == maxTuples){
+      if((rc = WriteRun(numTuples)))
+        return (rc);
+      runs.push_back(nextRun++);
+      numTuples = 0;
+    }
+    if(numTuples == innerCapacity){
+      innerCapacity = min(maxTuples, (innerCapacity == 0) ? 64 : 2 * innerCapacity);
+      innerTuples = (char *)realloc(innerTuples, innerCapacity * innerLength);
+    }
+    if((rc = node2.GetNext(innerTuples + numTuples * innerLength))){
+      if(rc == QL_EOI)
+        break;
+      return (rc);
+    }
+    numTuples++;
+    numInner++;
+  }
+  if((rc = node2.CloseIt()))
+    return (rc);
+  if(runs.empty()){
+    SortTuples(numTuples);
+    return (0);
+  }
+  if(numTuples > 0){
+    if((rc = WriteRun(numTuples)))
+      return (rc);
+    runs.push_back(nextRun++);
+  }
+  // The tuples in memory are all in runs now
+  free(innerTuples);
+  innerTuples = NULL;
+  innerCapacity = 0;
+  innerOrder.clear();
+
+  while(runs.size() > 1){
+    vector<int> merged;
+    for(unsigned int i = 0; i < runs.size(); i += fanIn){
+      int count = min(fanIn, (int)(runs.size() - i));
+      if(count == 1){
+        merged.push_back(runs[i]);
+        continue;
+      }
+      if((rc = MergeRuns(&runs[i], count)))
+        return (rc);
+      merged.push_back(nextRun++);
+    }
+    runs = merged;
+  }
+
+  innerRun = runs[0];
+  string name;
+  RunFileName(innerRun, name);
+  if((rc = pfm.OpenFile(name.c_str(), innerFile)))
+    return (rc);
+  innerSpilled = true;
+  innerPageNum = -1;
+  return (0);
+}
+
+/*
+ * Sorts the list of positions of the first numTuples inner tuples in
+ * memory on their key
+ */
+void QL_NodeMergeJoin::SortTuples(int numTuples){
+  int innerLength = tupleLength - firstNodeSize;
+  innerOrder.resize(numTuples);
+  for(int i = 0; i < numTuples; i++)
+    innerOrder[i] = i;
+  stable_sort(innerOrder.begin(), innerOrder.end(), [&](int a, int b){
+    return CompareKeys(innerTuples + a * innerLength + offset2, keyLength2,
+      innerTuples + b * innerLength + offset2, keyLength2) < 0;
+  });
+}
+
+/*
+ * Sorts the inner tuples in memory, and writes them in order to the file
+ * of run nextRun
+ */
+RC QL_NodeMergeJoin::WriteRun(int numTuples){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  SortTuples(numTuples);
+  string name;
+  RunFileName(nextRun, name);
+  PF_FileHandle fh;
+  if((rc = pfm.CreateFile(name.c_str())) || (rc = pfm.OpenFile(name.c_str(), fh)))
+    return (rc);
+  char *page = NULL;
+  PageNum pageNum = -1;
+  for(int i = 0; i < numTuples; i++){
+    if((rc = AppendToRun(fh, page, pageNum, innerTuples + innerOrder[i] * innerLength)))
+      return (rc);
+  }
+  if((rc = fh.UnpinPage(pageNum)) || (rc = pfm.CloseFile(fh)))
+    return (rc);
+  return (0);
+}
+
+/*
+ * Merges count runs into the file of run nextRun, and destroys them. Ties
+ * go to the earlier run, so the sort stays stable.
+ */
+RC QL_NodeMergeJoin::MergeRuns(int *runs, int count){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  vector<PF_FileHandle> files(count);
+  vector<char *> pages(count, (char *)NULL);
+  vector<PageNum> pageNums(count, -1);
+  vector<int> pos(count, 0);
+  auto later = [&](int a, int b){
+    int comp = CompareKeys(pages[a] + sizeof(int) + pos[a] * innerLength + offset2, keyLength2,
+      pages[b] + sizeof(int) + pos[b] * innerLength + offset2, keyLength2);
+    return (comp > 0 || (comp == 0 && a > b));
+  };
+  priority_queue<int, vector<int>, decltype(later)> heap(later);
+  for(int k = 0; k < count; k++){
+    string name;
+    RunFileName(runs[k], name);
+    PF_PageHandle ph;
+    if((rc = pfm.OpenFile(name.c_str(), files[k])) || (rc = files[k].GetFirstPage(ph)) ||
+      (rc = ph.GetPageNum(pageNums[k])) || (rc = ph.GetData(pages[k])))
+      return (rc);
+    heap.push(k);
+  }
+
+  string name;
+  RunFileName(nextRun, name);
+  PF_FileHandle out;
+  if((rc = pfm.CreateFile(name.c_str())) || (rc = pfm.OpenFile(name.c_str(), out)))
+    return (rc);
+  char *outPage = NULL;
+  PageNum outPageNum = -1;
+  while(! heap.empty()){
+    int k = heap.top();
+    heap.pop();
+    if((rc = AppendToRun(out, outPage, outPageNum, pages[k] + sizeof(int) + pos[k] * innerLength)))
+      return (rc);
+    if(++pos[k] < *(int *)pages[k]){
+      heap.push(k);
+      continue;
+    }
+    // The page of run k is used up, so go on with its next page
+    PF_PageHandle ph;
+    if((rc = files[k].UnpinPage(pageNums[k])))
+      return (rc);
+    if((rc = files[k].GetNextPage(pageNums[k], ph)) == 0){
+      if((rc = ph.GetPageNum(pageNums[k])) || (rc = ph.GetData(pages[k])))
+        return (rc);
+      pos[k] = 0;
+      heap.push(k);
+    }
+    else if(rc != PF_EOF)
+      return (rc);
+  }
+  if((rc = out.UnpinPage(outPageNum)) || (rc = pfm.CloseFile(out)))
+    return (rc);
+
+  for(int k = 0; k < count; k++){
+    RunFileName(runs[k], name);
+    if((rc = pfm.CloseFile(files[k])) || (rc = pfm.DestroyFile(name.c_str())))
+      return (rc);
+  }
+  return (0);
+}
+
+/*
+ * Copies a tuple to the end of a run. The last page of the run stays
+ * pinned in page, and a new one is allocated when it is full.
+ */
+RC QL_NodeMergeJoin::AppendToRun(PF_FileHandle &fh, char *&page, PageNum &pageNum, char *tuple){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  if(page == NULL || *(int *)page == tuplesPerPage){
+    if(page != NULL && (rc = fh.UnpinPage(pageNum)))
+      return (rc);
+    PF_PageHandle ph;
+    if((rc = fh.AllocatePage(ph)) || (rc = ph.GetPageNum(pageNum)) || (rc = ph.GetData(page)) ||
+      (rc = fh.MarkDirty(pageNum)))
+      return (rc);
+    *(int *)page = 0;
+  }
+  memcpy(page + sizeof(int) + *(int *)page * innerLength, tuple, innerLength);
+  (*(int *)page)++;
+  return (0);
+}
+
+/*
+ * Points tuple at the inner tuple at index in key order. When the inner
+ * is in a file, the page holding it is pinned until another one is needed.
+ * Every page of the file is full but the last.
+ */
+RC QL_NodeMergeJoin::InnerTuple(int index, char *&tuple){
+  RC rc = 0;
+  int innerLength = tupleLength - firstNodeSize;
+  if(! innerSpilled){
+    tuple = innerTuples + innerOrder[index] * innerLength;
+    return (0);
+  }
+  PageNum pageNum = index / tuplesPerPage;
+  if(pageNum != innerPageNum){
+    if(innerPageNum != -1 && (rc = innerFile.UnpinPage(innerPageNum)))
+      return (rc);
+    innerPageNum = -1;
+    PF_PageHandle ph;
+    if((rc = innerFile.GetThisPage(pageNum, ph)) || (rc = ph.GetData(innerPage)))
+      return (rc);
+    innerPageNum = pageNum;
+  }
+  tuple = innerPage + sizeof(int) + (index % tuplesPerPage) * innerLength;
+  return (0);
+}
+
+/*
+ * Closes and destroys the file of the sorted inner
+ */
+RC QL_NodeMergeJoin::CloseInner(){
+  RC rc = 0;
+  if(innerPageNum != -1 && (rc = innerFile.UnpinPage(innerPageNum)))
+    return (rc);
+  innerPageNum = -1;
+  innerSpilled = false;
+  string name;
+  RunFileName(innerRun, name);
+  if((rc = pfm.CloseFile(innerFile)) || (rc = pfm.DestroyFile(name.c_str())))
+    return (rc);
+  return (0);
+}
+
+int QL_NodeMergeJoin::CompareKeys(char *key1, int length1, char *key2, int length2){
+  return compare_key(key1, length1, key2, length2, keyType);
+}
+
+void QL_NodeMergeJoin::RunFileName(int run, string &name){
+  stringstream ss;
+  ss << "mergejoin." << getpid() << "." << fileId << "." << run;
+  name = ss.str();
+}
+
+/*
+ * Print the node, and instruct it to print its previous nodes
+ */
+RC QL_NodeMergeJoin::PrintNode(int numTabs){
+  for(int i=0; i < numTabs; i++){
+    cout << "\t";
+  }
+  cout << "--MERGE JOIN: \n";
+  for(int j=0; j <numTabs; j++){
+    cout << "\t";
+  }
+  PrintCondition(qlm.condptr[joinCond]);
+  cout << " (outer ordered, inner sorted in " << memoryKB << " KB)\n";
+  for(int i = 0; i < condIndex; i++){
+    for(int j=0; j <numTabs; j++){
+      cout << "\t";
+    }
+    PrintCondition(qlm.condptr[condsInNode[i]]);
+    cout << "\n";
+  }
+  node1.PrintNode(numTabs + 1);
+  node2.PrintNode(numTabs + 1);
+  return (0);
+}
+
+/*
+ * Free all memory associated with this node, and delete the previous nodes
+ */
+RC QL_NodeMergeJoin::DeleteNodes(){
+  node1.DeleteNodes();
+  node2.DeleteNodes();
+  delete &node1;
+  delete &node2;
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(condsInNode);
+    free(buffer);
+    free(outerTuple);
+    free(lastKey);
+  }
+  listsInitialized = false;
+  return (0);
+}
+
+bool QL_NodeMergeJoin::IsRelNode(){
+  return false;
+}
+
+RC QL_NodeMergeJoin::OpenIt(void *data){
+  return (QL_BADCALL);
+}
+
+RC QL_NodeMergeJoin::UseIndex(int attrNum, int indexNumber, void *data){
+  return (QL_BADCALL);
+}
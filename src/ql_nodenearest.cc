@@ -0,0 +1,268 @@
+//
+// File:          ql_nodenearest.cc
+// Description:   Nearest neighbour node: returns the k tuples closest to a
+//                query MBR, in increasing order of distance
+//
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <algorithm>
+#include "redbase.h"
+#include "sm.h"
+#include "rm.h"
+#include "ql.h"
+#include "ix.h"
+#include <string>
+#include "ql_node.h"
+#include "comparators.h"
+
+using namespace std;
+
+/*
+ * Initializes the state of the node
+ */
+QL_NodeNearest::QL_NodeNearest(QL_Manager &qlm, QL_Node &prevNode) : QL_Node(qlm), prevNode(prevNode) {
+  isOpen = false;
+  listsInitialized = false;
+  tupleLength = 0;
+  attrsInRecSize = 0;
+  condIndex = 0;
+  attrIndex = 0;
+  attrOffset = 0;
+  k = 0;
+  inputOrdered = false;
+  numReturned = 0;
+  tuples = NULL;
+  tuplesCapacity = 0;
+}
+
+/*
+ * Cleans up nearest neighbour node
+ */
+QL_NodeNearest::~QL_NodeNearest(){
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(buffer);
+  }
+  listsInitialized = false;
+  if(tuples != NULL)
+    free(tuples);
+  tuples = NULL;
+}
+
+/*
+ * Sets up the node with the index of the MBR attribute, the query MBR and
+ * the number of tuples to return. inputOrdered says whether the previous
+ * node already returns tuples in increasing distance to value (a nearest
+ * neighbour index scan). The attribute list is copied from the previous
+ * node.
+ */
+RC QL_NodeNearest::SetUpNode(int attrIndex, void *value, int k, bool inputOrdered){
+  RC rc = 0;
+  int *attrListPtr;
+  if((rc = prevNode.GetAttrList(attrListPtr, attrsInRecSize)))
+    return (rc);
+  attrsInRec = (int *)malloc(attrsInRecSize*sizeof(int));
+  for(int i = 0;  i < attrsInRecSize; i++){
+    attrsInRec[i] = attrListPtr[i];
+  }
+  prevNode.GetTupleLength(tupleLength);
+  buffer = (char *)malloc(tupleLength);
+  memset((void*)buffer, 0, tupleLength);
+  listsInitialized = true;
+
+  this->attrIndex = attrIndex;
+  int length;
+  if((rc = IndexToOffset(attrIndex, attrOffset, length)))
+    return (rc);
+  memcpy(&query, value, sizeof(mbr));
+  this->k = k;
+  this->inputOrdered = inputOrdered;
+  return (0);
+}
+
+/*
+ * Opens the previous node. If its tuples don't come out by distance, all of
+ * them are read here and the k closest are kept for GetNext.
+ */
+RC QL_NodeNearest::OpenIt(){
+  RC rc = 0;
+  ResetBatch();
+  if((rc = prevNode.OpenIt()))
+    return (rc);
+  numReturned = 0;
+  best.clear();
+  if(! inputOrdered){
+    if((rc = CollectNearest()))
+      return (rc);
+  }
+  isOpen = true;
+  return (0);
+}
+
+/*
+ * Fills the batch with the next closest tuples
+ */
+RC QL_NodeNearest::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
+/*
+ * Get the next closest tuple
+ */
+RC QL_NodeNearest::NextTuple(char *data){
+  RC rc = 0;
+  if(numReturned >= k)
+    return (QL_EOI);
+  if(inputOrdered){
+    if((rc = prevNode.GetNext(buffer)))
+      return (rc);
+    memcpy(data, buffer, tupleLength);
+  }
+  else{
+    if(numReturned >= (int)best.size())
+      return (QL_EOI);
+    memcpy(data, tuples + best[numReturned].second * tupleLength, tupleLength);
+  }
+  numReturned++;
+  return (0);
+}
+
+/*
+ * Close the iterator by closing the previous node's iterator
+ */
+RC QL_NodeNearest::CloseIt(){
+  RC rc = 0;
+  if((rc = prevNode.CloseIt()))
+    return (rc);
+  best.clear();
+  isOpen = false;
+  return (0);
+}
+
+/*
+ * Retrieves the next record from the previous node. This is only possible
+ * when the previous node returns records by distance; otherwise the
+ * records are not kept.
+ */
+RC QL_NodeNearest::GetNextRec(RM_Record &rec){
+  RC rc = 0;
+  if(! inputOrdered)
+    return (QL_BADCALL);
+  if(numReturned >= k)
+    return (QL_EOI);
+  if((rc = prevNode.GetNextRec(rec)))
+    return (rc);
+  numReturned++;
+  return (0);
+}
+
+/*
+ * Retrieves the next record from the previous node in place, under the
+ * same condition as above
+ */
+RC QL_NodeNearest::GetNextRec(RM_RecordView &rec){
+  RC rc = 0;
+  if(! inputOrdered)
+    return (QL_BADCALL);
+  if(numReturned >= k)
+    return (QL_EOI);
+  if((rc = prevNode.GetNextRec(rec)))
+    return (rc);
+  numReturned++;
+  return (0);
+}
+
+/*
+ * Reads every tuple of the previous node, keeping the k closest in a max
+ * heap on distance. When the heap is full a tuple only gets in by
+ * replacing the farthest one. At the end the heap is sorted so that best
+ * lists the kept tuples closest first.
+ */
+RC QL_NodeNearest::CollectNearest(){
+  RC rc = 0;
+  while(true){
+    if((rc = prevNode.GetNext(buffer))){
+      if(rc == QL_EOI)
+        break;
+      return (rc);
+    }
+    double dist = Distance(buffer);
+    int slot;
+    if((int)best.size() < k){
+      slot = best.size();
+      if(slot == tuplesCapacity){
+        tuplesCapacity = (tuplesCapacity == 0) ? min(k, 64) : min(k, 2*tuplesCapacity);
+        tuples = (char *)realloc(tuples, tuplesCapacity*tupleLength);
+      }
+    }
+    else if(dist < best.front().first){
+      pop_heap(best.begin(), best.end());
+      slot = best.back().second;
+      best.pop_back();
+    }
+    else
+      continue;
+    memcpy(tuples + slot*tupleLength, buffer, tupleLength);
+    best.push_back(make_pair(dist, slot));
+    push_heap(best.begin(), best.end());
+  }
+  sort_heap(best.begin(), best.end());
+  return (0);
+}
+
+/*
+ * Squared MINDIST from the MBR attribute of a tuple to the query MBR
+ */
+double QL_NodeNearest::Distance(char *tuple){
+  mbr key;
+  memcpy(&key, tuple + attrOffset, sizeof(mbr));
+  return mindist_mbr(key, query);
+}
+
+/*
+ * Print the node, and instruct it to print its previous nodes
+ */
+RC QL_NodeNearest::PrintNode(int numTabs){
+  for(int i=0; i < numTabs; i++){
+    cout << "\t";
+  }
+  cout << "--NEAREST: " << k << " closest on attribute " << qlm.attrEntries[attrIndex].attrName
+    << " to ";
+  print_mbr(&query, sizeof(mbr));
+  if(inputOrdered)
+    cout << "(ordered input)";
+  cout << endl;
+  prevNode.PrintNode(numTabs + 1);
+  return (0);
+}
+
+/*
+ * Free all memory associated with this node, and delete the previous node
+ */
+RC QL_NodeNearest::DeleteNodes(){
+  prevNode.DeleteNodes();
+  delete &prevNode;
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(buffer);
+  }
+  listsInitialized = false;
+  if(tuples != NULL)
+    free(tuples);
+  tuples = NULL;
+  return (0);
+}
+
+bool QL_NodeNearest::IsRelNode(){
+  return false;
+}
+
+RC QL_NodeNearest::OpenIt(void *data){
+  return (QL_BADCALL);
+}
+
+RC QL_NodeNearest::UseIndex(int attrNum, int indexNumber, void *data){
+  return (QL_BADCALL);
+}
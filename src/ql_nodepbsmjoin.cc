@@ -0,0 +1,625 @@
+//
+// File:          ql_nodepbsmjoin.cc
+// Description:   Partition based spatial merge join node: joins two inputs
+//                on intersecting MBR attributes without an index
+//
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include "redbase.h"
+#include "sm.h"
+#include "rm.h"
+#include "ql.h"
+#include "ix.h"
+#include <string>
+#include "ql_node.h"
+#include "comparators.h"
+
+using namespace std;
+
+// Partitions are sized for this much more data than the inputs hold, to
+// leave room for the tuples copied into more than one partition
+static const double PBSM_REPLICATION = 1.2;
+// Upper bound on the number of partitions, so that the files of one input
+// can all be open at once. A partition that outgrows the memory budget,
+// because of this bound or of clustered data, is joined a chunk at a time.
+static const int PBSM_MAX_PARTITIONS = 64;
+// Tiles per partition. More tiles spread clustered data more evenly over
+// the partitions, but copy more MBRs into several of them.
+static const int PBSM_TILES_PER_PARTITION = 4;
+
+static int pbsmNextFileId = 0;
+
+/*
+ * Create the node by constructing with the two nodes referring to
+ * nodes to join.
+ */
+QL_NodePBSMJoin::QL_NodePBSMJoin(QL_Manager &qlm, QL_Node &node1, QL_Node &node2) :
+  QL_Node(qlm), node1(node1), node2(node2){
+  isOpen = false;
+  listsInitialized = false;
+  attrsInRecSize = 0;
+  tupleLength = 0;
+  condIndex = 0;
+  firstNodeSize = 0;
+  offset1 = offset2 = 0;
+  joinCond = 0;
+  memoryBytes = 0;
+  fileId = pbsmNextFileId++;
+  filesCreated = false;
+  emptyUniverse = true;
+  numPartitions = 0;
+  tilesPerSide = 0;
+  currPartition = -1;
+  partitionOpen = false;
+  maxTuples1 = maxTuples2 = 0;
+  partTuples1 = NULL;
+  partTuples2 = NULL;
+  count1 = count2 = 0;
+  lastPage1 = lastPage2 = -1;
+  more1 = more2 = false;
+  whole2 = false;
+  nextResult = 0;
+}
+
+/*
+ * delete all memory
+ */
+QL_NodePBSMJoin::~QL_NodePBSMJoin(){
+  if(partitionOpen)
+    ClosePartition();
+  if(filesCreated)
+    DestroyPartitionFiles();
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(buffer);
+    free(condsInNode);
+  }
+  listsInitialized = false;
+  free(partTuples1);
+  free(partTuples2);
+}
+
+/*
+ * Set up the node with a max number of other conditions that the joined
+ * tuples must meet, the indices of the MBR attributes of node1 and node2,
+ * the number of the INTERSECTS condition between them, and the memory that
+ * one partition of both inputs may take
+ */
+RC QL_NodePBSMJoin::SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond, int memoryKB){
+  RC rc = 0;
+  int *attrList1;
+  int *attrList2;
+  int attrListSize1;
+  int attrListSize2;
+  if((rc = node1.GetAttrList(attrList1, attrListSize1)) ||
+    (rc = node2.GetAttrList(attrList2, attrListSize2)))
+    return (rc);
+  attrsInRecSize = attrListSize1 + attrListSize2;
+  attrsInRec = (int*)malloc(attrsInRecSize*sizeof(int));
+  for(int i = 0; i < attrListSize1; i++){
+    attrsInRec[i] = attrList1[i];
+  }
+  for(int i=0; i < attrListSize2; i++){
+    attrsInRec[attrListSize1+i] = attrList2[i];
+  }
+
+  condList = (Cond *)malloc(numConds * sizeof(Cond));
+  for(int i= 0; i < numConds; i++){
+    condList[i] = {0, NULL, true, NULL, 0, 0, INT};
+  }
+  condsInNode = (int*)malloc(numConds * sizeof(int));
+
+  int tupleLength1, tupleLength2;
+  node1.GetTupleLength(tupleLength1);
+  node2.GetTupleLength(tupleLength2);
+  tupleLength = tupleLength1 + tupleLength2;
+  firstNodeSize = tupleLength1;
+  buffer = (char *)malloc(tupleLength);
+  memset((void*)buffer, 0, tupleLength);
+  listsInitialized = true;
+
+  // Offsets in the joined tuple, made relative to each input's tuple
+  int length;
+  if((rc = IndexToOffset(attrIndex1, offset1, length)) ||
+    (rc = IndexToOffset(attrIndex2, offset2, length)))
+    return (rc);
+  offset2 -= firstNodeSize;
+  this->joinCond = joinCond;
+  memoryBytes = memoryKB * 1024;
+  // Each input of a partition gets half of the memory, and at least a page
+  maxTuples1 = max((int)((PF_PAGE_SIZE - sizeof(int)) / firstNodeSize), memoryBytes / 2 / firstNodeSize);
+  maxTuples2 = max((int)((PF_PAGE_SIZE - sizeof(int)) / tupleLength2), memoryBytes / 2 / tupleLength2);
+  return (0);
+}
+
+/*
+ * Partitions both inputs. Nothing is joined until GetNext asks for the
+ * first partition.
+ */
+RC QL_NodePBSMJoin::OpenIt(){
+  RC rc = 0;
+  ResetBatch();
+  currPartition = -1;
+  results.clear();
+  nextResult = 0;
+  if((rc = ComputeUniverse()))
+    return (rc);
+  if(! emptyUniverse){
+    filesCreated = true;
+    if((rc = PartitionInput(0)) || (rc = PartitionInput(1)))
+      return (rc);
+  }
+  isOpen = true;
+  return (0);
+}
+
+/*
+ * Fills the batch with the next pairs of tuples of the partitions
+ */
+RC QL_NodePBSMJoin::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
+/*
+ * Returns the next pair of tuples whose MBRs intersect and that meet the
+ * other conditions of this node
+ */
+RC QL_NodePBSMJoin::NextTuple(char *data){
+  RC rc = 0;
+  if(emptyUniverse)
+    return (QL_EOI);
+  int tupleLength2 = tupleLength - firstNodeSize;
+  while(true){
+    while(nextResult >= results.size()){
+      if((rc = NextChunks()))
+        return (rc);
+      JoinChunks();
+    }
+    pair<int, int> match = results[nextResult++];
+    memcpy(buffer, partTuples1 + match.first * firstNodeSize, firstNodeSize);
+    memcpy(buffer + firstNodeSize, partTuples2 + match.second * tupleLength2, tupleLength2);
+    if(CheckConditions(buffer) == 0)
+      break;
+  }
+  memcpy(data, buffer, tupleLength);
+  return (0);
+}
+
+/*
+ * Don't allow join nodes to retrieve records
+ */
+RC QL_NodePBSMJoin::GetNextRec(RM_Record &rec){
+  return (QL_BADCALL);
+}
+
+/*
+ * Frees the partition in memory, and destroys the partition files that
+ * were not joined. The inputs were already closed after partitioning.
+ */
+RC QL_NodePBSMJoin::CloseIt(){
+  RC rc = 0;
+  if(partitionOpen && (rc = ClosePartition()))
+    return (rc);
+  if(filesCreated && (rc = DestroyPartitionFiles()))
+    return (rc);
+  results.clear();
+  nextResult = 0;
+  free(partTuples1);
+  free(partTuples2);
+  partTuples1 = NULL;
+  partTuples2 = NULL;
+  isOpen = false;
+  return (0);
+}
+
+/*
+ * Scans both inputs for the rectangle covering all their MBRs. Only the
+ * intersection of the two covers can hold a result, so the grid is laid
+ * over that, and MBRs outside of it are dropped when partitioning. The
+ * number of partitions is the smallest that keeps each partition of both
+ * inputs within the memory budget, if the MBRs are spread evenly.
+ */
+RC QL_NodePBSMJoin::ComputeUniverse(){
+  RC rc = 0;
+  int cover[2][4];
+  int counts[2];
+  for(int side = 0; side < 2; side++){
+    QL_Node &node = (side == 0) ? node1 : node2;
+    int offset = (side == 0) ? offset1 : offset2;
+    int length = (side == 0) ? firstNodeSize : tupleLength - firstNodeSize;
+    char *tuple = (char *)malloc(length);
+    cover[side][0] = cover[side][2] = INT_MAX;
+    cover[side][1] = cover[side][3] = INT_MIN;
+    counts[side] = 0;
+    if((rc = node.OpenIt())){
+      free(tuple);
+      return (rc);
+    }
+    while((rc = node.GetNext(tuple)) == 0){
+      mbr key;
+      memcpy(&key, tuple + offset, sizeof(mbr));
+      cover[side][0] = min(cover[side][0], min(key.top_left_x, key.bottom_right_x));
+      cover[side][1] = max(cover[side][1], max(key.top_left_x, key.bottom_right_x));
+      cover[side][2] = min(cover[side][2], min(key.top_left_y, key.bottom_right_y));
+      cover[side][3] = max(cover[side][3], max(key.top_left_y, key.bottom_right_y));
+      counts[side]++;
+    }
+    free(tuple);
+    if(rc != QL_EOI)
+      return (rc);
+    if((rc = node.CloseIt()))
+      return (rc);
+  }
+
+  numTuples1 = counts[0];
+  numTuples2 = counts[1];
+  ux1 = max(cover[0][0], cover[1][0]);
+  ux2 = min(cover[0][1], cover[1][1]);
+  uy1 = max(cover[0][2], cover[1][2]);
+  uy2 = min(cover[0][3], cover[1][3]);
+  emptyUniverse = (numTuples1 == 0 || numTuples2 == 0 || ux1 > ux2 || uy1 > uy2);
+  if(emptyUniverse)
+    return (0);
+
+  double bytes = PBSM_REPLICATION * ((double)numTuples1 * firstNodeSize +
+    (double)numTuples2 * (tupleLength - firstNodeSize));
+  numPartitions = (int)ceil(bytes / memoryBytes);
+  numPartitions = max(1, min(numPartitions, PBSM_MAX_PARTITIONS));
+  tilesPerSide = (int)ceil(sqrt((double)PBSM_TILES_PER_PARTITION * numPartitions));
+  return (0);
+}
+
+/*
+ * Reads one input, and appends every tuple to the partitions of the tiles
+ * its MBR overlaps. A tuple goes into a partition only once, even when
+ * several of its tiles belong to it. Each partition fills one page in
+ * memory at a time, which is written out when it is full.
+ */
+RC QL_NodePBSMJoin::PartitionInput(int side){
+  RC rc = 0;
+  QL_Node &node = (side == 0) ? node1 : node2;
+  int offset = (side == 0) ? offset1 : offset2;
+  int length = (side == 0) ? firstNodeSize : tupleLength - firstNodeSize;
+  int tuplesPerPage = (PF_PAGE_SIZE - sizeof(int)) / length;
+
+  vector<PF_FileHandle> files(numPartitions);
+  vector<char *> pages(numPartitions);
+  vector<int> lastTuple(numPartitions, -1);
+  for(int p = 0; p < numPartitions; p++){
+    string name;
+    PartitionFileName(side, p, name);
+    if((rc = pfm.CreateFile(name.c_str())) || (rc = pfm.OpenFile(name.c_str(), files[p])))
+      return (rc);
+    pages[p] = (char *)malloc(PF_PAGE_SIZE);
+    *(int *)pages[p] = 0;
+  }
+
+  char *tuple = (char *)malloc(length);
+  if((rc = node.OpenIt()))
+    return (rc);
+  int tupleNum = 0;
+  while((rc = node.GetNext(tuple)) == 0){
+    mbr key;
+    memcpy(&key, tuple + offset, sizeof(mbr));
+    int x1 = max(min(key.top_left_x, key.bottom_right_x), ux1);
+    int x2 = min(max(key.top_left_x, key.bottom_right_x), ux2);
+    int y1 = max(min(key.top_left_y, key.bottom_right_y), uy1);
+    int y2 = min(max(key.top_left_y, key.bottom_right_y), uy2);
+    tupleNum++;
+    if(x1 > x2 || y1 > y2)
+      continue;
+    for(int ty = TileY(y1); ty <= TileY(y2); ty++){
+      for(int tx = TileX(x1); tx <= TileX(x2); tx++){
+        int p = TileToPartition(tx, ty);
+        if(lastTuple[p] == tupleNum)
+          continue;
+        lastTuple[p] = tupleNum;
+        int *count = (int *)pages[p];
+        memcpy(pages[p] + sizeof(int) + (*count) * length, tuple, length);
+        (*count)++;
+        if(*count == tuplesPerPage){
+          if((rc = FlushPartitionPage(files[p], pages[p])))
+            return (rc);
+          *count = 0;
+        }
+      }
+    }
+  }
+  free(tuple);
+  if(rc != QL_EOI)
+    return (rc);
+  if((rc = node.CloseIt()))
+    return (rc);
+
+  for(int p = 0; p < numPartitions; p++){
+    if(*(int *)pages[p] > 0 && (rc = FlushPartitionPage(files[p], pages[p])))
+      return (rc);
+    free(pages[p]);
+    if((rc = pfm.CloseFile(files[p])))
+      return (rc);
+  }
+  return (0);
+}
+
+/*
+ * Copies a partition page into a new page of its file
+ */
+RC QL_NodePBSMJoin::FlushPartitionPage(PF_FileHandle &fh, char *page){
+  RC rc = 0;
+  PF_PageHandle ph;
+  PageNum pageNum;
+  char *pData;
+  if((rc = fh.AllocatePage(ph)) || (rc = ph.GetPageNum(pageNum)) || (rc = ph.GetData(pData)))
+    return (rc);
+  memcpy(pData, page, PF_PAGE_SIZE);
+  if((rc = fh.MarkDirty(pageNum)) || (rc = fh.UnpinPage(pageNum)))
+    return (rc);
+  return (0);
+}
+
+/*
+ * Opens the files of the next partition
+ */
+RC QL_NodePBSMJoin::OpenPartition(){
+  RC rc = 0;
+  string name1, name2;
+  currPartition++;
+  PartitionFileName(0, currPartition, name1);
+  PartitionFileName(1, currPartition, name2);
+  if((rc = pfm.OpenFile(name1.c_str(), partFile1)))
+    return (rc);
+  if((rc = pfm.OpenFile(name2.c_str(), partFile2))){
+    pfm.CloseFile(partFile1);
+    return (rc);
+  }
+  partitionOpen = true;
+  lastPage1 = lastPage2 = -1;
+  return (0);
+}
+
+/*
+ * Closes the files of the current partition, and destroys them since each
+ * partition is joined only once
+ */
+RC QL_NodePBSMJoin::ClosePartition(){
+  RC rc = 0;
+  partitionOpen = false;
+  if((rc = pfm.CloseFile(partFile1)) || (rc = pfm.CloseFile(partFile2)))
+    return (rc);
+  for(int side = 0; side < 2; side++){
+    string name;
+    PartitionFileName(side, currPartition, name);
+    if((rc = pfm.DestroyFile(name.c_str())))
+      return (rc);
+  }
+  return (0);
+}
+
+/*
+ * Reads the pages of one input of the partition that follow the last one
+ * read, until the next page would take the chunk over its number of
+ * tuples. A chunk holds at least one page. more tells whether pages are
+ * left.
+ */
+RC QL_NodePBSMJoin::LoadChunk(int side){
+  RC rc = 0;
+  int length = (side == 0) ? firstNodeSize : tupleLength - firstNodeSize;
+  int maxTuples = (side == 0) ? maxTuples1 : maxTuples2;
+  PF_FileHandle &fh = (side == 0) ? partFile1 : partFile2;
+  char *&tuples = (side == 0) ? partTuples1 : partTuples2;
+  int &numTuples = (side == 0) ? count1 : count2;
+  PageNum &lastPage = (side == 0) ? lastPage1 : lastPage2;
+  bool &more = (side == 0) ? more1 : more2;
+
+  if(tuples == NULL)
+    tuples = (char *)malloc(maxTuples * length);
+  numTuples = 0;
+  more = false;
+  PF_PageHandle ph;
+  while((rc = fh.GetNextPage(lastPage, ph)) == 0){
+    PageNum pageNum;
+    char *pData;
+    if((rc = ph.GetPageNum(pageNum)) || (rc = ph.GetData(pData)))
+      return (rc);
+    int count = *(int *)pData;
+    if(numTuples + count > maxTuples){
+      more = true;
+      return (fh.UnpinPage(pageNum));
+    }
+    memcpy(tuples + numTuples * length, pData + sizeof(int), count * length);
+    numTuples += count;
+    lastPage = pageNum;
+    if((rc = fh.UnpinPage(pageNum)))
+      return (rc);
+  }
+  if(rc != PF_EOF)
+    return (rc);
+  return (0);
+}
+
+/*
+ * Moves on to the next pair of chunks to join. Within a partition, every
+ * chunk of the first input is joined with every chunk of the second one,
+ * which is read again from its start for each chunk of the first, unless
+ * it fits in a single chunk. Returns QL_EOI after the last partition.
+ */
+RC QL_NodePBSMJoin::NextChunks(){
+  RC rc = 0;
+  while(true){
+    if(! partitionOpen){
+      if(currPartition + 1 >= numPartitions)
+        return (QL_EOI);
+      if((rc = OpenPartition()) || (rc = LoadChunk(0)) || (rc = LoadChunk(1)))
+        return (rc);
+      whole2 = ! more2;
+    }
+    else if(more2){
+      if((rc = LoadChunk(1)))
+        return (rc);
+    }
+    else if(more1){
+      if((rc = LoadChunk(0)))
+        return (rc);
+      if(! whole2){
+        lastPage2 = -1;
+        if((rc = LoadChunk(1)))
+          return (rc);
+      }
+    }
+    else{
+      if((rc = ClosePartition()))
+        return (rc);
+      continue;
+    }
+    if(count1 > 0 && count2 > 0)
+      return (0);
+  }
+}
+
+/*
+ * Joins the chunks in memory with a plane sweep over both of them. A pair
+ * of MBRs that overlap more than one tile is found in every partition
+ * holding one of those tiles; it is only kept in the partition of the
+ * tile containing its reference point, the lower corner of the two MBRs'
+ * intersection.
+ */
+void QL_NodePBSMJoin::JoinChunks(){
+  vector<struct SweepEntry> entries[2];
+  for(int side = 0; side < 2; side++){
+    char *tuples = (side == 0) ? partTuples1 : partTuples2;
+    int count = (side == 0) ? count1 : count2;
+    int offset = (side == 0) ? offset1 : offset2;
+    int length = (side == 0) ? firstNodeSize : tupleLength - firstNodeSize;
+    entries[side].resize(count);
+    for(int i = 0; i < count; i++){
+      mbr key;
+      memcpy(&key, tuples + i * length + offset, sizeof(mbr));
+      struct SweepEntry &entry = entries[side][i];
+      entry.x1 = min(key.top_left_x, key.bottom_right_x);
+      entry.x2 = max(key.top_left_x, key.bottom_right_x);
+      entry.y1 = min(key.top_left_y, key.bottom_right_y);
+      entry.y2 = max(key.top_left_y, key.bottom_right_y);
+      entry.tuple = i;
+    }
+    sort(entries[side].begin(), entries[side].end(),
+      [](const struct SweepEntry &a, const struct SweepEntry &b){ return a.x1 < b.x1; });
+  }
+
+  vector<pair<int, int> > pairs;
+  plane_sweep(entries[0], entries[1], pairs);
+  results.clear();
+  nextResult = 0;
+  for(size_t i = 0; i < pairs.size(); i++){
+    struct SweepEntry &e1 = entries[0][pairs[i].first];
+    struct SweepEntry &e2 = entries[1][pairs[i].second];
+    int refX = max(e1.x1, e2.x1);
+    int refY = max(e1.y1, e2.y1);
+    if(TileToPartition(TileX(refX), TileY(refY)) == currPartition)
+      results.push_back(make_pair(e1.tuple, e2.tuple));
+  }
+}
+
+/*
+ * Destroys the files of the partitions after the current one, which have
+ * not been opened yet
+ */
+RC QL_NodePBSMJoin::DestroyPartitionFiles(){
+  RC rc = 0;
+  for(int p = currPartition + 1; p < numPartitions; p++){
+    for(int side = 0; side < 2; side++){
+      string name;
+      PartitionFileName(side, p, name);
+      if((rc = pfm.DestroyFile(name.c_str())))
+        return (rc);
+    }
+  }
+  currPartition = numPartitions;
+  filesCreated = false;
+  return (0);
+}
+
+int QL_NodePBSMJoin::TileX(int x){
+  long long tile = ((long long)x - ux1) * tilesPerSide / ((long long)ux2 - ux1 + 1);
+  return max(0, min((int)tile, tilesPerSide - 1));
+}
+
+int QL_NodePBSMJoin::TileY(int y){
+  long long tile = ((long long)y - uy1) * tilesPerSide / ((long long)uy2 - uy1 + 1);
+  return max(0, min((int)tile, tilesPerSide - 1));
+}
+
+/*
+ * Tiles are dealt out to the partitions round robin in row order, so that
+ * a dense area of the grid is spread over several partitions
+ */
+int QL_NodePBSMJoin::TileToPartition(int tx, int ty){
+  return (ty * tilesPerSide + tx) % numPartitions;
+}
+
+void QL_NodePBSMJoin::PartitionFileName(int side, int partition, string &name){
+  stringstream ss;
+  ss << "pbsm." << getpid() << "." << fileId << "." << side << "." << partition;
+  name = ss.str();
+}
+
+/*
+ * Print the node, and instruct it to print its previous nodes
+ */
+RC QL_NodePBSMJoin::PrintNode(int numTabs){
+  for(int i=0; i < numTabs; i++){
+    cout << "\t";
+  }
+  cout << "--PBSM JOIN: \n";
+  for(int j=0; j <numTabs; j++){
+    cout << "\t";
+  }
+  PrintCondition(qlm.condptr[joinCond]);
+  cout << " (partitioned, " << memoryBytes / 1024 << " KB per partition)\n";
+  for(int i = 0; i < condIndex; i++){
+    for(int j=0; j <numTabs; j++){
+      cout << "\t";
+    }
+    PrintCondition(qlm.condptr[condsInNode[i]]);
+    cout << "\n";
+  }
+  node1.PrintNode(numTabs + 1);
+  node2.PrintNode(numTabs + 1);
+  return (0);
+}
+
+/*
+ * Free all memory associated with this node, and delete the previous nodes
+ */
+RC QL_NodePBSMJoin::DeleteNodes(){
+  node1.DeleteNodes();
+  node2.DeleteNodes();
+  delete &node1;
+  delete &node2;
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(condsInNode);
+    free(buffer);
+  }
+  listsInitialized = false;
+  return (0);
+}
+
+bool QL_NodePBSMJoin::IsRelNode(){
+  return false;
+}
+
+RC QL_NodePBSMJoin::OpenIt(void *data){
+  return (QL_BADCALL);
+}
+
+RC QL_NodePBSMJoin::UseIndex(int attrNum, int indexNumber, void *data){
+  return (QL_BADCALL);
+}
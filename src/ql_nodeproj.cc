@@ -34,7 +34,6 @@ QL_NodeProj::QL_NodeProj(QL_Manager &qlm, QL_Node &prevNode) : QL_Node(qlm), pre
 QL_NodeProj::~QL_NodeProj(){
   if(listsInitialized == true){
     free(attrsInRec);
-    free(buffer);
   }
   listsInitialized = false;
 }
@@ -51,12 +50,10 @@ RC QL_NodeProj::SetUpNode(int numAttrToKeep){
   memset((void*)attrsInRec, 0, sizeof(attrsInRec));
   int attrsInRecSize = 0;
 
-  // malloc the buffer to keep the data for a tuple passed
-  // up from the previous node
+  // set up the batch to keep the tuples passed up from the previous node
   int bufLength;
   prevNode.GetTupleLength(bufLength);
-  buffer = (char *)malloc(bufLength);
-  memset((void*) buffer, 0, sizeof(buffer));
+  inBatch.Init(bufLength);
   listsInitialized = true;
 
   return (0);
@@ -67,20 +64,26 @@ RC QL_NodeProj::SetUpNode(int numAttrToKeep){
  */
 RC QL_NodeProj::OpenIt(){
   RC rc = 0;
+  ResetBatch();
   if((rc = prevNode.OpenIt()))
     return (rc);
   return (0);
 }
 
 /*
- * Get the Data from the previous node, and reconstruct it
+ * Get a batch from the previous node, and reconstruct each of its selected
+ * tuples into the batch passed in
  */
-RC QL_NodeProj::GetNext(char *data){
+RC QL_NodeProj::GetNextBatch(TupleBatch &batch){
   RC rc = 0;
-  if((rc = prevNode.GetNext(buffer)))
+  if((rc = prevNode.GetNextBatch(inBatch)))
     return (rc);
 
-  ReconstructRec(data);
+  batch.Clear();
+  for(int i = 0; i < inBatch.numSelected; i++){
+    ReconstructRec(inBatch.SelectedTuple(i), batch.NextSlot());
+    batch.AddTuple();
+  }
   return (0);
 }
 
@@ -107,11 +110,11 @@ RC QL_NodeProj::AddProj(int attrIndex){
 }
 
 /*
- * Given data from the previous node store in buffer, it reconstructs it
+ * Given a tuple from the previous node, it reconstructs it
  * by retrieving only the attributes to keep, and storing the
  * new data in the pointer passed in
  */
-RC QL_NodeProj::ReconstructRec(char *data){
+RC QL_NodeProj::ReconstructRec(char *tuple, char *data){
   RC rc = 0;
   int currIdx = 0;
   int *attrsInPrevNode;
@@ -130,7 +133,7 @@ RC QL_NodeProj::ReconstructRec(char *data){
     }
     // get offset of index j
     int attrIdx = attrsInRec[i];
-    memcpy(data + currIdx, buffer + bufIdx, qlm.attrEntries[attrIdx].attrLength);
+    memcpy(data + currIdx, tuple + bufIdx, qlm.attrEntries[attrIdx].attrLength);
     currIdx += qlm.attrEntries[attrIdx].attrLength;
   }
 
@@ -171,7 +174,6 @@ RC QL_NodeProj::DeleteNodes(){
   delete &prevNode;
   if(listsInitialized == true){
     free(attrsInRec);
-    free(buffer);
     //free(attrsToKeep);
   }
   listsInitialized = false;
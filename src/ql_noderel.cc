@@ -6,6 +6,11 @@
 
 #include <cstdio>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
 #include <unistd.h>
 #include "redbase.h"
 #include "sm.h"
@@ -19,6 +24,50 @@
 
 using namespace std;
 
+/*
+ * Number of morsels whose records may wait for the consumer before the
+ * workers of a parallel scan stop taking more
+ */
+static const int QL_MORSEL_QUEUE = 64;
+
+/*
+ * The state a parallel scan shares with its workers. Workers take the
+ * next morsel, a range of QL_MORSEL_PAGES pages, by incrementing
+ * nextMorsel, and queue the matching tuples of each morsel under its
+ * number. The consumer takes any queued morsel, or, to keep file order,
+ * the morsels in turn; workers then also queue empty morsels, and don't
+ * get more than QL_MORSEL_QUEUE morsels ahead of the consumer.
+ */
+struct QL_NodeRel::MorselScan{
+  MorselScan(QL_Node &filter, int numPages, int numWorkers, bool keepOrder) :
+    filter(filter), numPages(numPages), keepOrder(keepOrder){
+    nextMorsel = 0;
+    stop = false;
+    nextChunk = 0;
+    runningWorkers = numWorkers;
+    rc = 0;
+    nextTuple = 0;
+  }
+
+  QL_Node &filter;            // node whose conditions the workers check
+  int numPages;
+  bool keepOrder;
+  vector<thread> workers;
+  atomic<int> nextMorsel;
+  atomic<bool> stop;          // set when the scan is closed or a worker fails
+
+  mutex queueLatch;           // guards everything below
+  condition_variable notFull;
+  condition_variable notEmpty;
+  map<int, vector<char> > chunks; // tuples found, by morsel
+  int nextChunk;              // morsel the consumer waits for, if keepOrder
+  int runningWorkers;
+  RC rc;                      // first error of a worker
+
+  vector<char> current;       // tuples the consumer is returning
+  size_t nextTuple;           // offset of the next one in current
+};
+
 /*
  * Create the relation node given the relation entry of the relation
  * it refers to
@@ -34,10 +83,15 @@ QL_NodeRel::QL_NodeRel(QL_Manager &qlm, RelCatEntry *rEntry) : QL_Node(qlm){
   tupleLength = rEntry->tupleLength;
 
   useIndex = false;
+  indexOp = EQ_OP;
+  nearestScan = false;
   indexNo = 0;
   indexAttr = 0;
   void *value = NULL;
   useIndexJoin = false;
+  morsels = NULL;
+  fh = NULL;
+  ih = NULL;
 }
 
 /*
@@ -59,19 +113,28 @@ QL_NodeRel::~QL_NodeRel(){
  */
 RC QL_NodeRel::OpenIt(){
   RC rc = 0;
+  ResetBatch();
   isOpen = true;
   if(useIndex){
-    if((rc = qlm.ixm.OpenIndex(relName, indexNo, ih)))
+    if((rc = qlm.smm.GetIndexHandle(relName, indexNo, ih)))
       return (rc);
-    if((rc = is.OpenScan(ih, EQ_OP, value)))
+    if(nearestScan){
+      if((rc = is.OpenNearestScan(*ih, value)))
+        return (rc);
+    }
+    else if(indexOp == INTERSECTS_OP && qlm.smm.scanWorkers > 1){
+      if((rc = is.OpenParallelScan(*ih, value, qlm.smm.scanWorkers)))
+        return (rc);
+    }
+    else if((rc = is.OpenScan(*ih, indexOp, value)))
       return (rc);
-    if((rc = qlm.rmm.OpenFile(relName, fh)))
+    if((rc = qlm.smm.GetRelHandle(relName, fh)))
       return (rc);
   }
   else{
-    if((rc = qlm.rmm.OpenFile(relName, fh)))
+    if((rc = qlm.smm.GetRelHandle(relName, fh)))
       return (rc);
-    if((rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL)))
+    if((rc = fs.OpenScan(*fh, INT, 4, 0, NO_OP, NULL)))
       return (rc);
   }
   return (0);
@@ -79,49 +142,58 @@ RC QL_NodeRel::OpenIt(){
 
 RC QL_NodeRel::OpenIt(void *data){
   RC rc = 0;
+  ResetBatch();
   isOpen = true;
   value = data;
-  if((rc = qlm.ixm.OpenIndex(relName, indexNo, ih)))
+  if((rc = qlm.smm.GetIndexHandle(relName, indexNo, ih)))
     return (rc);
-  if((rc = is.OpenScan(ih, EQ_OP, value)))
+  if((rc = is.OpenScan(*ih, EQ_OP, value)))
     return (rc);
-  if((rc = qlm.rmm.OpenFile(relName, fh)))
+  if((rc = qlm.smm.GetRelHandle(relName, fh)))
     return (rc);
   return (0);
 }
 
 /*
- * Retrieve the next record data and copy it to the pointer passed in
+ * Copies the data of the next records into the batch, until it is full or
+ * the scan ends
  */
-RC QL_NodeRel::GetNext(char *data){
+RC QL_NodeRel::GetNextBatch(TupleBatch &batch){
   RC rc = 0;
   char *recData;
-  RM_Record rec;
-  if((rc = RetrieveNextRec(rec, recData))){
-    if(rc == RM_EOF || rc == IX_EOF){
-      return (QL_EOI);
+  if(morsels != NULL)
+    return GetNextParallelBatch(batch);
+  batch.Clear();
+  while(! batch.IsFull()){
+    if((rc = RetrieveNextRec(recView, recData))){
+      if(rc != RM_EOF && rc != IX_EOF)
+        return (rc);
+      if(batch.numSelected == 0)
+        return (QL_EOI);
+      break;
     }
-    return (rc);
+    memcpy(batch.NextSlot(), recData, tupleLength);
+    batch.AddTuple();
   }
-  memcpy(data, recData, tupleLength);
   return (0);
 }
 
 /*
- * Close the iterator by closing the filescan or indexscan
+ * Close the iterator by closing the filescan or indexscan. The file and
+ * index stay open for the next queries
  */
 RC QL_NodeRel::CloseIt(){
   RC rc = 0;
+  if((rc = recView.Release()))
+    return (rc);
   if(useIndex){
-    if((rc = qlm.rmm.CloseFile(fh)))
-      return (rc);
     if((rc = is.CloseScan()))
       return (rc);
-    if((rc = qlm.ixm.CloseIndex(ih )))
-      return (rc);
   }
   else{
-    if((rc = fs.CloseScan()) || (rc = qlm.rmm.CloseFile(fh)))
+    if(morsels != NULL)
+      StopScanWorkers();
+    if((rc = fs.CloseScan()))
       return (rc);
   }
   isOpen = false;
@@ -129,15 +201,147 @@ RC QL_NodeRel::CloseIt(){
 }
 
 /*
- * Retrieves the next record by either using the index or the filescan
+ * Starts the workers of a parallel scan. The filescan opened by OpenIt
+ * stays open, unread, and is closed with the node.
+ */
+RC QL_NodeRel::OpenParallelScan(QL_Node &filter, int numWorkers, bool keepOrder){
+  RC rc = 0;
+  if(useIndex || morsels != NULL || numWorkers < 1)
+    return (QL_BADCALL);
+  int numPages;
+  if((rc = fh->GetNumPages(numPages)))
+    return (rc);
+  morsels = new MorselScan(filter, numPages, numWorkers, keepOrder);
+  for(int w = 0; w < numWorkers; w++)
+    morsels->workers.push_back(thread(&QL_NodeRel::RunScanWorker, this));
+  return (0);
+}
+
+/*
+ * The loop of a worker thread. Each morsel is read by a scan of its own
+ * pages, and its matching tuples are copied out before they are queued,
+ * so that no page stays pinned while the worker waits. The first error
+ * of any worker stops them all.
+ */
+void QL_NodeRel::RunScanWorker(){
+  RC rc = 0;
+  MorselScan *ms = morsels;
+  RM_FileScan scan;
+  RM_RecordView rec;
+  char *recData;
+  while(! ms->stop){
+    int morsel = ms->nextMorsel++;
+    PageNum firstPage = 1 + morsel * QL_MORSEL_PAGES;
+    if(firstPage >= ms->numPages)
+      break;
+    PageNum endPage = firstPage + QL_MORSEL_PAGES;
+    if(endPage > ms->numPages)
+      endPage = ms->numPages;
+
+    vector<char> tuples;
+    if((rc = scan.OpenScan(*fh, INT, 4, 0, NO_OP, NULL)) || (rc = scan.LimitPages(firstPage, endPage)))
+      break;
+    while((rc = scan.GetNextRec(rec)) == 0 && (rc = rec.GetData(recData)) == 0){
+      if(ms->filter.CheckConditions(recData) == 0)
+        tuples.insert(tuples.end(), recData, recData + tupleLength);
+    }
+    if(rc != RM_EOF){
+      scan.CloseScan();
+      break;
+    }
+    if((rc = scan.CloseScan()))
+      break;
+    if(tuples.empty() && ! ms->keepOrder)
+      continue;
+
+    unique_lock<mutex> lock(ms->queueLatch);
+    ms->notFull.wait(lock, [ms, morsel]{
+      if(ms->keepOrder)
+        return ms->stop || morsel < ms->nextChunk + QL_MORSEL_QUEUE;
+      return ms->stop || (int)ms->chunks.size() < QL_MORSEL_QUEUE;
+    });
+    if(ms->stop)
+      break;
+    ms->chunks[morsel].swap(tuples);
+    ms->notEmpty.notify_one();
+  }
+
+  lock_guard<mutex> guard(ms->queueLatch);
+  if(rc != 0 && ms->rc == 0){
+    ms->rc = rc;
+    ms->stop = true;
+    ms->notFull.notify_all();
+  }
+  ms->runningWorkers--;
+  ms->notEmpty.notify_all();
+}
+
+/*
+ * Fills the batch with queued tuples, waiting for the workers whenever
+ * none are left. The scan ends once every worker is done and no morsel
+ * is left.
  */
-RC QL_NodeRel::RetrieveNextRec(RM_Record &rec, char *&recData){
+RC QL_NodeRel::GetNextParallelBatch(TupleBatch &batch){
+  MorselScan *ms = morsels;
+  batch.Clear();
+  while(! batch.IsFull()){
+    if(ms->nextTuple == ms->current.size()){
+      unique_lock<mutex> lock(ms->queueLatch);
+      ms->notEmpty.wait(lock, [ms]{
+        if(ms->keepOrder)
+          return ms->chunks.count(ms->nextChunk) > 0 || ms->runningWorkers == 0;
+        return ! ms->chunks.empty() || ms->runningWorkers == 0;
+      });
+      if(ms->rc != 0)
+        return (ms->rc);
+      map<int, vector<char> >::iterator it =
+        ms->keepOrder ? ms->chunks.find(ms->nextChunk) : ms->chunks.begin();
+      if(it == ms->chunks.end()){
+        if(batch.numSelected == 0)
+          return (QL_EOI);
+        break;
+      }
+      ms->current.swap(it->second);
+      ms->chunks.erase(it);
+      ms->nextTuple = 0;
+      ms->nextChunk++;
+      ms->notFull.notify_all();
+      continue;
+    }
+    memcpy(batch.NextSlot(), &ms->current[ms->nextTuple], tupleLength);
+    batch.AddTuple();
+    ms->nextTuple += tupleLength;
+  }
+  return (0);
+}
+
+/*
+ * Tells the workers to stop, wakes those waiting for room in the queue,
+ * and waits for all of them to finish
+ */
+void QL_NodeRel::StopScanWorkers(){
+  {
+    lock_guard<mutex> guard(morsels->queueLatch);
+    morsels->stop = true;
+    morsels->notFull.notify_all();
+  }
+  for(size_t i = 0; i < morsels->workers.size(); i++)
+    morsels->workers[i].join();
+  delete morsels;
+  morsels = NULL;
+}
+
+/*
+ * Retrieves a view of the next record by either using the index or the
+ * filescan
+ */
+RC QL_NodeRel::RetrieveNextRec(RM_RecordView &rec, char *&recData){
   RC rc = 0;
   if(useIndex){
     RID rid;
     if((rc = is.GetNextEntry(rid) ))
       return (rc);
-    if((rc = fh.GetRec(rid, rec) ))
+    if((rc = fh->GetRec(rid, rec) ))
       return (rc);
   }
   else{
@@ -150,9 +354,22 @@ RC QL_NodeRel::RetrieveNextRec(RM_Record &rec, char *&recData){
 }
 
 /*
- * Retrieves the next record from this relation
+ * Retrieves a copy of the next record from this relation
  */
 RC QL_NodeRel::GetNextRec(RM_Record &rec){
+  RC rc = 0;
+  char *recData;
+  RID rid;
+  if((rc = GetNextRec(recView)) || (rc = recView.GetData(recData)) ||
+    (rc = recView.GetRid(rid)))
+    return (rc);
+  return rec.SetRecord(rid, recData, tupleLength);
+}
+
+/*
+ * Retrieves the next record from this relation in place
+ */
+RC QL_NodeRel::GetNextRec(RM_RecordView &rec){
   RC rc = 0;
   char *recData;
   if((rc = RetrieveNextRec(rec, recData))){
@@ -208,7 +425,10 @@ RC QL_NodeRel::PrintNode(int numTabs){
       cout << endl;
     }
     else{
-      cout << " = ";
+      if(nearestScan)
+        cout << " by distance to ";
+      else
+        cout << indexOp << " ";
     
     if(qlm.attrEntries[indexAttr].attrType == INT){
       print_int(value, 4);
@@ -216,6 +436,9 @@ RC QL_NodeRel::PrintNode(int numTabs){
     else if(qlm.attrEntries[indexAttr].attrType == FLOAT){
       print_float(value, 4);
     }
+    else if(qlm.attrEntries[indexAttr].attrType == MBR){
+      print_mbr(value, sizeof(mbr));
+    }
     else{
       print_string(value, strlen((char *)value));
     }
@@ -27,6 +27,8 @@ QL_NodeSel::QL_NodeSel(QL_Manager &qlm, QL_Node &prevNode) : QL_Node(qlm), prevN
   attrsInRecSize = 0;
   condIndex = 0;
   attrsInRecSize = 0;
+  firstBatch = true;
+  parallelScan = false;
 }
 
 /*
@@ -36,7 +38,6 @@ QL_NodeSel::~QL_NodeSel(){
   if(listsInitialized == true){
     free(condList);
     free(attrsInRec);
-    free(buffer);
     free(condsInNode);
   }
   listsInitialized = false;
@@ -69,8 +70,6 @@ RC QL_NodeSel::SetUpNode(int numConds){
   memset((void*)condsInNode, 0, sizeof(condsInNode));
 
   prevNode.GetTupleLength(tupleLength);
-  buffer = (char *)malloc(tupleLength); // set up buffer
-  memset((void*)buffer, 0, sizeof(buffer));
   listsInitialized = true;
   return (0);
 }
@@ -82,26 +81,61 @@ RC QL_NodeSel::SetUpNode(int numConds){
  */
 RC QL_NodeSel::OpenIt(){
   RC rc = 0;
+  ResetBatch();
+  firstBatch = true;
+  parallelScan = false;
   if((rc = prevNode.OpenIt()))
     return (rc);
   return (0);
 }
 
 /*
- * Get the next record
+ * The scan only goes parallel once batches are asked for, since callers
+ * taking records one at a time rely on reading them in place, in order.
+ * Relations of a couple of morsels aren't worth starting threads for.
  */
-RC QL_NodeSel::GetNext(char *data){
+RC QL_NodeSel::StartParallelScan(){
   RC rc = 0;
-  while(true){
-    if((rc = prevNode.GetNext(buffer))){
+  if(qlm.smm.scanWorkers <= 1 || ! prevNode.IsRelNode())
+    return (0);
+  QL_NodeRel &relNode = static_cast<QL_NodeRel &>(prevNode);
+  if(relNode.useIndex)
+    return (0);
+  int numPages;
+  if((rc = relNode.fh->GetNumPages(numPages)))
+    return (rc);
+  if(numPages - 1 <= 2 * QL_MORSEL_PAGES)
+    return (0);
+  if((rc = relNode.OpenParallelScan(*this, qlm.smm.scanWorkers, qlm.smm.orderedScans)))
+    return (rc);
+  parallelScan = true;
+  return (0);
+}
+
+/*
+ * Gets batches from the previous node, and unselects the tuples that don't
+ * meet the conditions, until a batch has some left
+ */
+RC QL_NodeSel::GetNextBatch(TupleBatch &batch){
+  RC rc = 0;
+  if(firstBatch){
+    firstBatch = false;
+    if((rc = StartParallelScan()))
       return (rc);
-    }
-    // keep retrieving records until the conditions are met
-    RC cond = CheckConditions(buffer);
-    if(cond == 0)
-      break;
   }
-  memcpy(data, buffer, tupleLength);
+  // The workers have checked the conditions already
+  if(parallelScan)
+    return prevNode.GetNextBatch(batch);
+  do{
+    if((rc = prevNode.GetNextBatch(batch)))
+      return (rc);
+    int numSelected = 0;
+    for(int i = 0; i < batch.numSelected; i++){
+      if(CheckConditions(batch.SelectedTuple(i)) == 0)
+        batch.sel[numSelected++] = batch.sel[i];
+    }
+    batch.numSelected = numSelected;
+  } while(batch.numSelected == 0);
   return (0);
 }
 
@@ -110,6 +144,8 @@ RC QL_NodeSel::GetNext(char *data){
  */
 RC QL_NodeSel::CloseIt(){
   RC rc = 0;
+  if((rc = recView.Release()))
+    return (rc);
   if((rc = prevNode.CloseIt()))
     return (rc);
 
@@ -117,9 +153,24 @@ RC QL_NodeSel::CloseIt(){
 }
 
 /*
- * Retrieves the next record from the previous node
+ * Retrieves a copy of the next record from the previous node that meets
+ * the conditions. Records that don't are only looked at in place.
  */
 RC QL_NodeSel::GetNextRec(RM_Record &rec){
+  RC rc = 0;
+  char *pData;
+  RID rid;
+  if((rc = GetNextRec(recView)) || (rc = recView.GetData(pData)) ||
+    (rc = recView.GetRid(rid)))
+    return (rc);
+  return rec.SetRecord(rid, pData, tupleLength);
+}
+
+/*
+ * Retrieves the next record from the previous node that meets the
+ * conditions, in place
+ */
+RC QL_NodeSel::GetNextRec(RM_RecordView &rec){
   RC rc = 0;
   while(true){
     if((rc = prevNode.GetNextRec(rec)))
@@ -167,7 +218,6 @@ RC QL_NodeSel::DeleteNodes(){
   if(listsInitialized == true){
     free(condList);
     free(attrsInRec);
-    free(buffer);
     free(condsInNode);
   }
   listsInitialized = false;
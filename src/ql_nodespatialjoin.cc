@@ -0,0 +1,219 @@
+//
+// File:          ql_nodespatialjoin.cc
+// Description:   Spatial join node: joins two relations on intersecting MBR
+//                attributes using both of their R-tree indexes
+//
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include "redbase.h"
+#include "sm.h"
+#include "rm.h"
+#include "ql.h"
+#include "ix.h"
+#include <string>
+#include "ql_node.h"
+
+
+using namespace std;
+
+/*
+ * Create the node with the two relation nodes to join. Both relations are
+ * read through the join scan, so neither node is opened on its own.
+ */
+QL_NodeSpatialJoin::QL_NodeSpatialJoin(QL_Manager &qlm, QL_NodeRel &node1, QL_NodeRel &node2) :
+  QL_Node(qlm), node1(node1), node2(node2){
+  isOpen = false;
+  listsInitialized = false;
+  attrsInRecSize = 0;
+  tupleLength = 0;
+  condIndex = 0;
+  firstNodeSize = 0;
+  joinCond = 0;
+}
+
+/*
+ * delete all memory
+ */
+QL_NodeSpatialJoin::~QL_NodeSpatialJoin(){
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(buffer);
+    free(condsInNode);
+  }
+  listsInitialized = false;
+}
+
+/*
+ * Set up the node with a max number of other conditions that the joined
+ * tuples must meet, the indices of the two MBR attributes whose indexes
+ * are joined, and the number of the INTERSECTS condition between them
+ */
+RC QL_NodeSpatialJoin::SetUpNode(int numConds, int attrIndex1, int attrIndex2, int joinCond){
+  RC rc = 0;
+  int *attrList1;
+  int *attrList2;
+  int attrListSize1;
+  int attrListSize2;
+  if((rc = node1.GetAttrList(attrList1, attrListSize1)) ||
+    (rc = node2.GetAttrList(attrList2, attrListSize2)))
+    return (rc);
+  attrsInRecSize = attrListSize1 + attrListSize2;
+  attrsInRec = (int*)malloc(attrsInRecSize*sizeof(int));
+  for(int i = 0; i < attrListSize1; i++){
+    attrsInRec[i] = attrList1[i];
+  }
+  for(int i=0; i < attrListSize2; i++){
+    attrsInRec[attrListSize1+i] = attrList2[i];
+  }
+
+  condList = (Cond *)malloc(numConds * sizeof(Cond));
+  for(int i= 0; i < numConds; i++){
+    condList[i] = {0, NULL, true, NULL, 0, 0, INT};
+  }
+  condsInNode = (int*)malloc(numConds * sizeof(int));
+
+  int tupleLength1, tupleLength2;
+  node1.GetTupleLength(tupleLength1);
+  node2.GetTupleLength(tupleLength2);
+  tupleLength = tupleLength1 + tupleLength2;
+  firstNodeSize = tupleLength1;
+  buffer = (char *)malloc(tupleLength);
+  memset((void*)buffer, 0, tupleLength);
+  listsInitialized = true;
+
+  // The relation nodes only keep track of which index is used
+  if((rc = node1.UseIndex(attrIndex1, qlm.attrEntries[attrIndex1].indexNo, NULL)) ||
+    (rc = node2.UseIndex(attrIndex2, qlm.attrEntries[attrIndex2].indexNo, NULL)))
+    return (rc);
+  this->joinCond = joinCond;
+  return (0);
+}
+
+/*
+ * Open both indexes and relation files, and start the join scan
+ */
+RC QL_NodeSpatialJoin::OpenIt(){
+  RC rc = 0;
+  ResetBatch();
+  if((rc = qlm.smm.GetIndexHandle(node1.relName, node1.indexNo, node1.ih)) ||
+    (rc = qlm.smm.GetRelHandle(node1.relName, node1.fh)))
+    return (rc);
+  if((rc = qlm.smm.GetIndexHandle(node2.relName, node2.indexNo, node2.ih)) ||
+    (rc = qlm.smm.GetRelHandle(node2.relName, node2.fh)))
+    return (rc);
+  if((rc = js.OpenScan(*node1.ih, *node2.ih)))
+    return (rc);
+  isOpen = true;
+  return (0);
+}
+
+/*
+ * Fills the batch with the next pairs of tuples the join scan returns
+ */
+RC QL_NodeSpatialJoin::GetNextBatch(TupleBatch &batch){
+  return FillBatch(batch);
+}
+
+/*
+ * Returns the next pair of tuples whose MBRs intersect and that meet the
+ * other conditions of this node
+ */
+RC QL_NodeSpatialJoin::NextTuple(char *data){
+  RC rc = 0;
+  while(true){
+    RID rid1, rid2;
+    if((rc = js.GetNextPair(rid1, rid2))){
+      if(rc == IX_EOF)
+        return (QL_EOI);
+      return (rc);
+    }
+    RM_Record rec1, rec2;
+    char *recData1;
+    char *recData2;
+    if((rc = node1.fh->GetRec(rid1, rec1)) || (rc = rec1.GetData(recData1)) ||
+      (rc = node2.fh->GetRec(rid2, rec2)) || (rc = rec2.GetData(recData2)))
+      return (rc);
+    memcpy(buffer, recData1, firstNodeSize);
+    memcpy(buffer + firstNodeSize, recData2, tupleLength - firstNodeSize);
+    if(CheckConditions(buffer) == 0)
+      break;
+  }
+  memcpy(data, buffer, tupleLength);
+  return (0);
+}
+
+/*
+ * Don't allow join nodes to retrieve records
+ */
+RC QL_NodeSpatialJoin::GetNextRec(RM_Record &rec){
+  return (QL_BADCALL);
+}
+
+/*
+ * Close the join scan. Both indexes and relation files stay open
+ */
+RC QL_NodeSpatialJoin::CloseIt(){
+  RC rc = 0;
+  if((rc = js.CloseScan()))
+    return (rc);
+  isOpen = false;
+  return (0);
+}
+
+/*
+ * Print the node, and instruct it to print its previous nodes
+ */
+RC QL_NodeSpatialJoin::PrintNode(int numTabs){
+  for(int i=0; i < numTabs; i++){
+    cout << "\t";
+  }
+  cout << "--SPATIAL JOIN: \n";
+  for(int j=0; j <numTabs; j++){
+    cout << "\t";
+  }
+  PrintCondition(qlm.condptr[joinCond]);
+  cout << " (index traversal)\n";
+  for(int i = 0; i < condIndex; i++){
+    for(int j=0; j <numTabs; j++){
+      cout << "\t";
+    }
+    PrintCondition(qlm.condptr[condsInNode[i]]);
+    cout << "\n";
+  }
+  node1.PrintNode(numTabs + 1);
+  node2.PrintNode(numTabs + 1);
+  return (0);
+}
+
+/*
+ * Free all memory associated with this node, and delete the previous nodes
+ */
+RC QL_NodeSpatialJoin::DeleteNodes(){
+  node1.DeleteNodes();
+  node2.DeleteNodes();
+  delete &node1;
+  delete &node2;
+  if(listsInitialized == true){
+    free(attrsInRec);
+    free(condList);
+    free(condsInNode);
+    free(buffer);
+  }
+  listsInitialized = false;
+  return (0);
+}
+
+bool QL_NodeSpatialJoin::IsRelNode(){
+  return false;
+}
+
+RC QL_NodeSpatialJoin::OpenIt(void *data){
+  return (QL_BADCALL);
+}
+
+RC QL_NodeSpatialJoin::UseIndex(int attrNum, int indexNumber, void *data){
+  return (QL_BADCALL);
+}
@@ -84,6 +84,9 @@ RC QO_Manager::PrintRels(){
       cout << "  cost: " << it2->second->cost << endl;
       cout << "  indexAttr: " << it2->second->indexAttr << endl;
       cout << "  indexCond: " << it2->second->indexCond << endl;
+      cout << "  joinMethod: " << it2->second->joinMethod << endl;
+      cout << "  buildOuter: " << it2->second->buildOuter << endl;
+      cout << "  orderAttr: " << it2->second->orderAttr << endl;
 
       map<int, attrStat> attributes = it2->second->attrs;
       map<int, attrStat>::iterator it3;
@@ -166,6 +169,8 @@ RC QO_Manager::Compute(QO_Rel *relOrder, float &costEst, float &tupleEst){
     relOrder[index].relIdx = optcost[index][relsInJoin]->newRelIndex;
     relOrder[index].indexAttr = optcost[index][relsInJoin]->indexAttr;
     relOrder[index].indexCond = optcost[index][relsInJoin]->indexCond;
+    relOrder[index].joinMethod = optcost[index][relsInJoin]->joinMethod;
+    relOrder[index].buildOuter = optcost[index][relsInJoin]->buildOuter;
     relsInJoin = nextSubJoin;
   }
 
@@ -186,6 +191,9 @@ RC QO_Manager::CalculateOptJoin(int relsInJoin, int relSize){
   costTable->cost = FLT_MAX;
   costTable->indexAttr = -1;
   costTable->indexCond = -1;
+  costTable->joinMethod = QO_NESTEDLOOP;
+  costTable->buildOuter = false;
+  costTable->orderAttr = -1;
   // iterate through all ways of removing a relation a
   for(it = relsInJoinVec.begin(); it != relsInJoinVec.end(); ++it){
     int subJoin = relsInJoin;
@@ -197,11 +205,18 @@ RC QO_Manager::CalculateOptJoin(int relsInJoin, int relSize){
     float totalTuples;
     int indexAttr = -1;
     int indexCond = -1;
+    QO_JoinMethod joinMethod = QO_NESTEDLOOP;
+    bool buildOuter = false;
+    int orderAttr = -1;
     // Calculate the a join (S-a)
-    if((rc = CalculateJoin(subJoin, *it, relSize, cost, totalTuples, attrStats, indexAttr, indexCond)))
+    if((rc = CalculateJoin(subJoin, *it, relSize, cost, totalTuples, attrStats, indexAttr, indexCond,
+      joinMethod, buildOuter, orderAttr)))
       return (rc);
-    // if the cost is the smallest so far, update all values
-    if(cost < costTable->cost){ 
+    // if the cost is the smallest so far, update all values. Of two plans
+    // costing the same, keep one whose result is ordered, since a later
+    // merge join can use that order
+    if(cost < costTable->cost ||
+      (cost == costTable->cost && orderAttr != -1 && costTable->orderAttr == -1)){ 
       costTable->cost = cost;
       costTable->attrs.clear();
       costTable->attrs = attrStats;
@@ -210,6 +225,9 @@ RC QO_Manager::CalculateOptJoin(int relsInJoin, int relSize){
       costTable->numTuples = totalTuples;
       costTable->indexAttr = indexAttr;
       costTable->indexCond = indexCond;
+      costTable->joinMethod = joinMethod;
+      costTable->buildOuter = buildOuter;
+      costTable->orderAttr = orderAttr;
     }
   }
   // insert the costElem as the optimal way of arriving
@@ -227,7 +245,7 @@ RC QO_Manager::CalculateOptJoin(int relsInJoin, int relSize){
 // conditions, and whether to use an attribute or not.
 RC QO_Manager::CalculateJoin(int relsInJoin, int newRel, int relSize, 
   float &cost, float &totalTuples, map<int, attrStat> &attrStats,
-  int &indexAttr, int &indexCond){
+  int &indexAttr, int &indexCond, QO_JoinMethod &joinMethod, bool &buildOuter, int &orderAttr){
   RC rc = 0;
   // copy all attributes over. 
   attrStats = optcost[relSize-1][relsInJoin]->attrs;
@@ -296,9 +314,142 @@ RC QO_Manager::CalculateJoin(int relsInJoin, int newRel, int relSize,
       indexCond = -1;
     }
   //}
+  // Nested loop and index joins read the outer in order, so the result
+  // keeps its order
+  joinMethod = QO_NESTEDLOOP;
+  buildOuter = false;
+  orderAttr = optcost[relSize-1][relsInJoin]->orderAttr;
+
+  // Joins on R.A = S.B can also be run as a hash join or a merge join. The
+  // hash join reads both inputs once if the smaller one, which it builds
+  // on, fits in memory. Otherwise both inputs are partitioned first, and
+  // are written and read back once more. The merge join needs an outer
+  // that is already ordered on its attribute. It reads both inputs once if
+  // the inner, which it sorts, fits in memory. Otherwise the sorted runs of
+  // the inner are written and read back about once more. It keeps the
+  // order of the outer, so it wins ties with the hash join.
+  float memoryPages = ((float)qlm.smm.joinMemory * 1024) / PF_PAGE_SIZE;
+  for(int i=0; i < nConds; i++){
+    int outerAttr, innerAttr;
+    if(! IsEquiJoinCond(relsInJoin, i, newRel, outerAttr, innerAttr))
+      continue;
+    int outerLength = 0;
+    vector<int> outerRels;
+    ConvertBitmapToVec(relsInJoin, outerRels);
+    for(unsigned int j = 0; j < outerRels.size(); j++)
+      outerLength += rels[outerRels[j]].tupleLength;
+    float outerPages = CalculateNumPages(optcost[relSize-1][relsInJoin]->numTuples, outerLength);
+    float innerPages = CalculateNumPages(optcost[0][newRelBitmap]->numTuples, rels[newRel].tupleLength);
+    float readcost = optcost[relSize-1][relsInJoin]->cost + optcost[0][newRelBitmap]->cost;
+
+    float hashcost = readcost;
+    if(min(outerPages, innerPages) > memoryPages)
+      hashcost += 2 * (outerPages + innerPages);
+    if(hashcost <= cost){
+      cost = hashcost;
+      indexAttr = -1;
+      indexCond = i;
+      joinMethod = QO_HASHJOIN;
+      buildOuter = (outerPages < innerPages);
+      orderAttr = -1;
+    }
+    float mergecost = readcost;
+    if(innerPages > memoryPages)
+      mergecost += 2 * innerPages;
+    if(optcost[relSize-1][relsInJoin]->orderAttr == outerAttr && mergecost <= cost){
+      cost = mergecost;
+      indexAttr = -1;
+      indexCond = i;
+      joinMethod = QO_MERGEJOIN;
+      buildOuter = false;
+      orderAttr = outerAttr;
+    }
+  }
+
+  // Joins on R.A INTERSECTS S.B can also be run as a spatial join, when the
+  // outer is a single relation and both attributes are indexed, or as a
+  // partition based spatial merge join. A spatial join reads both R-trees
+  // once and each relation's records about once. PBSM reads both inputs
+  // twice, and writes and reads them back once from its partition files.
+  // The cost of the output is the same for every join method, so it's left
+  // out as in the nested loop cost. Ties go to the spatial join, then to
+  // PBSM, so that they are used before statistics have been gathered.
+  for(int i=0; i < nConds; i++){
+    if(! IsIntersectsJoinCond(relsInJoin, i, newRel))
+      continue;
+    int outerLength = 0;
+    vector<int> outerRels;
+    ConvertBitmapToVec(relsInJoin, outerRels);
+    for(unsigned int j = 0; j < outerRels.size(); j++)
+      outerLength += rels[outerRels[j]].tupleLength;
+    float outerTuples = optcost[relSize-1][relsInJoin]->numTuples;
+    float pbsmcost = 2 * (optcost[relSize-1][relsInJoin]->cost + optcost[0][newRelBitmap]->cost) +
+      2 * (CalculateNumPages(outerTuples, outerLength) +
+      CalculateNumPages(rels[newRel].numTuples, rels[newRel].tupleLength));
+    if(pbsmcost <= cost){
+      cost = pbsmcost;
+      indexAttr = -1;
+      indexCond = i;
+      joinMethod = QO_PBSMJOIN;
+      buildOuter = false;
+      orderAttr = -1;
+    }
+
+    int index1, index2;
+    qlm.GetAttrCatEntryPos(conds[i].lhsAttr, index1);
+    qlm.GetAttrCatEntryPos(conds[i].rhsAttr, index2);
+    if(relSize == 1 && attrs[index1].indexNo != -1 && attrs[index2].indexNo != -1){
+      float spatialcost = CalculateNumPages(rels[outerRels[0]].numTuples, sizeof(mbr)) +
+        CalculateNumPages(rels[newRel].numTuples, sizeof(mbr)) +
+        (float)rels[outerRels[0]].numTuples + (float)rels[newRel].numTuples;
+      if(spatialcost <= cost){
+        cost = spatialcost;
+        IsValidIndexCond(relsInJoin, i, newRel, indexAttr);
+        indexCond = i;
+        joinMethod = QO_SPATIALJOIN;
+        buildOuter = false;
+        orderAttr = -1;
+      }
+    }
+    break;
+  }
   return (rc);
 }
 
+bool QO_Manager::IsIntersectsJoinCond(int relsJoined, int condIndex, int relIdx){
+  if(conds[condIndex].op != INTERSECTS_OP || !conds[condIndex].bRhsIsAttr)
+    return false;
+  int firstRel, secondRel;
+  AttrToRelIndex(conds[condIndex].lhsAttr, firstRel);
+  AttrToRelIndex(conds[condIndex].rhsAttr, secondRel);
+  return ((IsBitSet(firstRel, relsJoined) && secondRel == relIdx) ||
+    (IsBitSet(secondRel, relsJoined) && firstRel == relIdx));
+}
+
+bool QO_Manager::IsEquiJoinCond(int relsJoined, int condIndex, int relIdx, int &outerAttr, int &innerAttr){
+  if(conds[condIndex].op != EQ_OP || !conds[condIndex].bRhsIsAttr)
+    return false;
+  int firstRel, secondRel;
+  AttrToRelIndex(conds[condIndex].lhsAttr, firstRel);
+  AttrToRelIndex(conds[condIndex].rhsAttr, secondRel);
+  int index1, index2;
+  qlm.GetAttrCatEntryPos(conds[condIndex].lhsAttr, index1);
+  qlm.GetAttrCatEntryPos(conds[condIndex].rhsAttr, index2);
+  if(attrs[index1].attrType == MBR || attrs[index1].attrType != attrs[index2].attrType)
+    return false;
+  if(IsBitSet(firstRel, relsJoined) && secondRel == relIdx){
+    outerAttr = index1;
+    innerAttr = index2;
+    return true;
+  }
+  if(IsBitSet(secondRel, relsJoined) && firstRel == relIdx){
+    outerAttr = index2;
+    innerAttr = index1;
+    return true;
+  }
+  return false;
+}
+
 // Check whether a given condition (given by its index number) should be applied
 // when the relations in bitmap relsJoined are joined with relation relIdx. If it
 // is valid, it returns the attr index associated with relIdx in attrIndex.
@@ -404,6 +555,9 @@ RC QO_Manager::InitializeBaseCases(){
     costEntry->newRelIndex = i;
     costEntry->indexAttr = -1;
     costEntry->indexCond = -1;
+    costEntry->joinMethod = QO_NESTEDLOOP;
+    costEntry->buildOuter = false;
+    costEntry->orderAttr = -1;
 
     int relsInJoin = 0;
     bool useIdx = false;
@@ -436,6 +590,20 @@ RC QO_Manager::InitializeBaseCases(){
     }
     costEntry->numTuples = totalTuples;
 
+    // A relation selected on R.A = v holds a single value of A, so it is
+    // ordered on A
+    for(int j=0; j < nConds; j++){
+      int condRel, condAttr;
+      if(conds[j].op != EQ_OP || conds[j].bRhsIsAttr)
+        continue;
+      AttrToRelIndex(conds[j].lhsAttr, condRel);
+      qlm.GetAttrCatEntryPos(conds[j].lhsAttr, condAttr);
+      if(condRel == i && attrs[condAttr].attrType != MBR){
+        costEntry->orderAttr = condAttr;
+        break;
+      }
+    }
+
     // if we are using an index to apply a condition, update the const
     // entry to reflect that
     if(useIdx){
@@ -500,6 +668,14 @@ RC QO_Manager::CalcCondsForRel(map<int, attrStat> & attrStats, int relsInJoin, i
         indexAttr = attributeNum;
         indexTupleNum = ((float)attrs[indexAttr].numDistinct);
       }
+      // A window search on an R-tree index only reads the nodes that intersect
+      // the query rectangle, so use it when no equality index was found
+      else if(conds[i].op == INTERSECTS_OP && !conds[i].bRhsIsAttr && !useIdx
+        && (attrs[attributeNum].indexNo != -1)){
+        useIdx = true;
+        indexCond = i;
+        indexAttr = attributeNum;
+      }
     }
   }
   return (0);
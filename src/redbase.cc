@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include "redbase.h"
@@ -19,7 +20,7 @@ using namespace std;
 PF_Manager pfm;
 RM_Manager rmm(pfm);
 IX_Manager ixm(pfm);
-SM_Manager smm(ixm, rmm);
+SM_Manager smm(ixm, rmm, pfm);
 QL_Manager qlm(smm, ixm, rmm);
 
 
@@ -29,16 +30,54 @@ QL_Manager qlm(smm, ixm, rmm);
 int main(int argc, char *argv[])
 {
     char *dbname;
+    char *bufferPages;
+    char *progName = argv[0];
+    bool readOnly = false;
     RC rc;
 
+    // The number of pages in the buffer pool can be given with -b, or
+    // else with the REDBASE_BUFFER_PAGES environment variable. With -r,
+    // the database is served read only, straight from the OS page cache.
+    bufferPages = getenv("REDBASE_BUFFER_PAGES");
+    while (argc > 2 && argv[1][0] == '-') {
+        if (argc > 3 && strcmp(argv[1], "-b") == 0) {
+            bufferPages = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else if (strcmp(argv[1], "-r") == 0) {
+            readOnly = true;
+            argv++;
+            argc--;
+        }
+        else
+            break;
+    }
+
     // Look for 2 arguments.  The first is always the name of the program
     // that was executed, and the second should be the name of the
     // database.
     if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " dbname \n";
+        cerr << "Usage: " << progName << " [-r] [-b bufferpages] dbname \n";
         exit(1);
     }
 
+    if (bufferPages != NULL) {
+        if (atoi(bufferPages) <= 0) {
+            cerr << "Invalid number of buffer pages: " << bufferPages << "\n";
+            exit(1);
+        }
+        if ((rc = pfm.ResizeBuffer(atoi(bufferPages)))) {
+            PrintError(rc);
+            return (1);
+        }
+    }
+
+    if (readOnly) {
+        rmm.SetReadOnly(true);
+        ixm.SetReadOnly(true);
+    }
+
     // Opens up the database folder    
     dbname = argv[1];
     if ((rc = smm.OpenDb(dbname))) {
@@ -72,6 +72,7 @@ RC RM_FileHandle::AllocateNewPage(PF_PageHandle &ph, PageNum &page){
                      // more page
   // update the free pages linked list
   header.firstFreePage = page;
+  header_modified = true;
   return (0);
 }
 
@@ -126,7 +127,7 @@ RC RM_FileHandle::GetRec (const RID &rid, RM_Record &rec) const {
   // Retrieves the appropriate page, and its bitmap and pageheader 
   // contents
   PF_PageHandle ph;
-  if((rc = pfh.GetThisPage(page, ph))){
+  if((rc = pfh.GetThisPage(page, ph, RANDOM))){
     return (rc);
   }
   char *bitmap;
@@ -156,6 +157,48 @@ RC RM_FileHandle::GetRec (const RID &rid, RM_Record &rec) const {
   return (rc); 
 }
 
+/*
+ * Given a RID, points the view at the record in its page, and leaves the
+ * page pinned for the view. If the view already holds the pin on that
+ * page, as when reading the records of a page one after the other, the
+ * pin is kept instead of being released and taken again.
+ */
+RC RM_FileHandle::GetRec (const RID &rid, RM_RecordView &rec) const {
+  // only proceed if this filehandle is associated with an open file
+  if (!isValidFH())
+    return (RM_INVALIDFILE);
+
+  RC rc = 0;
+  PageNum page;
+  SlotNum slot;
+  if((rc = GetPageNumAndSlot(rid, page, slot)))
+    return (rc);
+
+  if(rec.pinnedFile != &pfh || rec.pinnedPage != page){
+    if((rc = rec.Release()))
+      return (rc);
+    if((rc = pfh.GetThisPage(page, rec.pinnedPH, RANDOM)))
+      return (rc);
+    rec.pinnedFile = &pfh;
+    rec.pinnedPage = page;
+  }
+  rec.data = NULL;
+
+  // Check that the record is there, and point the view at it
+  char *bitmap;
+  struct RM_PageHeader *pageheader;
+  bool recordExists;
+  if((rc = GetPageDataAndBitmap(rec.pinnedPH, bitmap, pageheader)))
+    return (rc);
+  if ((rc = CheckBitSet(bitmap, header.numRecordsPerPage, slot, recordExists)))
+    return (rc);
+  if(!recordExists)
+    return (RM_INVALIDRECORD);
+  rec.rid = rid;
+  rec.data = bitmap + (header.bitmapSize) + slot*(header.recordSize);
+  return (0);
+}
+
 /*
  * Given some record data, it inserts the record into an available slot
  * in the file, and then returns it RID. If there is no available slot,
@@ -166,6 +209,8 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
 
   if (!isValidFH())
     return (RM_INVALIDFILE);
+  if (pfh.IsReadOnly())
+    return (PF_READONLY);
 
   RC rc = 0;
 
@@ -209,6 +254,7 @@ RC RM_FileHandle::InsertRec (const char *pData, RID &rid) {
   // if page is full, update the free-page-list in the file header
   if(pageheader->numRecords == header.numRecordsPerPage){
     header.firstFreePage = pageheader->nextFreePage;
+    header_modified = true;
   }
 
   // always unpin the page before returning
@@ -230,6 +276,8 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
   // only proceed if this filehandle is associated with an open file
   if (!isValidFH())
     return (RM_INVALIDFILE);
+  if (pfh.IsReadOnly())
+    return (PF_READONLY);
   RC rc = 0;
 
   // Retrieve page and slot number from the RID
@@ -264,6 +312,7 @@ RC RM_FileHandle::DeleteRec (const RID &rid) {
   if(pageheader->numRecords == header.numRecordsPerPage - 1){
     pageheader->nextFreePage = header.firstFreePage;
     header.firstFreePage = page;
+    header_modified = true;
  }
 
   // always unpin the page before returning
@@ -284,6 +333,8 @@ RC RM_FileHandle::UpdateRec (const RM_Record &rec) {
   // only proceed if this filehandle is associated with an open file
   if (!isValidFH())
     return (RM_INVALIDFILE);
+  if (pfh.IsReadOnly())
+    return (PF_READONLY);
   RC rc = 0;
 
   // retrieves the page and slot number of the record
@@ -343,14 +394,15 @@ RC RM_FileHandle::ForcePages(PageNum pageNum) {
 
 /*
  * Given a page and slot number, retrieves the next record that follows 
- * from this position, returning the record in rc, and the pagehandle
- * associated with it in ph. 
+ * from this position, returning its RID in rid and a pointer to its data
+ * in the page in recData, and the pagehandle associated with it in ph. 
  * nextPage indicate whether we should look on
  * the current or next page for this. If nextPage is false, it assumes
  * that the pagehadle passed in refers to a valid page handle that is
- * pinned in buffer. 
+ * pinned in buffer. The next pages are read with pinHint.
  */
-RC RM_FileHandle::GetNextRecord(PageNum page, SlotNum slot, RM_Record &rec, PF_PageHandle &ph, bool nextPage){
+RC RM_FileHandle::GetNextRecord(PageNum page, SlotNum slot, RID &rid, char *&recData, PF_PageHandle &ph, bool nextPage,
+  ClientHint pinHint, PageNum endPage){
   RC rc = 0;
   char *bitmap;
   struct RM_PageHeader *pageheader;
@@ -362,12 +414,20 @@ RC RM_FileHandle::GetNextRecord(PageNum page, SlotNum slot, RM_Record &rec, PF_P
   // we reach a page that has some records in it.
   if(nextPage){
     while(true){
-      if((PF_EOF == pfh.GetNextPage(nextRecPage, ph)))
+      if(endPage != ALL_PAGES && nextRecPage + 1 >= endPage)
+        return (RM_EOF); // reached the end of the range
+      if((PF_EOF == pfh.GetNextPage(nextRecPage, ph, pinHint)))
         return (RM_EOF); // reached the end of file
 
       // retrieve page and bitmap information
       if((rc = ph.GetPageNum(nextRecPage)))
         return (rc);
+      // the next used page may lie past the range
+      if(endPage != ALL_PAGES && nextRecPage >= endPage){
+        if((rc = pfh.UnpinPage(nextRecPage)))
+          return (rc);
+        return (RM_EOF);
+      }
       if((rc = GetPageDataAndBitmap(ph, bitmap, pageheader)))
         return (rc);
       // search for the next record
@@ -385,13 +445,48 @@ RC RM_FileHandle::GetNextRecord(PageNum page, SlotNum slot, RM_Record &rec, PF_P
     if(GetNextOneBit(bitmap, header.numRecordsPerPage, slot + 1, nextRec) == RM_ENDOFPAGE)
       return (RM_EOF);
   }
-  // set the RID, and data contents of this record
+  // set the RID, and point at the data contents of this record
   nextRecSlot = nextRec;
-  RID rid(nextRecPage, nextRecSlot);
-  if((rc = rec.SetRecord(rid, bitmap + (header.bitmapSize) + (nextRecSlot)*(header.recordSize), 
-    header.recordSize)))
-    return (rc);
+  rid = RID(nextRecPage, nextRecSlot);
+  recData = bitmap + (header.bitmapSize) + (nextRecSlot)*(header.recordSize);
+
+  return (0);
+}
+
+/*
+ * Returns the number of pages in the file, including the header page.
+ * The count is the PF layer's, which covers disposed pages too.
+ */
+RC RM_FileHandle::GetNumPages(int &numPages) const{
+  if(! isValidFileHeader())
+    return (RM_INVALIDFILE);
+  return pfh.GetNumPages(numPages);
+}
 
+/*
+ * Copies the header into the first page of the file if it was modified
+ * since it was last copied, and marks that page dirty
+ */
+RC RM_FileHandle::WriteHeader(){
+  RC rc = 0;
+  PF_PageHandle ph;
+  PageNum page;
+  char *pData;
+
+  if(header_modified == false)
+    return (0);
+  if((rc = pfh.GetFirstPage(ph)) || (rc = ph.GetPageNum(page)))
+    return (rc);
+  if((rc = ph.GetData(pData))){
+    RC rc2;
+    if((rc2 = pfh.UnpinPage(page)))
+      return (rc2);
+    return (rc);
+  }
+  memcpy(pData, &header, sizeof(struct RM_FileHeader));
+  if((rc = pfh.MarkDirty(page)) || (rc = pfh.UnpinPage(page)))
+    return (rc);
+  header_modified = false;
   return (0);
 }
 
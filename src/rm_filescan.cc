@@ -17,6 +17,7 @@ RM_FileScan::RM_FileScan(){
   initializedValue = false;
   hasPagePinned = false;
   scanEnded = true;
+  pinHint = NO_HINT;
 }
 
 RM_FileScan::~RM_FileScan(){
@@ -162,6 +163,7 @@ RC RM_FileScan::OpenScan (const RM_FileHandle &fileHandle,
   }
 
   // open the scan
+  this->pinHint = pinHint;
   openScan = true;
   scanEnded = false;
 
@@ -171,11 +173,27 @@ RC RM_FileScan::OpenScan (const RM_FileHandle &fileHandle,
   useNextPage = true;
   scanPage = 0;
   scanSlot = BEGIN_SCAN;
+  endPage = ALL_PAGES;
   numSeenOnPage = 0;
   hasPagePinned = false;
   return (0);
 } 
 
+/*
+ * Restricts the scan to a range of pages, so that several scans can split
+ * a file between them. Page 0 holds the file header, so the first page
+ * of records is 1.
+ */
+RC RM_FileScan::LimitPages(PageNum firstPage, PageNum endPage){
+  if(openScan == false || hasPagePinned == true || scanEnded == true)
+    return (RM_INVALIDSCAN);
+  if(firstPage < 1 || endPage < firstPage)
+    return (RM_INVALIDSCAN);
+  scanPage = firstPage - 1;
+  this->endPage = endPage;
+  return (0);
+}
+
 /*
  * Retrieves the number of records on a given page specified by an 
  * open PF_PageHandle. Returns that number in numRecords
@@ -191,25 +209,62 @@ RC RM_FileScan::GetNumRecOnPage(PF_PageHandle &ph, int &numRecords){
 }
 
 /*
- * Retrieves the next record that satisfies the scan conditions
+ * Retrieves a copy of the next record that satisfies the scan conditions
  */
 RC RM_FileScan::GetNextRec(RM_Record &rec) {
+  RC rc;
+  RID rid;
+  char *recData;
+  if((rc = NextRecord(rid, recData)))
+    return (rc);
+  return rec.SetRecord(rid, recData, fileHandle->getRecordSize());
+}
+
+/*
+ * Points the view at the next record that satisfies the scan conditions,
+ * in its page. The scan keeps the page pinned, and the view doesn't hold
+ * a pin of its own.
+ */
+RC RM_FileScan::GetNextRec(RM_RecordView &rec) {
+  RC rc;
+  if((rc = rec.Release()))
+    return (rc);
+  RID rid;
+  char *recData;
+  if((rc = NextRecord(rid, recData)))
+    return (rc);
+  rec.rid = rid;
+  rec.data = recData;
+  return (0);
+}
+
+/*
+ * Finds the next record that satisfies the scan conditions, and returns
+ * its RID and a pointer to its data in the page. The page stays pinned
+ * until the following call, even after its last record was returned, so
+ * that the pointer stays valid that long.
+ */
+RC RM_FileScan::NextRecord(RID &rid, char *&recData) {
   // If the scan has ended, or is not valid, return immediately
   if(scanEnded == true)
     return (RM_EOF);
   if(openScan == false)
     return (RM_INVALIDSCAN);
-  hasPagePinned = true;
   
   RC rc;
   while(true){
+    // If all the records on the pinned page were seen, the last of them
+    // isn't used anymore, so unpin the page before moving to the next
+    if(useNextPage && hasPagePinned){
+      if((rc = fileHandle->pfh.UnpinPage(scanPage)))
+        return (rc);
+      hasPagePinned = false;
+    }
+
     // Retrieve next record
-    RM_Record temprec;
-    if((rc=fileHandle->GetNextRecord(scanPage, scanSlot, temprec, currentPH, useNextPage))){
-      if(rc == RM_EOF){
-        hasPagePinned = false;
+    if((rc=fileHandle->GetNextRecord(scanPage, scanSlot, rid, recData, currentPH, useNextPage, pinHint, endPage))){
+      if(rc == RM_EOF)
         scanEnded = true;
-      }
       return (rc);
     }
     hasPagePinned = true;
@@ -219,45 +274,24 @@ RC RM_FileScan::GetNextRec(RM_Record &rec) {
       GetNumRecOnPage(currentPH, numRecOnPage);
       useNextPage = false;
       numSeenOnPage = 0;
-      if(numRecOnPage == 1)
-        currentPH.GetPageNum(scanPage);
     }
     numSeenOnPage++; // update # of records seen on this page
 
     // If we've seen all the record on this page, then next time, we 
-    // need to look on the next page, not this page, so unpin the page
-    // and set the indicator (useNextPage)
-    if(numRecOnPage == numSeenOnPage){
+    // need to look on the next page, not this page
+    if(numRecOnPage == numSeenOnPage)
       useNextPage = true;
-      if(rc = fileHandle->pfh.UnpinPage(scanPage)){
-        return (rc);
-      }
-      hasPagePinned = false;
-    }
    
-    // Retrieves the RID of the scan to update the progress of the scan
-    RID rid;
-    temprec.GetRid(rid);
+    // Updates the progress of the scan with the RID of the record
     rid.GetPageNum(scanPage);
     rid.GetSlotNum(scanSlot);
 
     // Check to see if it satisfies the scan comparison, and if it does,
     // exit the function, returning the record.
-    char *pData;
-    if((rc = temprec.GetData(pData))){
-      return (rc);
-    }
-    if(compOp != NO_OP){
-      bool satisfies = (* comparator)(pData + attrOffset, this->value, attrType, attrLength);
-      if(satisfies){
-        rec = temprec;
-        break;
-      }
-    }
-    else{
-      rec = temprec; // if no comparison, just return the record
+    if(compOp == NO_OP)
+      break;
+    if((* comparator)(recData + attrOffset, this->value, attrType, attrLength))
       break;
-    }
   }
   return (0);
 }
@@ -10,6 +10,16 @@
 
 
 RM_Manager::RM_Manager(PF_Manager &pfm) : pfm(pfm){
+  readOnly = false;
+}
+
+/*
+ * Makes the files opened from now on read-only mappings, whose pages are
+ * read from the OS page cache instead of the buffer pool, or not
+ */
+RC RM_Manager::SetReadOnly(bool readOnly){
+  this->readOnly = readOnly;
+  return (0);
 }
 
 RM_Manager::~RM_Manager(){
@@ -25,6 +35,8 @@ RC RM_Manager::CreateFile (const char *fileName, int recordSize) {
   RC rc = 0;
   if(fileName == NULL)
     return (RM_BADFILENAME);
+  if(readOnly)
+    return (PF_READONLY);
   // basic checks on record size
   if(recordSize <= 0 || recordSize > PF_PAGE_SIZE)
     return RM_BADRECORDSIZE;
@@ -76,6 +88,8 @@ RC RM_Manager::CreateFile (const char *fileName, int recordSize) {
 RC RM_Manager::DestroyFile(const char *fileName) {
   if(fileName == NULL)
     return (RM_BADFILENAME);
+  if(readOnly)
+    return (PF_READONLY);
   RC rc;
   if((rc = pfm.DestroyFile(fileName)))
     return (rc);
@@ -116,7 +130,7 @@ RC RM_Manager::OpenFile   (const char *fileName, RM_FileHandle &fileHandle){
   RC rc;
   // Open the file
   PF_FileHandle fh;
-  if((rc = pfm.OpenFile(fileName, fh)))
+  if((rc = pfm.OpenFile(fileName, fh, readOnly)))
     return (rc);
 
   // Gets the first page, and uses it to set up the header in fileHandle
@@ -166,26 +180,11 @@ RC RM_Manager::CleanUpFH(RM_FileHandle &fileHandle){
  */
 RC RM_Manager::CloseFile  (RM_FileHandle &fileHandle) {
   RC rc;
-  PF_PageHandle ph;
-  PageNum page;
-  char *pData;
 
   // If header was modified, put the first page into buffer again,
   // and update its contents, marking the page as dirty
-  if(fileHandle.header_modified == true){
-    if((rc = fileHandle.pfh.GetFirstPage(ph)) || ph.GetPageNum(page))
-      return (rc);
-    if((rc = ph.GetData(pData))){
-      RC rc2;
-      if((rc2 = fileHandle.pfh.UnpinPage(page)))
-        return (rc2);
-      return (rc);
-    }
-    memcpy(pData, &fileHandle.header, sizeof(struct RM_FileHeader));
-    if((rc = fileHandle.pfh.MarkDirty(page)) || (rc = fileHandle.pfh.UnpinPage(page)))
-      return (rc);
-
-  }
+  if((rc = fileHandle.WriteHeader()))
+    return (rc);
 
   // Close the file
   if((rc = pfm.CloseFile(fileHandle.pfh)))
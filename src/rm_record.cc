@@ -79,4 +79,48 @@ RC RM_Record::SetRecord(RID rec_rid, char *recData, int rec_size){
   return (0);
 }
 
+RM_RecordView::RM_RecordView(){
+  data = NULL;
+  pinnedFile = NULL;
+  pinnedPage = -1;
+}
+
+RM_RecordView::~RM_RecordView(){
+  Release();
+}
+
+/*
+ * Retrieves the pointer to the record data in the page, only if the view
+ * is associated with a record
+ */
+RC RM_RecordView::GetData(char *&pData) const {
+  if(data == NULL)
+    return (RM_INVALIDRECORD);
+  pData = data;
+  return (0);
+}
+
+/*
+ * Retrieves the RID of a record only if the RID  is valid
+ */
+RC RM_RecordView::GetRid (RID &rid) const {
+  RC rc;
+  if((rc = (this->rid).isValidRID()))
+    return rc;
+  rid = this->rid;
+  return (0);
+}
 
+/*
+ * Unpins the page the record is on if this view pinned it. The data
+ * can't be used afterwards.
+ */
+RC RM_RecordView::Release(){
+  RC rc = 0;
+  data = NULL;
+  if(pinnedFile != NULL){
+    rc = pinnedFile->UnpinPage(pinnedPage);
+    pinnedFile = NULL;
+  }
+  return (rc);
+}
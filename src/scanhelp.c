@@ -146,6 +146,22 @@ static int get_id(char *s)
    if(!strcmp(string, "off"))
       return yylval.ival = RW_OFF;
 
+   /* Nearest neighbour lexemes */
+   if(!strcmp(string, "order"))
+      return yylval.ival = RW_ORDER;
+   if(!strcmp(string, "by"))
+      return yylval.ival = RW_BY;
+   if(!strcmp(string, "distance"))
+      return yylval.ival = RW_DISTANCE;
+   if(!strcmp(string, "limit"))
+      return yylval.ival = RW_LIMIT;
+
+   /* Transaction lexemes */
+   if(!strcmp(string, "begin"))
+      return yylval.ival = RW_BEGIN;
+   if(!strcmp(string, "commit"))
+      return yylval.ival = RW_COMMIT;
+
    /*  unresolved lexemes are strings */
 
    yylval.sval = mk_string(s, len);
@@ -0,0 +1,188 @@
+//
+// File:          SM component catalog
+// Description:   This keeps the entries of relcat and attrcat in memory,
+//                so that relations and attributes are found without
+//                scanning the catalog files
+//
+
+#include <cstdio>
+#include <iostream>
+#include "rm.h"
+#include "sm.h"
+
+using namespace std;
+
+SM_Catalog::SM_Catalog(){
+  relcatFH = NULL;
+  attrcatFH = NULL;
+}
+
+SM_Catalog::~SM_Catalog(){
+
+}
+
+/*
+ * Reads every entry of relcat and attrcat. The file handles are kept to
+ * write changes through, and must stay open until Clear is called
+ */
+RC SM_Catalog::Load(RM_FileHandle &relcatFH, RM_FileHandle &attrcatFH){
+  RC rc = 0;
+  rels.clear();
+  this->relcatFH = &relcatFH;
+  this->attrcatFH = &attrcatFH;
+
+  // Read the relations first, to know how many attributes each has
+  RM_FileScan fs;
+  RM_Record rec;
+  if((rc = fs.OpenScan(relcatFH, INT, 4, 0, NO_OP, NULL)))
+    return (rc);
+  while(fs.GetNextRec(rec) != RM_EOF){
+    RelCatEntry *rEntry;
+    SM_CatalogRel rel;
+    if((rc = rec.GetData((char *&)rEntry)) || (rc = rec.GetRid(rel.relRID)))
+      return (rc);
+    rel.relEntry = *rEntry;
+    rel.attrRIDs.resize(rEntry->attrCount);
+    rel.attrEntries.resize(rEntry->attrCount);
+    rels[rEntry->relName] = rel;
+  }
+  if((rc = fs.CloseScan()))
+    return (rc);
+
+  // Then place each attribute in its relation
+  if((rc = fs.OpenScan(attrcatFH, INT, 4, 0, NO_OP, NULL)))
+    return (rc);
+  while(fs.GetNextRec(rec) != RM_EOF){
+    AttrCatEntry *aEntry;
+    if((rc = rec.GetData((char *&)aEntry)))
+      return (rc);
+    unordered_map<string, SM_CatalogRel>::iterator it = rels.find(aEntry->relName);
+    if(it == rels.end() || aEntry->attrNum < 0 || aEntry->attrNum >= it->second.relEntry.attrCount)
+      continue; // not part of any relation
+    SM_CatalogRel &rel = it->second;
+    if((rc = rec.GetRid(rel.attrRIDs[aEntry->attrNum])))
+      return (rc);
+    rel.attrEntries[aEntry->attrNum] = *aEntry;
+    rel.attrNums[aEntry->attrName] = aEntry->attrNum;
+  }
+  if((rc = fs.CloseScan()))
+    return (rc);
+
+  return (0);
+}
+
+/*
+ * Forgets every entry, when the database is closed
+ */
+void SM_Catalog::Clear(){
+  rels.clear();
+  relcatFH = NULL;
+  attrcatFH = NULL;
+}
+
+/*
+ * Returns the entry of a relation
+ */
+RC SM_Catalog::GetRel(const char *relName, RelCatEntry *&entry){
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  entry = &it->second.relEntry;
+  return (0);
+}
+
+/*
+ * Returns the entries of the attributes of a relation, as an array
+ * ordered by attrNum
+ */
+RC SM_Catalog::GetAttrs(const char *relName, AttrCatEntry *&entries){
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  entries = &it->second.attrEntries[0];
+  return (0);
+}
+
+/*
+ * Returns the entry of an attribute of a relation
+ */
+RC SM_Catalog::GetAttr(const char *relName, const char *attrName, AttrCatEntry *&entry){
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  unordered_map<string, int>::iterator attrIt = it->second.attrNums.find(attrName);
+  if(attrIt == it->second.attrNums.end())
+    return (SM_INVALIDATTR);
+  entry = &it->second.attrEntries[attrIt->second];
+  return (0);
+}
+
+/*
+ * Inserts a relation and its attributes, ordered by attrNum, into relcat
+ * and attrcat
+ */
+RC SM_Catalog::AddRel(const RelCatEntry &relEntry, const AttrCatEntry *attrEntries){
+  RC rc = 0;
+  SM_CatalogRel rel;
+  rel.relEntry = relEntry;
+  rel.attrRIDs.resize(relEntry.attrCount);
+  rel.attrEntries.assign(attrEntries, attrEntries + relEntry.attrCount);
+  for(int i = 0; i < relEntry.attrCount; i++){
+    if((rc = attrcatFH->InsertRec((const char *)&attrEntries[i], rel.attrRIDs[i])))
+      return (rc);
+    rel.attrNums[attrEntries[i].attrName] = i;
+  }
+  if((rc = relcatFH->InsertRec((const char *)&relEntry, rel.relRID)))
+    return (rc);
+  rels[relEntry.relName] = rel;
+  return (0);
+}
+
+/*
+ * Deletes a relation and its attributes from relcat and attrcat
+ */
+RC SM_Catalog::RemoveRel(const char *relName){
+  RC rc = 0;
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  SM_CatalogRel &rel = it->second;
+  for(int i = 0; i < rel.relEntry.attrCount; i++){
+    if((rc = attrcatFH->DeleteRec(rel.attrRIDs[i])))
+      return (rc);
+  }
+  if((rc = relcatFH->DeleteRec(rel.relRID)))
+    return (rc);
+  rels.erase(it);
+  return (0);
+}
+
+/*
+ * Writes the entry of a relation back to relcat
+ */
+RC SM_Catalog::WriteRel(RelCatEntry *entry){
+  RC rc = 0;
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(entry->relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  RM_Record rec;
+  if((rc = rec.SetRecord(it->second.relRID, (char *)entry, sizeof(RelCatEntry))) ||
+     (rc = relcatFH->UpdateRec(rec)))
+    return (rc);
+  return (0);
+}
+
+/*
+ * Writes the entry of an attribute back to attrcat
+ */
+RC SM_Catalog::WriteAttr(AttrCatEntry *entry){
+  RC rc = 0;
+  unordered_map<string, SM_CatalogRel>::iterator it = rels.find(entry->relName);
+  if(it == rels.end())
+    return (SM_BADRELNAME);
+  RM_Record rec;
+  if((rc = rec.SetRecord(it->second.attrRIDs[entry->attrNum], (char *)entry, sizeof(AttrCatEntry))) ||
+     (rc = attrcatFH->UpdateRec(rec)))
+    return (rc);
+  return (0);
+}
@@ -72,11 +72,17 @@ bool recInsert_string(char *location, string value, int length){
 /*
  * Constructor and destructor for SM_Manager
  */
-SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm) : ixm(ixm), rmm(rmm){
+SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm, PF_Manager &pfm) : ixm(ixm), rmm(rmm), pfm(pfm){
   printIndex = false;
   useQO = true;
+  indexInsertMode = IX_LINEAR_INSERT;
+  indexNodeFormat = IX_SLOTTED_NODES;
+  joinMemory = 1024;
+  scanWorkers = 1;
+  orderedScans = false;
   calcStats = false;
   printPageStats = true;
+  inTransaction = false;
 }
 
 SM_Manager::~SM_Manager()
@@ -101,13 +107,24 @@ RC SM_Manager::OpenDb(const char *dbName)
     return (SM_INVALIDDB);
   }
 
+  // Open the write-ahead log, which first recovers the files from
+  // a crash
+  if((rc = pfm.OpenLog(SM_LOGNAME))){
+    return (rc);
+  }
+
   // Open and keep the relcat and attrcat filehandles stored
-  // during duration of database
+  // during duration of database. A database in an older file format
+  // is reported as such
   if((rc = rmm.OpenFile("relcat", relcatFH) )){
-    return (SM_INVALIDDB);
+    return (rc == PF_BADFORMAT ? rc : SM_INVALIDDB);
   }
   if((rc = rmm.OpenFile("attrcat", attrcatFH))) {
-    return (SM_INVALIDDB);
+    return (rc == PF_BADFORMAT ? rc : SM_INVALIDDB);
+  }
+  // and read their entries, which are looked up in memory from now on
+  if((rc = catalog.Load(relcatFH, attrcatFH))){
+    return (rc);
   }
   
   return (0);
@@ -122,16 +139,166 @@ RC SM_Manager::CloseDb()
 {
   
   RC rc = 0;
+  // A transaction still running commits, and the relations and indexes
+  // kept open are closed
+  if(inTransaction && (rc = CommitTransaction())){
+    return (rc);
+  }
+  if((rc = CloseHandles())){
+    return (rc);
+  }
+  catalog.Clear();
   if((rc = rmm.CloseFile(relcatFH) )){
     return (rc);
   }
   if((rc = rmm.CloseFile(attrcatFH))){
     return (rc);
   } 
+
+  // Checkpoint the log, so that the files alone hold the database
+  if((rc = pfm.CloseLog())){
+    return (rc);
+  }
   
   return (0);
 }
 
+/*
+ * Begins a transaction. The changes of the commands run until it is
+ * committed are logged together.
+ */
+RC SM_Manager::BeginTransaction()
+{
+  RC rc = 0;
+  if(inTransaction)
+    return (PF_INTRANSACTION);
+  if((rc = pfm.BeginTransaction()))
+    return (rc);
+  inTransaction = true;
+  return (0);
+}
+
+/*
+ * Commits the transaction. The open relations and indexes keep their
+ * headers until they are closed, so the headers that changed are first
+ * copied into their pages, to be logged with the rest.
+ */
+RC SM_Manager::CommitTransaction()
+{
+  RC rc = 0, rcCommit = 0;
+  if(!inTransaction)
+    return (PF_NOTRANSACTION);
+  inTransaction = false;
+  for(map<pair<string, int>, IX_IndexHandle *>::iterator it = indexHandles.begin();
+      it != indexHandles.end(); ++it){
+    if((rc = it->second->WriteHeader()))
+      break;
+  }
+  for(map<string, RM_FileHandle *>::iterator it = relHandles.begin();
+      !rc && it != relHandles.end(); ++it){
+    if((rc = it->second->WriteHeader()))
+      break;
+  }
+  if(!rc && !(rc = relcatFH.WriteHeader()))
+    rc = attrcatFH.WriteHeader();
+  if((rcCommit = pfm.CommitTransaction()) && !rc)
+    rc = rcCommit;
+  return (rc);
+}
+
+/*
+ * Closes every relation and index handle kept open
+ */
+RC SM_Manager::CloseHandles()
+{
+  RC rc = 0, rcClose = 0;
+  for(map<pair<string, int>, IX_IndexHandle *>::iterator it = indexHandles.begin();
+      it != indexHandles.end(); ++it){
+    if((rcClose = ixm.CloseIndex(*it->second)) && !rc)
+      rc = rcClose;
+    delete it->second;
+  }
+  indexHandles.clear();
+  for(map<string, RM_FileHandle *>::iterator it = relHandles.begin();
+      it != relHandles.end(); ++it){
+    if((rcClose = rmm.CloseFile(*it->second)) && !rc)
+      rc = rcClose;
+    delete it->second;
+  }
+  relHandles.clear();
+  return (rc);
+}
+
+/*
+ * Closes the handles kept open for a relation and its indexes, before
+ * they are dropped or rebuilt
+ */
+RC SM_Manager::CloseHandles(const char *relName)
+{
+  RC rc = 0, rcClose = 0;
+  map<pair<string, int>, IX_IndexHandle *>::iterator it = indexHandles.begin();
+  while(it != indexHandles.end()){
+    if(it->first.first != relName){
+      ++it;
+      continue;
+    }
+    if((rcClose = ixm.CloseIndex(*it->second)) && !rc)
+      rc = rcClose;
+    delete it->second;
+    indexHandles.erase(it++);
+  }
+  map<string, RM_FileHandle *>::iterator relIt = relHandles.find(relName);
+  if(relIt != relHandles.end()){
+    if((rcClose = rmm.CloseFile(*relIt->second)) && !rc)
+      rc = rcClose;
+    delete relIt->second;
+    relHandles.erase(relIt);
+  }
+  return (rc);
+}
+
+/*
+ * Returns the handle of the relation, opening it the first time
+ */
+RC SM_Manager::GetRelHandle(const char *relName, RM_FileHandle *&fh)
+{
+  RC rc = 0;
+  map<string, RM_FileHandle *>::iterator it = relHandles.find(relName);
+  if(it != relHandles.end()){
+    fh = it->second;
+    return (0);
+  }
+  fh = new RM_FileHandle();
+  if((rc = rmm.OpenFile(relName, *fh))){
+    delete fh;
+    return (rc);
+  }
+  relHandles[relName] = fh;
+  return (0);
+}
+
+/*
+ * Returns the handle of an index of the relation, opening it the first
+ * time
+ */
+RC SM_Manager::GetIndexHandle(const char *relName, int indexNo, IX_IndexHandle *&ih)
+{
+  RC rc = 0;
+  pair<string, int> key(relName, indexNo);
+  map<pair<string, int>, IX_IndexHandle *>::iterator it = indexHandles.find(key);
+  if(it != indexHandles.end()){
+    ih = it->second;
+    return (0);
+  }
+  ih = new IX_IndexHandle();
+  if((rc = ixm.OpenIndex(relName, indexNo, *ih))){
+    delete ih;
+    return (rc);
+  }
+  indexHandles[key] = ih;
+  return (0);
+}
+
 
 /*
  * This function returns true if the attribute type
@@ -208,18 +375,19 @@ RC SM_Manager::CreateTable(const char *relName,
   if((rc = rmm.CreateFile(relName, totalRecSize)))
     return (SM_BADRELNAME);
 
-  // For each attribute, insert into attrcat:
-  RID rid;
+  // Set up an entry for each attribute, and one for the relation
+  vector<AttrCatEntry> attrEntries(attrCount);
   int currOffset = 0;
   for(int i = 0; i < attrCount; i++){
     AttrInfo attr = attributes[i];
-    if((rc = InsertAttrCat(relName, attr, currOffset, i)))
-      return (rc);
+    SetUpAttrCat(relName, attr, currOffset, i, attrEntries[i]);
     currOffset += attr.attrLength;
   }
+  RelCatEntry relEntry;
+  SetUpRelCat(relName, attrCount, totalRecSize, relEntry);
     
-  // Insert into RelCat
-  if((rc = InsertRelCat(relName, attrCount, totalRecSize)))
+  // Insert them into attrcat and relcat
+  if((rc = catalog.AddRel(relEntry, &attrEntries[0])))
     return (rc);
 
   // Make sure changes to attrcat and relcat are reflected
@@ -230,60 +398,36 @@ RC SM_Manager::CreateTable(const char *relName,
 }
 
 /*
- * This function inserts a relation entry into relcat. 
+ * This function sets up the relcat entry of a new relation
  */
-RC SM_Manager::InsertRelCat(const char *relName, int attrCount, int recSize){
-  RC rc = 0;
-
-  RelCatEntry* rEntry = (RelCatEntry *) malloc(sizeof(RelCatEntry));
-  memset((void*)rEntry, 0, sizeof(*rEntry));
-  *rEntry = (RelCatEntry) {"\0", 0, 0, 0, 0};
-  memcpy(rEntry->relName, relName, MAXNAME + 1); // name
-  rEntry->tupleLength = recSize;                 // record size
-  rEntry->attrCount = attrCount;                 // # of attributes
-  rEntry->indexCount = 0;             // starting # of incides
-  rEntry->indexCurrNum = 0;           // starting enumeration of indices
+void SM_Manager::SetUpRelCat(const char *relName, int attrCount, int recSize, RelCatEntry &rEntry){
+  memset((void*)&rEntry, 0, sizeof(rEntry));
+  strncpy(rEntry.relName, relName, MAXNAME + 1); // name
+  rEntry.tupleLength = recSize;                  // record size
+  rEntry.attrCount = attrCount;                  // # of attributes
+  rEntry.indexCount = 0;             // starting # of incides
+  rEntry.indexCurrNum = 0;           // starting enumeration of indices
   // FOR EX component
-  rEntry->numTuples = 0;
-  rEntry->statsInitialized = false;
-
-  // Insert into relcat
-  RID relRID;
-  rc = relcatFH.InsertRec((char *)rEntry, relRID);
-  free(rEntry);
-
-  return rc;
+  rEntry.numTuples = 0;
+  rEntry.statsInitialized = false;
 }
 
 /*
- * This function inserts an attribute into attrcat
+ * This function sets up the attrcat entry of an attribute of a new relation
  */
-RC SM_Manager::InsertAttrCat(const char *relName, AttrInfo attr, int offset, int attrNum){
-  RC rc = 0;
-  
-  AttrCatEntry *aEntry = (AttrCatEntry *)malloc(sizeof(AttrCatEntry));
-  memset((void*)aEntry, 0, sizeof(*aEntry));
-  *aEntry = (AttrCatEntry) {"\0", "\0", 0, INT, 0, 0, 0};
-  memcpy(aEntry->relName, relName, MAXNAME + 1);        // relation anme
-  memcpy(aEntry->attrName, attr.attrName, MAXNAME + 1); // attribute name
-  aEntry->offset = offset;                // attribute offset
-  aEntry->attrType = attr.attrType;       // type
-  aEntry->attrLength = attr.attrLength;   // length
-  aEntry->indexNo = NO_INDEXES;           // index number
-  aEntry->attrNum = attrNum;              // attribute # in sequence for this relation
+void SM_Manager::SetUpAttrCat(const char *relName, AttrInfo attr, int offset, int attrNum, AttrCatEntry &aEntry){
+  memset((void*)&aEntry, 0, sizeof(aEntry));
+  strncpy(aEntry.relName, relName, MAXNAME + 1);        // relation anme
+  strncpy(aEntry.attrName, attr.attrName, MAXNAME + 1); // attribute name
+  aEntry.offset = offset;                 // attribute offset
+  aEntry.attrType = attr.attrType;        // type
+  aEntry.attrLength = attr.attrLength;    // length
+  aEntry.indexNo = NO_INDEXES;            // index number
+  aEntry.attrNum = attrNum;               // attribute # in sequence for this relation
   // For EX component
-  aEntry->numDistinct = 0;
-  aEntry->maxValue = FLT_MIN;
-  aEntry->minValue = FLT_MAX;
-
-  // Do insertion
-  RID attrRID;
-  rc = attrcatFH.InsertRec((char *)aEntry, attrRID);
-  free(aEntry);
-  
-  
-  return rc;
-
+  aEntry.numDistinct = 0;
+  aEntry.maxValue = FLT_MIN;
+  aEntry.minValue = FLT_MAX;
 }
 
 
@@ -298,70 +442,41 @@ RC SM_Manager::DropTable(const char *relName)
 
   if(strlen(relName) > MAXNAME) // check for whether this is a valid name
     return (SM_BADRELNAME);
+  // Close the relation and its indexes if they are open
+  if((rc = CloseHandles(relName)))
+    return (rc);
   // Try to destroy the table. This should detect whether the file is there
   if((rc = rmm.DestroyFile(relName))){
     return (SM_BADRELNAME);
   }
 
-  // Retrieve the record associated with the relation
-  RM_Record relRec;
+  // Retrieve the entry associated with the relation
   RelCatEntry *relEntry;
-  if((rc = GetRelEntry(relName, relRec, relEntry)))
+  AttrCatEntry *attrEntries;
+  if((rc = GetRelEntry(relName, relEntry)) || (rc = catalog.GetAttrs(relName, attrEntries)))
     return (rc);
-  int numAttr = relEntry->attrCount;
 
-  // Retrieve all its attributes
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, const_cast<char*>(relName))))
-    return (rc);
-  AttrCatEntry *attrEntry;
-  RM_Record attrRec;
-  for(int i=0; i < numAttr; i++){
-    // Get the next attribute
-    if((rc = attrIt.GetNextAttr(attrRec, attrEntry))){
-      return (rc);
-    }
-    // Check whether it has indices. If so, delete it
-    if((attrEntry->indexNo != NO_INDEXES)){
-      if((rc = DropIndex(relName, attrEntry->attrName)))
+  // Check whether its attributes have indices. If so, delete them
+  for(int i=0; i < relEntry->attrCount; i++){
+    if((attrEntries[i].indexNo != NO_INDEXES)){
+      if((rc = DropIndex(relName, attrEntries[i].attrName)))
         return (rc);
     }
-    // Delete that attribute record
-    RID attrRID;
-    if((rc = attrRec.GetRid(attrRID)) || (rc = attrcatFH.DeleteRec(attrRID)))
-      return (rc);
-
   }
-  if((rc = attrIt.CloseIterator()))
-    return (rc);
 
-  // Delete the record associated with the relation
-  RID relRID;
-  if((rc = relRec.GetRid(relRID)) || (rc = relcatFH.DeleteRec(relRID)))
+  // Delete the records associated with the relation and its attributes
+  if((rc = catalog.RemoveRel(relName)))
     return (rc);
 
   return (0);
 }
 
 /*
- * Retrieves the record and data associated with a specific relation in relcat
+ * Retrieves the catalog entry of a specific relation. It is changed in
+ * place, and written back to relcat through the catalog
  */
-RC SM_Manager::GetRelEntry(const char *relName, RM_Record &relRec, RelCatEntry *&entry){
-  RC rc = 0;
-  // Use a scan to search for it
-  RM_FileScan fs;
-  if((rc = fs.OpenScan(relcatFH, STRING, MAXNAME+1, 0, EQ_OP, const_cast<char*>(relName))))
-    return (rc);
-  if((rc = fs.GetNextRec(relRec))) // there should be only one entry
-    return (SM_BADRELNAME);
-  
-  if((rc = fs.CloseScan())) 
-    return (rc);
-
-  if((rc = relRec.GetData((char *&)entry))) // retrieve its data contents
-    return (rc);
-
-  return (0);
+RC SM_Manager::GetRelEntry(const char *relName, RelCatEntry *&entry){
+  return catalog.GetRel(relName, entry);
 }
 
 /*
@@ -374,8 +489,7 @@ RC SM_Manager::GetAllRels(RelCatEntry *relEntries, int nRelations, const char *
   RC rc = 0;
   for(int i=0; i < nRelations; i++){
     RelCatEntry *rEntry;
-    RM_Record rec;
-    if((rc = GetRelEntry(relations[i], rec, rEntry))) // retrieve this entry
+    if((rc = GetRelEntry(relations[i], rEntry))) // retrieve this entry
       return (rc);
     *(relEntries + i) = (RelCatEntry) {"\0", 0, 0, 0, 0};
     memcpy((char *)(relEntries + i), (char *)rEntry, sizeof(RelCatEntry)); // copy it into appropraite spot
@@ -394,20 +508,13 @@ RC SM_Manager::GetAllRels(RelCatEntry *relEntries, int nRelations, const char *
  */
 RC SM_Manager::GetAttrForRel(RelCatEntry *relEntry, AttrCatEntry *aEntry, std::map<std::string, std::set<std::string> > &attrToRel){
   RC rc = 0;
-  // Iterate through all the attributes in this relation
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, (relEntry->relName))))
+  // Get all the attributes in this relation
+  AttrCatEntry *attrEntries;
+  if((rc = catalog.GetAttrs(relEntry->relName, attrEntries)))
     return (rc);
-  RM_Record attrRec;
-  AttrCatEntry *attrEntry;
-  for(int i = 0; i < relEntry->attrCount; i++){
-    // For each attribute, get its AttrCatEntry
-    if((rc = attrIt.GetNextAttr(attrRec, attrEntry)))
-      return (rc);
-    
-    int slot = attrEntry->attrNum;
-    *(aEntry + slot) = (AttrCatEntry) {"\0", "\0", 0, INT, 0, 0, 0};
-    memcpy((char *)(aEntry + slot), (char *)attrEntry, sizeof(AttrCatEntry));
+
+  for(int slot = 0; slot < relEntry->attrCount; slot++){
+    memcpy((char *)(aEntry + slot), (char *)&attrEntries[slot], sizeof(AttrCatEntry));
 
     // add this attribute to the mapping from attribute name to set of relations with this attribute name
     string attrString(aEntry[slot].attrName);
@@ -422,8 +529,6 @@ RC SM_Manager::GetAttrForRel(RelCatEntry *relEntry, AttrCatEntry *aEntry, std::m
       attrToRel[attrString].insert(relString);
     }
   }
-  if((rc = attrIt.CloseIterator())) // Done with search!
-    return (rc);
 
   return (0);
 }
@@ -443,15 +548,13 @@ RC SM_Manager::CreateIndex(const char *relName,
     << "   attrName=" << attrName << "\n";
 
   RC rc = 0;
-  RM_Record relRec;
   RelCatEntry *rEntry;
-  if((rc = GetRelEntry(relName, relRec, rEntry))) // get the relation info
+  if((rc = GetRelEntry(relName, rEntry))) // get the relation info
     return (rc);
 
   // Find the attribute associated with this index
-  RM_Record attrRec; 
   AttrCatEntry *aEntry;
-  if((rc = FindAttr(relName, attrName, attrRec, aEntry))){
+  if((rc = FindAttr(relName, attrName, aEntry))){
     return (rc);
   }
 
@@ -461,34 +564,51 @@ RC SM_Manager::CreateIndex(const char *relName,
 
 
   // Create this index
-  if((rc = ixm.CreateIndex(relName, rEntry->indexCurrNum, aEntry->attrType, aEntry->attrLength)))
+  if((rc = ixm.CreateIndex(relName, rEntry->indexCurrNum, aEntry->attrType, aEntry->attrLength, indexInsertMode,
+    indexNodeFormat)))
     return (rc);
 
   // Gets ready to scan through the file associated with the relation
-  IX_IndexHandle ih;
-  RM_FileHandle fh;
+  IX_IndexHandle *ih;
+  RM_FileHandle *fh;
   RM_FileScan fs;
-  if((rc = ixm.OpenIndex(relName, rEntry->indexCurrNum, ih)))
+  if((rc = GetIndexHandle(relName, rEntry->indexCurrNum, ih)))
     return (rc);
-  if((rc = rmm.OpenFile(relName, fh)))
+  if((rc = GetRelHandle(relName, fh)))
     return (rc);
 
   // scan through the entire file:
-  if((rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL))){
+  if((rc = fs.OpenScan(*fh, INT, 4, 0, NO_OP, NULL, SEQUENTIAL_SCAN))){
     return (rc);
   }
+  // MBR indexes are collected and packed with a bulk load instead of
+  // being inserted one entry at a time. All the entries are held in memory
+  // (24 bytes per tuple), as STR sorts them in place; a relation whose
+  // entries do not fit would need them sorted in runs on disk first
+  vector<IX_BulkEntry> bulkEntries;
   RM_Record rec;
   while(fs.GetNextRec(rec) != RM_EOF){
     char *pData;
     RID rid;
     if((rc = rec.GetData(pData) || (rc = rec.GetRid(rid)))) // retrieve the record
       return (rc);
-    if((rc = ih.InsertEntry(pData+ aEntry->offset, rid))) // insert into index
+    if(aEntry->attrType == MBR){
+      IX_BulkEntry entry;
+      memcpy(&entry.key, pData + aEntry->offset, sizeof(mbr));
+      if((rc = rid.GetPageNum(entry.page)) || (rc = rid.GetSlotNum(entry.slot)))
+        return (rc);
+      bulkEntries.push_back(entry);
+    }
+    else if((rc = ih->InsertEntry(pData+ aEntry->offset, rid))) // insert into index
+      return (rc);
+  }
+  if(! bulkEntries.empty()){
+    if((rc = ih->BulkLoad(&bulkEntries[0], bulkEntries.size())))
       return (rc);
   }
-  if((rc = fs.CloseScan()) || (rc = rmm.CloseFile(fh)) || (rc = ixm.CloseIndex(ih)))
+  if((rc = fs.CloseScan()))
     return (rc);
-  // Close all scans, indices and files
+  // Close the scan. The relation and index stay open
   
   // rewrite entry for attribute and relation in attrcat and relcat
   aEntry->indexNo = rEntry->indexCurrNum;
@@ -496,7 +616,7 @@ RC SM_Manager::CreateIndex(const char *relName,
   rEntry->indexCount++;
 
   // write both back
-  if((rc = relcatFH.UpdateRec(relRec)) || (rc = attrcatFH.UpdateRec(attrRec)))
+  if((rc = catalog.WriteRel(rEntry)) || (rc = catalog.WriteAttr(aEntry)))
     return (rc);
   if((rc = relcatFH.ForcePages() || (rc = attrcatFH.ForcePages())))
     return (rc);
@@ -505,38 +625,11 @@ RC SM_Manager::CreateIndex(const char *relName,
 }
 
 /*
- * This function returns a record and its data for a particular
- * attribute in a particular relation
+ * This function returns the catalog entry of a particular attribute
+ * in a particular relation
  */
-RC SM_Manager::FindAttr(const char *relName, const char *attrName, RM_Record &attrRec, AttrCatEntry *&entry){
-  RC rc = 0;
-  RM_Record relRec;
-  RelCatEntry * rEntry;
-  if((rc = GetRelEntry(relName, relRec, rEntry))) // get the relation
-    return (rc);
-  
-  // Iterate through attrcat for attributes in this relation
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, const_cast<char*>(relName))))
-    return (rc);
-  bool notFound = true;
-  while(notFound){
-    if((RM_EOF == attrIt.GetNextAttr(attrRec, entry))){
-      break;
-    }
-    // Check if the attribute names match
-    if(strncmp(entry->attrName, attrName, MAXNAME + 1) == 0){
-      notFound = false;
-      break;
-    }
-  }
-  if((rc = attrIt.CloseIterator())) // Done with search!
-    return (rc);
-
-  if(notFound == true)  // If attribute is not found, return error
-    return (SM_INVALIDATTR);
-  return (rc);
-
+RC SM_Manager::FindAttr(const char *relName, const char *attrName, AttrCatEntry *&entry){
+  return catalog.GetAttr(relName, attrName, entry);
 }
 
 
@@ -551,21 +644,21 @@ RC SM_Manager::DropIndex(const char *relName,
     << "   attrName=" << attrName << "\n";
 
   RC rc = 0;
-  RM_Record relRec;
   RelCatEntry *rEntry;
-  if((rc = GetRelEntry(relName, relRec, rEntry))) // retrieve relation
+  if((rc = GetRelEntry(relName, rEntry))) // retrieve relation
     return (rc);
 
-  RM_Record attrRec; // Finds the appropriate attribute
-  AttrCatEntry *aEntry;
-  if((rc = FindAttr(relName, attrName, attrRec, aEntry))){
+  AttrCatEntry *aEntry; // Finds the appropriate attribute
+  if((rc = FindAttr(relName, attrName, aEntry))){
     return (rc);
   }
 
   if((aEntry->indexNo == NO_INDEXES)) // Check that there is actually an index
     return (SM_NOINDEX);
   
-  // Destroys the index
+  // Closes the index if it is open, then destroys it
+  if((rc = CloseHandles(relName)))
+    return (rc);
   if((rc = ixm.DestroyIndex(relName, aEntry->indexNo)))
     return (rc);
 
@@ -574,7 +667,7 @@ RC SM_Manager::DropIndex(const char *relName,
   rEntry->indexCount--;
 
   // write both catalog pages back
-  if((rc = relcatFH.UpdateRec(relRec)) || (rc = attrcatFH.UpdateRec(attrRec)))
+  if((rc = catalog.WriteRel(rEntry)) || (rc = catalog.WriteAttr(aEntry)))
     return (rc);
   if((rc = relcatFH.ForcePages() || (rc = attrcatFH.ForcePages())))
     return (rc);
@@ -589,14 +682,11 @@ RC SM_Manager::DropIndex(const char *relName,
 RC SM_Manager::PrepareAttr(RelCatEntry *rEntry, Attr* attributes){
   RC rc = 0; 
   // Iterate through the attributes related to this relation
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, rEntry->relName)))
+  AttrCatEntry *attrEntries;
+  if((rc = catalog.GetAttrs(rEntry->relName, attrEntries)))
     return (rc);
-  RM_Record attrRec;
-  AttrCatEntry *aEntry;
   for(int i = 0; i < rEntry->attrCount; i++){
-    if((rc = attrIt.GetNextAttr(attrRec, aEntry)))
-      return (rc);
+    AttrCatEntry *aEntry = &attrEntries[i];
     // For each attribute, place its information in the appropriate slot
     int slot = aEntry->attrNum;
     attributes[slot].offset = aEntry->offset;
@@ -628,8 +718,6 @@ RC SM_Manager::PrepareAttr(RelCatEntry *rEntry, Attr* attributes){
     else
       attributes[slot].recInsert = &recInsert_string;
   }
-  if((rc = attrIt.CloseIterator()))
-    return (rc);
   return (0);
 }
 
@@ -644,12 +732,14 @@ RC SM_Manager::Load(const char *relName,
          << "   fileName=" << fileName << "\n";
 
   RC rc = 0;
-  RM_Record relRec;
   RelCatEntry *rEntry;
-  if((rc = GetRelEntry(relName, relRec, rEntry))) // retrieve the relation
+  if((rc = GetRelEntry(relName, rEntry))) // retrieve the relation
     return (rc);
   if(rEntry->statsInitialized == false)
     calcStats = true;
+  // The relation and its indexes are loaded through handles of their own
+  if((rc = CloseHandles(relName)))
+    return (rc);
 
   // Creates a struct containing info about the attributes to 
   // help with loading
@@ -666,36 +756,42 @@ RC SM_Manager::Load(const char *relName,
   RM_FileHandle relFH;
   if((rc = rmm.OpenFile(relName, relFH)))
     return (rc);
+  // If the relation holds no tuples yet, its MBR indexes are empty and can
+  // be bulk loaded once the whole file has been read
+  bool bulkLoad = false;
+  RM_FileScan fs;
+  RM_Record rec;
+  if((rc = fs.OpenScan(relFH, INT, 4, 0, NO_OP, NULL)))
+    return (rc);
+  if(fs.GetNextRec(rec) == RM_EOF)
+    bulkLoad = true;
+  if((rc = fs.CloseScan()))
+    return (rc);
+
   int totalRecs = 0;
   rc = OpenAndLoadFile(relFH, fileName, attributes, rEntry->attrCount,
-    rEntry->tupleLength, totalRecs);
+    rEntry->tupleLength, totalRecs, bulkLoad);
   RC rc2;
 
   // write back attribute and rel stats;
   if(calcStats){
     rEntry->numTuples = totalRecs;
     rEntry->statsInitialized = true;
-    if((rc = relcatFH.UpdateRec(relRec)) || (rc = relcatFH.ForcePages()))
+    if((rc = catalog.WriteRel(rEntry)) || (rc = relcatFH.ForcePages()))
       return (rc);
 
-    SM_AttrIterator attrIt;
-    if((rc = attrIt.OpenIterator(attrcatFH, rEntry->relName)))
+    AttrCatEntry *attrEntries;
+    if((rc = catalog.GetAttrs(relName, attrEntries)))
       return (rc);
-    RM_Record attrRec;
-    AttrCatEntry *aEntry;
     for(int i = 0; i < rEntry->attrCount; i++){
-      if((rc = attrIt.GetNextAttr(attrRec, aEntry)))
-        return (rc);
       // For each attribute, place its information in the appropriate slot
-      int slot = aEntry->attrNum;
-      aEntry->minValue = attributes[slot].minValue;
-      aEntry->maxValue = attributes[slot].maxValue;
-      aEntry->numDistinct = attributes[slot].numDistinct;
-      if((rc = attrcatFH.UpdateRec(attrRec)))
+      AttrCatEntry *aEntry = &attrEntries[i];
+      aEntry->minValue = attributes[i].minValue;
+      aEntry->maxValue = attributes[i].maxValue;
+      aEntry->numDistinct = attributes[i].numDistinct;
+      if((rc = catalog.WriteAttr(aEntry)))
         return (rc);
     }
-    if((rc = attrIt.CloseIterator()))
-      return (rc);
     if((rc = attrcatFH.ForcePages()))
       return (rc);
     calcStats = false;
@@ -722,7 +818,7 @@ RC SM_Manager::Load(const char *relName,
  * will be dealt with by truncation, and no error will be returned
  */
 RC SM_Manager::OpenAndLoadFile(RM_FileHandle &relFH, const char *fileName, Attr* attributes, int attrCount, 
-  int recLength, int &loadedRecs){
+  int recLength, int &loadedRecs, bool bulkLoad){
   RC rc = 0;
   loadedRecs = 0;
 
@@ -737,6 +833,8 @@ RC SM_Manager::OpenAndLoadFile(RM_FileHandle &relFH, const char *fileName, Attr*
   }
 
   vector<set<string> > numDistinct(attrCount);
+  // Entries of the bulk loaded indexes, held in memory like in CreateIndex
+  vector<vector<IX_BulkEntry> > bulkEntries(attrCount);
  
   string line, token;
   string delimiter = ","; // tuples separated by comma
@@ -773,7 +871,14 @@ RC SM_Manager::OpenAndLoadFile(RM_FileHandle &relFH, const char *fileName, Attr*
 
     // Insert the portions of the record into the appropriate indices
     for(int i=0; i < attrCount; i++){
-      if(attributes[i].indexNo != NO_INDEXES){
+      if(attributes[i].indexNo != NO_INDEXES && bulkLoad && attributes[i].type == MBR){
+        IX_BulkEntry entry;
+        memcpy(&entry.key, record + attributes[i].offset, sizeof(mbr));
+        recRID.GetPageNum(entry.page);
+        recRID.GetSlotNum(entry.slot);
+        bulkEntries[i].push_back(entry);
+      }
+      else if(attributes[i].indexNo != NO_INDEXES){
         if((rc = attributes[i].ih.InsertEntry(record + attributes[i].offset, recRID))){
           free(record);
           f.close();
@@ -808,6 +913,17 @@ RC SM_Manager::OpenAndLoadFile(RM_FileHandle &relFH, const char *fileName, Attr*
     attributes[i].numDistinct = numDistinct[i].size();
   }
 
+  // Pack the collected entries into the empty MBR indexes
+  for(int i=0; i < attrCount; i++){
+    if(bulkEntries[i].empty())
+      continue;
+    if((rc = attributes[i].ih.BulkLoad(&bulkEntries[i][0], bulkEntries[i].size()))){
+      free(record);
+      f.close();
+      return (rc);
+    }
+  }
+
 
 cleanup:
   free(record);
@@ -841,9 +957,8 @@ RC SM_Manager::Print(const char *relName)
     << "   relName=" << relName << "\n";
 
   RC rc = 0;
-  RM_Record relRec;
   RelCatEntry *relEntry;
-  if((rc = GetRelEntry(relName, relRec, relEntry))) // retrieves relation info
+  if((rc = GetRelEntry(relName, relEntry))) // retrieves relation info
     return (SM_BADRELNAME);
   int numAttr = relEntry->attrCount;
 
@@ -856,22 +971,17 @@ RC SM_Manager::Print(const char *relName)
   printer.PrintHeader(cout);
 
   // open the file, and a scan through the entire file
-  RM_FileHandle fh;
+  RM_FileHandle *fh;
   RM_FileScan fs;
-  if((rc = rmm.OpenFile(relName, fh)) || (rc = fs.OpenScan(fh, INT, 4, 0, NO_OP, NULL))){
+  if((rc = GetRelHandle(relName, fh)) || (rc = fs.OpenScan(*fh, INT, 4, 0, NO_OP, NULL, SEQUENTIAL_SCAN))){
     free(attributes);
     return (rc);
   }
 
-  // Retrieve each record and print it
-  RM_Record rec;
+  // Retrieve each record and print it in place
+  RM_RecordView rec;
   while(fs.GetNextRec(rec) != RM_EOF){
-    char *pData;
-    if((rec.GetData(pData))){
-      free(attributes);
-      return (rc);
-    }
-    printer.Print(cout, pData);
+    printer.Print(cout, rec);
   }
   fs.CloseScan();
 
@@ -887,19 +997,14 @@ RC SM_Manager::Print(const char *relName)
  */
 RC SM_Manager::SetUpPrint(RelCatEntry* rEntry, DataAttrInfo *attributes){
   RC rc = 0;
-  RID attrRID;
-  RM_Record attrRec;
-  AttrCatEntry *aEntry;
 
-  // Iterate through attrcat for attributes related to this relation
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, rEntry->relName)))
+  // Iterate through the attributes related to this relation
+  AttrCatEntry *attrEntries;
+  if((rc = catalog.GetAttrs(rEntry->relName, attrEntries)))
     return (rc);
 
   for(int i=0; i < rEntry->attrCount; i++){
-    if((rc = attrIt.GetNextAttr(attrRec, aEntry))){
-      return (rc);
-    }
+    AttrCatEntry *aEntry = &attrEntries[i];
     int slot = aEntry->attrNum; // insert its info in the appropriate slot
 
     memcpy(attributes[slot].relName, aEntry->relName, MAXNAME + 1);
@@ -909,8 +1014,6 @@ RC SM_Manager::SetUpPrint(RelCatEntry* rEntry, DataAttrInfo *attributes){
     attributes[slot].attrLength = aEntry->attrLength;
     attributes[slot].indexNo = aEntry->indexNo;
   }
-  if((rc = attrIt.CloseIterator()))
-    return (rc);
 
   return (rc);
 }
@@ -977,6 +1080,64 @@ RC SM_Manager::Set(const char *paramName, const char *value)
       useQO = false;
       return (0);
     }
+    if(strncmp(paramName, "indexInsert", 11) == 0 && strncmp(value, "rstar", 5) ==0){
+      cout << "New MBR indexes use R* insertion" << endl;
+      indexInsertMode = IX_RSTAR_INSERT;
+      return (0);
+    }
+    if(strncmp(paramName, "indexInsert", 11) == 0 && strncmp(value, "linear", 6) ==0){
+      cout << "New MBR indexes use linear insertion" << endl;
+      indexInsertMode = IX_LINEAR_INSERT;
+      return (0);
+    }
+    if(strncmp(paramName, "indexNodes", 10) == 0 && strncmp(value, "packed", 6) ==0){
+      cout << "New MBR indexes pack their nodes when bulk loaded, and can't be updated afterwards" << endl;
+      indexNodeFormat = IX_PACKED_NODES;
+      return (0);
+    }
+    if(strncmp(paramName, "indexNodes", 10) == 0 && strncmp(value, "slotted", 7) ==0){
+      cout << "New MBR indexes use slotted nodes" << endl;
+      indexNodeFormat = IX_SLOTTED_NODES;
+      return (0);
+    }
+    if(strncmp(paramName, "joinMemory", 10) == 0){
+      int kb = atoi(value);
+      if(kb <= 0)
+        return (SM_BADSET);
+      cout << "Partitioned, hash and merge joins use " << kb << " KB of memory" << endl;
+      joinMemory = kb;
+      return (0);
+    }
+    if(strncmp(paramName, "scanWorkers", 11) == 0){
+      int workers = atoi(value);
+      if(workers <= 0)
+        return (SM_BADSET);
+      cout << "Window queries and filtered table scans use " << workers << " worker threads" << endl;
+      scanWorkers = workers;
+      return (0);
+    }
+    if(strncmp(paramName, "scanOrder", 9) == 0 && strncmp(value, "file", 4) ==0){
+      cout << "Parallel table scans return records in file order" << endl;
+      orderedScans = true;
+      return (0);
+    }
+    if(strncmp(paramName, "scanOrder", 9) == 0 && strncmp(value, "any", 3) ==0){
+      cout << "Parallel table scans return records in any order" << endl;
+      orderedScans = false;
+      return (0);
+    }
+    if(strncmp(paramName, "bufferPolicy", 12) == 0 && strncmp(value, "lru2", 4) ==0){
+      cout << "Buffer pool replaces pages by LRU-2" << endl;
+      return pfm.SetBufferPolicy(PF_LRU2);
+    }
+    if(strncmp(paramName, "bufferPolicy", 12) == 0 && strncmp(value, "lru", 3) ==0){
+      cout << "Buffer pool replaces pages by LRU" << endl;
+      return pfm.SetBufferPolicy(PF_LRU);
+    }
+    if(strncmp(paramName, "bufferPolicy", 12) == 0 && strncmp(value, "clock", 5) ==0){
+      cout << "Buffer pool replaces pages by CLOCK" << endl;
+      return pfm.SetBufferPolicy(PF_CLOCK);
+    }
     if(strncmp(paramName, "printStats", 10) == 0){
       PrintStats(value);
       return (0);
@@ -1042,14 +1203,9 @@ RC SM_Manager::Help()
     return (rc);
   }
 
-  RM_Record rec; // iterate through all relation entries
+  RM_RecordView rec; // iterate through all relation entries
   while(fs.GetNextRec(rec) != RM_EOF){
-    char *pData;
-    if((rec.GetData(pData))){
-      free(attributes);
-      return (rc);
-    }
-    printer.Print(cout, pData);
+    printer.Print(cout, rec);
   }
 
   fs.CloseScan();
@@ -1107,18 +1263,12 @@ RC SM_Manager::Help(const char *relName)
     cout << "Help\n"
          << "   relName=" << relName << "\n";
   RC rc = 0;
-  RM_FileScan fs;
-  RM_Record rec;
 
   // Check that this relation exists:
-  if((rc = fs.OpenScan(relcatFH, STRING, MAXNAME+1, 0, EQ_OP, const_cast<char*>(relName))))
-    return (rc);
-  if(fs.GetNextRec(rec) == RM_EOF){
-    fs.CloseScan();
+  RelCatEntry *relEntry;
+  AttrCatEntry *attrEntries;
+  if(GetRelEntry(relName, relEntry) || catalog.GetAttrs(relName, attrEntries))
     return (SM_BADRELNAME);
-  }
-  fs.CloseScan();
-  
 
   // Sets up the DataAttrInfo for printing
   DataAttrInfo * attributes = (DataAttrInfo *)malloc(6* sizeof(DataAttrInfo));
@@ -1127,36 +1277,19 @@ RC SM_Manager::Help(const char *relName)
   Printer printer(attributes, 6);
   printer.PrintHeader(cout);
 
-  // Iterate through attrcat to find all attributes
-  // associated with this relation. And print them.
-  if((rc = fs.OpenScan(attrcatFH, STRING, MAXNAME+1, 0, EQ_OP, const_cast<char*>(relName))))
-    return (rc);
-
-  while(fs.GetNextRec(rec) != RM_EOF){
-    char *pData;
-    if((rec.GetData(pData)))
-      return (rc);
-    printer.Print(cout, pData);
+  // Print all attributes associated with this relation.
+  for(int i = 0; i < relEntry->attrCount; i++){
+    printer.Print(cout, (char *)&attrEntries[i]);
   }
 
-  if((rc = fs.CloseScan() ))
-    return (rc);
-
   // If we are to print the index, itereate through again, and print
   // the entire index
-  if((rc = fs.OpenScan(attrcatFH, STRING, MAXNAME+1, 0, EQ_OP, const_cast<char*>(relName))))
-    return (rc);
-  while(fs.GetNextRec(rec) != RM_EOF){
-    char *pData;
-    if((rec.GetData(pData)))
-      return (rc);
+  for(int i = 0; i < relEntry->attrCount; i++){
     if(printIndex){
-    AttrCatEntry *attr = (AttrCatEntry*)pData;
+    AttrCatEntry *attr = &attrEntries[i];
       if((attr->indexNo != NO_INDEXES)){
-        IX_IndexHandle ih;
-        if((rc = ixm.OpenIndex(relName, attr->indexNo, ih)))
-          return (rc);
-        if((rc = ixm.CloseIndex(ih)))
+        IX_IndexHandle *ih;
+        if((rc = GetIndexHandle(relName, attr->indexNo, ih)))
           return (rc);
       }
     }
@@ -1219,25 +1352,20 @@ RC SM_Manager::PrintStats(const char *relName){
   if(strlen(relName) > MAXNAME) // check for whether this is a valid name
     return (SM_BADRELNAME);
 
-  // Retrieve the record associated with the relation
-  RM_Record relRec;
+  // Retrieve the entry associated with the relation
   RelCatEntry *relEntry;
-  if((rc = GetRelEntry(relName, relRec, relEntry)))
+  if((rc = GetRelEntry(relName, relEntry)))
     return (rc);
 
   cout << "Total Tuples in Relation: " << relEntry->numTuples << endl;
   cout << endl;
-  
-  AttrCatEntry *aEntry;
-  SM_AttrIterator attrIt;
-  RM_Record attrRec;
-  if((rc = attrIt.OpenIterator(attrcatFH, relEntry->relName)))
+
+  AttrCatEntry *attrEntries;
+  if((rc = catalog.GetAttrs(relName, attrEntries)))
     return (rc);
 
   for(int i=0; i < relEntry->attrCount; i++){
-    if((rc = attrIt.GetNextAttr(attrRec, aEntry))){
-      return (rc);
-    }
+    AttrCatEntry *aEntry = &attrEntries[i];
     //int slot = aEntry->attrNum; // insert its info in the appropriate slot
 
     cout << "  Attribute: " << aEntry->attrName << endl;
@@ -1245,8 +1373,6 @@ RC SM_Manager::PrintStats(const char *relName){
     cout << "    Max value: " << aEntry->maxValue << endl;
     cout << "    Min value: " << aEntry->minValue << endl;
   }
-  if((rc = attrIt.CloseIterator()))
-    return (rc);
 
   return (0);
 }
@@ -1257,10 +1383,12 @@ RC SM_Manager::CalcStats(const char *relName){
   if(strlen(relName) > MAXNAME) // check for whether this is a valid name
     return (SM_BADRELNAME);
 
-  // Retrieve the record associated with the relation
-  RM_Record relRec;
+  // Retrieve the entry associated with the relation
   RelCatEntry *relEntry;
-  if((rc = GetRelEntry(relName, relRec, relEntry)))
+  if((rc = GetRelEntry(relName, relEntry)))
+    return (rc);
+  // The indexes are opened with handles of their own
+  if((rc = CloseHandles(relName)))
     return (rc);
 
   // Creates a struct containing info about the attributes to 
@@ -1285,9 +1413,9 @@ RC SM_Manager::CalcStats(const char *relName){
 
   // Open the relation and iterate through it
   RM_FileScan fs;
-  RM_FileHandle fh;
+  RM_FileHandle *fh;
   RM_Record rec;
-  if((rc = rmm.OpenFile(relName, fh)) || (rc = fs.OpenScan(fh, INT, 0, 0, NO_OP, NULL)))
+  if((rc = GetRelHandle(relName, fh)) || (rc = fs.OpenScan(*fh, INT, 0, 0, NO_OP, NULL, SEQUENTIAL_SCAN)))
     return (rc);
   while(RM_EOF != fs.GetNextRec(rec)){
     char * recData;
@@ -1317,30 +1445,26 @@ RC SM_Manager::CalcStats(const char *relName){
   }
 
   // write everything back
-  if((rc = relcatFH.UpdateRec(relRec)) || (rc = relcatFH.ForcePages()))
+  if((rc = catalog.WriteRel(relEntry)) || (rc = relcatFH.ForcePages()))
     return (rc);
 
-  SM_AttrIterator attrIt;
-  if((rc = attrIt.OpenIterator(attrcatFH, relEntry->relName)))
+  AttrCatEntry *attrEntries;
+  if((rc = catalog.GetAttrs(relName, attrEntries)))
     return (rc);
-  RM_Record attrRec;
-  AttrCatEntry *aEntry;
   for(int i = 0; i < relEntry->attrCount; i++){
-    if((rc = attrIt.GetNextAttr(attrRec, aEntry)))
-      return (rc);
     // For each attribute, place its information in the appropriate slot
-    int slot = aEntry->attrNum;
-    aEntry->minValue = attributes[slot].minValue;
-    aEntry->maxValue = attributes[slot].maxValue;
-    aEntry->numDistinct = numDistinct[slot].size();
-    if((rc = attrcatFH.UpdateRec(attrRec)))
+    AttrCatEntry *aEntry = &attrEntries[i];
+    aEntry->minValue = attributes[i].minValue;
+    aEntry->maxValue = attributes[i].maxValue;
+    aEntry->numDistinct = numDistinct[i].size();
+    if((rc = catalog.WriteAttr(aEntry)))
       return (rc);
   }
-  if((rc = attrIt.CloseIterator()))
-    return (rc);
   if((rc = attrcatFH.ForcePages()))
     return (rc);
 
+  if((rc = fs.CloseScan()) || (rc = CleanUpAttr(attributes, relEntry->attrCount)))
+    return (rc);
 
   return (0);
 }
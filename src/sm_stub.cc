@@ -61,7 +61,7 @@ bool recInsert_MBR(char *location, string value, int length){
 /*
  * Constructor and destructor for SM_Manager
  */
-SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm) : ixm(ixm), rmm(rmm){
+SM_Manager::SM_Manager(IX_Manager &ixm, RM_Manager &rmm, PF_Manager &pfm) : ixm(ixm), rmm(rmm), pfm(pfm){
   printIndex = false;
 }
 
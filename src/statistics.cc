@@ -30,6 +30,7 @@ const char *PF_GETPAGE = "GETPAGE";
 const char *PF_PAGEFOUND = "PAGEFOUND";
 const char *PF_PAGENOTFOUND = "PAGENOTFOUND";
 const char *PF_READPAGE = "READPAGE";           // IO
+const char *PF_READAHEAD = "READAHEAD";         // IO, included in READPAGE
 const char *PF_WRITEPAGE = "WRITEPAGE";         // IO
 const char *PF_FLUSHPAGES = "FLUSHPAGES";
 
@@ -130,6 +131,7 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
    if (psKey==NULL || (op != STAT_ADDONE && piValue == NULL))
       return STAT_INVALID_ARGS;
 
+   pthread_mutex_lock(&latch);
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -175,6 +177,7 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
       delete pStat;
    }
 
+   pthread_mutex_unlock(&latch);
    return 0;
 }
 
@@ -212,7 +215,9 @@ int *StatisticsMgr::Get(const char *psKey)
 {
    int i, iCount;
    Statistic *pStat = NULL;
+   int *piValue = NULL;
 
+   pthread_mutex_lock(&latch);
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -222,10 +227,11 @@ int *StatisticsMgr::Get(const char *psKey)
    }
 
    // Check to see if we found the Stat
-   if (i==iCount)
-      return NULL;
+   if (i!=iCount)
+      piValue = new int(pStat->iValue);
 
-   return new int(pStat->iValue);
+   pthread_mutex_unlock(&latch);
+   return piValue;
 }
 
 //
@@ -238,12 +244,14 @@ void StatisticsMgr::Print()
    int i, iCount;
    Statistic *pStat = NULL;
 
+   pthread_mutex_lock(&latch);
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
       pStat = llStats[i];
       cout << pStat->psKey << "::" << pStat->iValue << "\n";
    }
+   pthread_mutex_unlock(&latch);
 }
 
 //
@@ -260,6 +268,7 @@ RC StatisticsMgr::Reset(const char *psKey)
    if (psKey==NULL)
       return STAT_INVALID_ARGS;
 
+   pthread_mutex_lock(&latch);
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -271,7 +280,9 @@ RC StatisticsMgr::Reset(const char *psKey)
    // If we found the statistic then remove it from the list
    if (i!=iCount)
       llStats.Delete(i);
-   else
+   pthread_mutex_unlock(&latch);
+
+   if (i==iCount)
       return STAT_UNKNOWN_KEY;
 
    return 0;
@@ -285,6 +296,8 @@ RC StatisticsMgr::Reset(const char *psKey)
 //
 void StatisticsMgr::Reset()
 {
+   pthread_mutex_lock(&latch);
    llStats.Erase();
+   pthread_mutex_unlock(&latch);
 }
 